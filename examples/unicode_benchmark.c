@@ -1,186 +1,1582 @@
 //
 // Created by Георгий Имешкенов on 13.10.2023.
 //
+// Throughput benchmark of the public API: every function runs over generated per-script corpora, timings of repeated
+// trials are written to stdout as JSON, progress to stderr. See benchmark.md
+//
 
-#include "../src/unicode.c"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAS_TSC 1
+#else
+#define BENCH_HAS_TSC 0
+#endif
+
+#include "unicode.h"
+#include "unicode_arena.h"
+#include "unicode_case.h"
+#include "unicode_find.h"
+#include "unicode_grapheme.h"
+#include "unicode_indexed.h"
+#include "unicode_mmap.h"
+#include "unicode_normalize.h"
+#include "unicode_parallel.h"
+#include "unicode_property.h"
+#include "unicode_rope.h"
+#include "unicode_stream.h"
+#include "unicode_transcode.h"
+#include "unicode_view.h"
 
-#if defined(_WIN32)
-#define PLATFORM_NAME "windows" // Windows
-#define HARDWARE_INFO_CALL "msinfo32"
-#elif defined(_WIN64)
-#define PLATFORM_NAME "windows" // Windows
-#define HARDWARE_INFO_CALL "msinfo32"
-#elif defined(__CYGWIN__) && !defined(_WIN32)
-#define PLATFORM_NAME "windows" // Windows (Cygwin POSIX under Microsoft Window)
-#define HARDWARE_INFO_CALL "msinfo32"
-#elif defined(__ANDROID__)
+#if defined(__ANDROID__)
 #define PLATFORM_NAME "android" // Android (implies Linux, so it must come first)
-#define HARDWARE_INFO_CALL NULL
 #elif defined(__linux__)
 #define PLATFORM_NAME "linux" // Debian, Ubuntu, Gentoo, Fedora, openSUSE, RedHat, Centos and other
-#define HARDWARE_INFO_CALL "lscpu"
-#elif defined(__unix__) || !defined(__APPLE__) && defined(__MACH__)
-#include <sys/param.h>
-#if defined(BSD)
+#elif defined(__APPLE__) && defined(__MACH__)
+#define PLATFORM_NAME "osx" // Apple OSX and iOS (Darwin)
+#elif defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
 #define PLATFORM_NAME "bsd" // FreeBSD, NetBSD, OpenBSD, DragonFly BSD
-#endif
-#elif defined(__hpux)
-#define PLATFORM_NAME "hp-ux" // HP-UX
-#define HARDWARE_INFO_CALL NULL
-#elif defined(_AIX)
-#define PLATFORM_NAME "aix" // IBM AIX
-#define HARDWARE_INFO_CALL NULL
-#elif defined(__APPLE__) && defined(__MACH__) // Apple OSX and iOS (Darwin)
-
-#include <TargetConditionals.h>
-
-#if TARGET_IPHONE_SIMULATOR == 1
-#define PLATFORM_NAME "ios" // Apple iOS
-#define HARDWARE_INFO_CALL NULL
-#elif TARGET_OS_IPHONE == 1
-#define PLATFORM_NAME "ios" // Apple iOS
-#define HARDWARE_INFO_CALL NULL
-#elif TARGET_OS_MAC == 1
-#define PLATFORM_NAME "osx" // Apple OSX
-#define HARDWARE_INFO_CALL "/usr/sbin/system_profiler SPHardwareDataType"
-#endif
 #elif defined(__sun) && defined(__SVR4)
 #define PLATFORM_NAME "solaris" // Oracle Solaris, Open Indiana
-#define HARDWARE_INFO_CALL NULL
+#elif defined(__unix__)
+#define PLATFORM_NAME "unix"
+#else
+#define PLATFORM_NAME "unknown"
+#endif
+
+#if defined(__clang__)
+#define COMPILER_NAME "clang " __clang_version__
+#elif defined(__GNUC__)
+#define COMPILER_NAME "gcc " __VERSION__
 #else
-#define PLATFORM_NAME NULL
-#define HARDWARE_INFO_CALL NULL
+#define COMPILER_NAME "unknown"
 #endif
 
-const char *mix = "OoZe9ab8 \07Eef9hooj \nweiph7iD\r \xb0OoMai8ra FaHeaf7g ingie2Ah\t Wei4abah \xdf\xbf\xd3\x88uL3pheog тхеед4Бе еЦхамаЪ0 Привет, 😀ອັກສອນລາວ World";
-// TODO benchmark for comparing Unicode chars
-//const size_t cmp_str_one = u'<';
-//const size_t cmp_str_two = u'Ъ';
-//const size_t cmp_str_four = '😀';
-__attribute__((unused)) unsigned char tmp = '\0';
+#define DEFAULT_CORPUS_SIZE (1024 * 1024)
+#define DEFAULT_TRIALS 11
+#define DEFAULT_MIN_TRIAL_MS 10
+#define MAX_TRIALS 1000
+#define DECODER_CHUNK 4096
+#define ROPE_EDITS 64
+#define INDEXED_SLICE_CHARS 16
+
+/**
+ * Results of every benchmarked call are folded into sink, so the compiler can't drop the calls
+ */
+static volatile uint64_t sink;
+
+typedef struct Options_s {
+    size_t size;
+    unsigned trials;
+    unsigned min_trial_ms;
+    unsigned threads;
+    const char *filter;
+    const char *corpus;
+} Options;
 
-void
-read_benchmark() {
-    UnicodeChar *string;
-    read_unicode_string(mix, &string);
-    free(string);
+/**
+ * Corpus text and everything benchmarks need besides the call they time: the text in other representations and
+ * scratch buffers large enough for any output
+ */
+typedef struct Corpus_s {
+    const char *name;
+    uint8_t *bytes;
+    size_t nbytes;
+    // chars as `unicode_decoded_len` counts them, the unit of chars/s
+    size_t chars;
+    // chars as `unicode_strlen` counts them
+    size_t strlen_chars;
+    int valid;
+
+    uint8_t *bytes_copy;
+    UnicodeString *strings[3];
+    // equal to strings[USTR_LAYOUT_UCHAR], so comparisons have to scan whole strings
+    UnicodeString *copy;
+    uint32_t *code_points;
+    size_t code_points_len;
+    uint16_t *utf16;
+    size_t utf16_len;
+    UnicodeIndexedString *indexed;
+    UnicodeRope *rope;
+    // halves of the text, joined by concat_ustr
+    UnicodeString *halves[2];
+    // ROPE_EDITS slices of the rope, joined by rope_concat; patch is what rope_insert inserts
+    UnicodeRope *pieces[ROPE_EDITS];
+    UnicodeRope *patch;
+    UnicodeArena *arena;
+    // /dev/null, the sink of *_fd functions
+    int null_fd;
+    // NULL if the corpus couldn't be written to a temporary file
+    UnicodeMappedFile *mapped;
+    unsigned threads;
+
+    // needles[0] is the tail of the text, needles[1] never occurs in it
+    const uint8_t *needles[2];
+    size_t needle_sizes[2];
+    uint8_t absent_needle[32];
+
+    uint8_t *out;
+    size_t out_cap;
+    uint32_t *out32;
+    uint16_t *out16;
+    UnicodeChar *out_chars;
+    size_t *breaks;
+} Corpus;
+
+typedef uint64_t (*BenchmarkFn)(const Corpus *corpus);
+
+typedef struct Benchmark_s {
+    // public function the benchmark times
+    const char *function;
+    // what the function is called with, "" for the obvious
+    const char *variant;
+    BenchmarkFn fn;
+} Benchmark;
+
+/* ============ Corpora ============ */
+
+typedef struct Text_s {
+    uint8_t *p;
+    size_t len;
+    size_t cap;
+} Text;
+
+/**
+ * xorshift64* generator, corpora are the same on every run and machine
+ */
+static uint32_t
+rng_next(uint64_t *pState) {
+    uint64_t x = *pState;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *pState = x;
+    return (uint32_t) ((x * 0x2545F4914F6CDD1DULL) >> 32);
 }
 
-void
-iterate_benchmark(UnicodeChar **string) {
-    while ((*string)->octet[0] != '\0') {
-        tmp = (*string)->octet[0];
-        ++(*string);
+static uint32_t
+rng_below(uint64_t *pState, const uint32_t n) {
+    return rng_next(pState) % n;
+}
+
+/**
+ * Appends bytes to text, drops them if they don't fit
+ */
+static void
+text_put_bytes(Text *pText, const char *pBytes, const size_t n) {
+    if (pText->len + n <= pText->cap) {
+        memcpy(pText->p + pText->len, pBytes, n);
+        pText->len += n;
     }
 }
 
-void
-compare_benchmark() {
+/**
+ * Appends the UTF-8 encoding of a code point to text
+ */
+static void
+text_put(Text *pText, const uint32_t code_point) {
+    char buf[4];
+    size_t n;
 
+    if (code_point < 0x80) {
+        buf[0] = (char) code_point;
+        n = 1;
+    } else if (code_point < 0x800) {
+        buf[0] = (char) (0xC0 | code_point >> 6);
+        buf[1] = (char) (0x80 | (code_point & 0x3F));
+        n = 2;
+    } else if (code_point < 0x10000) {
+        buf[0] = (char) (0xE0 | code_point >> 12);
+        buf[1] = (char) (0x80 | (code_point >> 6 & 0x3F));
+        buf[2] = (char) (0x80 | (code_point & 0x3F));
+        n = 3;
+    } else {
+        buf[0] = (char) (0xF0 | code_point >> 18);
+        buf[1] = (char) (0x80 | (code_point >> 12 & 0x3F));
+        buf[2] = (char) (0x80 | (code_point >> 6 & 0x3F));
+        buf[3] = (char) (0x80 | (code_point & 0x3F));
+        n = 4;
+    }
+    text_put_bytes(pText, buf, n);
 }
 
-int
-main(int argc, char **argv) {
-    unsigned long runs[7] = {1, 100, 1000, 100000, 1000000, 10000000, 100000000};
-    double reads_total_time[7] = {0};
-    double iterates_total_time[7] = {0};
-    double total_read_time;
-    double total_iterate_time;
-    long target_runs = 5;
-    clock_t start_time;
-    double exec_time;
-
-    if (argc > 1) {
-        target_runs = strtol(argv[1], (char **) NULL, 10);
-    }
-
-    printf("unicode lib benchmark\n");
-    printf("compiler used: gcc\n");
-    printf("compiler info:\n");
-    system("gcc -v");
-    printf("machine info:\n");
-    if (HARDWARE_INFO_CALL != NULL) {
-        system(HARDWARE_INFO_CALL);
+/**
+ * Appends a space, mostly, or punctuation or a line break
+ */
+static void
+put_separator(Text *pText, uint64_t *pRng) {
+    static const char *const SEPARATORS[] = {", ", ". ", "\n", ": ", " - "};
+    const uint32_t r = rng_below(pRng, 20);
+
+    if (r < 15) {
+        text_put(pText, ' ');
+    } else {
+        const char *separator = SEPARATORS[r - 15];
+        text_put_bytes(pText, separator, strlen(separator));
+    }
+}
+
+static void
+ascii_word(Text *pText, uint64_t *pRng) {
+    static const char LETTERS[] = "etaoinshrdlcumwfgypbvkjxqzETAOINSHRDLCUMWFGYPBVKJXQZ0123456789";
+    const uint32_t len = 1 + rng_below(pRng, 10);
+
+    for (uint32_t i = 0; i < len; i++) {
+        // skewed towards the head of LETTERS, the way letter frequencies are
+        const uint32_t r = rng_below(pRng, sizeof(LETTERS) - 1);
+        text_put(pText, (uint8_t) LETTERS[r * r / (sizeof(LETTERS) - 1)]);
+    }
+    put_separator(pText, pRng);
+}
+
+/**
+ * Western European text: ASCII letters with every sixth one from the Latin-1 Supplement
+ */
+static void
+latin1_word(Text *pText, uint64_t *pRng) {
+    const uint32_t len = 1 + rng_below(pRng, 10);
+
+    for (uint32_t i = 0; i < len; i++) {
+        if (rng_below(pRng, 6) == 0) {
+            uint32_t code_point = (i == 0 ? 0xC0 : 0xE0) + rng_below(pRng, 31);
+            // skip the multiplication and division signs
+            text_put(pText, code_point == 0xD7 || code_point == 0xF7 ? code_point + 1 : code_point);
+        } else {
+            text_put(pText, (i == 0 && rng_below(pRng, 5) == 0 ? 'A' : 'a') + rng_below(pRng, 26));
+        }
+    }
+    put_separator(pText, pRng);
+}
+
+static void
+cyrillic_word(Text *pText, uint64_t *pRng) {
+    const uint32_t len = 1 + rng_below(pRng, 10);
+
+    for (uint32_t i = 0; i < len; i++) {
+        text_put(pText, (i == 0 && rng_below(pRng, 5) == 0 ? 0x410 : 0x430) + rng_below(pRng, 32));
+    }
+    put_separator(pText, pRng);
+}
+
+/**
+ * Chinese and Japanese text: ideographs and some hiragana, no spaces
+ */
+static void
+cjk_word(Text *pText, uint64_t *pRng) {
+    const uint32_t len = 1 + rng_below(pRng, 6);
+
+    for (uint32_t i = 0; i < len; i++) {
+        text_put(pText, rng_below(pRng, 7) ? 0x4E00 + rng_below(pRng, 0x5200) : 0x3041 + rng_below(pRng, 0x56));
+    }
+    const uint32_t r = rng_below(pRng, 20);
+    if (r < 3) {
+        text_put(pText, 0x3001);
+    } else if (r < 5) {
+        text_put(pText, 0x3002);
+    } else if (r == 5) {
+        text_put(pText, '\n');
+    }
+}
+
+/**
+ * Chat-like text: ASCII words and emoji, including modifier, ZWJ and flag sequences
+ */
+static void
+emoji_word(Text *pText, uint64_t *pRng) {
+    switch (rng_below(pRng, 10)) {
+        case 0:
+        case 1:
+            text_put(pText, 0x1F600 + rng_below(pRng, 0x50));
+            break;
+        case 2:
+            // waving hand with a skin tone
+            text_put(pText, 0x1F44B);
+            text_put(pText, 0x1F3FB + rng_below(pRng, 5));
+            break;
+        case 3:
+            // woman technologist
+            text_put(pText, 0x1F469);
+            text_put(pText, 0x200D);
+            text_put(pText, 0x1F4BB);
+            break;
+        case 4:
+            // flag
+            text_put(pText, 0x1F1E6 + rng_below(pRng, 26));
+            text_put(pText, 0x1F1E6 + rng_below(pRng, 26));
+            break;
+        case 5:
+            // heavy black heart, emoji presentation
+            text_put(pText, 0x2764);
+            text_put(pText, 0xFE0F);
+            break;
+        default:
+            ascii_word(pText, pRng);
+            return;
+    }
+    text_put(pText, ' ');
+}
+
+/**
+ * Cyrillic and ASCII words with an ill-formed subsequence after about every fourth one
+ */
+static void
+invalid_word(Text *pText, uint64_t *pRng) {
+    static const char *const ILL_FORMED[] = {
+            "\x80", "\xBF", "\xC0\xAF", "\xE2\x82", "\xED\xA0\x80", "\xF8", "\xFF", "\xF0\x9F\x98",
+    };
+
+    if (rng_below(pRng, 2)) {
+        cyrillic_word(pText, pRng);
     } else {
-        printf("Sorry, gathering system info is unavailable for your platform: %s\n", PLATFORM_NAME);
-    }
-    printf("target string:\n");
-    printf("\"\"\"\n");
-    printf("%s\n", mix);
-    printf("\"\"\"\n");
-
-    for (int i = 0; i < target_runs; i++) {
-        total_read_time = 0.0;
-        printf("benchmarking %lu iterations\n", runs[i]);
-        for (int j = 0; j < runs[i]; j++) {
-            start_time = clock();
-            read_benchmark();
-            exec_time = (double) (clock() - start_time) / CLOCKS_PER_SEC;
-            total_read_time += exec_time;
+        ascii_word(pText, pRng);
+    }
+    if (rng_below(pRng, 4) == 0) {
+        const char *bytes = ILL_FORMED[rng_below(pRng, sizeof(ILL_FORMED) / sizeof(ILL_FORMED[0]))];
+        text_put_bytes(pText, bytes, strlen(bytes));
+    }
+}
+
+typedef struct Script_s {
+    const char *name;
+    void (*word)(Text *pText, uint64_t *pRng);
+} Script;
+
+static const Script SCRIPTS[] = {
+        {"ascii", ascii_word},
+        {"latin1", latin1_word},
+        {"cyrillic", cyrillic_word},
+        {"cjk", cjk_word},
+        {"emoji", emoji_word},
+        {"invalid", invalid_word},
+};
+
+#define SCRIPTS_COUNT (sizeof(SCRIPTS) / sizeof(SCRIPTS[0]))
+
+/**
+ * Fills `size` bytes (or a few less, words are never cut) with words of a script
+ * @return number of bytes written
+ */
+static size_t
+generate_text(const Script *script, uint8_t *pOut, const size_t size, uint64_t seed) {
+    size_t len = 0;
+
+    for (;;) {
+        uint8_t buf[64];
+        Text word = {buf, 0, sizeof(buf)};
+        script->word(&word, &seed);
+        if (len + word.len > size) {
+            return len;
+        }
+        memcpy(pOut + len, buf, word.len);
+        len += word.len;
+    }
+}
+
+static void *
+checked_malloc(const size_t size) {
+    void *p = malloc(size ? size : 1);
+    if (p == NULL) {
+        fprintf(stderr, "unicode-bench: out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+/**
+ * Writes corpus bytes to a temporary file and maps it, the file is unlinked right away
+ */
+static UnicodeMappedFile *
+map_corpus(const Corpus *corpus) {
+    const char *tmpdir = getenv("TMPDIR");
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/unicode-bench-XXXXXX", tmpdir != NULL && *tmpdir ? tmpdir : "/tmp");
+
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+        return NULL;
+    }
+    size_t written = 0;
+    while (written < corpus->nbytes) {
+        const ssize_t n = write(fd, corpus->bytes + written, corpus->nbytes - written);
+        if (n <= 0) {
+            break;
+        }
+        written += (size_t) n;
+    }
+    close(fd);
+
+    UnicodeMappedFile *file = written == corpus->nbytes ? unicode_map_file(path) : NULL;
+    unlink(path);
+    return file;
+}
+
+static void
+init_corpus(Corpus *corpus, const Script *script, const size_t size, const unsigned threads, const uint64_t seed) {
+    memset(corpus, 0, sizeof(*corpus));
+    corpus->name = script->name;
+    corpus->threads = threads;
+    corpus->bytes = checked_malloc(size + 1);
+    corpus->nbytes = generate_text(script, corpus->bytes, size, seed);
+    corpus->bytes[corpus->nbytes] = '\0';
+    corpus->chars = unicode_decoded_len(corpus->bytes, corpus->nbytes);
+    corpus->strlen_chars = unicode_strlen(corpus->bytes, corpus->nbytes);
+    corpus->valid = unicode_validate(corpus->bytes, corpus->nbytes, NULL);
+
+    corpus->bytes_copy = checked_malloc(corpus->nbytes + 1);
+    memcpy(corpus->bytes_copy, corpus->bytes, corpus->nbytes + 1);
+    for (int layout = USTR_LAYOUT_UCHAR; layout <= USTR_LAYOUT_SPLIT; layout++) {
+        corpus->strings[layout] = read_into_unicode_string_with_layout(corpus->bytes, corpus->nbytes,
+                                                                       UNICODE_DECODE_DEFAULT, layout);
+    }
+    corpus->copy = read_into_unicode_string_with_layout(corpus->bytes, corpus->nbytes, UNICODE_DECODE_DEFAULT,
+                                                        USTR_LAYOUT_UCHAR);
+
+    corpus->code_points = checked_malloc((corpus->nbytes + 1) * sizeof(uint32_t));
+    corpus->code_points_len = utf8_to_utf32(corpus->bytes, corpus->nbytes, corpus->code_points).produced;
+    corpus->utf16 = checked_malloc((corpus->nbytes + 1) * sizeof(uint16_t));
+    corpus->utf16_len = utf8_to_utf16(corpus->bytes, corpus->nbytes, corpus->utf16, corpus->nbytes + 1,
+                                      UNICODE_LITTLE_ENDIAN).produced;
+    corpus->indexed = read_into_indexed_ustr(corpus->bytes, corpus->nbytes, UNICODE_DECODE_DEFAULT);
+    corpus->rope = new_rope(corpus->bytes, corpus->nbytes);
+    corpus->mapped = map_corpus(corpus);
+    if (corpus->strings[0] == NULL || corpus->copy == NULL || corpus->indexed == NULL || corpus->rope == NULL) {
+        fprintf(stderr, "unicode-bench: out of memory\n");
+        exit(1);
+    }
+
+    const size_t middle = unicode_offset_of(corpus->bytes, corpus->nbytes, corpus->strlen_chars / 2);
+    corpus->halves[0] = read_into_unicode_string_n(corpus->bytes, middle, UNICODE_DECODE_DEFAULT);
+    corpus->halves[1] = read_into_unicode_string_n(corpus->bytes + middle, corpus->nbytes - middle,
+                                                   UNICODE_DECODE_DEFAULT);
+    for (size_t k = 0; k < ROPE_EDITS; k++) {
+        corpus->pieces[k] = rope_slice(corpus->rope, k * corpus->rope->len / ROPE_EDITS,
+                                       (k + 1) * corpus->rope->len / ROPE_EDITS);
+    }
+    corpus->patch = new_rope(corpus->bytes, corpus->nbytes < 64 ? corpus->nbytes : 64);
+    corpus->arena = checked_malloc(sizeof(UnicodeArena));
+    unicode_arena_init(corpus->arena, 0);
+    corpus->null_fd = open("/dev/null", O_WRONLY);
+    if (corpus->null_fd < 0) {
+        fprintf(stderr, "unicode-bench: can't open /dev/null\n");
+        exit(1);
+    }
+
+    // the last few chars: the first match is at the end of most corpora
+    const size_t tail = unicode_offset_of(corpus->bytes, corpus->nbytes,
+                                          corpus->strlen_chars > 6 ? corpus->strlen_chars - 6 : 0);
+    corpus->needles[0] = corpus->bytes + tail;
+    corpus->needle_sizes[0] = corpus->nbytes - tail;
+    // no corpus has control chars other than line breaks
+    corpus->absent_needle[0] = '\x01';
+    memcpy(corpus->absent_needle + 1, corpus->needles[0], corpus->needle_sizes[0]);
+    corpus->needles[1] = corpus->absent_needle;
+    corpus->needle_sizes[1] = corpus->needle_sizes[0] + 1;
+
+    corpus->out_cap = corpus->nbytes * UNICODE_NORMALIZE_COMPAT_MAX_GROWTH + 64;
+    corpus->out = checked_malloc(corpus->out_cap);
+    corpus->out32 = checked_malloc((corpus->nbytes + 1) * sizeof(uint32_t));
+    corpus->out16 = checked_malloc((corpus->nbytes + 1) * sizeof(uint16_t));
+    corpus->out_chars = checked_malloc((corpus->nbytes + 1) * sizeof(UnicodeChar));
+    corpus->breaks = checked_malloc((corpus->nbytes + UNICODE_GRAPHEME_MAX_FINISH) * sizeof(size_t));
+}
+
+static void
+destroy_corpus(Corpus *corpus) {
+    free(corpus->bytes);
+    free(corpus->bytes_copy);
+    for (int layout = USTR_LAYOUT_UCHAR; layout <= USTR_LAYOUT_SPLIT; layout++) {
+        free_ustr(corpus->strings[layout]);
+    }
+    free_ustr(corpus->copy);
+    free(corpus->code_points);
+    free(corpus->utf16);
+    free_indexed_ustr(corpus->indexed);
+    free_rope(corpus->rope);
+    free_ustr(corpus->halves[0]);
+    free_ustr(corpus->halves[1]);
+    for (size_t k = 0; k < ROPE_EDITS; k++) {
+        free_rope(corpus->pieces[k]);
+    }
+    free_rope(corpus->patch);
+    unicode_arena_destroy(corpus->arena);
+    free(corpus->arena);
+    close(corpus->null_fd);
+    if (corpus->mapped != NULL) {
+        unicode_unmap_file(corpus->mapped);
+    }
+    free(corpus->out);
+    free(corpus->out32);
+    free(corpus->out16);
+    free(corpus->out_chars);
+    free(corpus->breaks);
+}
+
+/* ============ Benchmarks ============ */
+// Every benchmark processes the whole corpus once, so bytes and chars per second are comparable between functions
+
+static uint64_t
+bench_validate(const Corpus *c) {
+    size_t error_offset = 0;
+    return (uint64_t) unicode_validate(c->bytes, c->nbytes, &error_offset) + error_offset;
+}
+
+static uint64_t
+bench_decoded_len(const Corpus *c) {
+    return unicode_decoded_len(c->bytes, c->nbytes);
+}
+
+static uint64_t
+bench_strlen(const Corpus *c) {
+    return unicode_strlen(c->bytes, c->nbytes);
+}
+
+static uint64_t
+bench_offset_of(const Corpus *c) {
+    return unicode_offset_of(c->bytes, c->nbytes, c->strlen_chars - 1);
+}
+
+static uint64_t
+bench_read_array_cstr(const Corpus *c) {
+    UnicodeChar *chars;
+    read_into_unicode_array(c->bytes, &chars);
+    const uint64_t first = chars[0].octet[0];
+    free(chars);
+    return first;
+}
+
+static uint64_t
+bench_read_string_cstr(const Corpus *c) {
+    UnicodeString *string = read_into_unicode_string(c->bytes);
+    const uint64_t len = string->len;
+    free_ustr(string);
+    return len;
+}
+
+static uint64_t
+bench_read_array(const Corpus *c) {
+    UnicodeChar *chars;
+    const size_t len = read_into_unicode_array_n(c->bytes, c->nbytes, &chars, UNICODE_DECODE_DEFAULT);
+    free(chars);
+    return len;
+}
+
+/**
+ * Decodes into a string of the given layout and frees it
+ */
+static uint64_t
+read_string(const Corpus *c, const uint32_t flags, const UnicodeLayout layout) {
+    UnicodeString *string = read_into_unicode_string_with_layout(c->bytes, c->nbytes, flags, layout);
+    const uint64_t len = string->len;
+    free_ustr(string);
+    return len;
+}
+
+static uint64_t
+bench_read_string_uchar(const Corpus *c) {
+    return read_string(c, UNICODE_DECODE_DEFAULT, USTR_LAYOUT_UCHAR);
+}
+
+static uint64_t
+bench_read_string_utf32(const Corpus *c) {
+    return read_string(c, UNICODE_DECODE_DEFAULT, USTR_LAYOUT_UTF32);
+}
+
+static uint64_t
+bench_read_string_split(const Corpus *c) {
+    return read_string(c, UNICODE_DECODE_DEFAULT, USTR_LAYOUT_SPLIT);
+}
+
+static uint64_t
+bench_read_string_exact(const Corpus *c) {
+    UnicodeString *string = read_into_unicode_string_n(c->bytes, c->nbytes, UNICODE_DECODE_EXACT);
+    const uint64_t len = string->len;
+    free_ustr(string);
+    return len;
+}
+
+static uint64_t
+bench_read_string_arena(const Corpus *c) {
+    UnicodeString *string = read_into_unicode_string_with_allocator(c->bytes, c->nbytes, UNICODE_DECODE_DEFAULT,
+                                                                    USTR_LAYOUT_UCHAR, &c->arena->allocator);
+    const uint64_t len = string->len;
+    unicode_arena_reset(c->arena);
+    return len;
+}
+
+static uint64_t
+bench_ustr_convert(const Corpus *c) {
+    UnicodeString *string = ustr_convert(c->strings[USTR_LAYOUT_UCHAR], USTR_LAYOUT_UTF32);
+    const uint64_t len = string->len;
+    free_ustr(string);
+    return len;
+}
+
+/**
+ * Reads every char of a string by index
+ */
+static uint64_t
+sweep_char_at(const UnicodeString *string) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < string->len; i++) {
+        sum += ustr_char_at(string, i).octet[0];
+    }
+    return sum;
+}
+
+static uint64_t
+bench_char_at_uchar(const Corpus *c) {
+    return sweep_char_at(c->strings[USTR_LAYOUT_UCHAR]);
+}
+
+static uint64_t
+bench_char_at_utf32(const Corpus *c) {
+    return sweep_char_at(c->strings[USTR_LAYOUT_UTF32]);
+}
+
+static uint64_t
+bench_char_at_split(const Corpus *c) {
+    return sweep_char_at(c->strings[USTR_LAYOUT_SPLIT]);
+}
+
+static uint64_t
+bench_ord_at(const Corpus *c) {
+    const UnicodeString *string = c->strings[USTR_LAYOUT_UCHAR];
+    uint64_t sum = 0;
+    for (size_t i = 0; i < string->len; i++) {
+        sum += ustr_ord_at(string, i);
+    }
+    return sum;
+}
+
+static uint64_t
+bench_unicode_ord(const Corpus *c) {
+    const UnicodeString *string = c->strings[USTR_LAYOUT_UCHAR];
+    uint64_t sum = 0;
+    for (size_t i = 0; i < string->len; i++) {
+        sum += unicode_ord(string->data[i]);
+    }
+    return sum;
+}
+
+static uint64_t
+bench_unicode_chr(const Corpus *c) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < c->code_points_len; i++) {
+        sum += unicode_chr(c->code_points[i]).size;
+    }
+    return sum;
+}
+
+static uint64_t
+bench_push_uchar(const Corpus *c) {
+    const UnicodeString *source = c->strings[USTR_LAYOUT_UCHAR];
+    UnicodeString *string = new_ustr(-1);
+    for (size_t i = 0; i < source->len; i++) {
+        push_uchar(string, source->data[i]);
+    }
+    const uint64_t len = string->len;
+    free_ustr(string);
+    return len;
+}
+
+static uint64_t
+bench_ustr_append(const Corpus *c) {
+    const UnicodeString *source = c->strings[USTR_LAYOUT_UCHAR];
+    UnicodeString *string = new_ustr(-1);
+    // the way a decoder loop appends what each chunk gave
+    for (size_t i = 0; i < source->len; i += DECODER_CHUNK) {
+        ustr_append(string, source->data + i, source->len - i < DECODER_CHUNK ? source->len - i : DECODER_CHUNK);
+    }
+    const uint64_t len = string->len;
+    free_ustr(string);
+    return len;
+}
+
+static uint64_t
+bench_concat_ustr(const Corpus *c) {
+    UnicodeString *string = concat_ustr(c->halves[0], c->halves[1]);
+    const uint64_t len = string->len;
+    free_ustr(string);
+    return len;
+}
+
+static uint64_t
+bench_ustr_bytes_len(const Corpus *c) {
+    return ustr_bytes_len(c->strings[USTR_LAYOUT_UCHAR]);
+}
+
+static uint64_t
+bench_ustr_write_bytes(const Corpus *c) {
+    return ustr_write_bytes(c->strings[USTR_LAYOUT_UCHAR], c->out, c->out_cap);
+}
+
+static uint64_t
+bench_ustr_write_fd(const Corpus *c) {
+    return (uint64_t) ustr_write_fd(c->strings[USTR_LAYOUT_UCHAR], c->null_fd);
+}
+
+static uint64_t
+bench_compress(const Corpus *c) {
+    CompressedUnicodeString *compressed = compress_into_bytes_array(c->strings[USTR_LAYOUT_UCHAR]);
+    const uint64_t len = compressed->len;
+    free_compressed_ustr(compressed);
+    return len;
+}
+
+static uint64_t
+bench_ustr_equal(const Corpus *c) {
+    return (uint64_t) ustr_equal(c->strings[USTR_LAYOUT_UCHAR], c->copy);
+}
+
+static uint64_t
+bench_ustr_compare(const Corpus *c) {
+    return (uint64_t) ustr_compare(c->strings[USTR_LAYOUT_UCHAR], c->copy);
+}
+
+static uint64_t
+bench_ustr_hash(const Corpus *c) {
+    return ustr_hash(c->strings[USTR_LAYOUT_UCHAR], 0);
+}
+
+static uint64_t
+bench_unicode_equal(const Corpus *c) {
+    return (uint64_t) unicode_equal(c->bytes, c->nbytes, c->bytes_copy, c->nbytes);
+}
+
+static uint64_t
+bench_unicode_compare(const Corpus *c) {
+    return (uint64_t) unicode_compare(c->bytes, c->nbytes, c->bytes_copy, c->nbytes);
+}
+
+static uint64_t
+bench_unicode_hash(const Corpus *c) {
+    return unicode_hash(c->bytes, c->nbytes, 0);
+}
+
+static uint64_t
+bench_find(const Corpus *c) {
+    UnicodeMatch match = {0};
+    return (uint64_t) unicode_find(c->bytes, c->nbytes, c->needles[0], c->needle_sizes[0], &match) + match.offset;
+}
+
+static uint64_t
+bench_find_any(const Corpus *c) {
+    UnicodeMatch match = {0};
+    return (uint64_t) unicode_find_any(c->bytes, c->nbytes, c->needles, c->needle_sizes, 2, &match) + match.offset;
+}
+
+static uint64_t
+bench_utf8_to_utf32(const Corpus *c) {
+    return utf8_to_utf32(c->bytes, c->nbytes, c->out32).produced;
+}
+
+static uint64_t
+bench_utf32_to_utf8_len(const Corpus *c) {
+    return utf32_to_utf8_len(c->code_points, c->code_points_len);
+}
+
+static uint64_t
+bench_utf32_to_utf8(const Corpus *c) {
+    return utf32_to_utf8(c->code_points, c->code_points_len, c->out, c->out_cap).produced;
+}
+
+static uint64_t
+bench_utf8_to_utf16_len(const Corpus *c) {
+    return utf8_to_utf16_len(c->bytes, c->nbytes);
+}
+
+static uint64_t
+bench_utf8_to_utf16(const Corpus *c) {
+    return utf8_to_utf16(c->bytes, c->nbytes, c->out16, c->nbytes + 1, UNICODE_LITTLE_ENDIAN).produced;
+}
+
+static uint64_t
+bench_utf16_to_utf8_len(const Corpus *c) {
+    return utf16_to_utf8_len(c->utf16, c->utf16_len, UNICODE_LITTLE_ENDIAN);
+}
+
+static uint64_t
+bench_utf16_to_utf8(const Corpus *c) {
+    return utf16_to_utf8(c->utf16, c->utf16_len, c->out, c->out_cap, UNICODE_LITTLE_ENDIAN).produced;
+}
+
+static uint64_t
+bench_decoder_feed(const Corpus *c) {
+    UnicodeDecoder decoder = {0};
+    uint64_t count = 0;
+    for (size_t offset = 0; offset < c->nbytes; offset += DECODER_CHUNK) {
+        const size_t len = c->nbytes - offset < DECODER_CHUNK ? c->nbytes - offset : DECODER_CHUNK;
+        count += unicode_decoder_feed(&decoder, c->bytes + offset, len, c->out_chars, DECODER_CHUNK, NULL);
+    }
+    return count + unicode_decoder_finish(&decoder, c->out_chars, DECODER_CHUNK);
+}
+
+static uint64_t
+bench_decoder_feed_utf32(const Corpus *c) {
+    UnicodeDecoder decoder = {0};
+    uint64_t count = 0;
+    for (size_t offset = 0; offset < c->nbytes; offset += DECODER_CHUNK) {
+        const size_t len = c->nbytes - offset < DECODER_CHUNK ? c->nbytes - offset : DECODER_CHUNK;
+        count += unicode_decoder_feed_utf32(&decoder, c->bytes + offset, len, c->out32, DECODER_CHUNK, NULL);
+    }
+    return count + unicode_decoder_finish_utf32(&decoder, c->out32, DECODER_CHUNK);
+}
+
+static uint64_t
+bench_view_next(const Corpus *c) {
+    UnicodeView view = unicode_view(c->bytes, c->nbytes);
+    UnicodeChar uchar;
+    uint64_t sum = 0;
+    while (unicode_view_next(&view, &uchar)) {
+        sum += uchar.octet[0];
+    }
+    return sum;
+}
+
+static uint64_t
+bench_view_next_code_point(const Corpus *c) {
+    UnicodeView view = unicode_view(c->bytes, c->nbytes);
+    uint32_t code_point;
+    uint64_t sum = 0;
+    while (unicode_view_next_code_point(&view, &code_point)) {
+        sum += code_point;
+    }
+    return sum;
+}
+
+static uint64_t
+bench_view_slice(const Corpus *c) {
+    const UnicodeView view = unicode_view(c->bytes, c->nbytes);
+    return unicode_view_slice(view, c->chars - 1, c->chars).nbytes;
+}
+
+static uint64_t
+bench_read_indexed(const Corpus *c) {
+    UnicodeIndexedString *string = read_into_indexed_ustr(c->bytes, c->nbytes, UNICODE_DECODE_DEFAULT);
+    const uint64_t len = string->len;
+    free_indexed_ustr(string);
+    return len;
+}
+
+static uint64_t
+bench_indexed_char_at(const Corpus *c) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < c->indexed->len; i++) {
+        sum += indexed_ustr_char_at(c->indexed, i).octet[0];
+    }
+    return sum;
+}
+
+static uint64_t
+bench_indexed_ord_at(const Corpus *c) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < c->indexed->len; i++) {
+        sum += indexed_ustr_ord_at(c->indexed, i);
+    }
+    return sum;
+}
+
+static uint64_t
+bench_indexed_offset_of(const Corpus *c) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < c->indexed->len; i++) {
+        sum += indexed_ustr_offset_of(c->indexed, i);
+    }
+    return sum;
+}
+
+static uint64_t
+bench_indexed_slice(const Corpus *c) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < c->indexed->len; i += INDEXED_SLICE_CHARS) {
+        sum += indexed_ustr_slice(c->indexed, i, i + INDEXED_SLICE_CHARS).nbytes;
+    }
+    return sum;
+}
+
+static uint64_t
+bench_parallel_validate(const Corpus *c) {
+    return (uint64_t) unicode_parallel_validate(c->bytes, c->nbytes, c->threads, NULL);
+}
+
+static uint64_t
+bench_parallel_decoded_len(const Corpus *c) {
+    return unicode_parallel_decoded_len(c->bytes, c->nbytes, c->threads);
+}
+
+static uint64_t
+bench_read_string_parallel(const Corpus *c) {
+    UnicodeString *string = read_into_unicode_string_parallel(c->bytes, c->nbytes, UNICODE_DECODE_DEFAULT,
+                                                              USTR_LAYOUT_UCHAR, NULL, c->threads);
+    const uint64_t len = string->len;
+    free_ustr(string);
+    return len;
+}
+
+static uint64_t
+bench_new_rope(const Corpus *c) {
+    UnicodeRope *rope = new_rope(c->bytes, c->nbytes);
+    const uint64_t len = rope->len;
+    free_rope(rope);
+    return len;
+}
+
+static uint64_t
+bench_rope_char_at(const Corpus *c) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < c->rope->len; i++) {
+        sum += rope_char_at(c->rope, i).octet[0];
+    }
+    return sum;
+}
+
+static uint64_t
+bench_rope_next_leaf(const Corpus *c) {
+    UnicodeRopeIterator it;
+    UnicodeView leaf;
+    uint64_t sum = 0;
+    rope_iter_init(&it, c->rope);
+    while (rope_next_leaf(&it, &leaf)) {
+        sum += unicode_strlen(leaf.p, leaf.nbytes);
+    }
+    return sum;
+}
+
+static uint64_t
+bench_compress_rope(const Corpus *c) {
+    CompressedUnicodeString *compressed = compress_rope_into_bytes_array(c->rope);
+    const uint64_t len = compressed->len;
+    free_compressed_ustr(compressed);
+    return len;
+}
+
+static uint64_t
+bench_rope_write_fd(const Corpus *c) {
+    return (uint64_t) rope_write_fd(c->rope, c->null_fd);
+}
+
+static uint64_t
+bench_rope_concat(const Corpus *c) {
+    UnicodeRope *rope = new_rope(NULL, 0);
+    for (size_t k = 0; k < ROPE_EDITS; k++) {
+        UnicodeRope *next = rope_concat(rope, c->pieces[k]);
+        free_rope(rope);
+        rope = next;
+    }
+    const uint64_t len = rope->len;
+    free_rope(rope);
+    return len;
+}
+
+static uint64_t
+bench_rope_insert(const Corpus *c) {
+    UnicodeRope *rope = rope_slice(c->rope, 0, c->rope->len);
+    for (size_t k = 0; k < ROPE_EDITS; k++) {
+        UnicodeRope *next = rope_insert(rope, k * rope->len / ROPE_EDITS, c->patch);
+        free_rope(rope);
+        rope = next;
+    }
+    const uint64_t len = rope->len;
+    free_rope(rope);
+    return len;
+}
+
+static uint64_t
+bench_rope_delete(const Corpus *c) {
+    UnicodeRope *rope = rope_slice(c->rope, 0, c->rope->len);
+    for (size_t k = 0; k < ROPE_EDITS; k++) {
+        const size_t start = k * rope->len / ROPE_EDITS;
+        UnicodeRope *next = rope_delete(rope, start, start + 1);
+        free_rope(rope);
+        rope = next;
+    }
+    const uint64_t len = rope->len;
+    free_rope(rope);
+    return len;
+}
+
+static uint64_t
+bench_rope_slice(const Corpus *c) {
+    uint64_t sum = 0;
+    for (size_t k = 0; k < ROPE_EDITS; k++) {
+        UnicodeRope *slice = rope_slice(c->rope, k * c->rope->len / ROPE_EDITS, (k + 1) * c->rope->len / ROPE_EDITS);
+        sum += slice->nbytes;
+        free_rope(slice);
+    }
+    return sum;
+}
+
+static uint64_t
+bench_mapped_validate(const Corpus *c) {
+    return (uint64_t) unicode_mapped_validate(c->mapped, NULL);
+}
+
+static uint64_t
+bench_mapped_count(const Corpus *c) {
+    return unicode_mapped_count(c->mapped);
+}
+
+static uint64_t
+bench_mapped_next_chunk(const Corpus *c) {
+    UnicodeMappedIterator it;
+    UnicodeView chunk;
+    uint64_t sum = 0;
+    unicode_mapped_iter_init(&it, c->mapped);
+    while (unicode_mapped_next_chunk(&it, &chunk)) {
+        sum += unicode_decoded_len(chunk.p, chunk.nbytes);
+    }
+    return sum;
+}
+
+static uint64_t
+bench_mapped_to_utf16_fd(const Corpus *c) {
+    UnicodeTranscodeResult result = {0, 0, 0};
+    unicode_mapped_to_utf16_fd(c->mapped, c->null_fd, UNICODE_LITTLE_ENDIAN, &result);
+    return result.produced;
+}
+
+static uint64_t
+bench_mapped_to_utf32_fd(const Corpus *c) {
+    UnicodeTranscodeResult result = {0, 0, 0};
+    unicode_mapped_to_utf32_fd(c->mapped, c->null_fd, UNICODE_LITTLE_ENDIAN, &result);
+    return result.produced;
+}
+
+static uint64_t
+bench_case_map_lower(const Corpus *c) {
+    return unicode_case_map(c->bytes, c->nbytes, UNICODE_CASE_LOWER, c->out, c->out_cap);
+}
+
+static uint64_t
+bench_case_map_upper(const Corpus *c) {
+    return unicode_case_map(c->bytes, c->nbytes, UNICODE_CASE_UPPER, c->out, c->out_cap);
+}
+
+static uint64_t
+bench_case_map_fold(const Corpus *c) {
+    return unicode_case_map(c->bytes, c->nbytes, UNICODE_CASE_FOLD, c->out, c->out_cap);
+}
+
+static uint64_t
+bench_ustr_case_map(const Corpus *c) {
+    UnicodeString *string = ustr_case_map(c->strings[USTR_LAYOUT_UCHAR], UNICODE_CASE_FOLD);
+    const uint64_t len = string->len;
+    free_ustr(string);
+    return len;
+}
+
+static uint64_t
+bench_tolower(const Corpus *c) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < c->code_points_len; i++) {
+        sum += unicode_tolower(c->code_points[i]);
+    }
+    return sum;
+}
+
+static uint64_t
+bench_toupper(const Corpus *c) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < c->code_points_len; i++) {
+        sum += unicode_toupper(c->code_points[i]);
+    }
+    return sum;
+}
+
+static uint64_t
+bench_casefold(const Corpus *c) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < c->code_points_len; i++) {
+        sum += unicode_casefold(c->code_points[i]);
+    }
+    return sum;
+}
+
+static uint64_t
+bench_case_map_full(const Corpus *c) {
+    uint32_t buf[UNICODE_CASE_MAX_EXPANSION];
+    uint64_t sum = 0;
+    for (size_t i = 0; i < c->code_points_len; i++) {
+        sum += unicode_case_map_full(c->code_points[i], UNICODE_CASE_FOLD, buf) + buf[0];
+    }
+    return sum;
+}
+
+static uint64_t
+bench_general_category(const Corpus *c) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < c->code_points_len; i++) {
+        sum += unicode_general_category(c->code_points[i]);
+    }
+    return sum;
+}
+
+static uint64_t
+bench_east_asian_width(const Corpus *c) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < c->code_points_len; i++) {
+        sum += unicode_east_asian_width(c->code_points[i]);
+    }
+    return sum;
+}
+
+static uint64_t
+bench_char_width(const Corpus *c) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < c->code_points_len; i++) {
+        sum += (uint64_t) unicode_char_width(c->code_points[i]);
+    }
+    return sum;
+}
+
+static uint64_t
+bench_display_width(const Corpus *c) {
+    return unicode_display_width(c->bytes, c->nbytes);
+}
+
+static uint64_t
+bench_ustr_display_width(const Corpus *c) {
+    return ustr_display_width(c->strings[USTR_LAYOUT_UCHAR]);
+}
+
+static uint64_t
+bench_grapheme_feed(const Corpus *c) {
+    UnicodeGraphemeBreaker breaker = {0};
+    const size_t count = unicode_grapheme_feed(&breaker, c->bytes, c->nbytes, c->breaks, c->nbytes, NULL);
+    return count + unicode_grapheme_finish(&breaker, c->breaks + count, UNICODE_GRAPHEME_MAX_FINISH);
+}
+
+static uint64_t
+bench_grapheme_next(const Corpus *c) {
+    uint64_t count = 0;
+    for (size_t offset = 0; offset < c->nbytes; count++) {
+        offset = unicode_grapheme_next(c->bytes, c->nbytes, offset);
+    }
+    return count;
+}
+
+static uint64_t
+bench_ustr_grapheme_next(const Corpus *c) {
+    const UnicodeString *string = c->strings[USTR_LAYOUT_UCHAR];
+    uint64_t count = 0;
+    for (size_t index = 0; index < string->len; count++) {
+        index = ustr_grapheme_next(string, index);
+    }
+    return count;
+}
+
+/**
+ * Normalizes the corpus into the scratch buffer
+ */
+static uint64_t
+normalize(const Corpus *c, const UnicodeNormalizationForm form) {
+    UnicodeView out;
+    return unicode_normalize(c->bytes, c->nbytes, form, c->out, c->out_cap, &out) + (out.p == c->bytes);
+}
+
+static uint64_t
+bench_normalize_nfc(const Corpus *c) {
+    return normalize(c, UNICODE_NFC);
+}
+
+static uint64_t
+bench_normalize_nfd(const Corpus *c) {
+    return normalize(c, UNICODE_NFD);
+}
+
+static uint64_t
+bench_normalize_nfkc(const Corpus *c) {
+    return normalize(c, UNICODE_NFKC);
+}
+
+static uint64_t
+bench_normalize_nfkd(const Corpus *c) {
+    return normalize(c, UNICODE_NFKD);
+}
+
+static const Benchmark BENCHMARKS[] = {
+        {"unicode_validate", "", bench_validate},
+        {"unicode_decoded_len", "", bench_decoded_len},
+        {"unicode_strlen", "", bench_strlen},
+        {"unicode_offset_of", "last char", bench_offset_of},
+        {"read_into_unicode_array", "null-terminated", bench_read_array_cstr},
+        {"read_into_unicode_string", "null-terminated", bench_read_string_cstr},
+        {"read_into_unicode_array_n", "", bench_read_array},
+        {"read_into_unicode_string_with_layout", "uchar", bench_read_string_uchar},
+        {"read_into_unicode_string_with_layout", "utf32", bench_read_string_utf32},
+        {"read_into_unicode_string_with_layout", "split", bench_read_string_split},
+        {"read_into_unicode_string_n", "exact", bench_read_string_exact},
+        {"read_into_unicode_string_with_allocator", "arena, reset per call", bench_read_string_arena},
+        {"ustr_convert", "uchar to utf32", bench_ustr_convert},
+        {"ustr_char_at", "uchar, every index", bench_char_at_uchar},
+        {"ustr_char_at", "utf32, every index", bench_char_at_utf32},
+        {"ustr_char_at", "split, every index", bench_char_at_split},
+        {"ustr_ord_at", "uchar, every index", bench_ord_at},
+        {"unicode_ord", "every char", bench_unicode_ord},
+        {"unicode_chr", "every code point", bench_unicode_chr},
+        {"push_uchar", "every char", bench_push_uchar},
+        {"ustr_append", "4096-char runs", bench_ustr_append},
+        {"concat_ustr", "halves", bench_concat_ustr},
+        {"ustr_bytes_len", "uchar", bench_ustr_bytes_len},
+        {"ustr_write_bytes", "uchar", bench_ustr_write_bytes},
+        {"ustr_write_fd", "uchar, /dev/null", bench_ustr_write_fd},
+        {"compress_into_bytes_array", "uchar", bench_compress},
+        {"ustr_equal", "equal copy", bench_ustr_equal},
+        {"ustr_compare", "equal copy", bench_ustr_compare},
+        {"ustr_hash", "", bench_ustr_hash},
+        {"unicode_equal", "equal copy", bench_unicode_equal},
+        {"unicode_compare", "equal copy", bench_unicode_compare},
+        {"unicode_hash", "", bench_unicode_hash},
+        {"unicode_find", "tail", bench_find},
+        {"unicode_find_any", "tail, absent", bench_find_any},
+        {"utf8_to_utf32", "", bench_utf8_to_utf32},
+        {"utf32_to_utf8_len", "", bench_utf32_to_utf8_len},
+        {"utf32_to_utf8", "", bench_utf32_to_utf8},
+        {"utf8_to_utf16_len", "", bench_utf8_to_utf16_len},
+        {"utf8_to_utf16", "le", bench_utf8_to_utf16},
+        {"utf16_to_utf8_len", "le", bench_utf16_to_utf8_len},
+        {"utf16_to_utf8", "le", bench_utf16_to_utf8},
+        {"unicode_decoder_feed", "4 KiB chunks", bench_decoder_feed},
+        {"unicode_decoder_feed_utf32", "4 KiB chunks", bench_decoder_feed_utf32},
+        {"unicode_view_next", "", bench_view_next},
+        {"unicode_view_next_code_point", "", bench_view_next_code_point},
+        {"unicode_view_slice", "last char", bench_view_slice},
+        {"read_into_indexed_ustr", "", bench_read_indexed},
+        {"indexed_ustr_char_at", "every index", bench_indexed_char_at},
+        {"indexed_ustr_ord_at", "every index", bench_indexed_ord_at},
+        {"indexed_ustr_offset_of", "every index", bench_indexed_offset_of},
+        {"indexed_ustr_slice", "every 16 chars", bench_indexed_slice},
+        {"unicode_parallel_validate", "", bench_parallel_validate},
+        {"unicode_parallel_decoded_len", "", bench_parallel_decoded_len},
+        {"read_into_unicode_string_parallel", "uchar", bench_read_string_parallel},
+        {"new_rope", "", bench_new_rope},
+        {"rope_char_at", "every index", bench_rope_char_at},
+        {"rope_next_leaf", "", bench_rope_next_leaf},
+        {"compress_rope_into_bytes_array", "", bench_compress_rope},
+        {"rope_write_fd", "/dev/null", bench_rope_write_fd},
+        {"rope_concat", "64 slices", bench_rope_concat},
+        {"rope_insert", "64 inserts", bench_rope_insert},
+        {"rope_delete", "64 deletes", bench_rope_delete},
+        {"rope_slice", "64 slices", bench_rope_slice},
+        {"unicode_mapped_validate", "", bench_mapped_validate},
+        {"unicode_mapped_count", "", bench_mapped_count},
+        {"unicode_mapped_next_chunk", "", bench_mapped_next_chunk},
+        {"unicode_mapped_to_utf16_fd", "le, /dev/null", bench_mapped_to_utf16_fd},
+        {"unicode_mapped_to_utf32_fd", "le, /dev/null", bench_mapped_to_utf32_fd},
+        {"unicode_case_map", "lower", bench_case_map_lower},
+        {"unicode_case_map", "upper", bench_case_map_upper},
+        {"unicode_case_map", "fold", bench_case_map_fold},
+        {"ustr_case_map", "fold", bench_ustr_case_map},
+        {"unicode_tolower", "every code point", bench_tolower},
+        {"unicode_toupper", "every code point", bench_toupper},
+        {"unicode_casefold", "every code point", bench_casefold},
+        {"unicode_case_map_full", "fold, every code point", bench_case_map_full},
+        {"unicode_general_category", "every code point", bench_general_category},
+        {"unicode_east_asian_width", "every code point", bench_east_asian_width},
+        {"unicode_char_width", "every code point", bench_char_width},
+        {"unicode_display_width", "", bench_display_width},
+        {"ustr_display_width", "uchar", bench_ustr_display_width},
+        {"unicode_grapheme_feed", "one chunk", bench_grapheme_feed},
+        {"unicode_grapheme_next", "every cluster", bench_grapheme_next},
+        {"ustr_grapheme_next", "uchar, every cluster", bench_ustr_grapheme_next},
+        {"unicode_normalize", "nfc", bench_normalize_nfc},
+        {"unicode_normalize", "nfd", bench_normalize_nfd},
+        {"unicode_normalize", "nfkc", bench_normalize_nfkc},
+        {"unicode_normalize", "nfkd", bench_normalize_nfkd},
+};
+
+#define BENCHMARKS_COUNT (sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]))
+
+/* ============ Timing ============ */
+
+static uint64_t
+now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static uint64_t
+now_ticks(void) {
+#if BENCH_HAS_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+typedef struct Trial_s {
+    double ns;
+    double ticks;
+} Trial;
+
+/**
+ * Runs a benchmark `iterations` times
+ * @return time and TSC ticks per call
+ */
+static Trial
+run_trial(const Benchmark *benchmark, const Corpus *corpus, const uint64_t iterations) {
+    uint64_t acc = 0;
+    const uint64_t start_ticks = now_ticks();
+    const uint64_t start = now_ns();
+    for (uint64_t i = 0; i < iterations; i++) {
+        acc += benchmark->fn(corpus);
+    }
+    const uint64_t end = now_ns();
+    const uint64_t end_ticks = now_ticks();
+    sink += acc;
+    return (Trial) {
+            (double) (end - start) / (double) iterations,
+            (double) (end_ticks - start_ticks) / (double) iterations,
+    };
+}
+
+/**
+ * Warms caches, branch predictors and allocator up, and finds how many calls make a trial last at least min_ns
+ */
+static uint64_t
+calibrate(const Benchmark *benchmark, const Corpus *corpus, const uint64_t min_ns) {
+    uint64_t iterations = 1;
+    for (;;) {
+        const double ns = run_trial(benchmark, corpus, iterations).ns * (double) iterations;
+        if (ns >= (double) min_ns) {
+            return iterations;
+        }
+        // aim 20% past the target, at most 100 times more calls per step
+        const double grow = ns > 0 ? (double) min_ns * 1.2 / ns : 100;
+        iterations = (uint64_t) ((double) iterations * (grow < 100 ? grow : 100)) + 1;
+    }
+}
+
+static int
+compare_doubles(const void *pA, const void *pB) {
+    const double a = *(const double *) pA;
+    const double b = *(const double *) pB;
+    return (a > b) - (a < b);
+}
+
+/**
+ * Percentile of sorted values, linearly interpolated between the closest ranks
+ */
+static double
+percentile(const double *values, const size_t n, const double q) {
+    const double rank = q * (double) (n - 1);
+    const size_t low = (size_t) rank;
+    if (low + 1 >= n) {
+        return values[n - 1];
+    }
+    return values[low] + (values[low + 1] - values[low]) * (rank - (double) low);
+}
+
+/* ============ Output ============ */
+
+static void
+print_json_string(const char *str) {
+    putchar('"');
+    for (const unsigned char *p = (const unsigned char *) str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            printf("\\%c", *p);
+        } else if (*p < 0x20) {
+            printf("\\u%04x", *p);
+        } else {
+            putchar(*p);
         }
-        reads_total_time[i] = total_read_time;
     }
+    putchar('"');
+}
+
+/**
+ * Prints `"key": {"median": .., "p10": .., "p90": ..}` of rates `scale / time`; p10 is the rate of the p90 time
+ */
+static void
+print_rates(const char *key, const double scale, const double *sorted_ns, const size_t n) {
+    printf("\"%s\": {\"median\": %.6g, \"p10\": %.6g, \"p90\": %.6g}", key,
+           scale / percentile(sorted_ns, n, 0.5), scale / percentile(sorted_ns, n, 0.9),
+           scale / percentile(sorted_ns, n, 0.1));
+}
+
+static void
+print_result(const Benchmark *benchmark, const Corpus *corpus, const uint64_t iterations, Trial *trials,
+             const unsigned count) {
+    double ns[MAX_TRIALS];
+    double ticks[MAX_TRIALS];
+    for (unsigned i = 0; i < count; i++) {
+        ns[i] = trials[i].ns;
+        ticks[i] = trials[i].ticks;
+    }
+    qsort(ns, count, sizeof(double), compare_doubles);
+    qsort(ticks, count, sizeof(double), compare_doubles);
+
+    printf("    {\"function\": ");
+    print_json_string(benchmark->function);
+    printf(", \"variant\": ");
+    print_json_string(benchmark->variant);
+    printf(", \"corpus\": ");
+    print_json_string(corpus->name);
+    printf(", \"iterations\": %llu, \"trials\": %u,\n", (unsigned long long) iterations, count);
+    printf("     \"ns_per_call\": {\"median\": %.6g, \"p10\": %.6g, \"p90\": %.6g, \"min\": %.6g, \"max\": %.6g},\n",
+           percentile(ns, count, 0.5), percentile(ns, count, 0.1), percentile(ns, count, 0.9), ns[0],
+           ns[count - 1]);
+    printf("     ");
+    print_rates("mb_per_s", (double) corpus->nbytes * 1e9 / 1e6, ns, count);
+    printf(",\n     ");
+    print_rates("chars_per_s", (double) corpus->chars * 1e9, ns, count);
+    if (BENCH_HAS_TSC && corpus->nbytes) {
+        printf(",\n     \"tsc_per_byte\": %.6g", percentile(ticks, count, 0.5) / (double) corpus->nbytes);
+    }
+    printf("}");
+}
+
+static void
+print_corpus(const Corpus *corpus) {
+    printf("    {\"name\": ");
+    print_json_string(corpus->name);
+    printf(", \"bytes\": %zu, \"chars\": %zu, \"code_points\": %zu, \"valid\": %s}", corpus->nbytes, corpus->chars,
+           corpus->code_points_len, corpus->valid ? "true" : "false");
+}
+
+/* ============ Driver ============ */
 
-    UnicodeChar *string;
-    read_unicode_string(mix, &string);
+static void
+usage(FILE *stream) {
+    fprintf(stream,
+            "usage: unicode-bench [options] > results.json\n"
+            "  --size BYTES        corpus size, default %d\n"
+            "  --trials N          timed trials per benchmark, default %d, at most %d\n"
+            "  --min-time-ms MS    min duration of a trial, default %d\n"
+            "  --threads N         threads of unicode_parallel_* functions, default 0 (online CPUs)\n"
+            "  --filter SUBSTRING  run only functions whose name contains SUBSTRING\n"
+            "  --corpus NAME       run only on one corpus: ascii, latin1, cyrillic, cjk, emoji, invalid\n",
+            DEFAULT_CORPUS_SIZE, DEFAULT_TRIALS, MAX_TRIALS, DEFAULT_MIN_TRIAL_MS);
+}
+
+/**
+ * Parses a non-negative decimal option value, exits on garbage
+ */
+static unsigned long long
+parse_number(const char *option, const char *value) {
+    char *end;
+    const unsigned long long number = value != NULL ? strtoull(value, &end, 10) : 0;
+    if (value == NULL || *value == '\0' || *value == '-' || *end != '\0') {
+        fprintf(stderr, "unicode-bench: %s expects a number\n", option);
+        usage(stderr);
+        exit(2);
+    }
+    return number;
+}
+
+static Options
+parse_options(const int argc, char **argv) {
+    Options options = {DEFAULT_CORPUS_SIZE, DEFAULT_TRIALS, DEFAULT_MIN_TRIAL_MS, 0, NULL, NULL};
+
+    for (int i = 1; i < argc; i++) {
+        const char *option = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(option, "--help") == 0 || strcmp(option, "-h") == 0) {
+            usage(stdout);
+            exit(0);
+        } else if (strcmp(option, "--size") == 0) {
+            options.size = (size_t) parse_number(option, value);
+        } else if (strcmp(option, "--trials") == 0) {
+            options.trials = (unsigned) parse_number(option, value);
+        } else if (strcmp(option, "--min-time-ms") == 0) {
+            options.min_trial_ms = (unsigned) parse_number(option, value);
+        } else if (strcmp(option, "--threads") == 0) {
+            options.threads = (unsigned) parse_number(option, value);
+        } else if (strcmp(option, "--filter") == 0 && value != NULL) {
+            options.filter = value;
+        } else if (strcmp(option, "--corpus") == 0 && value != NULL) {
+            options.corpus = value;
+        } else {
+            fprintf(stderr, "unicode-bench: unknown option %s\n", option);
+            usage(stderr);
+            exit(2);
+        }
+        i++;
+    }
+    if (options.size < 64 || options.trials == 0 || options.trials > MAX_TRIALS) {
+        fprintf(stderr, "unicode-bench: --size must be at least 64, --trials between 1 and %d\n", MAX_TRIALS);
+        exit(2);
+    }
+    return options;
+}
+
+int
+main(int argc, char **argv) {
+    const Options options = parse_options(argc, argv);
+    Trial trials[MAX_TRIALS];
+    int first = 1;
+
+    printf("{\n");
+    printf("  \"platform\": \"%s\",\n", PLATFORM_NAME);
+    printf("  \"compiler\": ");
+    print_json_string(COMPILER_NAME);
+    printf(",\n");
+    printf("  \"timer\": \"clock_gettime(CLOCK_MONOTONIC)\",\n");
+    printf("  \"tsc\": %s,\n", BENCH_HAS_TSC ? "true" : "false");
+    printf("  \"corpus_size\": %zu, \"trials\": %u, \"min_trial_ms\": %u, \"threads\": %u,\n", options.size,
+           options.trials, options.min_trial_ms, options.threads);
+    printf("  \"results\": [\n");
+
+    Corpus corpora[SCRIPTS_COUNT];
+    int used[SCRIPTS_COUNT] = {0};
+    for (size_t s = 0; s < SCRIPTS_COUNT; s++) {
+        if (options.corpus != NULL && strcmp(options.corpus, SCRIPTS[s].name) != 0) {
+            continue;
+        }
+        Corpus *corpus = &corpora[s];
+        init_corpus(corpus, &SCRIPTS[s], options.size, options.threads, 0x9E3779B97F4A7C15ULL + s);
+        used[s] = 1;
+
+        for (size_t b = 0; b < BENCHMARKS_COUNT; b++) {
+            const Benchmark *benchmark = &BENCHMARKS[b];
+            if (options.filter != NULL && strstr(benchmark->function, options.filter) == NULL) {
+                continue;
+            }
+            if (corpus->mapped == NULL && strncmp(benchmark->function, "unicode_mapped_", 15) == 0) {
+                fprintf(stderr, "%-10s %-38s skipped: can't map a temporary file\n", corpus->name,
+                        benchmark->function);
+                continue;
+            }
+
+            const uint64_t iterations = calibrate(benchmark, corpus, (uint64_t) options.min_trial_ms * 1000000u);
+            for (unsigned t = 0; t < options.trials; t++) {
+                trials[t] = run_trial(benchmark, corpus, iterations);
+            }
+
+            fputs(first ? "" : ",\n", stdout);
+            first = 0;
+            print_result(benchmark, corpus, iterations, trials, options.trials);
+            fflush(stdout);
+
+            double ns[MAX_TRIALS];
+            for (unsigned t = 0; t < options.trials; t++) {
+                ns[t] = trials[t].ns;
+            }
+            qsort(ns, options.trials, sizeof(double), compare_doubles);
+            fprintf(stderr, "%-10s %-38s %-24s %10.1f MB/s\n", corpus->name, benchmark->function, benchmark->variant,
+                    (double) corpus->nbytes * 1e3 / percentile(ns, options.trials, 0.5));
+        }
+        // sizes and counts stay for the summary
+        destroy_corpus(corpus);
+    }
+    printf("\n  ],\n");
 
-    for (int i = 0; i < target_runs; i++) {
-        total_iterate_time = 0.0;
-        printf("benchmarking %lu iterations\n", runs[i]);
-        for (int j = 0; j < runs[i]; j++) {
-            start_time = clock();
-            iterate_benchmark(&string);
-            exec_time = (double) (clock() - start_time) / CLOCKS_PER_SEC;
-            total_iterate_time += exec_time;
+    printf("  \"corpora\": [\n");
+    first = 1;
+    for (size_t s = 0; s < SCRIPTS_COUNT; s++) {
+        if (used[s]) {
+            fputs(first ? "" : ",\n", stdout);
+            first = 0;
+            print_corpus(&corpora[s]);
         }
-        iterates_total_time[i] = total_iterate_time;
-    }
-    printf("\nRead string to UnicodeChar sequence benchmark\n");
-    printf(
-            "| %10s | %14s | %14s | %18s | %10s | %10s |\n",
-            "runs",
-            "total time, s",
-            "total time, μs",
-            "total time, ns",
-            "avg time per execution, μs",
-            "avg time per execution, ns"
-    );
-    printf("|------------|----------------|----------------|--------------------|----------------------------|----------------------------|\n");
-
-    for (int i = 0; i < 7; i++) {
-        printf(
-                "| %10lu | %14.3f | %14.3f | %18.3f | %26.3f | %26.3f |\n",
-                runs[i],
-                reads_total_time[i],
-                reads_total_time[i] * 1e6,
-                reads_total_time[i] * 1e9,
-                reads_total_time[i] * 1e6 / ((double) runs[i]),
-                reads_total_time[i] * 1e9 / ((double) runs[i])
-        );
-    }
-
-    printf("\nIterate over UnicodeChar sequence benchmark\n");
-    printf(
-            "| %10s | %14s | %14s | %18s | %10s | %10s |\n",
-            "runs",
-            "total time, s",
-            "total time, μs",
-            "total time, ns",
-            "avg time per execution, μs",
-            "avg time per execution, ns"
-    );
-    printf("|------------|----------------|----------------|--------------------|----------------------------|----------------------------|\n");
-
-    for (int i = 0; i < 7; i++) {
-        printf(
-                "| %10lu | %14.3f | %14.3f | %18.3f | %26.3f | %26.3f |\n",
-                runs[i],
-                iterates_total_time[i],
-                iterates_total_time[i] * 1e6,
-                iterates_total_time[i] * 1e9,
-                iterates_total_time[i] * 1e6 / ((double) runs[i]),
-                iterates_total_time[i] * 1e9 / ((double) runs[i])
-        );
     }
+    printf("\n  ]\n}\n");
+    return 0;
 }
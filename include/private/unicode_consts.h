@@ -11,7 +11,7 @@
 #define NEW_USTR_NULL_VALUE -1
 
 // define max int code for (i+1) octet Unicode char representation
-const uint32_t MAX_UNICODE_CHAR[4] = {
+static const uint32_t MAX_UNICODE_CHAR[4] = {
     0x7F,
     0x7FF,
     0xFFFF,
@@ -22,30 +22,30 @@ const uint32_t MAX_UNICODE_CHAR[4] = {
  * Octets headers values
  */
 
-const uint8_t START_ONE_OCTET = 0b00000000;
-const uint8_t START_TWO_OCTET = 0b11000000;
-const uint8_t START_THREE_OCTET = 0b11100000;
-const uint8_t START_FOUR_OCTET = 0b11110000;
-const uint8_t CONTINUE_OCTET = 0b10000000;
+static const uint8_t START_ONE_OCTET = 0b00000000;
+static const uint8_t START_TWO_OCTET = 0b11000000;
+static const uint8_t START_THREE_OCTET = 0b11100000;
+static const uint8_t START_FOUR_OCTET = 0b11110000;
+static const uint8_t CONTINUE_OCTET = 0b10000000;
 
 /**
  * Masks for Unicode characters start bytes
  * Mask itself leaves only significant for octet-defining bits
  * 0XXX XXXX
  */
-const uint8_t ONE_OCTET_MASK = 0b10000000;
-const uint8_t ONE_OCTET = 0b00000000;
+static const uint8_t ONE_OCTET_MASK = 0b10000000;
+static const uint8_t ONE_OCTET = 0b00000000;
 // 110X XXXX
-const uint8_t TWO_OCTET_MASK = 0b11100000;
-const uint8_t TWO_OCTET = 0b11000000;
+static const uint8_t TWO_OCTET_MASK = 0b11100000;
+static const uint8_t TWO_OCTET = 0b11000000;
 // 1110 XXXX
-const uint8_t THREE_OCTET_MASK = 0b11110000;
-const uint8_t THREE_OCTET = 0b11100000;
+static const uint8_t THREE_OCTET_MASK = 0b11110000;
+static const uint8_t THREE_OCTET = 0b11100000;
 // 1111 0XXXX
-const uint8_t FOUR_OCTET_MASK = 0b11111000;
-const uint8_t FOUR_OCTET = 0b11110000;
+static const uint8_t FOUR_OCTET_MASK = 0b11111000;
+static const uint8_t FOUR_OCTET = 0b11110000;
 
-const uint8_t HEXES[16] = {
+static const uint8_t HEXES[16] = {
     '0',
     '1',
     '2',
@@ -67,11 +67,30 @@ const uint8_t HEXES[16] = {
 /**
  * Size of UnicodeChar struct in bytes
  */
-const size_t UCHAR_SIZE = sizeof(UnicodeChar);
+static const size_t UCHAR_SIZE = sizeof(UnicodeChar);
 
 /**
  * Size of UnicodeString struct in bytes
 */
-const size_t USTR_SIZE = sizeof(UnicodeString);
+static const size_t USTR_SIZE = sizeof(UnicodeString);
+
+/**
+ * Size in bytes of one element of UnicodeString main storage array for each UnicodeLayout
+ */
+static const size_t USTR_LAYOUT_SLOT_SIZE[3] = {
+    sizeof(UnicodeChar),
+    sizeof(uint32_t),
+    sizeof(uint32_t)
+};
+
+/**
+ * Number of chars UnicodeString inline storage holds for each UnicodeLayout, one more slot is left for the terminator.
+ * SPLIT layout keeps `sizes` right after its octets
+ */
+static const size_t USTR_LAYOUT_INLINE_CAPACITY[3] = {
+    USTR_INLINE_SIZE / sizeof(UnicodeChar) - 1,
+    USTR_INLINE_SIZE / sizeof(uint32_t) - 1,
+    USTR_INLINE_SIZE / (sizeof(uint32_t) + 1) - 1
+};
 
 #endif //UNICODE_CONSTS_H
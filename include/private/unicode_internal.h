@@ -0,0 +1,277 @@
+//
+// Helpers shared between library translation units. Not a part of the public API.
+//
+
+#ifndef UNICODE_INTERNAL_H
+#define UNICODE_INTERNAL_H
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unicode_consts.h"
+
+/**
+ * Stack block that sinks encode into before handing bytes to stdio / write(2)
+ */
+#define UNICODE_WRITE_BLOCK_SIZE (64 * 1024)
+
+/**
+ * Returned by decoders in strict mode when the input is ill-formed
+ */
+#define DECODE_ILL_FORMED SIZE_MAX
+
+/**
+ * Slot an invalid byte is decoded to: 4 printable octets of its `\xNN` hex representation
+ */
+static inline UnicodeChar
+invalid_byte_uchar(const uint8_t byte) {
+    return (UnicodeChar){{'\\', 'x', HEXES[byte >> 4], HEXES[byte & 0xF]}, 4};
+}
+
+/**
+ * Decodes one non-ASCII char (or invalid byte) at pStr into pOut without reading past pEnd.
+ * Sequences truncated by the end of input are decoded byte-wise as invalid bytes
+ * @return number of source bytes consumed
+ */
+static inline uint8_t
+decode_one_n(const uint8_t *pStr, const uint8_t *pEnd, UnicodeChar *pOut) {
+    if (get_octets_num(pStr) > pEnd - pStr) {
+        // truncated sequence: render the lead byte as invalid, its continuation bytes follow as invalid too
+        *pOut = invalid_byte_uchar(*pStr);
+        return 1;
+    }
+    // read_unicode_char_fast leaves unused octets untouched, they must stay zero
+    *pOut = (UnicodeChar){0};
+    return read_unicode_char_fast(pStr, &pOut);
+}
+
+/**
+ * Length of the well-formed sequence at pStr (Unicode Table 3-7) without reading past pEnd: lead byte range,
+ * second byte range for E0 / ED / F0 / F4 leads and continuation bytes are all checked
+ * @return 1..4, or 0 if the sequence is ill-formed or truncated
+ */
+static inline uint8_t
+utf8_sequence_len(const uint8_t *pStr, const uint8_t *pEnd) {
+    const uint8_t lead = *pStr;
+    uint8_t len, low = 0x80, high = 0xBF;
+
+    if (lead < 0x80) {
+        return 1;
+    } else if (lead < 0xC2) {
+        return 0;
+    } else if (lead < 0xE0) {
+        len = 2;
+    } else if (lead < 0xF0) {
+        len = 3;
+        low = lead == 0xE0 ? 0xA0 : 0x80;
+        high = lead == 0xED ? 0x9F : 0xBF;
+    } else if (lead < 0xF5) {
+        len = 4;
+        low = lead == 0xF0 ? 0x90 : 0x80;
+        high = lead == 0xF4 ? 0x8F : 0xBF;
+    } else {
+        return 0;
+    }
+
+    if (pEnd - pStr < len || pStr[1] < low || pStr[1] > high) {
+        return 0;
+    }
+    for (uint8_t i = 2; i < len; i++) {
+        if ((pStr[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    return len;
+}
+
+/**
+ * Decodes a well-formed sequence of `len` bytes, see `utf8_sequence_len`
+ */
+static inline uint32_t
+decode_utf8_valid(const uint8_t *pStr, const uint8_t len) {
+    switch (len) {
+        case 1:
+            return pStr[0];
+        case 2:
+            return (uint32_t) (pStr[0] & 0x1F) << 6 | (pStr[1] & 0x3F);
+        case 3:
+            return (uint32_t) (pStr[0] & 0x0F) << 12 | (uint32_t) (pStr[1] & 0x3F) << 6 | (pStr[2] & 0x3F);
+        default:
+            return (uint32_t) (pStr[0] & 0x07) << 18 | (uint32_t) (pStr[1] & 0x3F) << 12
+                   | (uint32_t) (pStr[2] & 0x3F) << 6 | (pStr[3] & 0x3F);
+    }
+}
+
+/**
+ * Code point of uchar for UTF-32 storage, the terminating slot becomes 0. Chars the lax decoder took by their lead
+ * byte alone are checked as `utf8_sequence_len` checks input: invalid byte slots, overlong forms (C0 AF is not `/`),
+ * surrogates, chars past U+10FFFF and lead bytes followed by a non-continuation byte all become U+FFFD
+ */
+static inline uint32_t
+uchar_to_code_point(const UnicodeChar uchar) {
+    if (!uchar.size) {
+        return 0;
+    }
+    const uint8_t len = utf8_sequence_len(uchar.octet, uchar.octet + uchar.size);
+    return len == uchar.size ? decode_utf8_valid(uchar.octet, len) : UNICODE_REPLACEMENT_CHAR;
+}
+
+/**
+ * Inverse of `uchar_to_code_point`; unlike `unicode_chr` keeps U+0000 a 1-octet char and encodes values above
+ * U+10FFFF as U+FFFD
+ */
+static inline UnicodeChar
+code_point_to_uchar(const uint32_t code_point) {
+    if (code_point == 0) {
+        return (UnicodeChar){{0, 0, 0, 0}, 1};
+    }
+    return unicode_chr(code_point <= MAX_UNICODE_CHAR[3] ? code_point : UNICODE_REPLACEMENT_CHAR);
+}
+
+/**
+ * Number of UTF-8 bytes code_point is encoded with, invalid code points take 3 bytes of UNICODE_REPLACEMENT_CHAR
+ */
+static inline uint8_t
+utf8_encoded_len(const uint32_t code_point) {
+    if (code_point < 0x80) {
+        return 1;
+    } else if (code_point < 0x800) {
+        return 2;
+    } else if (code_point < 0x10000 || code_point > 0x10FFFF) {
+        return 3;
+    }
+    return 4;
+}
+
+/**
+ * Encodes one valid code point of `len` bytes at pOut
+ */
+static inline void
+encode_utf8_char(const uint32_t code_point, const uint8_t len, uint8_t *pOut) {
+    switch (len) {
+        case 1:
+            pOut[0] = code_point;
+            break;
+        case 2:
+            pOut[0] = 0xC0 | (code_point >> 6);
+            pOut[1] = 0x80 | (code_point & 0x3F);
+            break;
+        case 3:
+            pOut[0] = 0xE0 | (code_point >> 12);
+            pOut[1] = 0x80 | ((code_point >> 6) & 0x3F);
+            pOut[2] = 0x80 | (code_point & 0x3F);
+            break;
+        default:
+            pOut[0] = 0xF0 | (code_point >> 18);
+            pOut[1] = 0x80 | ((code_point >> 12) & 0x3F);
+            pOut[2] = 0x80 | ((code_point >> 6) & 0x3F);
+            pOut[3] = 0x80 | (code_point & 0x3F);
+            break;
+    }
+}
+
+/**
+ * Stores chr at position i of self in its own layout
+ */
+static inline void
+ustr_set(UnicodeString *self, const size_t i, const UnicodeChar chr) {
+    switch (self->layout) {
+        case USTR_LAYOUT_UTF32:
+            self->code_points[i] = uchar_to_code_point(chr);
+            break;
+        case USTR_LAYOUT_SPLIT:
+            memcpy(self->octets + i, chr.octet, sizeof(uint32_t));
+            self->sizes[i] = chr.size;
+            break;
+        default:
+            self->data[i] = chr;
+            break;
+    }
+}
+
+/**
+ * Writes the null-terminating slot right after the last char
+ */
+static inline void
+ustr_terminate(UnicodeString *self) {
+    ustr_set(self, self->len, (UnicodeChar){0});
+}
+
+/**
+ * Decodes pStr[0..nbytes) into slots [at, ..) of self in its own layout, see `read_into_unicode_string_n`.
+ * Storage must have room for `unicode_decoded_len(pStr, nbytes)` slots past `at`; len and the terminator are not set
+ * @return number of slots written, or DECODE_ILL_FORMED if `strict` is set and the input is not well-formed
+ */
+size_t
+ustr_decode_at(UnicodeString *self, size_t at, const uint8_t *pStr, size_t nbytes, int strict);
+
+/**
+ * Encodes chars of self starting at *pIndex into pOut until the next char doesn't fit into cap bytes, advancing
+ * *pIndex past the chars written. UnicodeChar slots are copied as whole 4-byte words while there is room for them
+ * @return number of bytes written
+ */
+size_t
+ustr_encode_chars(const UnicodeString *self, size_t *pIndex, uint8_t *pOut, size_t cap);
+
+/**
+ * Allocation through a UnicodeAllocator vtable
+ */
+static inline void *
+unicode_alloc(const UnicodeAllocator *allocator, const size_t size) {
+    return allocator->alloc(allocator->ctx, size);
+}
+
+static inline void *
+unicode_resize(const UnicodeAllocator *allocator, void *ptr, const size_t old_size, const size_t new_size) {
+    return allocator->resize(allocator->ctx, ptr, old_size, new_size);
+}
+
+static inline void
+unicode_release(const UnicodeAllocator *allocator, void *ptr, const size_t size) {
+    allocator->release(allocator->ctx, ptr, size);
+}
+
+/**
+ * Allocates a CompressedUnicodeString for nbytes bytes: the struct, then its null-terminated data at the exact size
+ * as a block of its own, so `free(data); free(struct)` of libc-allocated strings keeps working. Only the terminator
+ * is written
+ */
+static inline CompressedUnicodeString *
+new_compressed_ustr(const UnicodeAllocator *allocator, const size_t nbytes) {
+    CompressedUnicodeString *compressed = unicode_alloc(allocator, sizeof(CompressedUnicodeString));
+    if (compressed == NULL) {
+        return NULL;
+    }
+    compressed->data = unicode_alloc(allocator, nbytes + 1);
+    if (compressed->data == NULL) {
+        unicode_release(allocator, compressed, sizeof(CompressedUnicodeString));
+        return NULL;
+    }
+    compressed->data[nbytes] = '\0';
+    compressed->len = nbytes + 1;
+    compressed->allocator = allocator;
+    return compressed;
+}
+
+/**
+ * Writes all of buf[0..n) to fd, retrying partial writes and writes interrupted by a signal
+ * @return 0 on success, -1 if write fails (errno is set by write)
+ */
+static inline int
+write_all(const int fd, const uint8_t *buf, size_t n) {
+    while (n) {
+        const ssize_t written = write(fd, buf, n);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += written;
+        n -= (size_t) written;
+    }
+    return 0;
+}
+
+#endif //UNICODE_INTERNAL_H
@@ -0,0 +1,406 @@
+//
+// Vector kernels shared by decoding / scanning routines.
+//
+
+#ifndef UNICODE_SIMD_H
+#define UNICODE_SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "unicode.h"
+
+/**
+ * x86 vector kernels are compiled with per-function `target` attributes and selected at runtime, so the library can be
+ * built for the SSE2 baseline and still use AVX2 on hosts that have it
+ */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define UNICODE_SIMD_X86 1
+#include <immintrin.h>
+#define UNICODE_TARGET_AVX2 __attribute__((target("avx2")))
+// every AVX2 CPU has POPCNT
+#define UNICODE_TARGET_AVX2_POPCNT __attribute__((target("avx2,popcnt")))
+#define UNICODE_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+
+/**
+ * Every byte with the high bit set is a part of a multibyte sequence (or invalid), so 8 bytes at a time can be tested
+ */
+#define ASCII_WORD_MASK 0x8080808080808080ULL
+
+#ifdef UNICODE_SIMD_X86
+/**
+ * pshufb indices expanding 16 ASCII bytes into 16 UnicodeChar slots (80 bytes, five 16-byte stores).
+ * Slot byte 0 takes the source byte, other bytes are zeroed (0x80 index)
+ */
+static const uint8_t ASCII_EXPAND_SHUFFLE[5][16] = {
+    {0x00, 0x80, 0x80, 0x80, 0x80, 0x01, 0x80, 0x80, 0x80, 0x80, 0x02, 0x80, 0x80, 0x80, 0x80, 0x03},
+    {0x80, 0x80, 0x80, 0x80, 0x04, 0x80, 0x80, 0x80, 0x80, 0x05, 0x80, 0x80, 0x80, 0x80, 0x06, 0x80},
+    {0x80, 0x80, 0x80, 0x07, 0x80, 0x80, 0x80, 0x80, 0x08, 0x80, 0x80, 0x80, 0x80, 0x09, 0x80, 0x80},
+    {0x80, 0x80, 0x0a, 0x80, 0x80, 0x80, 0x80, 0x0b, 0x80, 0x80, 0x80, 0x80, 0x0c, 0x80, 0x80, 0x80},
+    {0x80, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x0f, 0x80, 0x80, 0x80, 0x80},
+};
+
+/**
+ * `size` field of every expanded slot, OR-ed over the shuffled bytes
+ */
+static const uint8_t ASCII_EXPAND_SIZE[5][16] = {
+    {0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0},
+    {0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0},
+    {0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0},
+    {0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0},
+    {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1},
+};
+
+/**
+ * CPU features are read from the flags the runtime fills in once at startup, so these are safe to call from any
+ * thread and cost a load and a test; no cache of their own is kept
+ */
+static inline int
+unicode_cpu_has_avx2(void) {
+    return __builtin_cpu_supports("avx2") ? 1 : 0;
+}
+
+static inline int
+unicode_cpu_has_ssse3(void) {
+    return __builtin_cpu_supports("ssse3") ? 1 : 0;
+}
+
+static inline size_t
+ascii_prefix_len_sse2(const uint8_t *pStr, const size_t len) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) (pStr + i)));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i;
+}
+
+UNICODE_TARGET_AVX2 static inline size_t
+ascii_prefix_len_avx2(const uint8_t *pStr, const size_t len) {
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        const __m256i lo = _mm256_loadu_si256((const __m256i *) (pStr + i));
+        const __m256i hi = _mm256_loadu_si256((const __m256i *) (pStr + i + 32));
+        if (_mm256_movemask_epi8(_mm256_or_si256(lo, hi))) {
+            break;
+        }
+    }
+    for (; i + 32 <= len; i += 32) {
+        const uint32_t mask = (uint32_t) _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *) (pStr + i)));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i;
+}
+
+UNICODE_TARGET_AVX2 static inline void
+expand_ascii_block16_avx2(const __m128i block, UnicodeChar *pOut) {
+    uint8_t *dst = (uint8_t *) pOut;
+    for (size_t k = 0; k < 5; k++) {
+        const __m128i shuffle = _mm_loadu_si128((const __m128i *) ASCII_EXPAND_SHUFFLE[k]);
+        const __m128i size = _mm_loadu_si128((const __m128i *) ASCII_EXPAND_SIZE[k]);
+        _mm_storeu_si128((__m128i *) (dst + 16 * k), _mm_or_si128(_mm_shuffle_epi8(block, shuffle), size));
+    }
+}
+
+UNICODE_TARGET_AVX2 static inline size_t
+expand_ascii_run_avx2(const uint8_t *pStr, const size_t len, UnicodeChar *pOut) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        const __m256i block = _mm256_loadu_si256((const __m256i *) (pStr + i));
+        if (_mm256_movemask_epi8(block)) {
+            break;
+        }
+        expand_ascii_block16_avx2(_mm256_castsi256_si128(block), pOut + i);
+        expand_ascii_block16_avx2(_mm256_extracti128_si256(block, 1), pOut + i + 16);
+    }
+    return i;
+}
+
+static inline size_t
+expand_ascii_run_sse2(const uint8_t *pStr, const size_t len, UnicodeChar *pOut) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *) (pStr + i)))) {
+            break;
+        }
+        for (size_t j = 0; j < 16; j++) {
+            pOut[i + j] = (UnicodeChar){{pStr[i + j], 0, 0, 0}, 1};
+        }
+    }
+    return i;
+}
+
+/**
+ * Lead and ASCII bytes compare greater than 0xBF as signed bytes, continuation bytes (0x80..0xBF) don't.
+ * Matches are counted in per-byte counters, which are summed into 64-bit lanes every 255 blocks before they overflow
+ */
+UNICODE_TARGET_AVX2 static inline size_t
+count_utf8_leads_avx2(const uint8_t *pStr, const size_t len, size_t *pLeads) {
+    const __m256i continuation_max = _mm256_set1_epi8((char) 0xBF);
+    size_t i = 0;
+
+    while (i + 32 <= len) {
+        const size_t blocks = (len - i) / 32 < 255 ? (len - i) / 32 : 255;
+        __m256i counters = _mm256_setzero_si256();
+        for (size_t k = 0; k < blocks; k++, i += 32) {
+            const __m256i block = _mm256_loadu_si256((const __m256i *) (pStr + i));
+            counters = _mm256_sub_epi8(counters, _mm256_cmpgt_epi8(block, continuation_max));
+        }
+        uint64_t sums[4];
+        _mm256_storeu_si256((__m256i *) sums, _mm256_sad_epu8(counters, _mm256_setzero_si256()));
+        *pLeads += (size_t) (sums[0] + sums[1] + sums[2] + sums[3]);
+    }
+    return i;
+}
+
+static inline size_t
+count_utf8_leads_sse2(const uint8_t *pStr, const size_t len, size_t *pLeads) {
+    const __m128i continuation_max = _mm_set1_epi8((char) 0xBF);
+    size_t i = 0;
+
+    while (i + 16 <= len) {
+        const size_t blocks = (len - i) / 16 < 255 ? (len - i) / 16 : 255;
+        __m128i counters = _mm_setzero_si128();
+        for (size_t k = 0; k < blocks; k++, i += 16) {
+            const __m128i block = _mm_loadu_si128((const __m128i *) (pStr + i));
+            counters = _mm_sub_epi8(counters, _mm_cmpgt_epi8(block, continuation_max));
+        }
+        const __m128i sums = _mm_sad_epu8(counters, _mm_setzero_si128());
+        *pLeads += (size_t) _mm_cvtsi128_si32(sums) + (size_t) _mm_extract_epi16(sums, 4);
+    }
+    return i;
+}
+
+/**
+ * Skips whole 64-byte blocks while they hold no more than *pIndex lead bytes, *pIndex is decreased by the skipped ones
+ * @return number of bytes skipped
+ */
+UNICODE_TARGET_AVX2_POPCNT static inline size_t
+skip_utf8_leads_avx2(const uint8_t *pStr, const size_t len, size_t *pIndex) {
+    const __m256i continuation_max = _mm256_set1_epi8((char) 0xBF);
+    size_t i = 0;
+
+    for (; i + 64 <= len; i += 64) {
+        const __m256i lo = _mm256_loadu_si256((const __m256i *) (pStr + i));
+        const __m256i hi = _mm256_loadu_si256((const __m256i *) (pStr + i + 32));
+        const uint32_t lo_mask = (uint32_t) _mm256_movemask_epi8(_mm256_cmpgt_epi8(lo, continuation_max));
+        const uint32_t hi_mask = (uint32_t) _mm256_movemask_epi8(_mm256_cmpgt_epi8(hi, continuation_max));
+        const uint64_t mask = lo_mask | (uint64_t) hi_mask << 32;
+        const size_t leads = (size_t) __builtin_popcountll(mask);
+        if (leads > *pIndex) {
+            break;
+        }
+        *pIndex -= leads;
+    }
+    return i;
+}
+
+UNICODE_TARGET_AVX2 static inline size_t
+common_prefix_len_avx2(const uint8_t *pA, const uint8_t *pB, const size_t len) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        const __m256i a = _mm256_loadu_si256((const __m256i *) (pA + i));
+        const __m256i b = _mm256_loadu_si256((const __m256i *) (pB + i));
+        const uint32_t mask = ~(uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i;
+}
+
+static inline size_t
+common_prefix_len_sse2(const uint8_t *pA, const uint8_t *pB, const size_t len) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i *) (pA + i));
+        const __m128i b = _mm_loadu_si128((const __m128i *) (pB + i));
+        const uint32_t mask = ~(uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) & 0xFFFF;
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i;
+}
+#endif
+
+/**
+ * Returns the number of leading bytes of pStr[0..len) that are ASCII (high bit clear)
+ *
+ * @param pStr bytes to scan
+ * @param len number of bytes available at pStr
+ * @return length of the ASCII prefix, `len` if all bytes are ASCII
+ */
+static inline size_t
+ascii_prefix_len(const uint8_t *pStr, const size_t len) {
+    size_t i = 0;
+#ifdef UNICODE_SIMD_X86
+    i = unicode_cpu_has_avx2() ? ascii_prefix_len_avx2(pStr, len) : ascii_prefix_len_sse2(pStr, len);
+#endif
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, pStr + i, sizeof(word));
+        if (word & ASCII_WORD_MASK) {
+            break;
+        }
+    }
+    while (i < len && pStr[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+/**
+ * Returns the number of bytes of pStr[0..len) that are not continuation bytes (10xxxxxx). For well-formed UTF-8 that
+ * is the number of code points
+ *
+ * @param pStr bytes to scan
+ * @param len number of bytes available at pStr
+ * @return number of lead and ASCII bytes
+ */
+static inline size_t
+count_utf8_leads(const uint8_t *pStr, const size_t len) {
+    size_t leads = 0;
+    size_t i = 0;
+#ifdef UNICODE_SIMD_X86
+    i = unicode_cpu_has_avx2() ? count_utf8_leads_avx2(pStr, len, &leads) : count_utf8_leads_sse2(pStr, len, &leads);
+#endif
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, pStr + i, sizeof(word));
+        leads += 8 - (size_t) __builtin_popcountll(word & ~(word << 1) & ASCII_WORD_MASK);
+    }
+    for (; i < len; i++) {
+        leads += (pStr[i] & 0xC0) != 0x80;
+    }
+    return leads;
+}
+
+/**
+ * Returns the number of leading bytes pA[0..len) and pB[0..len) have in common
+ *
+ * @param pA first buffer
+ * @param pB second buffer
+ * @param len number of bytes available at both buffers
+ * @return index of the first differing byte, `len` if buffers are equal
+ */
+static inline size_t
+common_prefix_len(const uint8_t *pA, const uint8_t *pB, const size_t len) {
+    size_t i = 0;
+#ifdef UNICODE_SIMD_X86
+    i = unicode_cpu_has_avx2() ? common_prefix_len_avx2(pA, pB, len) : common_prefix_len_sse2(pA, pB, len);
+#endif
+    for (; i + 8 <= len; i += 8) {
+        uint64_t a, b;
+        memcpy(&a, pA + i, sizeof(a));
+        memcpy(&b, pB + i, sizeof(b));
+        if (a != b) {
+            break;
+        }
+    }
+    while (i < len && pA[i] == pB[i]) {
+        i++;
+    }
+    return i;
+}
+
+/**
+ * Skips up to *pCount chars of pStr[0..nbytes), counting them the way UnicodeView decodes them: an invalid byte or the
+ * lead byte of a truncated sequence is one char. ASCII runs are skipped block-wise
+ *
+ * @param pStr bytes to scan
+ * @param nbytes number of bytes available at pStr
+ * @param pCount number of chars to skip, set to the number of chars actually skipped
+ * @return byte offset past the skipped chars, `nbytes` if there are fewer chars
+ */
+static inline size_t
+utf8_skip_chars(const uint8_t *pStr, const size_t nbytes, size_t *pCount) {
+    size_t i = 0;
+    size_t index = *pCount;
+
+    while (i < nbytes && index) {
+        const uint8_t lead = pStr[i];
+        if (lead < 0x80) {
+            const size_t limit = nbytes - i < index ? nbytes - i : index;
+            const size_t ascii_len = ascii_prefix_len(pStr + i, limit);
+            i += ascii_len;
+            index -= ascii_len;
+            continue;
+        }
+        // same as get_octets_num: 0 for continuation and 0xF8..0xFF bytes, which are one invalid char each
+        const uint8_t octets = lead >= 0xF8 ? 0 : lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 0;
+        i += octets && octets <= nbytes - i ? octets : 1;
+        index--;
+    }
+
+    *pCount -= index;
+    return i;
+}
+
+/**
+ * Same as `utf8_skip_chars` for well-formed UTF-8 only: there every byte that is not a continuation byte starts a
+ * char, so chars are counted 64 (AVX2) or 8 bytes at a time without branching on their lengths
+ */
+static inline size_t
+utf8_skip_chars_valid(const uint8_t *pStr, const size_t nbytes, size_t *pCount) {
+    size_t i = 0;
+    size_t index = *pCount;
+
+#ifdef UNICODE_SIMD_X86
+    if (unicode_cpu_has_avx2()) {
+        i = skip_utf8_leads_avx2(pStr, nbytes, &index);
+    }
+#endif
+    for (; i + 8 <= nbytes; i += 8) {
+        uint64_t word;
+        memcpy(&word, pStr + i, sizeof(word));
+        // continuation bytes are 10xxxxxx: high bit set, next bit clear
+        const uint64_t continuation = word & ~(word << 1) & ASCII_WORD_MASK;
+        const size_t leads = 8 - (size_t) __builtin_popcountll(continuation);
+        if (leads > index) {
+            break;
+        }
+        index -= leads;
+    }
+    for (; i < nbytes; i++) {
+        if ((pStr[i] & 0xC0) != 0x80) {
+            if (!index) {
+                break;
+            }
+            index--;
+        }
+    }
+
+    *pCount -= index;
+    return i;
+}
+
+/**
+ * Expands the leading ASCII run of pStr[0..len) into UnicodeChar slots, one slot per byte.
+ * Whole 16/32-byte blocks are expanded with vector shuffles, the tail is expanded byte by byte.
+ *
+ * @param pStr bytes to read
+ * @param len number of bytes available at pStr
+ * @param pOut UnicodeChar array with room for at least `len` slots
+ * @return number of bytes consumed (and slots written)
+ */
+static inline size_t
+expand_ascii_run(const uint8_t *pStr, const size_t len, UnicodeChar *pOut) {
+    size_t i = 0;
+#ifdef UNICODE_SIMD_X86
+    i = unicode_cpu_has_avx2() ? expand_ascii_run_avx2(pStr, len, pOut) : expand_ascii_run_sse2(pStr, len, pOut);
+#endif
+    while (i < len && pStr[i] < 0x80) {
+        pOut[i] = (UnicodeChar){{pStr[i], 0, 0, 0}, 1};
+        i++;
+    }
+    return i;
+}
+
+#endif //UNICODE_SIMD_H
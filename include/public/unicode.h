@@ -6,6 +6,11 @@
 #ifndef UNICODE_H
 #define UNICODE_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
 /**
  * Unicode char consist of max 4 octets, 1 byte each.
  * Each octet consists of 8 bits, first 1, 3, 4, and 5 bits encode how octets are necessary
@@ -22,18 +27,86 @@ typedef struct UnicodeChar_s {
 #pragma pack(pop)
 
 /**
- * UnicodeString represents a string that is formally an array of UnicodeChar structs
+ * Allocator used by UnicodeString and its derived objects. Every function receives `ctx` as its first argument.
+ * `resize` and `release` receive the size of the block given at its allocation (or last resize), so allocators
+ * don't have to track sizes themselves. `alloc` and `resize` return NULL on failure, leaving `ptr` untouched
+ */
+typedef struct UnicodeAllocator_s {
+    void *(*alloc)(void *ctx, size_t size);
+    void *(*resize)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+    void (*release)(void *ctx, void *ptr, size_t size);
+    void *ctx;
+} UnicodeAllocator;
+
+/**
+ * Code point that invalid bytes are decoded to when a string is stored as code points
+ */
+#define UNICODE_REPLACEMENT_CHAR 0xFFFD
+
+/**
+ * Storage layout of UnicodeString characters, selected when a string is created
+ */
+typedef enum UnicodeLayout_e {
+    // `data`: packed 5-byte UnicodeChar slots, the default
+    USTR_LAYOUT_UCHAR = 0,
+    // `code_points`: 4-byte aligned UTF-32 code points; invalid bytes and ill-formed chars are stored as
+    // UNICODE_REPLACEMENT_CHAR
+    USTR_LAYOUT_UTF32,
+    // `octets` + `sizes`: 4 octets of each char as one aligned uint32_t (in memory order) and their sizes apart
+    USTR_LAYOUT_SPLIT,
+} UnicodeLayout;
+
+/**
+ * Bytes of storage kept inside UnicodeString itself: 15 chars (plus the terminator) in UCHAR and SPLIT layouts, 19 in
+ * UTF32 layout
+ */
+#define USTR_INLINE_SIZE 80
+
+/**
+ * UnicodeString represents a string that is formally an array of UnicodeChar structs.
+ * `len` is the number of characters in the string, not counting the null-terminating (zero-size / zero) slot.
+ * `capacity` is the number of characters storage can hold before it has to be reallocated; storage always has one
+ * more slot for the terminator.
+ * Which storage member is valid depends on `layout`; the layout-independent way to read a char is `ustr_char_at`.
+ * Short strings keep their chars in `inline_storage`, so the string is a single allocation; storage moves to the heap
+ * once the string outgrows it. Storage pointers may point into the struct, so it must not be copied by value
  */
 typedef struct UnicodeString_s {
-    UnicodeChar *data;
+    union {
+        UnicodeChar *data;
+        uint32_t *code_points;
+        uint32_t *octets;
+    };
+    uint8_t *sizes;
     size_t len;
+    size_t capacity;
+    UnicodeLayout layout;
+    // allocator the string and its storage were allocated with, never NULL
+    const UnicodeAllocator *allocator;
+    // storage of short strings, see USTR_INLINE_SIZE; uint32_t keeps code points / octets aligned
+    uint32_t inline_storage[USTR_INLINE_SIZE / sizeof(uint32_t)];
 } UnicodeString;
 
 typedef struct CompressedUnicodeString_s {
+    // null-terminated bytes, allocated apart from the struct at the exact size
     uint8_t *data;
     size_t len;
+    // allocator the struct and data were allocated with, NULL for libc
+    const UnicodeAllocator *allocator;
 } CompressedUnicodeString;
 
+/**
+ * Flags accepted by length-aware `*_n` decoding functions, can be OR-ed
+ */
+typedef enum UnicodeDecodeFlags_e {
+    UNICODE_DECODE_DEFAULT = 0,
+    // run a counting pre-pass and allocate exactly `chars + 1` slots instead of the `nbytes + 1` upper bound
+    UNICODE_DECODE_EXACT = 1 << 0,
+    // reject ill-formed input (invalid / overlong / surrogate / truncated sequences) instead of decoding it
+    // byte-wise as `\xNN` chars; use `unicode_validate` to find where the input is ill-formed
+    UNICODE_DECODE_STRICT = 1 << 1,
+} UnicodeDecodeFlags;
+
 #ifdef __cplusplus
 extern "C" {
 
@@ -89,8 +162,8 @@ UnicodeChar
 read_unicode_char_with_offset_safe(const uint8_t *pStr, uint32_t offset);
 
 /**
- * Main function to read `char *` string into an array of UnicodeChar. It reads input pStr in a given pUstr. If an invalid Unicode byte is met,
- *  it will be replaced with null-terminator, so be careful with it (known bug will be fixed)
+ * Main function to read `char *` string into an array of UnicodeChar. It reads input pStr in a given pUstr. An invalid
+ * Unicode byte takes one slot holding its `\xNN` representation (size 4), so the string never ends before pStr does
  * Resulting string has length of Unicode chars + 1 - last is a null-terminating octet
  *
  *
@@ -103,18 +176,17 @@ read_unicode_char_with_offset_safe(const uint8_t *pStr, uint32_t offset);
  * read_into_unicode_array(mix, &string);
  * free(string);
  *
- * @attention Invalid Unicode byte will be replaced with null-terminator
  * @attention Memory allocated for pUstr is not freed automatically! You have to utilize it by yourself when you
  * don't need that string anymore (see example)
  */
-// TODO: edit null-terminator replacing with byte representation replace
 void
 read_into_unicode_array(const uint8_t *pStr, UnicodeChar **pUstr);
 
 /**
- * Main function to read `char *` string into UnicodeString struct. It reads input pStr in a given pUstr. If an invalid Unicode byte is met,
- * it will be replaced with null-terminator, so be careful with it (known bug will be fixed)
- * Resulting string has length of Unicode chars + 1 - last is null-terminating octet
+ * Main function to read `char *` string into a USTR_LAYOUT_UCHAR UnicodeString. An invalid Unicode byte takes one char
+ * holding its `\xNN` representation, as in USTR_LAYOUT_SPLIT strings; USTR_LAYOUT_UTF32 strings store it as
+ * UNICODE_REPLACEMENT_CHAR
+ * Resulting string `len` is the number of Unicode chars, `data` is followed by one null-terminating slot
  *
  *
  * @param pStr char array pointer to read a Unicode sequence from
@@ -122,14 +194,12 @@ read_into_unicode_array(const uint8_t *pStr, UnicodeChar **pUstr);
  * @example
  * ```
  * char *mix = "Привет, 😀ອັກສອນລາວ World";
- * UnicodeString *string = read_into_unicode_array(mix);
- * free(string);
+ * UnicodeString *string = read_into_unicode_string(mix);
+ * free_ustr(string);
  * ```
  *
- * @return UnicodeString
+ * @return UnicodeString, or NULL if allocation fails
  *
- * @attention In the worst case (ascii-symbols)
- * @attention Invalid Unicode byte will be replaced with null-terminator
  * @attention Memory allocated for returned string is not freed automatically! You have to utilize it by yourself when
  * you don't need that string anymore (see example)
  */
@@ -137,20 +207,244 @@ UnicodeString *
 read_into_unicode_string(const uint8_t *pStr);
 
 /**
- * Creates a new UnicodeString instance with the specified size. If size params is NULL, then the default size is 16
+ * Returns the number of UnicodeChar slots that decoding pStr[0..nbytes) produces (without the null-terminating slot).
+ * Every valid lead byte and every invalid byte count as one slot, so the result is exactly what `*_n` functions return.
+ * ASCII runs are skipped block-wise, so this pre-pass is much cheaper than decoding itself
+ *
+ * @param pStr bytes to count characters in, not required to be null-terminated
+ * @param nbytes number of bytes to read from pStr
+ * @return number of characters in pStr
+ */
+size_t
+unicode_decoded_len(const uint8_t *pStr, size_t nbytes);
+
+/**
+ * Returns the number of code points in well-formed UTF-8 pStr[0..nbytes) without decoding or allocating: bytes that
+ * are not continuation bytes (10xxxxxx) are counted, whole vector blocks at a time. Input is not validated; unlike
+ * `unicode_decoded_len` a stray continuation byte is counted as a part of the char before it
  *
- * @param size Pointer to a size_t value specifying the size of the UnicodeString to be created.
- * @return A pointer to the newly allocated UnicodeString, or nullptr if allocation fails.
+ * @param pStr bytes to count characters in, not required to be null-terminated
+ * @param nbytes number of bytes to read from pStr
+ * @return number of characters in pStr
+ */
+size_t
+unicode_strlen(const uint8_t *pStr, size_t nbytes);
+
+/**
+ * Returns the byte offset of char `index` of pStr[0..nbytes), counting chars the same way as `unicode_strlen`.
+ * The offset is always at a char start, so cutting the buffer there never splits a well-formed sequence
+ *
+ * @param pStr bytes to look up, not required to be null-terminated
+ * @param nbytes number of bytes to read from pStr
+ * @param index index of the char
+ * @return byte offset of the char, `nbytes` if index is not less than `unicode_strlen(pStr, nbytes)`
+ *
+ * @example
+ * ```
+ * // truncate a line to at most 80 chars
+ * const size_t cut = unicode_offset_of(line, line_len, 80);
+ * fwrite(line, 1, cut, stdout);
+ * ```
+ */
+size_t
+unicode_offset_of(const uint8_t *pStr, size_t nbytes, size_t index);
+
+/**
+ * Checks that pStr[0..nbytes) is well-formed UTF-8 (Unicode Table 3-7): no invalid lead or continuation bytes,
+ * overlong encodings, surrogates, code points above U+10FFFF or sequences truncated by the end of input.
+ * Whole blocks are checked with vector lookups where the CPU supports it (SSSE3 / AVX2), the rest by a byte-class DFA
+ *
+ * @param pStr bytes to validate, not required to be null-terminated
+ * @param nbytes number of bytes to read from pStr
+ * @param pErrorOffset if not NULL, receives the byte offset of the first ill-formed sequence when the input is invalid
+ * @return 1 if the input is valid, 0 otherwise
+ */
+int
+unicode_validate(const uint8_t *pStr, size_t nbytes, size_t *pErrorOffset);
+
+/**
+ * Length-aware analog of `read_into_unicode_array`. Reads exactly nbytes from pStr, so the input may contain embedded
+ * null bytes (decoded as U+0000 chars of size 1) and does not need a terminator. A multibyte sequence truncated by
+ * the end of input is decoded as invalid bytes; nothing past pStr + nbytes is ever read.
+ * Resulting array is followed by one null-terminating (zero-size) slot
+ *
+ * @param pStr bytes to read Unicode sequence from
+ * @param nbytes number of bytes to read from pStr
+ * @param pUstr ptr to UnicodeChar array pointer to read Unicode sequence into
+ * @param flags `UnicodeDecodeFlags`, e.g. `UNICODE_DECODE_EXACT` to allocate exactly as many slots as needed
+ * @return number of decoded characters, or 0 with *pUstr set to NULL if allocation fails or the input is ill-formed
+ * with `UNICODE_DECODE_STRICT`
+ *
+ * @example
+ * ```
+ * UnicodeChar *string;
+ * size_t len = read_into_unicode_array_n(buf, buf_len, &string, UNICODE_DECODE_EXACT);
+ * free(string);
+ * ```
+ */
+size_t
+read_into_unicode_array_n(const uint8_t *pStr, size_t nbytes, UnicodeChar **pUstr, uint32_t flags);
+
+/**
+ * Length-aware analog of `read_into_unicode_string`, see `read_into_unicode_array_n` for input handling.
+ * Resulting string `len` is set from the decoder output, without walking the string again
+ *
+ * @param pStr bytes to read Unicode sequence from
+ * @param nbytes number of bytes to read from pStr
+ * @param flags `UnicodeDecodeFlags`
+ * @return UnicodeString, or NULL if allocation fails or the input is ill-formed with `UNICODE_DECODE_STRICT`
+ */
+UnicodeString *
+read_into_unicode_string_n(const uint8_t *pStr, size_t nbytes, uint32_t flags);
+
+/**
+ * Same as `read_into_unicode_string_n`, but stores the string in the given layout without an intermediate
+ * UnicodeChar array
+ *
+ * @param pStr bytes to read Unicode sequence from
+ * @param nbytes number of bytes to read from pStr
+ * @param flags `UnicodeDecodeFlags`
+ * @param layout storage layout of the resulting string
+ * @return UnicodeString, or NULL if allocation fails or the input is ill-formed with `UNICODE_DECODE_STRICT`
+ */
+UnicodeString *
+read_into_unicode_string_with_layout(const uint8_t *pStr, size_t nbytes, uint32_t flags, UnicodeLayout layout);
+
+/**
+ * Same as `read_into_unicode_string_with_layout`, allocates the string with the given allocator
+ *
+ * @param pStr bytes to read Unicode sequence from
+ * @param nbytes number of bytes to read from pStr
+ * @param flags `UnicodeDecodeFlags`
+ * @param layout storage layout of the resulting string
+ * @param allocator allocator for the string, NULL for the default one
+ * @return UnicodeString, or NULL if allocation fails or the input is ill-formed with `UNICODE_DECODE_STRICT`
+ */
+UnicodeString *
+read_into_unicode_string_with_allocator(const uint8_t *pStr, size_t nbytes, uint32_t flags, UnicodeLayout layout,
+                                        const UnicodeAllocator *allocator);
+
+/**
+ * Sets the allocator used for strings created without an explicit one. Strings keep the allocator they were created
+ * with, so it's safe to switch the default while older strings are alive. Not thread-safe: set it once at startup
+ *
+ * @param allocator allocator to use by default, NULL to restore libc malloc / realloc / free
+ */
+void
+unicode_set_default_allocator(const UnicodeAllocator *allocator);
+
+/**
+ * Returns the allocator used for strings created without an explicit one
+ *
+ * @return current default allocator, never NULL
+ */
+const UnicodeAllocator *
+unicode_get_default_allocator(void);
+
+/**
+ * Creates a new empty USTR_LAYOUT_UCHAR UnicodeString with room for `size` chars. A size up to the inline capacity
+ * (15 chars) keeps them in the inline storage, a larger one allocates `size + 1` slots. A negative size means no
+ * capacity: the string starts with its inline storage and no heap storage at all
+ *
+ * @param size number of chars to reserve, -1 to start with the inline storage
+ * @return A pointer to the newly allocated UnicodeString, or NULL if allocation fails.
  */
 UnicodeString *
 new_ustr(ssize_t size);
 
+/**
+ * Same as `new_ustr`, with the given storage layout.
+ *
+ * @param size Capacity of the string to be created, or -1 for the default one.
+ * @param layout Storage layout of the string.
+ * @return A pointer to the newly allocated UnicodeString, or NULL if allocation fails.
+ */
+UnicodeString *
+new_ustr_with_layout(ssize_t size, UnicodeLayout layout);
+
+/**
+ * Same as `new_ustr_with_layout`, allocates the string and all its future storage with the given allocator.
+ *
+ * @param size Capacity of the string to be created, or -1 for the default one.
+ * @param layout Storage layout of the string.
+ * @param allocator Allocator for the string, NULL for the default one. Must outlive the string.
+ * @return A pointer to the newly allocated UnicodeString, or NULL if allocation fails.
+ */
+UnicodeString *
+new_ustr_with_allocator(ssize_t size, UnicodeLayout layout, const UnicodeAllocator *allocator);
+
+/**
+ * Creates a copy of a UnicodeString stored in another layout, with the same allocator.
+ *
+ * @param self The UnicodeString to convert.
+ * @param layout Storage layout of the copy.
+ * @return A new UnicodeString, or NULL if allocation fails.
+ */
+UnicodeString *
+ustr_convert(const UnicodeString *self, UnicodeLayout layout);
+
+/**
+ * Returns the character at index i of a UnicodeString in any layout.
+ *
+ * @param self The UnicodeString to read from.
+ * @param i Index of the character, must be less than `len`.
+ * @return UnicodeChar at index i.
+ */
+UnicodeChar
+ustr_char_at(const UnicodeString *self, size_t i);
+
+/**
+ * Returns the code point at index i of a UnicodeString in any layout, an analog of `unicode_ord(ustr_char_at(...))`.
+ * Invalid byte chars and chars that are not well-formed UTF-8 (overlong forms, surrogates, values past U+10FFFF,
+ * a lead byte with a non-continuation byte after it) give UNICODE_REPLACEMENT_CHAR.
+ *
+ * @param self The UnicodeString to read from.
+ * @param i Index of the character, must be less than `len`.
+ * @return Code point at index i.
+ */
+uint32_t
+ustr_ord_at(const UnicodeString *self, size_t i);
+
+/**
+ * Makes sure the string can hold at least `capacity` characters without reallocation. Never shrinks the string
+ *
+ * @param self A pointer to the UnicodeString to grow.
+ * @param capacity Number of characters to reserve room for.
+ * @return self, or NULL if reallocation fails (self is left untouched then).
+ */
+UnicodeString *
+ustr_reserve(UnicodeString *self, size_t capacity);
+
+/**
+ * Releases unused capacity, so `capacity == len` afterward. A string that fits its inline storage is moved there
+ * and keeps the inline capacity instead.
+ *
+ * @param self A pointer to the UnicodeString to shrink.
+ * @return self, or NULL if reallocation fails (self is left untouched then).
+ */
+UnicodeString *
+ustr_shrink_to_fit(UnicodeString *self);
+
+/**
+ * Appends n UnicodeChars to the end of a UnicodeString. Capacity grows geometrically, so a sequence of appends is
+ * amortized O(1) per character.
+ *
+ * @param self A pointer to the UnicodeString to append to.
+ * @param chars UnicodeChar array to append, may point into self->data.
+ * @param n Number of UnicodeChars to append.
+ * @return self, or NULL if reallocation fails (self is left untouched then).
+ */
+UnicodeString *
+ustr_append(UnicodeString *self, const UnicodeChar *chars, size_t n);
+
 /**
  * Concatenates two UnicodeString objects and returns a new UnicodeString containing the result.
+ * The result is stored in the layout of self and allocated with its allocator, layouts of the arguments may differ.
  *
  * @param self The first UnicodeString object.
  * @param other The second UnicodeString object to append to the first.
- * @return A new UnicodeString containing the concatenated result of the two input strings.
+ * @return A new UnicodeString containing the concatenated result of the two input strings, or NULL if allocation
+ * fails.
  */
 UnicodeString *
 concat_ustr(const UnicodeString *self, const UnicodeString *other);
@@ -179,20 +473,149 @@ push_uchar(UnicodeString *self, UnicodeChar chr);
 
 /**
  * Frees the memory allocated for a UnicodeString object, including its internal array of UnicodeChar elements.
+ * Memory is returned to the allocator the string was created with.
  *
  * @param self A pointer to the UnicodeString object to be deallocated.
  */
 void
 free_ustr(UnicodeString *self);
 
+/**
+ * Returns the exact number of bytes the string is encoded with: the sum of `size` of its chars, without a
+ * null-terminator
+ *
+ * @param self UnicodeString to measure
+ * @return encoded length of self in bytes
+ */
+size_t
+ustr_bytes_len(const UnicodeString *self);
+
+/**
+ * Writes only significant bytes of the string into a caller-supplied buffer, without a null-terminator.
+ * Nothing is written if the buffer is too small, so the call can be repeated with a buffer of the returned size
+ *
+ * @param self UnicodeString to encode
+ * @param pOut buffer for the encoded bytes
+ * @param cap number of bytes available at pOut
+ * @return encoded length of self in bytes (`ustr_bytes_len`); if it is greater than cap, pOut is left untouched
+ *
+ * @example
+ * ```
+ * uint8_t buf[256];
+ * size_t len = ustr_write_bytes(str, buf, sizeof(buf));
+ * if (len <= sizeof(buf)) {
+ *     send(sock, buf, len, 0);
+ * }
+ * ```
+ */
+size_t
+ustr_write_bytes(const UnicodeString *self, uint8_t *pOut, size_t cap);
+
+/**
+ * Writes only significant bytes of the string to a stdio stream. Bytes are encoded into a 64 KiB block on the stack
+ * and written a block at a time, so no heap memory is used
+ *
+ * @param self UnicodeString to write
+ * @param stream stream to write to
+ * @return number of bytes written, or -1 if fwrite fails
+ */
+ssize_t
+ustr_write_file(const UnicodeString *self, FILE *stream);
+
+/**
+ * Writes only significant bytes of the string to a file descriptor the same way as `ustr_write_file`.
+ * Partial writes and writes interrupted by a signal are retried
+ *
+ * @param self UnicodeString to write
+ * @param fd file descriptor to write to
+ * @return number of bytes written, or -1 if write fails (errno is set by write)
+ */
+ssize_t
+ustr_write_fd(const UnicodeString *self, int fd);
+
 /**
  * Read UnicodeString into an array of `uint8_t`s. The resulting array is filled with only significant bytes of
- * UnicodeString and null-terminated
+ * UnicodeString and null-terminated. The bytes are allocated at the exact size with the allocator of string, free the
+ * result with `free_compressed_ustr`. The string is only read, so it can be shared between threads
  * @param string
- * @return
+ * @return CompressedUnicodeString, or NULL if allocation fails
  */
 CompressedUnicodeString *
-compress_into_bytes_array(UnicodeString *string);
+compress_into_bytes_array(const UnicodeString *string);
+
+/**
+ * Frees a CompressedUnicodeString and its data with the allocator they were allocated with
+ * @param self CompressedUnicodeString to free
+ */
+void
+free_compressed_ustr(CompressedUnicodeString *self);
+
+/**
+ * Checks whether two strings hold the same chars, whatever their layouts are. Strings of the same layout are compared
+ * as whole storage blocks with vector compares
+ *
+ * @param self first string
+ * @param other second string
+ * @return 1 if strings are equal, 0 otherwise
+ */
+int
+ustr_equal(const UnicodeString *self, const UnicodeString *other);
+
+/**
+ * Compares two strings char by char in code point order, which is also the order of their UTF-8 bytes. An invalid byte
+ * slot compares as its `\xNN` bytes. The first differing char of strings of the same layout is located with vector
+ * compares
+ *
+ * @param self first string
+ * @param other second string
+ * @return negative if self sorts before other, 0 if they are equal, positive otherwise
+ */
+int
+ustr_compare(const UnicodeString *self, const UnicodeString *other);
+
+/**
+ * Returns a 64-bit hash (XXH64) of the UTF-8 bytes of the string, see `ustr_write_bytes`. Equal strings have equal
+ * hashes whatever their layouts are, and `ustr_hash(str, seed) == unicode_hash(bytes, nbytes, seed)` for the bytes
+ * str was decoded from (if they are well-formed), so decoded and raw strings can be joined on the hash
+ *
+ * @param self string to hash
+ * @param seed hash seed, e.g. a random per-process value against collision flooding
+ * @return 64-bit hash
+ *
+ * @example
+ * ```
+ * const uint64_t bucket = ustr_hash(key, seed) & (buckets_count - 1);
+ * ```
+ */
+uint64_t
+ustr_hash(const UnicodeString *self, uint64_t seed);
+
+/**
+ * Checks whether two byte buffers are equal
+ *
+ * @return 1 if pA[0..nA) and pB[0..nB) are equal, 0 otherwise
+ */
+int
+unicode_equal(const uint8_t *pA, size_t nA, const uint8_t *pB, size_t nB);
+
+/**
+ * Compares two UTF-8 buffers byte by byte, which for well-formed UTF-8 is code point order
+ *
+ * @return negative if pA[0..nA) sorts before pB[0..nB), 0 if they are equal, positive otherwise
+ */
+int
+unicode_compare(const uint8_t *pA, size_t nA, const uint8_t *pB, size_t nB);
+
+/**
+ * Returns the XXH64 hash of pStr[0..nbytes), same as the reference XXH64 implementation with the same seed
+ *
+ * @param pStr bytes to hash, not required to be null-terminated
+ * @param nbytes number of bytes to read from pStr
+ * @param seed hash seed
+ * @return 64-bit hash
+ */
+uint64_t
+unicode_hash(const uint8_t *pStr, size_t nbytes, uint64_t seed);
 
 /**
  * Return octets that a given `chr` is encoded with. If `chr` is not valid, Unicode start byte 0 is returned that will
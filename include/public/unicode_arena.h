@@ -0,0 +1,65 @@
+//
+// Bump-pointer arena implementing UnicodeAllocator for request-scoped strings.
+//
+#pragma once
+
+#ifndef UNICODE_ARENA_H
+#define UNICODE_ARENA_H
+
+#include "unicode.h"
+
+/**
+ * Default size of one arena block, allocations bigger than a block get a block of their own
+ */
+#define UNICODE_ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+typedef struct UnicodeArenaBlock_s UnicodeArenaBlock;
+
+/**
+ * Arena hands out memory from big blocks by bumping a pointer; individual frees are no-ops (except for the latest
+ * allocation, which is rolled back) and everything is released at once by `unicode_arena_reset`.
+ * Pass `&arena.allocator` wherever a UnicodeAllocator is accepted. The arena must not be moved after
+ * `unicode_arena_init`, since the allocator refers to it. Not thread-safe
+ */
+typedef struct UnicodeArena_s {
+    UnicodeAllocator allocator;
+    UnicodeArenaBlock *head;
+    UnicodeArenaBlock *current;
+    size_t block_size;
+} UnicodeArena;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Initializes an empty arena, blocks are allocated on first use
+ *
+ * @param arena arena to initialize
+ * @param block_size size of one block in bytes, 0 for UNICODE_ARENA_DEFAULT_BLOCK_SIZE
+ */
+void
+unicode_arena_init(UnicodeArena *arena, size_t block_size);
+
+/**
+ * Frees everything allocated from the arena in O(1): blocks are kept and reused by later allocations.
+ * All strings allocated from the arena become invalid and must not be passed to `free_ustr`
+ *
+ * @param arena arena to reset
+ */
+void
+unicode_arena_reset(UnicodeArena *arena);
+
+/**
+ * Returns all arena blocks to libc, arena can be initialized again afterward
+ *
+ * @param arena arena to destroy
+ */
+void
+unicode_arena_destroy(UnicodeArena *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //UNICODE_ARENA_H
@@ -0,0 +1,118 @@
+//
+// Case mapping and case folding of code points, UTF-8 buffers and UnicodeStrings.
+//
+#pragma once
+
+#ifndef UNICODE_CASE_H
+#define UNICODE_CASE_H
+
+#include "unicode.h"
+
+/**
+ * Maximum number of code points a full case mapping of one code point produces (U+0390 folds to U+03B9 U+0308 U+0301)
+ */
+#define UNICODE_CASE_MAX_EXPANSION 3
+
+/**
+ * A full case mapping of UTF-8 text is at most this many times longer than the text (a 2-byte char mapping to
+ * three 2-byte ones), so `nbytes * UNICODE_CASE_MAX_GROWTH` bytes of output are always enough
+ */
+#define UNICODE_CASE_MAX_GROWTH 3
+
+/**
+ * Case mappings from the Unicode Character Database: lowercase and uppercase mappings of UnicodeData.txt and
+ * SpecialCasing.txt, case folding of CaseFolding.txt
+ */
+typedef enum UnicodeCaseMapping_e {
+    UNICODE_CASE_LOWER = 0,
+    UNICODE_CASE_UPPER,
+    // case folding erases case differences for caseless matching, it is not the same as lowercasing: "ß" folds to "ss"
+    UNICODE_CASE_FOLD,
+} UnicodeCaseMapping;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Returns the simple (one-to-one) lowercase mapping of a code point. Code points without one, including values
+ * above U+10FFFF, map to themselves
+ *
+ * @param code_point code point to map
+ * @return lowercase code point
+ */
+uint32_t
+unicode_tolower(uint32_t code_point);
+
+/**
+ * Returns the simple (one-to-one) uppercase mapping of a code point, see `unicode_tolower`
+ *
+ * @param code_point code point to map
+ * @return uppercase code point
+ */
+uint32_t
+unicode_toupper(uint32_t code_point);
+
+/**
+ * Returns the simple case folding (statuses C and S of CaseFolding.txt) of a code point, see `unicode_tolower`
+ *
+ * @param code_point code point to fold
+ * @return case-folded code point
+ */
+uint32_t
+unicode_casefold(uint32_t code_point);
+
+/**
+ * Writes the full mapping of a code point, which may expand it to several code points ("ß" uppercases to "SS").
+ * Mappings of SpecialCasing.txt that depend on context or language (final sigma, Lithuanian, Turkish and Azeri) are
+ * not applied, neither are Turkic case foldings
+ *
+ * @param code_point code point to map
+ * @param mapping case mapping to apply
+ * @param pOut buffer for the mapped code points, must have room for UNICODE_CASE_MAX_EXPANSION of them
+ * @return number of code points written, 1..UNICODE_CASE_MAX_EXPANSION
+ */
+size_t
+unicode_case_map_full(uint32_t code_point, UnicodeCaseMapping mapping, uint32_t *pOut);
+
+/**
+ * Applies the full case mapping to UTF-8 text. Code points are looked up in compact tables generated from the UCD, so
+ * there is no branching on the char itself; runs of ASCII are mapped a 16/32-byte block at a time with vector
+ * compares where the CPU supports it. Ill-formed subsequences are copied as they are.
+ * Nothing is written past cap: mapping goes on without writing once pOut is full, so the call can be repeated with a
+ * buffer of the returned size
+ *
+ * @param pStr UTF-8 bytes to map, not required to be null-terminated
+ * @param nbytes number of bytes to read from pStr
+ * @param mapping case mapping to apply
+ * @param pOut buffer for the mapped bytes, not null-terminated; must not overlap pStr, mapped chars may be longer
+ * @param cap number of bytes available at pOut; `nbytes * UNICODE_CASE_MAX_GROWTH` is always enough
+ * @return length of the mapped text in bytes; if it is greater than cap, the contents of pOut are unspecified
+ *
+ * @example
+ * ```
+ * // case-insensitive token key
+ * uint8_t key[64 * UNICODE_CASE_MAX_GROWTH];
+ * size_t key_len = unicode_case_map(token, token_len, UNICODE_CASE_FOLD, key, sizeof(key));
+ * index_add(index, key, key_len);
+ * ```
+ */
+size_t
+unicode_case_map(const uint8_t *pStr, size_t nbytes, UnicodeCaseMapping mapping, uint8_t *pOut, size_t cap);
+
+/**
+ * Applies the full case mapping to a string the same way as `unicode_case_map`. The result has the layout and the
+ * allocator of self and exactly as many slots as it needs; invalid byte slots are copied as they are
+ *
+ * @param self UnicodeString to map
+ * @param mapping case mapping to apply
+ * @return new UnicodeString, or NULL if allocation fails
+ */
+UnicodeString *
+ustr_case_map(const UnicodeString *self, UnicodeCaseMapping mapping);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //UNICODE_CASE_H
@@ -0,0 +1,81 @@
+//
+// Substring search over raw UTF-8.
+//
+#pragma once
+
+#ifndef UNICODE_FIND_H
+#define UNICODE_FIND_H
+
+#include "unicode.h"
+
+/**
+ * Needles shorter than this are searched with a vector filter on their first and last bytes, longer ones with the
+ * Two-Way algorithm, which is linear in the haystack size whatever the needle is
+ */
+#define UNICODE_FIND_TWO_WAY_MIN 64
+
+/**
+ * Position of a match in the haystack
+ */
+typedef struct UnicodeMatch_s {
+    // byte offset of the match
+    size_t offset;
+    // number of chars before the match, counted as `unicode_strlen` does
+    size_t index;
+    // index of the matched needle, 0 for `unicode_find`
+    size_t needle;
+} UnicodeMatch;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Finds the first occurrence of pNeedle[0..needle_nbytes) in pHaystack[0..nbytes). Bytes are compared as they are,
+ * so a well-formed needle only matches at char starts of a well-formed haystack. The char index of the match is
+ * counted only once it is found. An empty needle matches at offset 0
+ *
+ * @param pHaystack bytes to search in, not required to be null-terminated
+ * @param nbytes number of bytes to read from pHaystack
+ * @param pNeedle bytes to search for
+ * @param needle_nbytes number of bytes to read from pNeedle
+ * @param pMatch receives the position of the match if one is found
+ * @return 1 if the needle is found, 0 otherwise
+ *
+ * @example
+ * ```
+ * // all non-overlapping matches: continue after each match, keeping the char index running
+ * UnicodeMatch match;
+ * size_t offset = 0, index = 0;
+ * while (unicode_find(line + offset, len - offset, needle, needle_len, &match)) {
+ *     printf("match at char %zu\n", index + match.index);
+ *     offset += match.offset + needle_len;
+ *     index += match.index + unicode_strlen(needle, needle_len);
+ * }
+ * ```
+ */
+int
+unicode_find(const uint8_t *pHaystack, size_t nbytes, const uint8_t *pNeedle, size_t needle_nbytes,
+             UnicodeMatch *pMatch);
+
+/**
+ * Finds the leftmost occurrence of any of `count` needles, a tie goes to the needle listed first. Needles are searched
+ * one after another as with `unicode_find`, each only in the part of the haystack before the best match so far
+ *
+ * @param pHaystack bytes to search in, not required to be null-terminated
+ * @param nbytes number of bytes to read from pHaystack
+ * @param pNeedles needles to search for
+ * @param pNeedleSizes number of bytes of each needle
+ * @param count number of needles
+ * @param pMatch receives the position of the match and the index of the needle if one is found
+ * @return 1 if any needle is found, 0 otherwise
+ */
+int
+unicode_find_any(const uint8_t *pHaystack, size_t nbytes, const uint8_t *const *pNeedles, const size_t *pNeedleSizes,
+                 size_t count, UnicodeMatch *pMatch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //UNICODE_FIND_H
@@ -0,0 +1,128 @@
+//
+// Grapheme cluster segmentation (UAX #29): user-perceived characters of UTF-8 text and UnicodeStrings.
+//
+#pragma once
+
+#ifndef UNICODE_GRAPHEME_H
+#define UNICODE_GRAPHEME_H
+
+#include "unicode.h"
+
+/**
+ * Max number of boundaries `unicode_grapheme_finish` can produce: one per byte of an unfinished sequence and the
+ * end of the stream
+ */
+#define UNICODE_GRAPHEME_MAX_FINISH 4
+
+/**
+ * Segmenter state carried between chunks: the number of bytes fed so far, the context of the last code point the rules
+ * look back at (regional indicator pairs, emoji ZWJ sequences) and the head of a multibyte sequence split by a chunk
+ * boundary.
+ * Zero-initialized (or `unicode_grapheme_init`-ed) state is ready to use, no cleanup is required
+ */
+typedef struct UnicodeGraphemeBreaker_s {
+    size_t offset;
+    uint8_t prev;
+    uint8_t ri_odd;
+    uint8_t emoji;
+    uint8_t pending[4];
+    uint8_t pending_len;
+} UnicodeGraphemeBreaker;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Resets segmenter state to the start of a stream
+ *
+ * @param breaker segmenter to reset
+ */
+void
+unicode_grapheme_init(UnicodeGraphemeBreaker *breaker);
+
+/**
+ * Finds extended grapheme cluster boundaries (Unicode 14.0, rules GB1..GB13 and GB999 of UAX #29) in the next chunk
+ * of a stream. A boundary is reported as the stream offset a cluster starts at, the first one is 0. The boundary
+ * in front of a code point is known once the code point is seen, so a cluster split by a chunk boundary is simply
+ * reported by the call that sees the start of the next one; `unicode_grapheme_finish` reports the end of the last
+ * cluster. Any chunking of input gives the same boundaries.
+ * Properties are looked up in tables generated from the UCD, pairs of them are resolved with a table as well;
+ * nothing is allocated. Every byte of an ill-formed subsequence is taken as a U+FFFD of its own.
+ * Every boundary consumes at least one chunk byte, so `cap >= len` guarantees that the whole chunk is consumed
+ *
+ * @param breaker segmenter state
+ * @param chunk next bytes of the stream
+ * @param len number of bytes in chunk
+ * @param pBreaks buffer to write stream offsets of boundaries into, in increasing order
+ * @param cap number of offsets available at pBreaks
+ * @param pConsumed if not NULL, receives the number of chunk bytes consumed; less than len only if pBreaks is full
+ * @return number of offsets written to pBreaks
+ *
+ * @example
+ * ```
+ * UnicodeGraphemeBreaker breaker = {0};
+ * size_t breaks[4096];
+ * while ((n = read(fd, buf, sizeof(buf))) > 0) {
+ *     size_t count = unicode_grapheme_feed(&breaker, buf, n, breaks, 4096, NULL);
+ *     ...
+ * }
+ * size_t count = unicode_grapheme_finish(&breaker, breaks, 4096);
+ * ```
+ */
+size_t
+unicode_grapheme_feed(UnicodeGraphemeBreaker *breaker, const uint8_t *chunk, size_t len, size_t *pBreaks, size_t cap,
+                      size_t *pConsumed);
+
+/**
+ * Ends the stream: bytes of an unfinished sequence are taken as ill-formed, then the stream offset of the end of the
+ * last cluster is written (nothing for an empty stream) and breaker is reset. If cap is too small, what didn't fit
+ * is written by the next call
+ *
+ * @param breaker segmenter state
+ * @param pBreaks buffer to write stream offsets of boundaries into
+ * @param cap number of offsets available at pBreaks, UNICODE_GRAPHEME_MAX_FINISH is always enough
+ * @return number of offsets written to pBreaks
+ */
+size_t
+unicode_grapheme_finish(UnicodeGraphemeBreaker *breaker, size_t *pBreaks, size_t cap);
+
+/**
+ * Returns the end of the grapheme cluster starting at offset of UTF-8 text, by the same rules as
+ * `unicode_grapheme_feed`. Text before offset is not looked at, so offset must be a cluster boundary: 0 or a value
+ * returned before
+ *
+ * @param pStr UTF-8 bytes, not required to be null-terminated
+ * @param nbytes number of bytes in pStr
+ * @param offset byte offset of a cluster start
+ * @return byte offset of the next cluster start, nbytes for the last cluster (and for offset >= nbytes)
+ *
+ * @example
+ * ```
+ * // truncate a label to at most 10 user-perceived chars without splitting flags and accents
+ * size_t end = 0;
+ * for (int i = 0; i < 10 && end < label_len; i++) {
+ *     end = unicode_grapheme_next(label, label_len, end);
+ * }
+ * fwrite(label, 1, end, stdout);
+ * ```
+ */
+size_t
+unicode_grapheme_next(const uint8_t *pStr, size_t nbytes, size_t offset);
+
+/**
+ * Returns the end of the grapheme cluster starting at char index of a string, see `unicode_grapheme_next`.
+ * Invalid byte slots are taken as U+FFFD
+ *
+ * @param self UnicodeString to segment
+ * @param index index of the first char of a cluster
+ * @return index of the first char of the next cluster, self->len for the last cluster (and for index >= self->len)
+ */
+size_t
+ustr_grapheme_next(const UnicodeString *self, size_t index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //UNICODE_GRAPHEME_H
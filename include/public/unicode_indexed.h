@@ -0,0 +1,140 @@
+//
+// Compact UTF-8 string with a sparse char index for near-constant time random access.
+//
+#pragma once
+
+#ifndef UNICODE_INDEXED_H
+#define UNICODE_INDEXED_H
+
+#include "unicode.h"
+#include "unicode_view.h"
+
+/**
+ * Number of chars between two consecutive index entries. Locating a char takes one index lookup and a scan of at most
+ * `UNICODE_INDEX_STRIDE - 1` chars (ASCII block-wise)
+ */
+#define UNICODE_INDEX_STRIDE 64
+
+/**
+ * Number of chars covered by one absolute offset; entries within it are stored as 16-bit offsets relative to it
+ */
+#define UNICODE_INDEX_BLOCK (UNICODE_INDEX_STRIDE * 64)
+
+/**
+ * UnicodeIndexedString keeps the original UTF-8 bytes and the byte offset of every `UNICODE_INDEX_STRIDE`th char:
+ * an absolute `size_t` offset per `UNICODE_INDEX_BLOCK` chars and a `uint16_t` offset relative to it per stride.
+ * The index costs about 2 bytes per 64 chars, ~3% over the bytes for ASCII text and less for other scripts, while
+ * UnicodeString slots take 5 bytes per char.
+ * Chars are counted the same way UnicodeView decodes them: an invalid byte (or the lead byte of a sequence truncated
+ * by the end of the string) is one `\xNN` char.
+ * The struct, index and bytes are one allocation; the string is immutable and safe to read from several threads
+ */
+typedef struct UnicodeIndexedString_s {
+    // null-terminated copy of the source bytes
+    const uint8_t *bytes;
+    size_t nbytes;
+    // number of chars
+    size_t len;
+    // byte offset of char `k * UNICODE_INDEX_BLOCK`
+    const size_t *blocks;
+    // byte offset of char `k * UNICODE_INDEX_STRIDE`, relative to its block
+    const uint16_t *strides;
+    // non-zero if bytes are well-formed UTF-8: chars are then located by counting lead bytes, 8 at a time
+    int well_formed;
+    // allocator the string was allocated with, never NULL
+    const UnicodeAllocator *allocator;
+} UnicodeIndexedString;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Copies pStr[0..nbytes) and indexes it in one pass. pStr may contain null bytes and does not need a terminator
+ *
+ * @param pStr UTF-8 bytes to copy
+ * @param nbytes number of bytes to read from pStr
+ * @param flags `UnicodeDecodeFlags`; `UNICODE_DECODE_STRICT` rejects ill-formed input, others are ignored
+ * @return UnicodeIndexedString, or NULL if allocation fails or the input is ill-formed with `UNICODE_DECODE_STRICT`
+ *
+ * @example
+ * ```
+ * UnicodeIndexedString *str = read_into_indexed_ustr(buf, len, UNICODE_DECODE_DEFAULT);
+ * UnicodeChar last = indexed_ustr_char_at(str, str->len - 1);
+ * free_indexed_ustr(str);
+ * ```
+ */
+UnicodeIndexedString *
+read_into_indexed_ustr(const uint8_t *pStr, size_t nbytes, uint32_t flags);
+
+/**
+ * Same as `read_into_indexed_ustr`, allocates the string with the given allocator
+ *
+ * @param allocator allocator to use, NULL for the default one
+ */
+UnicodeIndexedString *
+read_into_indexed_ustr_with_allocator(const uint8_t *pStr, size_t nbytes, uint32_t flags,
+                                      const UnicodeAllocator *allocator);
+
+/**
+ * Frees a UnicodeIndexedString with the allocator it was allocated with
+ *
+ * @param self UnicodeIndexedString to free
+ */
+void
+free_indexed_ustr(UnicodeIndexedString *self);
+
+/**
+ * Returns the byte offset of char `index` in self->bytes
+ *
+ * @param self string to look up
+ * @param index index of the char
+ * @return byte offset of the char, `self->nbytes` if index is not less than `self->len`
+ */
+size_t
+indexed_ustr_offset_of(const UnicodeIndexedString *self, size_t index);
+
+/**
+ * Returns the char at the given index
+ *
+ * @param self string to look up
+ * @param index index of the char
+ * @return UnicodeChar, a zero-size char if index is not less than `self->len`
+ */
+UnicodeChar
+indexed_ustr_char_at(const UnicodeIndexedString *self, size_t index);
+
+/**
+ * Same as `indexed_ustr_char_at`, returns a code point; invalid bytes are UNICODE_REPLACEMENT_CHAR
+ *
+ * @return code point of the char, 0 if index is not less than `self->len`
+ */
+uint32_t
+indexed_ustr_ord_at(const UnicodeIndexedString *self, size_t index);
+
+/**
+ * Returns a view over the whole string
+ *
+ * @param self string to view
+ * @return UnicodeView borrowing the bytes of self
+ */
+UnicodeView
+indexed_ustr_view(const UnicodeIndexedString *self);
+
+/**
+ * Returns a view over chars [start, end) of the string without copying, both bounds are clamped to `self->len`.
+ * Unlike `unicode_view_slice` both bounds are located through the index
+ *
+ * @param self string to slice
+ * @param start index of the first char of the slice
+ * @param end index of the char past the last char of the slice
+ * @return UnicodeView borrowing the bytes of self
+ */
+UnicodeView
+indexed_ustr_slice(const UnicodeIndexedString *self, size_t start, size_t end);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //UNICODE_INDEXED_H
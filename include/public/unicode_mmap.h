@@ -0,0 +1,149 @@
+//
+// Read-only memory-mapped UTF-8 files: validation, counting, iteration and transcoding without heap copies.
+//
+#pragma once
+
+#ifndef UNICODE_MMAP_H
+#define UNICODE_MMAP_H
+
+#include "unicode.h"
+#include "unicode_transcode.h"
+#include "unicode_view.h"
+
+/**
+ * Files are processed in windows of this many bytes; pages of a window are dropped from the process (not from the
+ * page cache) once it is done, so resident memory doesn't grow with the file size
+ */
+#define UNICODE_MAP_WINDOW (8 * 1024 * 1024)
+
+/**
+ * UnicodeMappedFile is a read-only private mapping of a whole file, `view` borrows its bytes until
+ * `unicode_unmap_file`. The mapping is advised for sequential access
+ */
+typedef struct UnicodeMappedFile_s {
+    UnicodeView view;
+    // allocator the struct was allocated with
+    const UnicodeAllocator *allocator;
+} UnicodeMappedFile;
+
+/**
+ * Chunk-by-chunk iteration state, see `unicode_mapped_next_chunk`
+ */
+typedef struct UnicodeMappedIterator_s {
+    const UnicodeMappedFile *file;
+    size_t offset;
+    // bytes at the start of the file whose pages are already dropped
+    size_t released;
+} UnicodeMappedIterator;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maps a regular file into memory read-only. An empty file gives an empty view without a mapping
+ *
+ * @param path path of the file to map
+ * @return UnicodeMappedFile, or NULL with errno set if the file can't be opened, isn't a regular file or can't be
+ * mapped
+ *
+ * @example
+ * ```
+ * UnicodeMappedFile *file = unicode_map_file("dump.txt");
+ * size_t error_offset;
+ * if (!unicode_mapped_validate(file, &error_offset)) {
+ *     fprintf(stderr, "ill-formed UTF-8 at byte %zu\n", error_offset);
+ * }
+ * unicode_unmap_file(file);
+ * ```
+ */
+UnicodeMappedFile *
+unicode_map_file(const char *path);
+
+/**
+ * Unmaps the file, views over it become invalid
+ *
+ * @param file file to unmap
+ */
+void
+unicode_unmap_file(UnicodeMappedFile *file);
+
+/**
+ * Same as `unicode_validate` over the whole file, window by window
+ *
+ * @param file file to validate
+ * @param pErrorOffset if not NULL, receives the byte offset of the first ill-formed sequence when the file is invalid
+ * @return 1 if the file is well-formed UTF-8, 0 otherwise
+ */
+int
+unicode_mapped_validate(const UnicodeMappedFile *file, size_t *pErrorOffset);
+
+/**
+ * Counts chars of the file the way UnicodeView decodes them, for well-formed UTF-8 this is the number of code points
+ *
+ * @param file file to count chars of
+ * @return number of chars in the file
+ */
+size_t
+unicode_mapped_count(const UnicodeMappedFile *file);
+
+/**
+ * Starts chunk iteration over the file
+ *
+ * @param it iterator to initialize
+ * @param file file to iterate over
+ */
+void
+unicode_mapped_iter_init(UnicodeMappedIterator *it, const UnicodeMappedFile *file);
+
+/**
+ * Returns the next chunk of the file as a view of about `UNICODE_MAP_WINDOW` bytes. Chunks end on char boundaries,
+ * so chars read from a chunk with `unicode_view_next` are the same as if the whole file was read at once. Pages of
+ * earlier chunks are dropped, views over them stay valid but are read from the page cache again
+ *
+ * @param it iterator initialized with `unicode_mapped_iter_init`
+ * @param pOut view to set to the next chunk
+ * @return 1 if pOut is set, 0 at the end of the file
+ *
+ * @example
+ * ```
+ * UnicodeMappedIterator it;
+ * UnicodeView chunk;
+ * uint32_t code_point;
+ * unicode_mapped_iter_init(&it, file);
+ * while (unicode_mapped_next_chunk(&it, &chunk)) {
+ *     while (unicode_view_next_code_point(&chunk, &code_point)) {
+ *         histogram[code_point >> 8]++;
+ *     }
+ * }
+ * ```
+ */
+int
+unicode_mapped_next_chunk(UnicodeMappedIterator *it, UnicodeView *pOut);
+
+/**
+ * Converts the file to UTF-16 and writes it to a file descriptor through a 64 KiB block, see `utf8_to_utf16`.
+ * A char truncated by the end of the file is written as UNICODE_REPLACEMENT_CHAR
+ *
+ * @param file file to convert
+ * @param fd file descriptor to write to
+ * @param order byte order of the written code units
+ * @param pResult if not NULL, receives bytes consumed, code units written and ill-formed subsequences replaced
+ * @return 0 on success, -1 if write fails (errno is set by write)
+ */
+int
+unicode_mapped_to_utf16_fd(const UnicodeMappedFile *file, int fd, UnicodeByteOrder order,
+                           UnicodeTranscodeResult *pResult);
+
+/**
+ * Same as `unicode_mapped_to_utf16_fd`, writes UTF-32 code points in the given byte order
+ */
+int
+unicode_mapped_to_utf32_fd(const UnicodeMappedFile *file, int fd, UnicodeByteOrder order,
+                           UnicodeTranscodeResult *pResult);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //UNICODE_MMAP_H
@@ -0,0 +1,81 @@
+//
+// Unicode normalization forms (UAX #15) of UTF-8 text.
+//
+#pragma once
+
+#ifndef UNICODE_NORMALIZE_H
+#define UNICODE_NORMALIZE_H
+
+#include "unicode.h"
+#include "unicode_view.h"
+
+/**
+ * NFC or NFD of UTF-8 text is at most this many times longer than the text (U+1D160 decomposes into three 4-byte
+ * chars), so `nbytes * UNICODE_NORMALIZE_MAX_GROWTH` bytes of output are always enough
+ */
+#define UNICODE_NORMALIZE_MAX_GROWTH 3
+
+/**
+ * Same as UNICODE_NORMALIZE_MAX_GROWTH for NFKC and NFKD (U+FDFA decomposes into 18 chars, 33 bytes)
+ */
+#define UNICODE_NORMALIZE_COMPAT_MAX_GROWTH 11
+
+/**
+ * Returned by `unicode_normalize` if memory for a combining sequence can't be allocated
+ */
+#define UNICODE_NORMALIZE_FAILED SIZE_MAX
+
+/**
+ * Normalization forms: canonical composition and decomposition, compatibility composition and decomposition
+ */
+typedef enum UnicodeNormalizationForm_e {
+    UNICODE_NFC = 0,
+    UNICODE_NFD,
+    UNICODE_NFKC,
+    UNICODE_NFKD,
+} UnicodeNormalizationForm;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Normalizes UTF-8 text. A quick check pass (UAX #15, section 9) runs first: runs of ASCII are skipped a 32/64-byte
+ * block at a time where the CPU supports it, other chars take one table lookup. Text that passes it is not copied,
+ * pOut is a view of pStr. Otherwise the normalized prefix is copied and the rest is normalized a combining sequence at
+ * a time, each sequence going through the quick check again; if the result turns out equal to the text, pOut is a
+ * view of pStr as well.
+ * Decompositions, combining classes and compositions come from compact tables generated from the UCD, Hangul
+ * syllables are decomposed and composed algorithmically. Ill-formed subsequences are copied as they are.
+ * Combining sequences are sorted on the stack; one longer than 64 code points is sorted in memory of the default
+ * allocator
+ *
+ * @param pStr UTF-8 bytes to normalize, not required to be null-terminated
+ * @param nbytes number of bytes to read from pStr
+ * @param form normalization form
+ * @param pBuf buffer for the normalized bytes if they differ from pStr, not null-terminated; must not overlap pStr
+ * @param cap number of bytes available at pBuf; `nbytes * UNICODE_NORMALIZE_MAX_GROWTH` is always enough for NFC
+ *            and NFD, `nbytes * UNICODE_NORMALIZE_COMPAT_MAX_GROWTH` for NFKC and NFKD
+ * @param pOut receives the normalized text: a view of pStr, of pBuf, or {NULL, 0} if it doesn't fit into cap
+ * @return length of the normalized text in bytes, UNICODE_NORMALIZE_FAILED if allocation fails
+ *
+ * @example
+ * ```
+ * // normalization-insensitive lookup key
+ * uint8_t buf[64 * UNICODE_NORMALIZE_MAX_GROWTH];
+ * UnicodeView key;
+ * unicode_normalize(name, name_len, UNICODE_NFC, buf, sizeof(buf), &key);
+ * if (key.p != NULL) {
+ *     index_add(index, key.p, key.nbytes);
+ * }
+ * ```
+ */
+size_t
+unicode_normalize(const uint8_t *pStr, size_t nbytes, UnicodeNormalizationForm form, uint8_t *pBuf, size_t cap,
+                  UnicodeView *pOut);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //UNICODE_NORMALIZE_H
@@ -0,0 +1,80 @@
+//
+// Multithreaded counting, validation and decoding of large UTF-8 buffers.
+//
+#pragma once
+
+#ifndef UNICODE_PARALLEL_H
+#define UNICODE_PARALLEL_H
+
+#include "unicode.h"
+
+/**
+ * Smallest chunk given to a thread: smaller buffers use fewer threads, buffers below twice this size are processed
+ * on the calling thread only
+ */
+#define UNICODE_PARALLEL_MIN_CHUNK (1024 * 1024)
+
+/**
+ * Upper bound of the number of threads a call uses
+ */
+#define UNICODE_PARALLEL_MAX_THREADS 256
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Same as `unicode_decoded_len`, counts chars of equal chunks of pStr on several threads.
+ * Each chunk boundary is moved forward past continuation bytes to a byte where a char starts however the bytes before
+ * it are decoded, so chunks give the same chars as the whole buffer, invalid bytes included
+ *
+ * @param pStr bytes to count characters in, not required to be null-terminated
+ * @param nbytes number of bytes to read from pStr
+ * @param threads max number of threads to use including the calling one, 0 for the number of online CPUs
+ * @return number of characters in pStr
+ */
+size_t
+unicode_parallel_decoded_len(const uint8_t *pStr, size_t nbytes, unsigned threads);
+
+/**
+ * Same as `unicode_validate`, validates chunks of pStr on several threads, see `unicode_parallel_decoded_len`
+ *
+ * @param pStr bytes to validate, not required to be null-terminated
+ * @param nbytes number of bytes to read from pStr
+ * @param threads max number of threads to use including the calling one, 0 for the number of online CPUs
+ * @param pErrorOffset if not NULL, receives the byte offset of the first ill-formed sequence when the input is invalid
+ * @return 1 if the input is valid, 0 otherwise
+ */
+int
+unicode_parallel_validate(const uint8_t *pStr, size_t nbytes, unsigned threads, size_t *pErrorOffset);
+
+/**
+ * Same as `read_into_unicode_string_with_allocator`, decodes chunks of pStr on several threads. Chars of each chunk
+ * are counted first, so every thread decodes straight into its own range of the string (offsets are prefix sums of
+ * the counts) and the string is always allocated exactly, as with `UNICODE_DECODE_EXACT`
+ *
+ * @param pStr bytes to read Unicode sequence from
+ * @param nbytes number of bytes to read from pStr
+ * @param flags `UnicodeDecodeFlags`
+ * @param layout storage layout of the resulting string
+ * @param allocator allocator for the string, NULL for the default one. It is only called from the calling thread
+ * @param threads max number of threads to use including the calling one, 0 for the number of online CPUs
+ * @return UnicodeString, or NULL if allocation fails or the input is ill-formed with `UNICODE_DECODE_STRICT`
+ *
+ * @example
+ * ```
+ * UnicodeMappedFile *file = unicode_map_file("dump.txt");
+ * UnicodeString *str = read_into_unicode_string_parallel(file->view.p, file->view.nbytes, UNICODE_DECODE_DEFAULT,
+ *                                                        USTR_LAYOUT_UTF32, NULL, 0);
+ * unicode_unmap_file(file);
+ * ```
+ */
+UnicodeString *
+read_into_unicode_string_parallel(const uint8_t *pStr, size_t nbytes, uint32_t flags, UnicodeLayout layout,
+                                  const UnicodeAllocator *allocator, unsigned threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //UNICODE_PARALLEL_H
@@ -0,0 +1,141 @@
+//
+// Character properties: general category, East Asian Width and display width.
+//
+#pragma once
+
+#ifndef UNICODE_PROPERTY_H
+#define UNICODE_PROPERTY_H
+
+#include "unicode.h"
+
+/**
+ * General_Category values of the Unicode Character Database, unassigned code points are UNICODE_GC_CN
+ */
+typedef enum UnicodeGeneralCategory_e {
+    UNICODE_GC_CN = 0,
+    // letters: uppercase, lowercase, titlecase, modifier, other
+    UNICODE_GC_LU,
+    UNICODE_GC_LL,
+    UNICODE_GC_LT,
+    UNICODE_GC_LM,
+    UNICODE_GC_LO,
+    // marks: nonspacing, spacing, enclosing
+    UNICODE_GC_MN,
+    UNICODE_GC_MC,
+    UNICODE_GC_ME,
+    // numbers: decimal digit, letter, other
+    UNICODE_GC_ND,
+    UNICODE_GC_NL,
+    UNICODE_GC_NO,
+    // punctuation: connector, dash, open, close, initial quote, final quote, other
+    UNICODE_GC_PC,
+    UNICODE_GC_PD,
+    UNICODE_GC_PS,
+    UNICODE_GC_PE,
+    UNICODE_GC_PI,
+    UNICODE_GC_PF,
+    UNICODE_GC_PO,
+    // symbols: math, currency, modifier, other
+    UNICODE_GC_SM,
+    UNICODE_GC_SC,
+    UNICODE_GC_SK,
+    UNICODE_GC_SO,
+    // separators: space, line, paragraph
+    UNICODE_GC_ZS,
+    UNICODE_GC_ZL,
+    UNICODE_GC_ZP,
+    // other: control, format, surrogate, private use
+    UNICODE_GC_CC,
+    UNICODE_GC_CF,
+    UNICODE_GC_CS,
+    UNICODE_GC_CO,
+} UnicodeGeneralCategory;
+
+/**
+ * East_Asian_Width values (UAX #11), code points not listed in EastAsianWidth.txt are UNICODE_EAW_NEUTRAL
+ */
+typedef enum UnicodeEastAsianWidth_e {
+    UNICODE_EAW_NEUTRAL = 0,
+    UNICODE_EAW_AMBIGUOUS,
+    UNICODE_EAW_HALFWIDTH,
+    UNICODE_EAW_WIDE,
+    UNICODE_EAW_FULLWIDTH,
+    UNICODE_EAW_NARROW,
+} UnicodeEastAsianWidth;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Returns the general category of a code point. Values above U+10FFFF are UNICODE_GC_CN
+ *
+ * @param code_point code point to look up
+ * @return general category
+ */
+UnicodeGeneralCategory
+unicode_general_category(uint32_t code_point);
+
+/**
+ * Returns the East Asian Width of a code point. Values above U+10FFFF are UNICODE_EAW_NEUTRAL
+ *
+ * @param code_point code point to look up
+ * @return East_Asian_Width property value
+ */
+UnicodeEastAsianWidth
+unicode_east_asian_width(uint32_t code_point);
+
+/**
+ * Returns the number of terminal columns a code point takes, the way wcwidth(3) of most terminals counts them:
+ *  - 2 for wide and fullwidth chars (CJK, most emoji);
+ *  - 0 for nonspacing and enclosing marks, format chars other than the soft hyphen, controls and conjoining Hangul
+ *    vowels and trailing consonants;
+ *  - 1 for everything else, ambiguous chars and unassigned code points included.
+ * Zero-width rules come first: a wide nonspacing mark takes 0 columns. Unlike wcwidth, controls take 0 columns
+ * instead of -1, so widths can always be summed
+ *
+ * @param code_point code point to measure
+ * @return 0, 1 or 2
+ */
+int
+unicode_char_width(uint32_t code_point);
+
+/**
+ * Returns the number of terminal columns UTF-8 text takes, the sum of `unicode_char_width` of its code points.
+ * Every byte of an ill-formed subsequence takes 1 column, as the U+FFFD terminals show for it. Runs of ASCII are
+ * measured a 16/32-byte block at a time with vector compares where the CPU supports it.
+ * Grapheme clusters are not taken into account: a flag (a pair of regional indicators) takes 2 columns, an emoji
+ * ZWJ sequence takes the sum of widths of its emoji
+ *
+ * @param pStr UTF-8 bytes to measure, not required to be null-terminated
+ * @param nbytes number of bytes to read from pStr
+ * @return display width in columns
+ *
+ * @example
+ * ```
+ * // right-align a cell
+ * size_t width = unicode_display_width(cell, cell_len);
+ * for (size_t i = width; i < column_width; i++) {
+ *     putchar(' ');
+ * }
+ * fwrite(cell, 1, cell_len, stdout);
+ * ```
+ */
+size_t
+unicode_display_width(const uint8_t *pStr, size_t nbytes);
+
+/**
+ * Returns the number of terminal columns a string takes when printed with `print_unicode_string`: the sum of
+ * `unicode_char_width` of its chars, where an invalid byte slot takes the 4 columns of its `\xNN` representation
+ *
+ * @param self UnicodeString to measure
+ * @return display width in columns
+ */
+size_t
+ustr_display_width(const UnicodeString *self);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //UNICODE_PROPERTY_H
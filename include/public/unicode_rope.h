@@ -0,0 +1,214 @@
+//
+// Rope of UTF-8 chunks for assembling and editing large texts.
+//
+#pragma once
+
+#ifndef UNICODE_ROPE_H
+#define UNICODE_ROPE_H
+
+#include "unicode.h"
+#include "unicode_view.h"
+
+/**
+ * Max number of bytes in one leaf. Leaves are never cut inside a char, so every leaf but the last one of a text
+ * holds at least `UNICODE_ROPE_LEAF_SIZE - 3` bytes when the rope is built from bytes
+ */
+#define UNICODE_ROPE_LEAF_SIZE 1024
+
+/**
+ * Upper bound of the rope tree height: AVL balance keeps it below 1.45 * log2 of the number of leaves
+ */
+#define UNICODE_ROPE_MAX_HEIGHT 96
+
+typedef struct UnicodeRopeNode_s UnicodeRopeNode;
+
+/**
+ * UnicodeRope is an immutable text stored as a balanced (AVL) tree of UTF-8 leaves. Concatenation, insertion,
+ * deletion and slicing by char index take O(log n) and return a new rope that shares unchanged subtrees with its
+ * arguments, so arguments stay valid and are freed separately.
+ * Chars are counted the same way UnicodeView decodes them and never span two leaves: a sequence cut between two
+ * concatenated ropes stays two invalid chars, as with `concat_ustr`.
+ * Nodes are reference counted without atomics: ropes sharing nodes must not be used from several threads at once
+ */
+typedef struct UnicodeRope_s {
+    // NULL for an empty rope
+    UnicodeRopeNode *root;
+    // number of chars
+    size_t len;
+    // number of bytes
+    size_t nbytes;
+    // allocator the rope and its new nodes are allocated with, never NULL
+    const UnicodeAllocator *allocator;
+} UnicodeRope;
+
+/**
+ * Leaf-by-leaf iteration state, see `rope_next_leaf`. The rope must outlive the iterator
+ */
+typedef struct UnicodeRopeIterator_s {
+    const UnicodeRopeNode *stack[UNICODE_ROPE_MAX_HEIGHT];
+    size_t depth;
+} UnicodeRopeIterator;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates a rope from a copy of pStr[0..nbytes). pStr may contain null bytes and does not need a terminator
+ *
+ * @param pStr UTF-8 bytes to copy
+ * @param nbytes number of bytes to read from pStr
+ * @return UnicodeRope, or NULL if allocation fails
+ */
+UnicodeRope *
+new_rope(const uint8_t *pStr, size_t nbytes);
+
+/**
+ * Same as `new_rope`, allocates the rope with the given allocator
+ *
+ * @param allocator allocator to use, NULL for the default one
+ */
+UnicodeRope *
+new_rope_with_allocator(const uint8_t *pStr, size_t nbytes, const UnicodeAllocator *allocator);
+
+/**
+ * Releases the rope and the nodes no other rope shares
+ *
+ * @param self UnicodeRope to free
+ */
+void
+free_rope(UnicodeRope *self);
+
+/**
+ * Returns a rope of chars of self followed by chars of other. Small adjacent leaves are merged, so building a text
+ * from many short fragments doesn't leave a leaf per fragment
+ *
+ * @param self first rope
+ * @param other second rope
+ * @return new UnicodeRope allocated with the allocator of self, or NULL if allocation fails
+ *
+ * @example
+ * ```
+ * UnicodeRope *doc = new_rope(NULL, 0);
+ * for (size_t i = 0; i < count; i++) {
+ *     UnicodeRope *fragment = new_rope(fragments[i], sizes[i]);
+ *     UnicodeRope *next = rope_concat(doc, fragment);
+ *     free_rope(fragment);
+ *     free_rope(doc);
+ *     doc = next;
+ * }
+ * rope_write_fd(doc, fd);
+ * ```
+ */
+UnicodeRope *
+rope_concat(const UnicodeRope *self, const UnicodeRope *other);
+
+/**
+ * Returns a rope with chars of other inserted before char `index` of self
+ *
+ * @param self rope to insert into
+ * @param index index of the char to insert before, clamped to `self->len`
+ * @param other rope to insert
+ * @return new UnicodeRope, or NULL if allocation fails
+ */
+UnicodeRope *
+rope_insert(const UnicodeRope *self, size_t index, const UnicodeRope *other);
+
+/**
+ * Returns a rope without chars [start, end) of self, both bounds are clamped to `self->len`
+ *
+ * @param self rope to delete from
+ * @param start index of the first char to delete
+ * @param end index of the char past the last char to delete
+ * @return new UnicodeRope, or NULL if allocation fails
+ */
+UnicodeRope *
+rope_delete(const UnicodeRope *self, size_t start, size_t end);
+
+/**
+ * Returns a rope of chars [start, end) of self, both bounds are clamped to `self->len`
+ *
+ * @param self rope to slice
+ * @param start index of the first char of the slice
+ * @param end index of the char past the last char of the slice
+ * @return new UnicodeRope, or NULL if allocation fails
+ */
+UnicodeRope *
+rope_slice(const UnicodeRope *self, size_t start, size_t end);
+
+/**
+ * Returns the char at the given index in O(log n)
+ *
+ * @param self rope to look up
+ * @param index index of the char
+ * @return UnicodeChar, a zero-size char if index is not less than `self->len`
+ */
+UnicodeChar
+rope_char_at(const UnicodeRope *self, size_t index);
+
+/**
+ * Starts leaf iteration over self
+ *
+ * @param it iterator to initialize
+ * @param self rope to iterate over
+ */
+void
+rope_iter_init(UnicodeRopeIterator *it, const UnicodeRope *self);
+
+/**
+ * Returns the next leaf of the rope as a view over its bytes. Leaves hold whole chars, so each of them can be
+ * decoded, printed or written on its own
+ *
+ * @param it iterator initialized with `rope_iter_init`
+ * @param pOut view to set to the next leaf
+ * @return 1 if pOut is set, 0 after the last leaf
+ *
+ * @example
+ * ```
+ * UnicodeRopeIterator it;
+ * UnicodeView leaf;
+ * rope_iter_init(&it, rope);
+ * while (rope_next_leaf(&it, &leaf)) {
+ *     fwrite(leaf.p, 1, leaf.nbytes, stdout);
+ * }
+ * ```
+ */
+int
+rope_next_leaf(UnicodeRopeIterator *it, UnicodeView *pOut);
+
+/**
+ * Writes bytes of the rope to a stdio stream, leaf by leaf
+ *
+ * @param self rope to write
+ * @param stream stream to write to
+ * @return number of bytes written, or -1 if fwrite fails
+ */
+ssize_t
+rope_write_file(const UnicodeRope *self, FILE *stream);
+
+/**
+ * Writes bytes of the rope to a file descriptor. Leaves are gathered into 64 KiB blocks, so a rope of small leaves
+ * doesn't cost a syscall per leaf; partial writes and writes interrupted by a signal are retried
+ *
+ * @param self rope to write
+ * @param fd file descriptor to write to
+ * @return number of bytes written, or -1 if write fails (errno is set by write)
+ */
+ssize_t
+rope_write_fd(const UnicodeRope *self, int fd);
+
+/**
+ * Same as `compress_into_bytes_array` for a rope: bytes of all leaves, null-terminated, allocated at the exact size
+ * with the allocator of self. Free it with `free_compressed_ustr`
+ *
+ * @param self rope to compress
+ * @return CompressedUnicodeString, or NULL if allocation fails
+ */
+CompressedUnicodeString *
+compress_rope_into_bytes_array(const UnicodeRope *self);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //UNICODE_ROPE_H
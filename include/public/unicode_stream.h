@@ -0,0 +1,96 @@
+//
+// Incremental UTF-8 decoding of chunked input (sockets, pipes, fread).
+//
+#pragma once
+
+#ifndef UNICODE_STREAM_H
+#define UNICODE_STREAM_H
+
+#include "unicode.h"
+
+/**
+ * Max number of chars `unicode_decoder_finish` can produce: bytes of an unfinished sequence, one char each at most
+ */
+#define UNICODE_DECODER_MAX_PENDING 3
+
+/**
+ * Decoder state carried between chunks: the head of a multibyte sequence split by a chunk boundary.
+ * Zero-initialized (or `unicode_decoder_init`-ed) state is ready to use, no cleanup is required
+ */
+typedef struct UnicodeDecoder_s {
+    uint8_t pending[4];
+    uint8_t pending_len;
+} UnicodeDecoder;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Resets decoder state, dropping any pending bytes
+ *
+ * @param decoder decoder to reset
+ */
+void
+unicode_decoder_init(UnicodeDecoder *decoder);
+
+/**
+ * Decodes the next chunk of a stream into a caller-provided UnicodeChar buffer. A multibyte sequence cut by the end of
+ * the chunk is kept in decoder and completed by the next call, so any chunking of input produces the same chars as
+ * `read_into_unicode_array_n` over the whole input.
+ * Every char consumes at least one chunk byte, so `out_cap >= len` guarantees that the whole chunk is consumed.
+ *
+ * @param decoder decoder state
+ * @param chunk next bytes of the stream
+ * @param len number of bytes in chunk
+ * @param out buffer to write decoded chars into (not null-terminated)
+ * @param out_cap number of UnicodeChar slots available at out
+ * @param pConsumed if not NULL, receives the number of chunk bytes consumed; less than len only if out is full
+ * @return number of chars written to out
+ *
+ * @example
+ * ```
+ * UnicodeDecoder decoder = {0};
+ * UnicodeChar chars[65536];
+ * while ((n = read(fd, buf, sizeof(buf))) > 0) {
+ *     size_t count = unicode_decoder_feed(&decoder, buf, n, chars, 65536, NULL);
+ *     ...
+ * }
+ * size_t count = unicode_decoder_finish(&decoder, chars, 65536);
+ * ```
+ */
+size_t
+unicode_decoder_feed(UnicodeDecoder *decoder, const uint8_t *chunk, size_t len, UnicodeChar *out, size_t out_cap,
+                     size_t *pConsumed);
+
+/**
+ * Same as `unicode_decoder_feed`, writes code points instead of UnicodeChars. Invalid bytes are decoded as
+ * UNICODE_REPLACEMENT_CHAR
+ */
+size_t
+unicode_decoder_feed_utf32(UnicodeDecoder *decoder, const uint8_t *chunk, size_t len, uint32_t *out, size_t out_cap,
+                           size_t *pConsumed);
+
+/**
+ * Ends the stream: an unfinished sequence is flushed the way `read_into_unicode_array_n` decodes a truncated
+ * sequence at the end of input (its lead byte as an invalid byte) and decoder is reset
+ *
+ * @param decoder decoder state
+ * @param out buffer to write flushed chars into
+ * @param out_cap number of UnicodeChar slots available at out, UNICODE_DECODER_MAX_PENDING is always enough
+ * @return number of chars written to out
+ */
+size_t
+unicode_decoder_finish(UnicodeDecoder *decoder, UnicodeChar *out, size_t out_cap);
+
+/**
+ * Same as `unicode_decoder_finish`, writes code points instead of UnicodeChars
+ */
+size_t
+unicode_decoder_finish_utf32(UnicodeDecoder *decoder, uint32_t *out, size_t out_cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //UNICODE_STREAM_H
@@ -0,0 +1,158 @@
+//
+// Bulk conversion between UTF-8 bytes and other Unicode encoding forms.
+//
+#pragma once
+
+#ifndef UNICODE_TRANSCODE_H
+#define UNICODE_TRANSCODE_H
+
+#include "unicode.h"
+
+/**
+ * Progress of a bulk conversion: source units read, destination units written and ill-formed source subsequences
+ * (or invalid code points) replaced by UNICODE_REPLACEMENT_CHAR
+ */
+typedef struct UnicodeTranscodeResult_s {
+    size_t consumed;
+    size_t produced;
+    size_t replaced;
+} UnicodeTranscodeResult;
+
+/**
+ * Byte order of UTF-16 code units in memory, independent of the host byte order
+ */
+typedef enum UnicodeByteOrder_e {
+    UNICODE_LITTLE_ENDIAN = 0,
+    UNICODE_BIG_ENDIAN,
+} UnicodeByteOrder;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Converts UTF-8 bytes to UTF-32 code points in one pass. Runs of ASCII, 2-byte and 3-byte sequences are decoded
+ * with vector kernels where the CPU supports it, everything else char by char.
+ * Every ill-formed subsequence (its maximal subpart, as in Unicode chapter 3.9) is converted to one
+ * UNICODE_REPLACEMENT_CHAR. A well-formed sequence prefix cut by the end of src is not consumed, so the conversion can
+ * be resumed by passing `src + consumed` bytes joined with the next chunk; at the end of input these
+ * `n - consumed` (at most 3) bytes are a truncated char.
+ *
+ * @param src UTF-8 bytes to convert, not required to be null-terminated
+ * @param n number of bytes in src
+ * @param dst buffer for code points, must have room for `n` code points
+ * @return bytes of src consumed, code points written to dst and ill-formed subsequences replaced
+ *
+ * @example
+ * ```
+ * uint32_t *code_points = malloc(len * sizeof(uint32_t));
+ * UnicodeTranscodeResult result = utf8_to_utf32(buf, len, code_points);
+ * tokenize(code_points, result.produced);
+ * ```
+ */
+UnicodeTranscodeResult
+utf8_to_utf32(const uint8_t *src, size_t n, uint32_t *dst);
+
+/**
+ * Returns the exact number of bytes `utf32_to_utf8` writes for src[0..n), so the output can be allocated at once.
+ * Invalid code points count as the 3 bytes of UNICODE_REPLACEMENT_CHAR
+ *
+ * @param src code points to measure
+ * @param n number of code points in src
+ * @return UTF-8 length of src in bytes
+ */
+size_t
+utf32_to_utf8_len(const uint32_t *src, size_t n);
+
+/**
+ * Converts UTF-32 code points to UTF-8 bytes in one pass. Blocks of ASCII and other BMP code points are encoded with
+ * vector kernels where the CPU supports it, everything else code point by code point.
+ * Surrogates (U+D800..U+DFFF) and values above U+10FFFF are encoded as UNICODE_REPLACEMENT_CHAR and counted in
+ * `replaced`. Conversion stops before the first code point that doesn't fit into dst, so it can be resumed from
+ * `src + consumed` with a fresh buffer
+ *
+ * @param src code points to convert
+ * @param n number of code points in src
+ * @param dst buffer for UTF-8 bytes, not null-terminated
+ * @param cap number of bytes available at dst; `utf32_to_utf8_len(src, n)` bytes are always enough
+ * @return code points of src consumed, bytes written to dst and invalid code points replaced
+ *
+ * @example
+ * ```
+ * size_t len = utf32_to_utf8_len(code_points, count);
+ * uint8_t *bytes = malloc(len);
+ * UnicodeTranscodeResult result = utf32_to_utf8(code_points, count, bytes, len);
+ * fwrite(bytes, 1, result.produced, stdout);
+ * ```
+ */
+UnicodeTranscodeResult
+utf32_to_utf8(const uint32_t *src, size_t n, uint8_t *dst, size_t cap);
+
+/**
+ * Returns the exact number of code units `utf8_to_utf16` writes for src[0..n), so the output can be allocated at once.
+ * Well-formed input is measured by counting lead bytes, without decoding
+ *
+ * @param src UTF-8 bytes to measure
+ * @param n number of bytes in src
+ * @return UTF-16 length of src in code units
+ */
+size_t
+utf8_to_utf16_len(const uint8_t *src, size_t n);
+
+/**
+ * Converts UTF-8 bytes to UTF-16 code units in the given byte order, chars above U+FFFF become surrogate pairs.
+ * Ill-formed input and chars cut by the end of src are handled as in `utf8_to_utf32`; conversion also stops before
+ * the first char that doesn't fit into dst. Vector kernels only run while dst has room for a whole vector, so nothing
+ * is written past `dst + cap`
+ *
+ * @param src UTF-8 bytes to convert, not required to be null-terminated
+ * @param n number of bytes in src
+ * @param dst buffer for code units
+ * @param cap number of code units available at dst; `utf8_to_utf16_len(src, n)` units are always enough
+ * @param order byte order of code units written to dst
+ * @return bytes of src consumed, code units written to dst and ill-formed subsequences replaced
+ *
+ * @example
+ * ```
+ * size_t units_len = utf8_to_utf16_len(buf, len);
+ * uint16_t *units = malloc(units_len * sizeof(uint16_t));
+ * UnicodeTranscodeResult result = utf8_to_utf16(buf, len, units, units_len, UNICODE_LITTLE_ENDIAN);
+ * ```
+ */
+UnicodeTranscodeResult
+utf8_to_utf16(const uint8_t *src, size_t n, uint16_t *dst, size_t cap, UnicodeByteOrder order);
+
+/**
+ * Returns the exact number of bytes `utf16_to_utf8` writes for src[0..n). Unpaired surrogates count as the 3 bytes of
+ * UNICODE_REPLACEMENT_CHAR
+ *
+ * @param src UTF-16 code units to measure
+ * @param n number of code units in src
+ * @param order byte order of code units in src
+ * @return UTF-8 length of src in bytes
+ */
+size_t
+utf16_to_utf8_len(const uint16_t *src, size_t n, UnicodeByteOrder order);
+
+/**
+ * Converts UTF-16 code units in the given byte order to UTF-8 bytes. Blocks of BMP code units are encoded with vector
+ * kernels where the CPU supports it, surrogate pairs char by char.
+ * Unpaired surrogates are encoded as UNICODE_REPLACEMENT_CHAR and counted in `replaced`. A high surrogate at the end of
+ * src is not consumed, so the conversion can be resumed with the next chunk; conversion also stops before the first
+ * char that doesn't fit into dst
+ *
+ * @param src UTF-16 code units to convert
+ * @param n number of code units in src
+ * @param dst buffer for UTF-8 bytes, not null-terminated
+ * @param cap number of bytes available at dst; `utf16_to_utf8_len(src, n, order)` bytes are always enough
+ * @param order byte order of code units in src
+ * @return code units of src consumed, bytes written to dst and unpaired surrogates replaced
+ */
+UnicodeTranscodeResult
+utf16_to_utf8(const uint16_t *src, size_t n, uint8_t *dst, size_t cap, UnicodeByteOrder order);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //UNICODE_TRANSCODE_H
@@ -0,0 +1,114 @@
+//
+// Non-owning views over borrowed UTF-8 bytes and allocation-free iteration.
+//
+#pragma once
+
+#ifndef UNICODE_VIEW_H
+#define UNICODE_VIEW_H
+
+#include "unicode.h"
+
+/**
+ * UnicodeView borrows `nbytes` UTF-8 bytes at `p`; it never owns, copies or frees them.
+ * Iteration consumes the view from the front, so iterate over a copy to keep the original.
+ * Chars are decoded the same way `read_into_unicode_array_n` decodes them: an invalid byte (or the lead byte of a
+ * sequence truncated by the end of the view) yields one `\xNN` UnicodeChar / UNICODE_REPLACEMENT_CHAR code point
+ */
+typedef struct UnicodeView_s {
+    const uint8_t *p;
+    size_t nbytes;
+} UnicodeView;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates a view over pStr[0..nbytes), pStr may contain null bytes and does not need a terminator
+ *
+ * @param pStr bytes to view
+ * @param nbytes number of bytes to view
+ * @return UnicodeView
+ */
+UnicodeView
+unicode_view(const uint8_t *pStr, size_t nbytes);
+
+/**
+ * Creates a view over a null-terminated string, not including the terminator
+ *
+ * @param pStr null-terminated string to view
+ * @return UnicodeView
+ */
+UnicodeView
+unicode_view_cstr(const char *pStr);
+
+/**
+ * Reads the first char of view into pOut without consuming it
+ *
+ * @param view view to read from
+ * @param pOut UnicodeChar to read into, may be NULL to only get the char byte length
+ * @return number of bytes the char occupies in view, 0 if view is empty
+ */
+uint8_t
+unicode_view_peek(const UnicodeView *view, UnicodeChar *pOut);
+
+/**
+ * Reads the first char of view into pOut and advances view past it
+ *
+ * @param view view to read from
+ * @param pOut UnicodeChar to read into, may be NULL to skip a char
+ * @return number of bytes consumed, 0 if view is empty
+ *
+ * @example
+ * ```
+ * UnicodeView it = unicode_view_cstr("Привет, World");
+ * UnicodeChar uchar;
+ * while (unicode_view_next(&it, &uchar)) {
+ *     print_unicode_char(uchar);
+ * }
+ * ```
+ */
+uint8_t
+unicode_view_next(UnicodeView *view, UnicodeChar *pOut);
+
+/**
+ * Same as `unicode_view_peek`, reads a code point
+ */
+uint8_t
+unicode_view_peek_code_point(const UnicodeView *view, uint32_t *pOut);
+
+/**
+ * Same as `unicode_view_next`, reads a code point
+ */
+uint8_t
+unicode_view_next_code_point(UnicodeView *view, uint32_t *pOut);
+
+/**
+ * Returns a sub-view of bytes [start, end) of view, both bounds are clamped to the view length.
+ * Bounds are not moved to char boundaries, so a sequence cut by them reads as invalid bytes
+ *
+ * @param view view to slice
+ * @param start first byte of the slice
+ * @param end byte past the last byte of the slice
+ * @return UnicodeView
+ */
+UnicodeView
+unicode_view_slice_bytes(UnicodeView view, size_t start, size_t end);
+
+/**
+ * Returns a sub-view of chars [start, end) of view, both bounds are clamped to the view char count.
+ * Takes O(end) time: chars are counted from the start of view, ASCII runs block-wise
+ *
+ * @param view view to slice
+ * @param start index of the first char of the slice
+ * @param end index of the char past the last char of the slice
+ * @return UnicodeView
+ */
+UnicodeView
+unicode_view_slice(UnicodeView view, size_t start, size_t end);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //UNICODE_VIEW_H
@@ -7,7 +7,9 @@
 #include <string.h>
 
 #include "unicode_consts.h"
-#include "../../dsa/include/public/mallocs.h"
+#include "unicode_internal.h"
+#include "unicode_simd.h"
+#include "unicode_transcode.h"
 
 UnicodeChar
 read_unicode_char(const uint8_t *pStr) {
@@ -42,47 +44,482 @@ read_unicode_char_fast(const uint8_t *pStr, UnicodeChar **pUstr) {
     return octets;
 }
 
+/**
+ * Decodes pStr[0..nbytes) into pOut, which must have room for `unicode_decoded_len(pStr, nbytes)` slots.
+ * @return number of slots written, or DECODE_ILL_FORMED if `strict` is set and the input is not well-formed
+ */
+static size_t
+decode_into_array(const uint8_t *pStr, const size_t nbytes, UnicodeChar *pOut, const int strict) {
+    const uint8_t *pEnd = pStr + nbytes;
+    UnicodeChar *pInit = pOut;
+
+    while (pStr < pEnd) {
+        // mostly-ASCII input is expanded block-wise, only non-ASCII bytes go through the per-char path
+        const size_t ascii_len = expand_ascii_run(pStr, pEnd - pStr, pOut);
+        pStr += ascii_len;
+        pOut += ascii_len;
+        if (pStr == pEnd) {
+            break;
+        }
+        if (strict && !utf8_sequence_len(pStr, pEnd)) {
+            return DECODE_ILL_FORMED;
+        }
+        pStr += decode_one_n(pStr, pEnd, pOut);
+        ++pOut;
+    }
+
+    return pOut - pInit;
+}
+
+/**
+ * Same as `decode_into_array` for USTR_LAYOUT_UTF32 storage, invalid bytes are stored as U+FFFD
+ */
+static size_t
+decode_into_utf32(const uint8_t *pStr, const size_t nbytes, uint32_t *pOut, const int strict) {
+    const uint8_t *pEnd = pStr + nbytes;
+    uint32_t *pInit = pOut;
+
+    while (pStr < pEnd) {
+        const size_t ascii_len = ascii_prefix_len(pStr, pEnd - pStr);
+        for (size_t i = 0; i < ascii_len; i++) {
+            pOut[i] = pStr[i];
+        }
+        pStr += ascii_len;
+        pOut += ascii_len;
+        if (pStr == pEnd) {
+            break;
+        }
+        if (strict && !utf8_sequence_len(pStr, pEnd)) {
+            return DECODE_ILL_FORMED;
+        }
+        UnicodeChar uchar;
+        pStr += decode_one_n(pStr, pEnd, &uchar);
+        *pOut++ = uchar_to_code_point(uchar);
+    }
+
+    return pOut - pInit;
+}
+
+/**
+ * Same as `decode_into_array` for USTR_LAYOUT_SPLIT storage
+ */
+static size_t
+decode_into_split(const uint8_t *pStr, const size_t nbytes, uint32_t *pOctets, uint8_t *pSizes, const int strict) {
+    const uint8_t *pEnd = pStr + nbytes;
+    size_t chars = 0;
+
+    while (pStr < pEnd) {
+        if (strict && *pStr >= 0x80 && !utf8_sequence_len(pStr, pEnd)) {
+            return DECODE_ILL_FORMED;
+        }
+        UnicodeChar uchar = {{*pStr, 0, 0, 0}, 1};
+        pStr += *pStr < 0x80 ? 1 : decode_one_n(pStr, pEnd, &uchar);
+        memcpy(pOctets + chars, uchar.octet, sizeof(uint32_t));
+        pSizes[chars++] = uchar.size;
+    }
+
+    return chars;
+}
+
+size_t
+ustr_decode_at(UnicodeString *self, const size_t at, const uint8_t *pStr, const size_t nbytes, const int strict) {
+    switch (self->layout) {
+        case USTR_LAYOUT_UTF32:
+            return decode_into_utf32(pStr, nbytes, self->code_points + at, strict);
+        case USTR_LAYOUT_SPLIT:
+            return decode_into_split(pStr, nbytes, self->octets + at, self->sizes + at, strict);
+        default:
+            return decode_into_array(pStr, nbytes, self->data + at, strict);
+    }
+}
+
+size_t
+unicode_decoded_len(const uint8_t *pStr, const size_t nbytes) {
+    size_t chars = 0;
+    size_t i = 0;
+
+    while (i < nbytes) {
+        const size_t ascii_len = ascii_prefix_len(pStr + i, nbytes - i);
+        i += ascii_len;
+        chars += ascii_len;
+        if (i == nbytes) {
+            break;
+        }
+        const uint8_t octets = get_octets_num(pStr + i);
+        i += octets && octets <= nbytes - i ? octets : 1;
+        chars++;
+    }
+
+    return chars;
+}
+
+size_t
+unicode_strlen(const uint8_t *pStr, const size_t nbytes) {
+    return count_utf8_leads(pStr, nbytes);
+}
+
+size_t
+unicode_offset_of(const uint8_t *pStr, const size_t nbytes, const size_t index) {
+    size_t count = index;
+    return utf8_skip_chars_valid(pStr, nbytes, &count);
+}
+
+size_t
+read_into_unicode_array_n(const uint8_t *pStr, const size_t nbytes, UnicodeChar **pUstr, const uint32_t flags) {
+    const size_t slots = flags & UNICODE_DECODE_EXACT ? unicode_decoded_len(pStr, nbytes) : nbytes;
+
+    *pUstr = (UnicodeChar *) malloc((slots + 1) * UCHAR_SIZE);
+    if (*pUstr == NULL) {
+        return 0;
+    }
+
+    const size_t chars = decode_into_array(pStr, nbytes, *pUstr, flags & UNICODE_DECODE_STRICT);
+    if (chars == DECODE_ILL_FORMED) {
+        free(*pUstr);
+        *pUstr = NULL;
+        return 0;
+    }
+    (*pUstr)[chars] = (UnicodeChar){0};
+    return chars;
+}
+
 void
 read_into_unicode_array(const uint8_t *pStr, UnicodeChar **pUstr) {
-    *pUstr = (UnicodeChar *) calloc(strlen((char *) pStr) + 1, UCHAR_SIZE);
-    UnicodeChar *pInit = *pUstr;
+    read_into_unicode_array_n(pStr, strlen((char *) pStr), pUstr, UNICODE_DECODE_DEFAULT);
+}
+
+static void *
+libc_alloc(void *ctx, const size_t size) {
+    (void) ctx;
+    return malloc(size);
+}
+
+static void *
+libc_resize(void *ctx, void *ptr, const size_t old_size, const size_t new_size) {
+    (void) ctx;
+    (void) old_size;
+    return realloc(ptr, new_size);
+}
 
-    while (*pStr != '\0') {
-        pStr += read_unicode_char_fast(pStr, pUstr);
-        ++*pUstr;
+static void
+libc_release(void *ctx, void *ptr, const size_t size) {
+    (void) ctx;
+    (void) size;
+    free(ptr);
+}
+
+static const UnicodeAllocator LIBC_ALLOCATOR = {libc_alloc, libc_resize, libc_release, NULL};
+
+static const UnicodeAllocator *default_allocator = &LIBC_ALLOCATOR;
+
+void
+unicode_set_default_allocator(const UnicodeAllocator *allocator) {
+    default_allocator = allocator != NULL ? allocator : &LIBC_ALLOCATOR;
+}
+
+const UnicodeAllocator *
+unicode_get_default_allocator(void) {
+    return default_allocator;
+}
+
+UnicodeString *
+read_into_unicode_string_n(const uint8_t *pStr, const size_t nbytes, const uint32_t flags) {
+    return read_into_unicode_string_with_allocator(pStr, nbytes, flags, USTR_LAYOUT_UCHAR, NULL);
+}
+
+UnicodeString *
+read_into_unicode_string_with_layout(const uint8_t *pStr, const size_t nbytes, const uint32_t flags,
+                                     const UnicodeLayout layout) {
+    return read_into_unicode_string_with_allocator(pStr, nbytes, flags, layout, NULL);
+}
+
+UnicodeString *
+read_into_unicode_string_with_allocator(const uint8_t *pStr, const size_t nbytes, const uint32_t flags,
+                                        const UnicodeLayout layout, const UnicodeAllocator *allocator) {
+    const size_t capacity = flags & UNICODE_DECODE_EXACT ? unicode_decoded_len(pStr, nbytes) : nbytes;
+    UnicodeString *str = new_ustr_with_allocator((ssize_t) capacity, layout, allocator);
+    if (str == NULL) {
+        return NULL;
     }
 
-    **pUstr = (UnicodeChar){0};
-    *pUstr = pInit;
+    const size_t len = ustr_decode_at(str, 0, pStr, nbytes, flags & UNICODE_DECODE_STRICT);
+    if (len == DECODE_ILL_FORMED) {
+        free_ustr(str);
+        return NULL;
+    }
+    str->len = len;
+    ustr_terminate(str);
+    return str;
 }
 
 UnicodeString *
 read_into_unicode_string(const uint8_t *pStr) {
-    UnicodeString *ccalloc_safe(str, 1, USTR_SIZE);
-    str->len = 1;
-    read_into_unicode_array(pStr, &str->data);
-    while (str->data++->size != 0) str->len++;
-    str->data -= str->len;
-    return str;
+    return read_into_unicode_string_n(pStr, strlen((char *) pStr), UNICODE_DECODE_DEFAULT);
+}
+
+static int
+ustr_is_inline(const UnicodeString *self) {
+    return (const void *) self->data == (const void *) self->inline_storage;
+}
+
+/**
+ * Points storage of self into its inline buffer, contents are not touched
+ */
+static void
+ustr_use_inline_storage(UnicodeString *self) {
+    self->octets = self->inline_storage;
+    self->capacity = USTR_LAYOUT_INLINE_CAPACITY[self->layout];
+    self->sizes = self->layout == USTR_LAYOUT_SPLIT ? (uint8_t *) (self->inline_storage + self->capacity + 1) : NULL;
 }
 
 UnicodeString *
 new_ustr(const ssize_t size) {
-    const size_t string_len = size > NEW_USTR_NULL_VALUE ? size : NEW_USTR_DEFAULT_LEN;
+    return new_ustr_with_allocator(size, USTR_LAYOUT_UCHAR, NULL);
+}
+
+UnicodeString *
+new_ustr_with_layout(const ssize_t size, const UnicodeLayout layout) {
+    return new_ustr_with_allocator(size, layout, NULL);
+}
+
+UnicodeString *
+new_ustr_with_allocator(const ssize_t size, const UnicodeLayout layout, const UnicodeAllocator *allocator) {
+    // without a size the string starts inline and grows on demand
+    const size_t string_len = size > NEW_USTR_NULL_VALUE ? (size_t) size : 0;
+    if (allocator == NULL) {
+        allocator = default_allocator;
+    }
 
-    UnicodeString *ccalloc_safe(str, 1, USTR_SIZE);
-    ccalloc_safe(str->data, string_len, UCHAR_SIZE);
+    UnicodeString *str = unicode_alloc(allocator, USTR_SIZE);
+    if (str == NULL) {
+        return NULL;
+    }
+    *str = (UnicodeString){.capacity = string_len, .layout = layout, .allocator = allocator};
+    if (string_len <= USTR_LAYOUT_INLINE_CAPACITY[layout]) {
+        ustr_use_inline_storage(str);
+        ustr_terminate(str);
+        return str;
+    }
+
+    str->data = unicode_alloc(allocator, (string_len + 1) * USTR_LAYOUT_SLOT_SIZE[layout]);
+    if (layout == USTR_LAYOUT_SPLIT) {
+        str->sizes = unicode_alloc(allocator, string_len + 1);
+    }
+    if (str->data == NULL || (layout == USTR_LAYOUT_SPLIT && str->sizes == NULL)) {
+        free_ustr(str);
+        return NULL;
+    }
+    ustr_terminate(str);
 
     return str;
 }
 
+/**
+ * Reallocates storage arrays of self to hold `capacity` chars plus the terminator. Storage moves from the inline
+ * buffer to the heap when it grows past it, and back when it shrinks enough
+ */
+static UnicodeString *
+ustr_resize_storage(UnicodeString *self, const size_t capacity) {
+    const size_t slot_size = USTR_LAYOUT_SLOT_SIZE[self->layout];
+    const int split = self->layout == USTR_LAYOUT_SPLIT;
+
+    if (capacity <= USTR_LAYOUT_INLINE_CAPACITY[self->layout]) {
+        if (ustr_is_inline(self)) {
+            return self;
+        }
+        void *data = self->data;
+        uint8_t *sizes = self->sizes;
+        const size_t old_capacity = self->capacity;
+        ustr_use_inline_storage(self);
+        memcpy(self->data, data, (self->len + 1) * slot_size);
+        unicode_release(self->allocator, data, (old_capacity + 1) * slot_size);
+        if (split) {
+            memcpy(self->sizes, sizes, self->len + 1);
+            unicode_release(self->allocator, sizes, old_capacity + 1);
+        }
+        return self;
+    }
+
+    if (ustr_is_inline(self)) {
+        void *data = unicode_alloc(self->allocator, (capacity + 1) * slot_size);
+        uint8_t *sizes = split && data != NULL ? unicode_alloc(self->allocator, capacity + 1) : NULL;
+        if (data == NULL || (split && sizes == NULL)) {
+            if (data != NULL) {
+                unicode_release(self->allocator, data, (capacity + 1) * slot_size);
+            }
+            return NULL;
+        }
+        memcpy(data, self->data, (self->len + 1) * slot_size);
+        if (split) {
+            memcpy(sizes, self->sizes, self->len + 1);
+        }
+        self->data = data;
+        self->sizes = sizes;
+        self->capacity = capacity;
+        return self;
+    }
+
+    // sizes of a split string move to a new block first: if data can't be resized, the new block is released and
+    // both arrays still match `capacity`, which a failed resize of the second array would break
+    uint8_t *sizes = NULL;
+    if (split) {
+        sizes = unicode_alloc(self->allocator, capacity + 1);
+        if (sizes == NULL) {
+            return NULL;
+        }
+    }
+    void *data = unicode_resize(self->allocator, self->data, (self->capacity + 1) * slot_size,
+                                (capacity + 1) * slot_size);
+    if (data == NULL) {
+        if (split) {
+            unicode_release(self->allocator, sizes, capacity + 1);
+        }
+        return NULL;
+    }
+    self->data = data;
+    if (split) {
+        memcpy(sizes, self->sizes, self->len + 1);
+        unicode_release(self->allocator, self->sizes, self->capacity + 1);
+        self->sizes = sizes;
+    }
+
+    self->capacity = capacity;
+    return self;
+}
+
+UnicodeString *
+ustr_reserve(UnicodeString *self, const size_t capacity) {
+    if (capacity <= self->capacity) {
+        return self;
+    }
+    return ustr_resize_storage(self, capacity);
+}
+
+UnicodeString *
+ustr_shrink_to_fit(UnicodeString *self) {
+    if (self->capacity == self->len) {
+        return self;
+    }
+    return ustr_resize_storage(self, self->len);
+}
+
+/**
+ * Makes room for n more chars, growing capacity geometrically so a sequence of appends is amortized O(1)
+ */
+static UnicodeString *
+ustr_grow(UnicodeString *self, const size_t n) {
+    const size_t string_len = self->len + n;
+    if (string_len <= self->capacity) {
+        return self;
+    }
+
+    size_t capacity = self->capacity > NEW_USTR_DEFAULT_LEN / 2 ? self->capacity * 2 : NEW_USTR_DEFAULT_LEN;
+    if (capacity < string_len) {
+        capacity = string_len;
+    }
+    return ustr_reserve(self, capacity);
+}
+
+UnicodeString *
+ustr_append(UnicodeString *self, const UnicodeChar *chars, const size_t n) {
+    if (self->len + n > self->capacity) {
+        // chars may alias self->data, which is about to move
+        const int aliased = self->layout == USTR_LAYOUT_UCHAR && chars >= self->data && chars < self->data + self->len;
+        const size_t chars_offset = aliased ? (size_t) (chars - self->data) : 0;
+
+        if (ustr_grow(self, n) == NULL) {
+            return NULL;
+        }
+        if (aliased) {
+            chars = self->data + chars_offset;
+        }
+    }
+
+    if (self->layout == USTR_LAYOUT_UCHAR) {
+        memcpy(self->data + self->len, chars, n * UCHAR_SIZE);
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            ustr_set(self, self->len + i, chars[i]);
+        }
+    }
+    self->len += n;
+    ustr_terminate(self);
+
+    return self;
+}
+
+/**
+ * Appends all chars of other to self, converting them into the layout of self
+ */
+static UnicodeString *
+ustr_extend(UnicodeString *self, const UnicodeString *other) {
+    const size_t other_len = other->len;
+    if (ustr_grow(self, other_len) == NULL) {
+        return NULL;
+    }
+
+    if (self->layout == other->layout) {
+        memcpy((uint8_t *) self->data + self->len * USTR_LAYOUT_SLOT_SIZE[self->layout], other->data,
+               other_len * USTR_LAYOUT_SLOT_SIZE[self->layout]);
+        if (self->layout == USTR_LAYOUT_SPLIT) {
+            memcpy(self->sizes + self->len, other->sizes, other_len);
+        }
+    } else if (self->layout == USTR_LAYOUT_UTF32) {
+        for (size_t i = 0; i < other_len; i++) {
+            self->code_points[self->len + i] = ustr_ord_at(other, i);
+        }
+    } else {
+        for (size_t i = 0; i < other_len; i++) {
+            ustr_set(self, self->len + i, ustr_char_at(other, i));
+        }
+    }
+    self->len += other_len;
+    ustr_terminate(self);
+
+    return self;
+}
+
+UnicodeString *
+ustr_convert(const UnicodeString *self, const UnicodeLayout layout) {
+    UnicodeString *str = new_ustr_with_allocator((ssize_t) self->len, layout, self->allocator);
+    if (str == NULL) {
+        return NULL;
+    }
+    return ustr_extend(str, self);
+}
+
+UnicodeChar
+ustr_char_at(const UnicodeString *self, const size_t i) {
+    UnicodeChar uchar;
+    switch (self->layout) {
+        case USTR_LAYOUT_UTF32:
+            return code_point_to_uchar(self->code_points[i]);
+        case USTR_LAYOUT_SPLIT:
+            memcpy(uchar.octet, self->octets + i, sizeof(uint32_t));
+            uchar.size = self->sizes[i];
+            return uchar;
+        default:
+            return self->data[i];
+    }
+}
+
+uint32_t
+ustr_ord_at(const UnicodeString *self, const size_t i) {
+    if (self->layout == USTR_LAYOUT_UTF32) {
+        return self->code_points[i];
+    }
+    return uchar_to_code_point(ustr_char_at(self, i));
+}
+
 UnicodeString *
 concat_ustr(const UnicodeString *self, const UnicodeString *other) {
-    const size_t string_len = self->len + other->len;
-    UnicodeString *ccalloc_safe(str, 1, USTR_SIZE);
-    ccalloc_safe(str->data, string_len, UCHAR_SIZE);
-    memcpy(str->data, self->data, self->len * UCHAR_SIZE);
-    memcpy(str->data + self->len * UCHAR_SIZE, other->data, other->len * UCHAR_SIZE);
+    UnicodeString *str = new_ustr_with_allocator((ssize_t) (self->len + other->len), self->layout, self->allocator);
+    if (str == NULL) {
+        return NULL;
+    }
+    // capacity is reserved upfront, so extending can't fail
+    ustr_extend(str, self);
+    ustr_extend(str, other);
     return str;
 }
 
@@ -94,60 +531,155 @@ push_char(UnicodeString *self, const char chr) {
 
 UnicodeString *
 push_uchar(UnicodeString *self, const UnicodeChar chr) {
-    const size_t string_len = self->len + 1;
-
-    UnicodeString *ccalloc_safe(tmp_str, 1, USTR_SIZE);
-    ccalloc_safe(tmp_str->data, string_len, UCHAR_SIZE);
-    memcpy(tmp_str->data, self->data, self->len * UCHAR_SIZE);
-
-    free(self->data);
-    ccalloc_safe(self->data, string_len, UCHAR_SIZE);
-    memcpy(self->data, tmp_str->data, self->len * UCHAR_SIZE);
-    self->data[self->len] = chr;
-    self->len = string_len;
-
-    free_ustr(tmp_str);
-
-    return self;
+    return ustr_append(self, &chr, 1);
 }
 
 void
 free_ustr(UnicodeString *self) {
-    free(self->data);
-    free(self);
+    const UnicodeAllocator *allocator = self->allocator;
+    if (ustr_is_inline(self)) {
+        unicode_release(allocator, self, USTR_SIZE);
+        return;
+    }
+    if (self->data != NULL) {
+        unicode_release(allocator, self->data, (self->capacity + 1) * USTR_LAYOUT_SLOT_SIZE[self->layout]);
+    }
+    if (self->sizes != NULL) {
+        unicode_release(allocator, self->sizes, self->capacity + 1);
+    }
+    unicode_release(allocator, self, USTR_SIZE);
 }
 
-CompressedUnicodeString *
-compress_into_bytes_array(UnicodeString *string) {
-    uint32_t bytes_count = 0;
+size_t
+ustr_encode_chars(const UnicodeString *self, size_t *pIndex, uint8_t *pOut, const size_t cap) {
+    size_t i = *pIndex;
+    size_t written = 0;
+
+    switch (self->layout) {
+        case USTR_LAYOUT_UTF32:
+            // not utf32_to_utf8: surrogates decoded from non-strict input are kept as they are in other layouts
+            for (; i < self->len; i++) {
+                const UnicodeChar uchar = code_point_to_uchar(self->code_points[i]);
+                if (uchar.size > cap - written) {
+                    break;
+                }
+                memcpy(pOut + written, uchar.octet, cap - written >= sizeof(uint32_t) ? sizeof(uint32_t) : uchar.size);
+                written += uchar.size;
+            }
+            break;
+        case USTR_LAYOUT_SPLIT:
+            for (; i < self->len; i++) {
+                const uint8_t size = self->sizes[i];
+                if (size > cap - written) {
+                    break;
+                }
+                memcpy(pOut + written, self->octets + i, cap - written >= sizeof(uint32_t) ? sizeof(uint32_t) : size);
+                written += size;
+            }
+            break;
+        default:
+            for (; i < self->len; i++) {
+                const UnicodeChar *uchar = self->data + i;
+                if (uchar->size > cap - written) {
+                    break;
+                }
+                // a whole 4-byte copy is cheaper than a sized one while the output has room for it
+                const size_t copy = cap - written >= sizeof(uint32_t) ? sizeof(uint32_t) : uchar->size;
+                memcpy(pOut + written, uchar->octet, copy);
+                written += uchar->size;
+            }
+            break;
+    }
+    *pIndex = i;
+    return written;
+}
 
-    uint8_t * ccalloc_safe(compressed_string, string->len * 4, sizeof(uint8_t));
+size_t
+ustr_bytes_len(const UnicodeString *self) {
+    size_t bytes_count = 0;
+    switch (self->layout) {
+        case USTR_LAYOUT_UTF32:
+            // surrogates and replaced code points are 3 bytes either way
+            return utf32_to_utf8_len(self->code_points, self->len);
+        case USTR_LAYOUT_SPLIT:
+            for (size_t i = 0; i < self->len; i++) {
+                bytes_count += self->sizes[i];
+            }
+            return bytes_count;
+        default:
+            for (size_t i = 0; i < self->len; i++) {
+                bytes_count += self->data[i].size;
+            }
+            return bytes_count;
+    }
+}
 
-    while (string->data->size != 0) {
-        memcpy(compressed_string + bytes_count, string->data->octet, string->data->size);
-        bytes_count += string->data->size;
-        string->data++;
+size_t
+ustr_write_bytes(const UnicodeString *self, uint8_t *pOut, const size_t cap) {
+    const size_t bytes_count = ustr_bytes_len(self);
+    if (bytes_count > cap) {
+        return bytes_count;
     }
-    string->data -= string->len - 1;
+    size_t index = 0;
+    ustr_encode_chars(self, &index, pOut, bytes_count);
+    return bytes_count;
+}
 
-    CompressedUnicodeString *compressed = calloc(1, sizeof(CompressedUnicodeString));
-    if (compressed == NULL) {
-        exit(-1);
+ssize_t
+ustr_write_file(const UnicodeString *self, FILE *stream) {
+    uint8_t block[UNICODE_WRITE_BLOCK_SIZE];
+    size_t index = 0;
+    size_t total = 0;
+
+    while (index < self->len) {
+        const size_t written = ustr_encode_chars(self, &index, block, sizeof(block));
+        if (fwrite(block, 1, written, stream) != written) {
+            return -1;
+        }
+        total += written;
+    }
+    return (ssize_t) total;
+}
+
+ssize_t
+ustr_write_fd(const UnicodeString *self, const int fd) {
+    uint8_t block[UNICODE_WRITE_BLOCK_SIZE];
+    size_t index = 0;
+    size_t total = 0;
+
+    while (index < self->len) {
+        const size_t written = ustr_encode_chars(self, &index, block, sizeof(block));
+        if (write_all(fd, block, written) < 0) {
+            return -1;
+        }
+        total += written;
     }
+    return (ssize_t) total;
+}
 
-    compressed->data = malloc(bytes_count + 1);
-    if (compressed->data == NULL) {
-        exit(3);
+CompressedUnicodeString *
+compress_into_bytes_array(const UnicodeString *string) {
+    const UnicodeAllocator *allocator = string->allocator;
+    const size_t bytes_count = ustr_bytes_len(string);
+
+    CompressedUnicodeString *compressed = new_compressed_ustr(allocator, bytes_count);
+    if (compressed == NULL) {
+        return NULL;
     }
 
-    compressed->len = bytes_count + 1;
-    memmove(compressed->data, compressed_string, bytes_count);
-    free(compressed_string);
-    *(compressed->data + bytes_count) = '\0';
+    size_t index = 0;
+    ustr_encode_chars(string, &index, compressed->data, bytes_count);
 
     return compressed;
 }
 
+void
+free_compressed_ustr(CompressedUnicodeString *self) {
+    const UnicodeAllocator *allocator = self->allocator != NULL ? self->allocator : &LIBC_ALLOCATOR;
+    unicode_release(allocator, self->data, self->len);
+    unicode_release(allocator, self, sizeof(CompressedUnicodeString));
+}
+
 UnicodeChar
 read_unicode_char_with_offset(const uint8_t *pStr, const uint32_t offset) {
     const uint8_t *pStr_shifted = pStr + offset;
@@ -190,9 +722,7 @@ print_unicode_char_array(const UnicodeChar *uCharArray) {
 
 void
 print_unicode_string(const UnicodeString *pUstr) {
-    for (int i = 0; i < pUstr->len; i++) {
-        print_unicode_char(pUstr->data[i]);
-    }
+    ustr_write_file(pUstr, stdout);
 }
 
 void
@@ -268,8 +798,8 @@ unicode_chr(uint32_t char_ord) {
     } else if (char_ord > MAX_UNICODE_CHAR[2] && char_ord <= MAX_UNICODE_CHAR[3]) {
         uchr.octet[3] = CONTINUE_OCTET + get_next_octet(&char_ord, 6);
         uchr.octet[2] = CONTINUE_OCTET + get_next_octet(&char_ord, 6);
-        uchr.octet[1] = CONTINUE_OCTET + char_ord;
-        uchr.octet[0] = START_FOUR_OCTET;
+        uchr.octet[1] = CONTINUE_OCTET + get_next_octet(&char_ord, 6);
+        uchr.octet[0] = START_FOUR_OCTET + char_ord;
         uchr.size = 4;
     }
 
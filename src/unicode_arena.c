@@ -0,0 +1,144 @@
+//
+// Bump-pointer arena implementing UnicodeAllocator.
+//
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unicode_arena.h"
+
+#define ARENA_ALIGN _Alignof(max_align_t)
+#define ARENA_NO_LAST SIZE_MAX
+
+struct UnicodeArenaBlock_s {
+    UnicodeArenaBlock *next;
+    // usable bytes in data
+    size_t size;
+    size_t used;
+    // offset of the latest allocation, which can still be resized in place or rolled back
+    size_t last;
+    max_align_t data[];
+};
+
+static size_t
+align_up(const size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+static uint8_t *
+block_bump(UnicodeArenaBlock *block, const size_t size) {
+    uint8_t *ptr = (uint8_t *) block->data + block->used;
+    block->last = block->used;
+    block->used += size;
+    return ptr;
+}
+
+static int
+block_is_last(const UnicodeArenaBlock *block, const void *ptr) {
+    return block != NULL && block->last != ARENA_NO_LAST && (const uint8_t *) block->data + block->last == ptr;
+}
+
+static void *
+arena_alloc(void *ctx, size_t size) {
+    UnicodeArena *arena = ctx;
+    size = align_up(size);
+
+    UnicodeArenaBlock *block = arena->current;
+    if (block != NULL && block->size - block->used >= size) {
+        return block_bump(block, size);
+    }
+
+    // blocks after the current one are unused since the last reset
+    while (block != NULL && block->next != NULL) {
+        block = block->next;
+        block->used = 0;
+        block->last = ARENA_NO_LAST;
+        if (block->size >= size) {
+            arena->current = block;
+            return block_bump(block, size);
+        }
+    }
+
+    const size_t block_size = size > arena->block_size ? size : arena->block_size;
+    UnicodeArenaBlock *new_block = malloc(sizeof(UnicodeArenaBlock) + block_size);
+    if (new_block == NULL) {
+        return NULL;
+    }
+    *new_block = (UnicodeArenaBlock){NULL, block_size, 0, ARENA_NO_LAST};
+
+    if (arena->current == NULL) {
+        arena->head = new_block;
+    } else {
+        new_block->next = arena->current->next;
+        arena->current->next = new_block;
+    }
+    arena->current = new_block;
+    return block_bump(new_block, size);
+}
+
+static void *
+arena_resize(void *ctx, void *ptr, const size_t old_size, const size_t new_size) {
+    UnicodeArena *arena = ctx;
+    UnicodeArenaBlock *block = arena->current;
+
+    if (ptr == NULL) {
+        return arena_alloc(ctx, new_size);
+    }
+
+    // the latest allocation grows and shrinks in place while the block has room
+    if (block_is_last(block, ptr) && block->size - block->last >= align_up(new_size)) {
+        block->used = block->last + align_up(new_size);
+        return ptr;
+    }
+
+    void *new_ptr = arena_alloc(ctx, new_size);
+    if (new_ptr == NULL) {
+        return NULL;
+    }
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    return new_ptr;
+}
+
+static void
+arena_release(void *ctx, void *ptr, const size_t size) {
+    (void) size;
+    UnicodeArena *arena = ctx;
+    UnicodeArenaBlock *block = arena->current;
+
+    if (block_is_last(block, ptr)) {
+        block->used = block->last;
+        block->last = ARENA_NO_LAST;
+    }
+}
+
+void
+unicode_arena_init(UnicodeArena *arena, const size_t block_size) {
+    *arena = (UnicodeArena){
+        .allocator = {arena_alloc, arena_resize, arena_release, arena},
+        .head = NULL,
+        .current = NULL,
+        .block_size = block_size ? block_size : UNICODE_ARENA_DEFAULT_BLOCK_SIZE,
+    };
+}
+
+void
+unicode_arena_reset(UnicodeArena *arena) {
+    arena->current = arena->head;
+    if (arena->head != NULL) {
+        arena->head->used = 0;
+        arena->head->last = ARENA_NO_LAST;
+    }
+}
+
+void
+unicode_arena_destroy(UnicodeArena *arena) {
+    UnicodeArenaBlock *block = arena->head;
+    while (block != NULL) {
+        UnicodeArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+    arena->current = NULL;
+}
@@ -0,0 +1,240 @@
+//
+// Case mapping and case folding through tables generated from the UCD, see tools/unicode_gen_tables.c.
+//
+
+#include "unicode_case.h"
+#include "unicode_case_tables.h"
+#include "unicode_internal.h"
+#include "unicode_simd.h"
+
+_Static_assert(CASE_MAX_EXPANSION <= UNICODE_CASE_MAX_EXPANSION, "case expansions don't fit the public bound");
+
+/**
+ * Returned by `ustr_code_point_at` for invalid byte slots
+ */
+#define INVALID_SLOT UINT32_MAX
+
+static inline const CaseRecord *
+case_record(const uint32_t code_point) {
+    return &CASE_RECORDS[case_lookup(code_point)];
+}
+
+#ifdef UNICODE_SIMD_X86
+/**
+ * Maps 32-byte blocks of ASCII by flipping bit 0x20 of bytes in [first, first + 26). A block with a non-ASCII byte is
+ * still stored whole, but only its ASCII prefix is counted as mapped and the run ends there
+ * @return number of bytes mapped
+ */
+UNICODE_TARGET_AVX2 static size_t
+ascii_case_run_avx2(const uint8_t *pStr, const size_t len, uint8_t *pOut, const uint8_t first) {
+    // bytes above 0x7F are negative as signed bytes and never fall into the range
+    const __m256i low = _mm256_set1_epi8((char) (first - 1));
+    const __m256i high = _mm256_set1_epi8((char) (first + 26));
+    const __m256i flip = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        const __m256i block = _mm256_loadu_si256((const __m256i *) (pStr + i));
+        const __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(block, low), _mm256_cmpgt_epi8(high, block));
+        _mm256_storeu_si256((__m256i *) (pOut + i), _mm256_xor_si256(block, _mm256_and_si256(letters, flip)));
+        const uint32_t non_ascii = (uint32_t) _mm256_movemask_epi8(block);
+        if (non_ascii) {
+            return i + __builtin_ctz(non_ascii);
+        }
+    }
+    return i;
+}
+
+static size_t
+ascii_case_run_sse2(const uint8_t *pStr, const size_t len, uint8_t *pOut, const uint8_t first) {
+    const __m128i low = _mm_set1_epi8((char) (first - 1));
+    const __m128i high = _mm_set1_epi8((char) (first + 26));
+    const __m128i flip = _mm_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        const __m128i block = _mm_loadu_si128((const __m128i *) (pStr + i));
+        const __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(block, low), _mm_cmpgt_epi8(high, block));
+        _mm_storeu_si128((__m128i *) (pOut + i), _mm_xor_si128(block, _mm_and_si128(letters, flip)));
+        const uint32_t non_ascii = (uint32_t) _mm_movemask_epi8(block);
+        if (non_ascii) {
+            return i + __builtin_ctz(non_ascii);
+        }
+    }
+    return i;
+}
+#endif
+
+/**
+ * Maps the leading ASCII run of pStr[0..len) into pOut a whole vector block at a time, pOut has room for len bytes
+ * @return number of bytes mapped, 0 if the run is shorter than a block
+ */
+static inline size_t
+ascii_case_run(const uint8_t *pStr, const size_t len, uint8_t *pOut, const uint8_t first) {
+#ifdef UNICODE_SIMD_X86
+    return unicode_cpu_has_avx2() ? ascii_case_run_avx2(pStr, len, pOut, first)
+                                  : ascii_case_run_sse2(pStr, len, pOut, first);
+#else
+    (void) pStr;
+    (void) len;
+    (void) pOut;
+    (void) first;
+    return 0;
+#endif
+}
+
+/**
+ * Copies pStr[0..len) to pOut at *pProduced if it fits into cap, advancing *pProduced either way. Once a copy doesn't
+ * fit *pProduced exceeds cap, so nothing is written after it
+ */
+static inline void
+put_bytes(uint8_t *pOut, const size_t cap, size_t *pProduced, const uint8_t *pStr, const size_t len) {
+    if (*pProduced + len <= cap) {
+        memcpy(pOut + *pProduced, pStr, len);
+    }
+    *pProduced += len;
+}
+
+static inline void
+put_code_point(uint8_t *pOut, const size_t cap, size_t *pProduced, const uint32_t code_point) {
+    const uint8_t len = utf8_encoded_len(code_point);
+    if (*pProduced + len <= cap) {
+        encode_utf8_char(code_point, len, pOut + *pProduced);
+    }
+    *pProduced += len;
+}
+
+/**
+ * Code point of the char at i of self, INVALID_SLOT for an invalid byte slot
+ */
+static inline uint32_t
+ustr_code_point_at(const UnicodeString *self, const size_t i) {
+    if (self->layout == USTR_LAYOUT_UTF32) {
+        return self->code_points[i];
+    }
+    const UnicodeChar uchar = ustr_char_at(self, i);
+    return get_octets_num(uchar.octet) == uchar.size ? unicode_ord(uchar) : INVALID_SLOT;
+}
+
+uint32_t
+unicode_tolower(const uint32_t code_point) {
+    return code_point + (uint32_t) case_record(code_point)->delta[UNICODE_CASE_LOWER];
+}
+
+uint32_t
+unicode_toupper(const uint32_t code_point) {
+    return code_point + (uint32_t) case_record(code_point)->delta[UNICODE_CASE_UPPER];
+}
+
+uint32_t
+unicode_casefold(const uint32_t code_point) {
+    return code_point + (uint32_t) case_record(code_point)->delta[UNICODE_CASE_FOLD];
+}
+
+size_t
+unicode_case_map_full(const uint32_t code_point, const UnicodeCaseMapping mapping, uint32_t *pOut) {
+    const CaseRecord *record = case_record(code_point);
+    const uint16_t full = record->full[mapping];
+    if (!full) {
+        *pOut = code_point + (uint32_t) record->delta[mapping];
+        return 1;
+    }
+    const size_t len = CASE_EXPANSIONS[full];
+    memcpy(pOut, CASE_EXPANSIONS + full + 1, len * sizeof(uint32_t));
+    return len;
+}
+
+size_t
+unicode_case_map(const uint8_t *pStr, const size_t nbytes, const UnicodeCaseMapping mapping, uint8_t *pOut,
+                 const size_t cap) {
+    // ASCII letters only map to ASCII letters: lowercasing and folding flip A..Z, uppercasing flips a..z
+    const uint8_t first = mapping == UNICODE_CASE_UPPER ? 'a' : 'A';
+    const uint8_t *pEnd = pStr + nbytes;
+    size_t produced = 0;
+    size_t i = 0;
+
+    while (i < nbytes) {
+        const uint8_t byte = pStr[i];
+        if (byte < 0x80) {
+            const size_t room = produced < cap ? cap - produced : 0;
+            const size_t run = ascii_case_run(pStr + i, nbytes - i < room ? nbytes - i : room, pOut + produced, first);
+            if (run) {
+                i += run;
+                produced += run;
+                continue;
+            }
+            if (produced < cap) {
+                pOut[produced] = (uint8_t) (byte - first) < 26 ? byte ^ 0x20 : byte;
+            }
+            produced++;
+            i++;
+            continue;
+        }
+
+        // Latin, Greek and Cyrillic letters are 2-byte chars that map to 2-byte chars: a shortcut for them
+        if (byte >= 0xC2 && byte < 0xE0 && i + 1 < nbytes && (pStr[i + 1] & 0xC0) == 0x80 && produced + 2 <= cap) {
+            const uint32_t code_point = (uint32_t) (byte & 0x1F) << 6 | (pStr[i + 1] & 0x3F);
+            const CaseRecord *record = case_record(code_point);
+            const uint32_t mapped = code_point + (uint32_t) record->delta[mapping];
+            if (!record->full[mapping] && mapped - 0x80 < 0x780) {
+                pOut[produced] = (uint8_t) (0xC0 | mapped >> 6);
+                pOut[produced + 1] = (uint8_t) (0x80 | (mapped & 0x3F));
+                produced += 2;
+                i += 2;
+                continue;
+            }
+        }
+
+        const uint8_t len = utf8_sequence_len(pStr + i, pEnd);
+        if (!len) {
+            put_bytes(pOut, cap, &produced, pStr + i, 1);
+            i++;
+            continue;
+        }
+        const uint32_t code_point = decode_utf8_valid(pStr + i, len);
+        const CaseRecord *record = case_record(code_point);
+        const uint16_t full = record->full[mapping];
+        if (full) {
+            for (uint32_t k = 1; k <= CASE_EXPANSIONS[full]; k++) {
+                put_code_point(pOut, cap, &produced, CASE_EXPANSIONS[full + k]);
+            }
+        } else if (record->delta[mapping]) {
+            put_code_point(pOut, cap, &produced, code_point + (uint32_t) record->delta[mapping]);
+        } else {
+            put_bytes(pOut, cap, &produced, pStr + i, len);
+        }
+        i += len;
+    }
+    return produced;
+}
+
+UnicodeString *
+ustr_case_map(const UnicodeString *self, const UnicodeCaseMapping mapping) {
+    size_t len = 0;
+    for (size_t i = 0; i < self->len; i++) {
+        const uint32_t code_point = ustr_code_point_at(self, i);
+        const uint16_t full = code_point != INVALID_SLOT ? case_record(code_point)->full[mapping] : 0;
+        len += full ? CASE_EXPANSIONS[full] : 1;
+    }
+
+    UnicodeString *str = new_ustr_with_allocator((ssize_t) len, self->layout, self->allocator);
+    if (str == NULL) {
+        return NULL;
+    }
+    uint32_t mapped[UNICODE_CASE_MAX_EXPANSION];
+    size_t at = 0;
+    for (size_t i = 0; i < self->len; i++) {
+        const uint32_t code_point = ustr_code_point_at(self, i);
+        if (code_point == INVALID_SLOT) {
+            ustr_set(str, at++, ustr_char_at(self, i));
+            continue;
+        }
+        const size_t count = unicode_case_map_full(code_point, mapping, mapped);
+        for (size_t k = 0; k < count; k++) {
+            ustr_set(str, at++, code_point_to_uchar(mapped[k]));
+        }
+    }
+    str->len = len;
+    ustr_terminate(str);
+    return str;
+}
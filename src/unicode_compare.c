@@ -0,0 +1,258 @@
+//
+// Equality, ordering and hashing of UnicodeStrings and UTF-8 buffers.
+//
+
+#include <string.h>
+
+#include "unicode_consts.h"
+#include "unicode_internal.h"
+#include "unicode_simd.h"
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+/**
+ * Streaming XXH64 state: 4 accumulators fed with 32-byte stripes, a partial stripe is buffered between updates
+ */
+typedef struct HashState_s {
+    uint64_t acc[4];
+    uint64_t seed;
+    uint64_t total;
+    uint8_t buffer[32];
+    size_t buffered;
+} HashState;
+
+static inline uint64_t
+rotl64(const uint64_t x, const int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t
+read64_le(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint32_t
+read32_le(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+static inline uint64_t
+xxh64_round(uint64_t acc, const uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t
+xxh64_merge_round(uint64_t acc, const uint64_t value) {
+    acc ^= xxh64_round(0, value);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static void
+hash_init(HashState *state, const uint64_t seed) {
+    state->acc[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+    state->acc[1] = seed + XXH_PRIME64_2;
+    state->acc[2] = seed;
+    state->acc[3] = seed - XXH_PRIME64_1;
+    state->seed = seed;
+    state->total = 0;
+    state->buffered = 0;
+}
+
+/**
+ * Feeds whole stripes of pStr[0..nbytes) into the accumulators
+ * @return number of bytes consumed, a multiple of 32
+ */
+static size_t
+hash_stripes(HashState *state, const uint8_t *pStr, const size_t nbytes) {
+    // local accumulators stay in registers, the 4 lanes are independent multiply chains
+    uint64_t acc0 = state->acc[0], acc1 = state->acc[1], acc2 = state->acc[2], acc3 = state->acc[3];
+    size_t i = 0;
+    for (; i + 32 <= nbytes; i += 32) {
+        acc0 = xxh64_round(acc0, read64_le(pStr + i));
+        acc1 = xxh64_round(acc1, read64_le(pStr + i + 8));
+        acc2 = xxh64_round(acc2, read64_le(pStr + i + 16));
+        acc3 = xxh64_round(acc3, read64_le(pStr + i + 24));
+    }
+    state->acc[0] = acc0;
+    state->acc[1] = acc1;
+    state->acc[2] = acc2;
+    state->acc[3] = acc3;
+    return i;
+}
+
+static void
+hash_update(HashState *state, const uint8_t *pStr, size_t nbytes) {
+    state->total += nbytes;
+    if (state->buffered) {
+        const size_t fill = 32 - state->buffered < nbytes ? 32 - state->buffered : nbytes;
+        memcpy(state->buffer + state->buffered, pStr, fill);
+        state->buffered += fill;
+        pStr += fill;
+        nbytes -= fill;
+        if (state->buffered < 32) {
+            return;
+        }
+        hash_stripes(state, state->buffer, 32);
+        state->buffered = 0;
+    }
+    const size_t consumed = hash_stripes(state, pStr, nbytes);
+    memcpy(state->buffer, pStr + consumed, nbytes - consumed);
+    state->buffered = nbytes - consumed;
+}
+
+static uint64_t
+hash_digest(const HashState *state) {
+    uint64_t hash;
+    if (state->total >= 32) {
+        hash = rotl64(state->acc[0], 1) + rotl64(state->acc[1], 7) + rotl64(state->acc[2], 12)
+               + rotl64(state->acc[3], 18);
+        for (size_t k = 0; k < 4; k++) {
+            hash = xxh64_merge_round(hash, state->acc[k]);
+        }
+    } else {
+        hash = state->seed + XXH_PRIME64_5;
+    }
+    hash += state->total;
+
+    const uint8_t *p = state->buffer;
+    size_t left = state->buffered;
+    for (; left >= 8; left -= 8, p += 8) {
+        hash ^= xxh64_round(0, read64_le(p));
+        hash = rotl64(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    if (left >= 4) {
+        hash ^= (uint64_t) read32_le(p) * XXH_PRIME64_1;
+        hash = rotl64(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        left -= 4;
+        p += 4;
+    }
+    for (; left; left--, p++) {
+        hash ^= *p * XXH_PRIME64_5;
+        hash = rotl64(hash, 11) * XXH_PRIME64_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/**
+ * Compares chars by their octets read as a big-endian number, which is the order of their UTF-8 bytes
+ */
+static int
+compare_chars(const UnicodeChar a, const UnicodeChar b) {
+    const uint32_t key_a = (uint32_t) a.octet[0] << 24 | (uint32_t) a.octet[1] << 16 | (uint32_t) a.octet[2] << 8
+                           | a.octet[3];
+    const uint32_t key_b = (uint32_t) b.octet[0] << 24 | (uint32_t) b.octet[1] << 16 | (uint32_t) b.octet[2] << 8
+                           | b.octet[3];
+    if (key_a != key_b) {
+        return key_a < key_b ? -1 : 1;
+    }
+    return (a.size > b.size) - (a.size < b.size);
+}
+
+/**
+ * Returns the number of leading chars of two strings of the same layout whose storage slots are equal
+ */
+static size_t
+ustr_common_prefix(const UnicodeString *self, const UnicodeString *other, const size_t len) {
+    switch (self->layout) {
+        case USTR_LAYOUT_UTF32:
+            return common_prefix_len((const uint8_t *) self->code_points, (const uint8_t *) other->code_points,
+                                     len * sizeof(uint32_t)) / sizeof(uint32_t);
+        case USTR_LAYOUT_SPLIT: {
+            const size_t octets = common_prefix_len((const uint8_t *) self->octets, (const uint8_t *) other->octets,
+                                                    len * sizeof(uint32_t)) / sizeof(uint32_t);
+            return common_prefix_len(self->sizes, other->sizes, octets);
+        }
+        default:
+            return common_prefix_len((const uint8_t *) self->data, (const uint8_t *) other->data,
+                                     len * UCHAR_SIZE) / UCHAR_SIZE;
+    }
+}
+
+int
+ustr_equal(const UnicodeString *self, const UnicodeString *other) {
+    if (self->len != other->len) {
+        return 0;
+    }
+    if (self->layout == other->layout) {
+        return ustr_common_prefix(self, other, self->len) == self->len;
+    }
+    for (size_t i = 0; i < self->len; i++) {
+        if (compare_chars(ustr_char_at(self, i), ustr_char_at(other, i))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int
+ustr_compare(const UnicodeString *self, const UnicodeString *other) {
+    const size_t len = self->len < other->len ? self->len : other->len;
+    size_t i = self->layout == other->layout ? ustr_common_prefix(self, other, len) : 0;
+
+    for (; i < len; i++) {
+        const int diff = compare_chars(ustr_char_at(self, i), ustr_char_at(other, i));
+        if (diff) {
+            return diff;
+        }
+    }
+    return (self->len > other->len) - (self->len < other->len);
+}
+
+uint64_t
+ustr_hash(const UnicodeString *self, const uint64_t seed) {
+    uint8_t block[UNICODE_WRITE_BLOCK_SIZE];
+    HashState state;
+    size_t index = 0;
+
+    hash_init(&state, seed);
+    while (index < self->len) {
+        const size_t written = ustr_encode_chars(self, &index, block, sizeof(block));
+        hash_update(&state, block, written);
+    }
+    return hash_digest(&state);
+}
+
+int
+unicode_equal(const uint8_t *pA, const size_t nA, const uint8_t *pB, const size_t nB) {
+    return nA == nB && common_prefix_len(pA, pB, nA) == nA;
+}
+
+int
+unicode_compare(const uint8_t *pA, const size_t nA, const uint8_t *pB, const size_t nB) {
+    const size_t len = nA < nB ? nA : nB;
+    const size_t i = common_prefix_len(pA, pB, len);
+    if (i < len) {
+        return pA[i] < pB[i] ? -1 : 1;
+    }
+    return (nA > nB) - (nA < nB);
+}
+
+uint64_t
+unicode_hash(const uint8_t *pStr, const size_t nbytes, const uint64_t seed) {
+    HashState state;
+    hash_init(&state, seed);
+    hash_update(&state, pStr, nbytes);
+    return hash_digest(&state);
+}
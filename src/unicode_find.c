@@ -0,0 +1,263 @@
+//
+// Substring search over raw UTF-8.
+//
+
+#include <string.h>
+
+#include "unicode_find.h"
+#include "unicode_simd.h"
+
+/**
+ * Returned by search helpers when there is no match
+ */
+#define NOT_FOUND SIZE_MAX
+
+#ifdef UNICODE_SIMD_X86
+/**
+ * Candidates are positions where both the `head` byte (the first one or the one after the lead byte) and the last byte
+ * of the needle match, found for a whole block at once; only they are compared in full. Positions whose last byte
+ * would be past the last whole block are left to the scalar search, *pNext is set to the first of them
+ */
+UNICODE_TARGET_AVX2 static size_t
+find_filtered_avx2(const uint8_t *pHaystack, const size_t nbytes, const uint8_t *pNeedle, const size_t needle_nbytes,
+                   const size_t head, size_t *pNext) {
+    const __m256i first = _mm256_set1_epi8((char) pNeedle[head]);
+    const __m256i last = _mm256_set1_epi8((char) pNeedle[needle_nbytes - 1]);
+    size_t i = 0;
+
+    for (; i + needle_nbytes - 1 + 32 <= nbytes; i += 32) {
+        const __m256i block_first = _mm256_loadu_si256((const __m256i *) (pHaystack + i + head));
+        const __m256i block_last = _mm256_loadu_si256((const __m256i *) (pHaystack + i + needle_nbytes - 1));
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_last, last)));
+        while (mask) {
+            const size_t pos = i + __builtin_ctz(mask);
+            if (!memcmp(pHaystack + pos, pNeedle, needle_nbytes)) {
+                return pos;
+            }
+            mask &= mask - 1;
+        }
+    }
+    *pNext = i;
+    return NOT_FOUND;
+}
+
+static size_t
+find_filtered_sse2(const uint8_t *pHaystack, const size_t nbytes, const uint8_t *pNeedle, const size_t needle_nbytes,
+                   const size_t head, size_t *pNext) {
+    const __m128i first = _mm_set1_epi8((char) pNeedle[head]);
+    const __m128i last = _mm_set1_epi8((char) pNeedle[needle_nbytes - 1]);
+    size_t i = 0;
+
+    for (; i + needle_nbytes - 1 + 16 <= nbytes; i += 16) {
+        const __m128i block_first = _mm_loadu_si128((const __m128i *) (pHaystack + i + head));
+        const __m128i block_last = _mm_loadu_si128((const __m128i *) (pHaystack + i + needle_nbytes - 1));
+        uint32_t mask = (uint32_t) _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last)));
+        while (mask) {
+            const size_t pos = i + __builtin_ctz(mask);
+            if (!memcmp(pHaystack + pos, pNeedle, needle_nbytes)) {
+                return pos;
+            }
+            mask &= mask - 1;
+        }
+    }
+    *pNext = i;
+    return NOT_FOUND;
+}
+#endif
+
+/**
+ * Checks positions from `pos` on: memchr finds the first byte of the needle, the rest is compared in full
+ */
+static size_t
+find_scalar(const uint8_t *pHaystack, const size_t nbytes, const uint8_t *pNeedle, const size_t needle_nbytes,
+            size_t pos) {
+    while (pos + needle_nbytes <= nbytes) {
+        const uint8_t *p = memchr(pHaystack + pos, pNeedle[0], nbytes - needle_nbytes + 1 - pos);
+        if (p == NULL) {
+            return NOT_FOUND;
+        }
+        pos = (size_t) (p - pHaystack);
+        if (!memcmp(p + 1, pNeedle + 1, needle_nbytes - 1)) {
+            return pos;
+        }
+        pos++;
+    }
+    return NOT_FOUND;
+}
+
+/**
+ * Computes the critical factorization of the needle: the start of its maximal suffix by byte order (or the reverse
+ * order when `reverse` is set) and the period of that suffix
+ */
+static size_t
+maximal_suffix(const uint8_t *pNeedle, const size_t needle_nbytes, const int reverse, size_t *pPeriod) {
+    // ip starts at -1, indices are unsigned and wrap back to 0 on `ip + k`
+    size_t ip = SIZE_MAX;
+    size_t jp = 0;
+    size_t k = 1;
+    size_t p = 1;
+
+    while (jp + k < needle_nbytes) {
+        const uint8_t a = pNeedle[ip + k];
+        const uint8_t b = pNeedle[jp + k];
+        if (a == b) {
+            if (k == p) {
+                jp += p;
+                k = 1;
+            } else {
+                k++;
+            }
+        } else if (reverse ? a < b : a > b) {
+            jp += k;
+            k = 1;
+            p = jp - ip;
+        } else {
+            ip = jp++;
+            k = p = 1;
+        }
+    }
+    *pPeriod = p;
+    return ip;
+}
+
+/**
+ * Two-Way string matching (Crochemore, Perrin) with a bad-character shift on the last byte of the window:
+ * O(nbytes + needle_nbytes) time and no allocation
+ */
+static size_t
+find_two_way(const uint8_t *pHaystack, const size_t nbytes, const uint8_t *pNeedle, const size_t needle_nbytes) {
+    uint64_t byteset[4] = {0};
+    size_t shift[256];
+
+    for (size_t i = 0; i < needle_nbytes; i++) {
+        byteset[pNeedle[i] >> 6] |= 1ULL << (pNeedle[i] & 63);
+        shift[pNeedle[i]] = i + 1;
+    }
+
+    size_t period, reverse_period;
+    size_t ms = maximal_suffix(pNeedle, needle_nbytes, 0, &period);
+    const size_t reverse_ms = maximal_suffix(pNeedle, needle_nbytes, 1, &reverse_period);
+    if (reverse_ms + 1 > ms + 1) {
+        ms = reverse_ms;
+        period = reverse_period;
+    }
+
+    // bytes of a periodic needle already known to match after a shift by its period
+    size_t mem0;
+    if (memcmp(pNeedle, pNeedle + period, ms + 1)) {
+        mem0 = 0;
+        period = (ms > needle_nbytes - ms - 1 ? ms : needle_nbytes - ms - 1) + 1;
+    } else {
+        mem0 = needle_nbytes - period;
+    }
+
+    size_t mem = 0;
+    size_t pos = 0;
+    while (nbytes - pos >= needle_nbytes) {
+        const uint8_t *window = pHaystack + pos;
+        const uint8_t tail = window[needle_nbytes - 1];
+        if (!(byteset[tail >> 6] >> (tail & 63) & 1)) {
+            pos += needle_nbytes;
+            mem = 0;
+            continue;
+        }
+        size_t k = needle_nbytes - shift[tail];
+        if (k) {
+            pos += k < mem ? mem : k;
+            mem = 0;
+            continue;
+        }
+
+        // right half of the factorization first, then the left one
+        k = ms + 1 > mem ? ms + 1 : mem;
+        while (k < needle_nbytes && pNeedle[k] == window[k]) {
+            k++;
+        }
+        if (k < needle_nbytes) {
+            pos += k - ms;
+            mem = 0;
+            continue;
+        }
+        k = ms + 1;
+        while (k > mem && pNeedle[k - 1] == window[k - 1]) {
+            k--;
+        }
+        if (k <= mem) {
+            return pos;
+        }
+        pos += period;
+        mem = mem0;
+    }
+    return NOT_FOUND;
+}
+
+/**
+ * Returns the byte offset of the first occurrence of the needle, NOT_FOUND if there is none
+ */
+static size_t
+find_bytes(const uint8_t *pHaystack, const size_t nbytes, const uint8_t *pNeedle, const size_t needle_nbytes) {
+    if (!needle_nbytes) {
+        return 0;
+    }
+    if (needle_nbytes > nbytes) {
+        return NOT_FOUND;
+    }
+    if (needle_nbytes == 1) {
+        const uint8_t *p = memchr(pHaystack, pNeedle[0], nbytes);
+        return p != NULL ? (size_t) (p - pHaystack) : NOT_FOUND;
+    }
+    if (needle_nbytes >= UNICODE_FIND_TWO_WAY_MIN) {
+        return find_two_way(pHaystack, nbytes, pNeedle, needle_nbytes);
+    }
+
+    size_t pos = 0;
+#ifdef UNICODE_SIMD_X86
+    // a lead byte is shared by a whole script (every Cyrillic letter starts with D0 or D1), the byte after it isn't
+    const size_t head = pNeedle[0] >= 0xC0 && needle_nbytes > 2 ? 1 : 0;
+    const size_t found = unicode_cpu_has_avx2()
+                             ? find_filtered_avx2(pHaystack, nbytes, pNeedle, needle_nbytes, head, &pos)
+                             : find_filtered_sse2(pHaystack, nbytes, pNeedle, needle_nbytes, head, &pos);
+    if (found != NOT_FOUND) {
+        return found;
+    }
+#endif
+    return find_scalar(pHaystack, nbytes, pNeedle, needle_nbytes, pos);
+}
+
+int
+unicode_find(const uint8_t *pHaystack, const size_t nbytes, const uint8_t *pNeedle, const size_t needle_nbytes,
+             UnicodeMatch *pMatch) {
+    const size_t offset = find_bytes(pHaystack, nbytes, pNeedle, needle_nbytes);
+    if (offset == NOT_FOUND) {
+        return 0;
+    }
+    *pMatch = (UnicodeMatch){offset, count_utf8_leads(pHaystack, offset), 0};
+    return 1;
+}
+
+int
+unicode_find_any(const uint8_t *pHaystack, const size_t nbytes, const uint8_t *const *pNeedles,
+                 const size_t *pNeedleSizes, const size_t count, UnicodeMatch *pMatch) {
+    size_t best = NOT_FOUND;
+    size_t best_needle = 0;
+
+    for (size_t k = 0; k < count && best; k++) {
+        // only a match starting before the best one can win
+        size_t limit = nbytes;
+        if (best != NOT_FOUND && best - 1 + pNeedleSizes[k] < nbytes) {
+            limit = best - 1 + pNeedleSizes[k];
+        }
+        const size_t offset = find_bytes(pHaystack, limit, pNeedles[k], pNeedleSizes[k]);
+        if (offset != NOT_FOUND) {
+            best = offset;
+            best_needle = k;
+        }
+    }
+    if (best == NOT_FOUND) {
+        return 0;
+    }
+    *pMatch = (UnicodeMatch){best, count_utf8_leads(pHaystack, best), best_needle};
+    return 1;
+}
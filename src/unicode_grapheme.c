@@ -0,0 +1,275 @@
+//
+// Grapheme cluster segmentation through tables generated from the UCD, see tools/unicode_gen_tables.c.
+//
+
+#include <string.h>
+
+#include "unicode_grapheme.h"
+#include "unicode_grapheme_tables.h"
+#include "unicode_internal.h"
+
+/**
+ * GB11 state: nothing, `ExtPict Extend*` or `ExtPict Extend* ZWJ` seen last
+ */
+#define EMOJI_NONE 0
+#define EMOJI_PICTOGRAPH 1
+#define EMOJI_ZWJ 2
+
+/**
+ * Grapheme table value of a code point, printable ASCII is all Other
+ */
+static inline uint8_t
+grapheme_value(const uint32_t code_point) {
+    return code_point - 0x20 < 0x5F ? GRAPHEME_OTHER : grapheme_lookup(code_point);
+}
+
+/**
+ * Whether a cluster boundary precedes a code point with grapheme table value `value`, given the code points seen before
+ * it. GB1 is up to the caller
+ */
+static inline int
+grapheme_breaks(const UnicodeGraphemeBreaker *breaker, const uint8_t value) {
+    const uint8_t cur = value & GRAPHEME_BREAK_MASK;
+    if (breaker->prev == GRAPHEME_REGIONAL_INDICATOR && cur == GRAPHEME_REGIONAL_INDICATOR) {
+        // GB12, GB13: regional indicators pair up from the start of a run
+        return !breaker->ri_odd;
+    }
+    if (breaker->prev == GRAPHEME_ZWJ && (value & GRAPHEME_PICTOGRAPHIC) && breaker->emoji == EMOJI_ZWJ) {
+        return 0;
+    }
+    return GRAPHEME_PAIR_BREAKS[breaker->prev][cur];
+}
+
+/**
+ * Makes a code point with grapheme table value `value` the last one seen
+ */
+static inline void
+grapheme_advance(UnicodeGraphemeBreaker *breaker, const uint8_t value) {
+    const uint8_t cur = value & GRAPHEME_BREAK_MASK;
+    breaker->ri_odd = cur == GRAPHEME_REGIONAL_INDICATOR && !breaker->ri_odd;
+    if (value & GRAPHEME_PICTOGRAPHIC) {
+        breaker->emoji = EMOJI_PICTOGRAPH;
+    } else if (breaker->emoji == EMOJI_PICTOGRAPH && (cur == GRAPHEME_EXTEND || cur == GRAPHEME_ZWJ)) {
+        breaker->emoji = cur == GRAPHEME_ZWJ ? EMOJI_ZWJ : EMOJI_PICTOGRAPH;
+    } else {
+        breaker->emoji = EMOJI_NONE;
+    }
+    breaker->prev = cur;
+}
+
+/**
+ * Decodes the code point at pStr, an ill-formed or truncated sequence gives one UNICODE_REPLACEMENT_CHAR per byte
+ * @return number of bytes decoded
+ */
+static inline uint8_t
+grapheme_decode(const uint8_t *pStr, const uint8_t *pEnd, uint32_t *pCodePoint) {
+    if (*pStr < 0x80) {
+        *pCodePoint = *pStr;
+        return 1;
+    }
+    const uint8_t len = utf8_sequence_len(pStr, pEnd);
+    if (!len) {
+        *pCodePoint = UNICODE_REPLACEMENT_CHAR;
+        return 1;
+    }
+    *pCodePoint = decode_utf8_valid(pStr, len);
+    return len;
+}
+
+/**
+ * Whether pStr[0..len) is the head of a well-formed sequence that more bytes could complete
+ */
+static int
+is_sequence_head(const uint8_t *pStr, const size_t len) {
+    const uint8_t lead = pStr[0];
+    uint8_t octets, low = 0x80, high = 0xBF;
+
+    if (lead < 0xC2 || lead > 0xF4) {
+        return 0;
+    } else if (lead < 0xE0) {
+        octets = 2;
+    } else if (lead < 0xF0) {
+        octets = 3;
+        low = lead == 0xE0 ? 0xA0 : 0x80;
+        high = lead == 0xED ? 0x9F : 0xBF;
+    } else {
+        octets = 4;
+        low = lead == 0xF0 ? 0x90 : 0x80;
+        high = lead == 0xF4 ? 0x8F : 0xBF;
+    }
+
+    if (len >= octets || (len > 1 && (pStr[1] < low || pStr[1] > high))) {
+        return 0;
+    }
+    for (size_t i = 2; i < len; i++) {
+        if ((pStr[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void
+unicode_grapheme_init(UnicodeGraphemeBreaker *breaker) {
+    *breaker = (UnicodeGraphemeBreaker){0};
+}
+
+size_t
+unicode_grapheme_feed(UnicodeGraphemeBreaker *breaker, const uint8_t *chunk, const size_t len, size_t *pBreaks,
+                      const size_t cap, size_t *pConsumed) {
+    // stream offset of chunk[0]; pending bytes are the ones right before chunk[i]
+    const size_t base = breaker->offset;
+    size_t count = 0;
+    size_t i = 0;
+
+    while (breaker->pending_len && i < len) {
+        // complete the sequence started by a previous chunk
+        uint8_t buf[4];
+        const size_t pending_len = breaker->pending_len;
+        const size_t taken = len - i < 4 - pending_len ? len - i : 4 - pending_len;
+        memcpy(buf, breaker->pending, pending_len);
+        memcpy(buf + pending_len, chunk + i, taken);
+        if (is_sequence_head(buf, pending_len + taken)) {
+            memcpy(breaker->pending + pending_len, chunk + i, taken);
+            breaker->pending_len = (uint8_t) (pending_len + taken);
+            i += taken;
+            break;
+        }
+
+        uint32_t code_point;
+        const uint8_t seq_len = grapheme_decode(buf, buf + pending_len + taken, &code_point);
+        const uint8_t value = grapheme_value(code_point);
+        const size_t start = base + i - pending_len;
+        if (start == 0 || grapheme_breaks(breaker, value)) {
+            if (count == cap) {
+                break;
+            }
+            pBreaks[count++] = start;
+        }
+        grapheme_advance(breaker, value);
+        if (seq_len >= pending_len) {
+            i += seq_len - pending_len;
+            breaker->pending_len = 0;
+        } else {
+            breaker->pending_len = (uint8_t) (pending_len - seq_len);
+            memmove(breaker->pending, breaker->pending + seq_len, breaker->pending_len);
+        }
+    }
+
+    while (!breaker->pending_len && i < len) {
+        uint32_t code_point;
+        const uint8_t seq_len = grapheme_decode(chunk + i, chunk + len, &code_point);
+        if (seq_len == 1 && chunk[i] >= 0x80 && is_sequence_head(chunk + i, len - i)) {
+            // sequence continues in the next chunk
+            breaker->pending_len = (uint8_t) (len - i);
+            memcpy(breaker->pending, chunk + i, breaker->pending_len);
+            i = len;
+            break;
+        }
+
+        const uint8_t value = grapheme_value(code_point);
+        if (base + i == 0 || grapheme_breaks(breaker, value)) {
+            if (count == cap) {
+                break;
+            }
+            pBreaks[count++] = base + i;
+        }
+        grapheme_advance(breaker, value);
+        i += seq_len;
+    }
+
+    breaker->offset = base + i;
+    if (pConsumed != NULL) {
+        *pConsumed = i;
+    }
+    return count;
+}
+
+size_t
+unicode_grapheme_finish(UnicodeGraphemeBreaker *breaker, size_t *pBreaks, const size_t cap) {
+    // pending bytes are the end of input now: none of them can be completed, each is a U+FFFD
+    const uint8_t value = grapheme_value(UNICODE_REPLACEMENT_CHAR);
+    size_t count = 0;
+
+    while (breaker->pending_len) {
+        const size_t start = breaker->offset - breaker->pending_len;
+        if (start == 0 || grapheme_breaks(breaker, value)) {
+            if (count == cap) {
+                return count;
+            }
+            pBreaks[count++] = start;
+        }
+        grapheme_advance(breaker, value);
+        breaker->pending_len--;
+        memmove(breaker->pending, breaker->pending + 1, breaker->pending_len);
+    }
+
+    if (breaker->offset) {
+        if (count == cap) {
+            return count;
+        }
+        pBreaks[count++] = breaker->offset;
+    }
+    unicode_grapheme_init(breaker);
+    return count;
+}
+
+size_t
+unicode_grapheme_next(const uint8_t *pStr, const size_t nbytes, size_t offset) {
+    const uint8_t *pEnd = pStr + nbytes;
+    UnicodeGraphemeBreaker breaker = {0};
+    uint32_t code_point;
+
+    if (offset >= nbytes) {
+        return nbytes;
+    }
+    if (offset + 1 < nbytes && pStr[offset] - 0x20u < 0x5F && pStr[offset + 1] - 0x20u < 0x5F) {
+        // printable ASCII followed by printable ASCII: GB999, the common case of text
+        return offset + 1;
+    }
+    // the first code point starts the cluster whatever it is
+    offset += grapheme_decode(pStr + offset, pEnd, &code_point);
+    grapheme_advance(&breaker, grapheme_value(code_point));
+
+    while (offset < nbytes) {
+        const uint8_t seq_len = grapheme_decode(pStr + offset, pEnd, &code_point);
+        const uint8_t value = grapheme_value(code_point);
+        if (grapheme_breaks(&breaker, value)) {
+            break;
+        }
+        grapheme_advance(&breaker, value);
+        offset += seq_len;
+    }
+    return offset;
+}
+
+/**
+ * Code point of the char at i of self, invalid byte slots are U+FFFD
+ */
+static inline uint32_t
+ustr_code_point_at(const UnicodeString *self, const size_t i) {
+    if (self->layout == USTR_LAYOUT_UTF32) {
+        return self->code_points[i];
+    }
+    const UnicodeChar uchar = ustr_char_at(self, i);
+    return get_octets_num(uchar.octet) == uchar.size ? unicode_ord(uchar) : UNICODE_REPLACEMENT_CHAR;
+}
+
+size_t
+ustr_grapheme_next(const UnicodeString *self, size_t index) {
+    UnicodeGraphemeBreaker breaker = {0};
+
+    if (index >= self->len) {
+        return self->len;
+    }
+    grapheme_advance(&breaker, grapheme_value(ustr_code_point_at(self, index++)));
+
+    for (; index < self->len; index++) {
+        const uint8_t value = grapheme_value(ustr_code_point_at(self, index));
+        if (grapheme_breaks(&breaker, value)) {
+            break;
+        }
+        grapheme_advance(&breaker, value);
+    }
+    return index;
+}
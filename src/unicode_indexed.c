@@ -0,0 +1,128 @@
+//
+// Compact UTF-8 string with a sparse char index.
+//
+
+#include <string.h>
+
+#include "unicode_indexed.h"
+#include "unicode_internal.h"
+#include "unicode_simd.h"
+
+#define STRIDES_PER_BLOCK (UNICODE_INDEX_BLOCK / UNICODE_INDEX_STRIDE)
+
+/**
+ * Size of the single allocation holding the struct, the index and the bytes. Every char takes at least one byte, so
+ * `nbytes` bounds the number of index entries and the size can be computed before the chars are counted
+ */
+static size_t
+indexed_ustr_size(const size_t nbytes) {
+    return sizeof(UnicodeIndexedString) + (nbytes / UNICODE_INDEX_BLOCK + 1) * sizeof(size_t) +
+           (nbytes / UNICODE_INDEX_STRIDE + 1) * sizeof(uint16_t) + nbytes + 1;
+}
+
+static size_t
+skip_chars(const int well_formed, const uint8_t *pStr, const size_t nbytes, size_t *pCount) {
+    return well_formed ? utf8_skip_chars_valid(pStr, nbytes, pCount) : utf8_skip_chars(pStr, nbytes, pCount);
+}
+
+UnicodeIndexedString *
+read_into_indexed_ustr(const uint8_t *pStr, const size_t nbytes, const uint32_t flags) {
+    return read_into_indexed_ustr_with_allocator(pStr, nbytes, flags, NULL);
+}
+
+UnicodeIndexedString *
+read_into_indexed_ustr_with_allocator(const uint8_t *pStr, const size_t nbytes, const uint32_t flags,
+                                      const UnicodeAllocator *allocator) {
+    const int well_formed = unicode_validate(pStr, nbytes, NULL);
+    if (flags & UNICODE_DECODE_STRICT && !well_formed) {
+        return NULL;
+    }
+    if (allocator == NULL) {
+        allocator = unicode_get_default_allocator();
+    }
+
+    UnicodeIndexedString *str = unicode_alloc(allocator, indexed_ustr_size(nbytes));
+    if (str == NULL) {
+        return NULL;
+    }
+
+    size_t *blocks = (size_t *) (str + 1);
+    uint16_t *strides = (uint16_t *) (blocks + nbytes / UNICODE_INDEX_BLOCK + 1);
+    uint8_t *bytes = (uint8_t *) (strides + nbytes / UNICODE_INDEX_STRIDE + 1);
+    memcpy(bytes, pStr, nbytes);
+    bytes[nbytes] = '\0';
+
+    size_t offset = 0;
+    size_t len = 0;
+    for (size_t k = 0;; k++) {
+        if (k % STRIDES_PER_BLOCK == 0) {
+            blocks[k / STRIDES_PER_BLOCK] = offset;
+        }
+        // at most 63 strides of 4-byte chars past the block offset, fits 16 bits
+        strides[k] = (uint16_t) (offset - blocks[k / STRIDES_PER_BLOCK]);
+
+        size_t count = UNICODE_INDEX_STRIDE;
+        offset += skip_chars(well_formed, bytes + offset, nbytes - offset, &count);
+        len += count;
+        if (count < UNICODE_INDEX_STRIDE || offset == nbytes) {
+            break;
+        }
+    }
+
+    str->bytes = bytes;
+    str->nbytes = nbytes;
+    str->len = len;
+    str->blocks = blocks;
+    str->strides = strides;
+    str->well_formed = well_formed;
+    str->allocator = allocator;
+    return str;
+}
+
+void
+free_indexed_ustr(UnicodeIndexedString *self) {
+    unicode_release(self->allocator, self, indexed_ustr_size(self->nbytes));
+}
+
+size_t
+indexed_ustr_offset_of(const UnicodeIndexedString *self, const size_t index) {
+    if (index >= self->len) {
+        return self->nbytes;
+    }
+
+    const size_t k = index / UNICODE_INDEX_STRIDE;
+    const size_t offset = self->blocks[k / STRIDES_PER_BLOCK] + self->strides[k];
+    size_t count = index % UNICODE_INDEX_STRIDE;
+    return offset + skip_chars(self->well_formed, self->bytes + offset, self->nbytes - offset, &count);
+}
+
+UnicodeChar
+indexed_ustr_char_at(const UnicodeIndexedString *self, const size_t index) {
+    UnicodeChar uchar = {{0, 0, 0, 0}, 0};
+    if (index < self->len) {
+        const size_t offset = indexed_ustr_offset_of(self, index);
+        const UnicodeView view = unicode_view(self->bytes + offset, self->nbytes - offset);
+        unicode_view_peek(&view, &uchar);
+    }
+    return uchar;
+}
+
+uint32_t
+indexed_ustr_ord_at(const UnicodeIndexedString *self, const size_t index) {
+    return uchar_to_code_point(indexed_ustr_char_at(self, index));
+}
+
+UnicodeView
+indexed_ustr_view(const UnicodeIndexedString *self) {
+    return unicode_view(self->bytes, self->nbytes);
+}
+
+UnicodeView
+indexed_ustr_slice(const UnicodeIndexedString *self, const size_t start, size_t end) {
+    if (end > self->len) {
+        end = self->len;
+    }
+    const size_t start_offset = indexed_ustr_offset_of(self, start < end ? start : end);
+    const size_t end_offset = indexed_ustr_offset_of(self, end);
+    return unicode_view(self->bytes + start_offset, end_offset - start_offset);
+}
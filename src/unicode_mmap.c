@@ -0,0 +1,231 @@
+//
+// Read-only memory-mapped UTF-8 files.
+//
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "unicode_mmap.h"
+#include "unicode_internal.h"
+#include "unicode_simd.h"
+
+/**
+ * Drops pages of file bytes [*pReleased, offset) from the process once a whole window of them is done
+ */
+static void
+release_behind(const UnicodeMappedFile *file, size_t *pReleased, const size_t offset) {
+    const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    const size_t end = offset - offset % page_size;
+    if (end - *pReleased < UNICODE_MAP_WINDOW) {
+        return;
+    }
+    // the mapping is private and never written, so dropped pages are read back from the page cache on access
+    madvise((void *) (file->view.p + *pReleased), end - *pReleased, MADV_DONTNEED);
+    *pReleased = end;
+}
+
+/**
+ * Skips whole chars from offset until `end` is reached, at most 3 bytes past it (or the end of the file)
+ * @param pChars incremented by the number of chars skipped
+ * @return offset past the skipped chars
+ */
+static size_t
+skip_chars_to(const UnicodeView *view, size_t offset, const size_t end, size_t *pChars) {
+    while (offset < end) {
+        // a char takes at most 4 bytes, so this many chars never cross `end` by a whole char
+        size_t count = (end - offset + 3) / 4;
+        offset += utf8_skip_chars(view->p + offset, view->nbytes - offset, &count);
+        *pChars += count;
+        if (!count) {
+            break;
+        }
+    }
+    return offset;
+}
+
+UnicodeMappedFile *
+unicode_map_file(const char *path) {
+    const UnicodeAllocator *allocator = unicode_get_default_allocator();
+    struct stat st;
+
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    const int stat_failed = fstat(fd, &st) < 0;
+    if (stat_failed || !S_ISREG(st.st_mode)) {
+        const int error = stat_failed ? errno : EINVAL;
+        close(fd);
+        errno = error;
+        return NULL;
+    }
+
+    UnicodeMappedFile *file = unicode_alloc(allocator, sizeof(UnicodeMappedFile));
+    if (file == NULL) {
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+    *file = (UnicodeMappedFile){{NULL, 0}, allocator};
+
+    if (st.st_size > 0) {
+        void *addr = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            const int error = errno;
+            close(fd);
+            unicode_release(allocator, file, sizeof(UnicodeMappedFile));
+            errno = error;
+            return NULL;
+        }
+        madvise(addr, (size_t) st.st_size, MADV_SEQUENTIAL);
+        file->view = unicode_view(addr, (size_t) st.st_size);
+    }
+    close(fd);
+
+    return file;
+}
+
+void
+unicode_unmap_file(UnicodeMappedFile *file) {
+    if (file->view.nbytes) {
+        munmap((void *) file->view.p, file->view.nbytes);
+    }
+    unicode_release(file->allocator, file, sizeof(UnicodeMappedFile));
+}
+
+int
+unicode_mapped_validate(const UnicodeMappedFile *file, size_t *pErrorOffset) {
+    const uint8_t *pStr = file->view.p;
+    const size_t nbytes = file->view.nbytes;
+    size_t released = 0;
+
+    for (size_t offset = 0; offset < nbytes;) {
+        size_t end = nbytes - offset > UNICODE_MAP_WINDOW ? offset + UNICODE_MAP_WINDOW : nbytes;
+        // don't cut a sequence: end on a lead byte, more than 3 continuation bytes in a row are ill-formed anyway
+        for (int back = 0; back < 3 && end < nbytes && (pStr[end] & 0xC0) == 0x80; back++) {
+            end--;
+        }
+
+        size_t error_offset;
+        if (!unicode_validate(pStr + offset, end - offset, &error_offset)) {
+            if (pErrorOffset != NULL) {
+                *pErrorOffset = offset + error_offset;
+            }
+            return 0;
+        }
+        offset = end;
+        release_behind(file, &released, offset);
+    }
+    return 1;
+}
+
+size_t
+unicode_mapped_count(const UnicodeMappedFile *file) {
+    const size_t nbytes = file->view.nbytes;
+    size_t chars = 0;
+    size_t released = 0;
+
+    for (size_t offset = 0; offset < nbytes;) {
+        const size_t end = nbytes - offset > UNICODE_MAP_WINDOW ? offset + UNICODE_MAP_WINDOW : nbytes;
+        offset = skip_chars_to(&file->view, offset, end, &chars);
+        release_behind(file, &released, offset);
+    }
+    return chars;
+}
+
+void
+unicode_mapped_iter_init(UnicodeMappedIterator *it, const UnicodeMappedFile *file) {
+    *it = (UnicodeMappedIterator){file, 0, 0};
+}
+
+int
+unicode_mapped_next_chunk(UnicodeMappedIterator *it, UnicodeView *pOut) {
+    const UnicodeView *view = &it->file->view;
+    if (it->offset >= view->nbytes) {
+        return 0;
+    }
+
+    release_behind(it->file, &it->released, it->offset);
+    const size_t start = it->offset;
+    const size_t end = view->nbytes - start > UNICODE_MAP_WINDOW ? start + UNICODE_MAP_WINDOW : view->nbytes;
+    size_t chars = 0;
+    it->offset = skip_chars_to(view, start, end, &chars);
+    *pOut = unicode_view(view->p + start, it->offset - start);
+    return 1;
+}
+
+/**
+ * Converts the file block by block: `unit_size` is 2 for UTF-16 and 4 for UTF-32. Every input byte makes at most one
+ * code unit, so input is read in steps of as many bytes as the block holds units
+ */
+static int
+mapped_transcode_fd(const UnicodeMappedFile *file, const int fd, const UnicodeByteOrder order, const size_t unit_size,
+                    UnicodeTranscodeResult *pResult) {
+    union {
+        uint8_t bytes[UNICODE_WRITE_BLOCK_SIZE];
+        uint16_t utf16[UNICODE_WRITE_BLOCK_SIZE / sizeof(uint16_t)];
+        uint32_t utf32[UNICODE_WRITE_BLOCK_SIZE / sizeof(uint32_t)];
+    } block;
+    const size_t step = UNICODE_WRITE_BLOCK_SIZE / unit_size;
+    const int swap_utf32 = (order == UNICODE_BIG_ENDIAN) != (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__);
+    const uint8_t *pStr = file->view.p;
+    const size_t nbytes = file->view.nbytes;
+    UnicodeTranscodeResult total = {0, 0, 0};
+    size_t released = 0;
+    int status = 0;
+
+    while (total.consumed < nbytes) {
+        const size_t len = nbytes - total.consumed < step ? nbytes - total.consumed : step;
+        UnicodeTranscodeResult result = unit_size == sizeof(uint16_t)
+                                            ? utf8_to_utf16(pStr + total.consumed, len, block.utf16, step, order)
+                                            : utf8_to_utf32(pStr + total.consumed, len, block.utf32);
+        if (!result.consumed) {
+            // only a char truncated by the end of the file is left unconsumed by a step
+            result = (UnicodeTranscodeResult){len, 1, 1};
+            if (unit_size == sizeof(uint16_t)) {
+                const uint8_t high = UNICODE_REPLACEMENT_CHAR >> 8, low = UNICODE_REPLACEMENT_CHAR & 0xFF;
+                block.bytes[0] = order == UNICODE_BIG_ENDIAN ? high : low;
+                block.bytes[1] = order == UNICODE_BIG_ENDIAN ? low : high;
+            } else {
+                block.utf32[0] = UNICODE_REPLACEMENT_CHAR;
+            }
+        }
+        if (unit_size == sizeof(uint32_t) && swap_utf32) {
+            for (size_t i = 0; i < result.produced; i++) {
+                block.utf32[i] = __builtin_bswap32(block.utf32[i]);
+            }
+        }
+
+        if (write_all(fd, block.bytes, result.produced * unit_size) < 0) {
+            status = -1;
+            break;
+        }
+        total.consumed += result.consumed;
+        total.produced += result.produced;
+        total.replaced += result.replaced;
+        release_behind(file, &released, total.consumed);
+    }
+
+    if (pResult != NULL) {
+        *pResult = total;
+    }
+    return status;
+}
+
+int
+unicode_mapped_to_utf16_fd(const UnicodeMappedFile *file, const int fd, const UnicodeByteOrder order,
+                           UnicodeTranscodeResult *pResult) {
+    return mapped_transcode_fd(file, fd, order, sizeof(uint16_t), pResult);
+}
+
+int
+unicode_mapped_to_utf32_fd(const UnicodeMappedFile *file, const int fd, const UnicodeByteOrder order,
+                           UnicodeTranscodeResult *pResult) {
+    return mapped_transcode_fd(file, fd, order, sizeof(uint32_t), pResult);
+}
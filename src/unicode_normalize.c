@@ -0,0 +1,371 @@
+//
+// Normalization forms through tables generated from the UCD, see tools/unicode_gen_tables.c.
+//
+
+#include <string.h>
+
+#include "unicode_normalize.h"
+#include "unicode_normalize_tables.h"
+#include "unicode_internal.h"
+#include "unicode_simd.h"
+
+/**
+ * Hangul syllables decompose into conjoining jamo and compose back algorithmically (Unicode 3.12)
+ */
+#define HANGUL_S_BASE 0xAC00
+#define HANGUL_L_BASE 0x1100
+#define HANGUL_V_BASE 0x1161
+#define HANGUL_T_BASE 0x11A7
+#define HANGUL_L_COUNT 19
+#define HANGUL_V_COUNT 21
+#define HANGUL_T_COUNT 28
+#define HANGUL_S_COUNT 11172
+
+/**
+ * Segment entries hold a code point in bits 0..23 and its combining class in bits 24..31
+ */
+#define SEGMENT_INLINE 64
+#define ENTRY_CODE_POINT(entry) ((entry) & 0xFFFFFF)
+#define ENTRY_CCC(entry) ((entry) >> 24)
+
+/**
+ * Code points of the combining sequence being normalized, in entries on the stack until they don't fit
+ */
+typedef struct Segment_s {
+    uint32_t *entries;
+    size_t len;
+    size_t cap;
+    uint32_t inline_entries[SEGMENT_INLINE];
+} Segment;
+
+static inline uint16_t
+norm_value(const uint32_t code_point) {
+    return NORM_VALUES[norm_lookup(code_point)];
+}
+
+/**
+ * Whether text before a char with NORM_VALUES entry `value` is not affected by the char and what follows it: the char
+ * is a starter that is normalized in form and never composes with a previous one
+ */
+static inline int
+is_boundary(const uint16_t value, const UnicodeNormalizationForm form) {
+    return !NORM_CCC(value) && NORM_QC(value, form) == NORM_QC_YES;
+}
+
+/**
+ * Quick check of pStr[0..nbytes): scans it while it is certainly normalized in form
+ * @return nbytes if the text is normalized, otherwise offset of the boundary the first combining sequence that needs
+ * normalization starts at
+ */
+static size_t
+quick_check(const uint8_t *pStr, const size_t nbytes, const UnicodeNormalizationForm form) {
+    const uint8_t *pEnd = pStr + nbytes;
+    const uint32_t qc_min = NORM_QC_MIN[form];
+    size_t boundary = 0;
+    uint8_t last_ccc = 0;
+    size_t i = 0;
+
+    while (i < nbytes) {
+        const uint8_t byte = pStr[i];
+        if (byte < 0x80) {
+            // ASCII chars are starters normalized in every form
+            i += i + 1 < nbytes && pStr[i + 1] < 0x80 ? ascii_prefix_len(pStr + i, nbytes - i) : 1;
+            boundary = i - 1;
+            last_ccc = 0;
+            continue;
+        }
+
+        uint32_t code_point;
+        uint8_t len;
+        if (byte >= 0xC2 && byte < 0xE0 && i + 1 < nbytes && (pStr[i + 1] & 0xC0) == 0x80) {
+            code_point = (uint32_t) (byte & 0x1F) << 6 | (pStr[i + 1] & 0x3F);
+            len = 2;
+            if (code_point < qc_min) {
+                // Latin-1 letters in NFC, say: no lookup needed
+                boundary = i;
+                last_ccc = 0;
+                i += 2;
+                continue;
+            }
+        } else {
+            len = utf8_sequence_len(pStr + i, pEnd);
+            if (!len) {
+                // ill-formed bytes are copied as they are, nothing composes with them
+                boundary = i;
+                last_ccc = 0;
+                i++;
+                continue;
+            }
+            code_point = decode_utf8_valid(pStr + i, len);
+        }
+
+        const uint16_t value = norm_value(code_point);
+        const uint8_t ccc = NORM_CCC(value);
+        if ((ccc && last_ccc > ccc) || NORM_QC(value, form) != NORM_QC_YES) {
+            return boundary;
+        }
+        if (!ccc) {
+            boundary = i;
+        }
+        last_ccc = ccc;
+        i += len;
+    }
+    return nbytes;
+}
+
+/**
+ * Appends a code point to segment, moving entries to the heap once they don't fit on the stack
+ * @return 0 if allocation fails
+ */
+static int
+segment_push(Segment *segment, const uint32_t code_point, const uint8_t ccc) {
+    if (segment->len == segment->cap) {
+        const UnicodeAllocator *allocator = unicode_get_default_allocator();
+        const size_t size = segment->cap * sizeof(uint32_t);
+        uint32_t *entries;
+        if (segment->entries == segment->inline_entries) {
+            entries = unicode_alloc(allocator, 2 * size);
+            if (entries != NULL) {
+                memcpy(entries, segment->entries, size);
+            }
+        } else {
+            entries = unicode_resize(allocator, segment->entries, size, 2 * size);
+        }
+        if (entries == NULL) {
+            return 0;
+        }
+        segment->entries = entries;
+        segment->cap *= 2;
+    }
+    segment->entries[segment->len++] = code_point | (uint32_t) ccc << 24;
+    return 1;
+}
+
+/**
+ * Appends the full decomposition of a code point to segment, the compatibility one for NFKC and NFKD
+ * @return 0 if allocation fails
+ */
+static int
+segment_decompose(Segment *segment, const uint32_t code_point, const uint16_t value,
+                  const UnicodeNormalizationForm form) {
+    if (code_point - HANGUL_S_BASE < HANGUL_S_COUNT) {
+        const uint32_t index = code_point - HANGUL_S_BASE;
+        const uint32_t trailing = index % HANGUL_T_COUNT;
+        return segment_push(segment, HANGUL_L_BASE + index / (HANGUL_V_COUNT * HANGUL_T_COUNT), 0)
+               && segment_push(segment, HANGUL_V_BASE + index % (HANGUL_V_COUNT * HANGUL_T_COUNT) / HANGUL_T_COUNT, 0)
+               && (!trailing || segment_push(segment, HANGUL_T_BASE + trailing, 0));
+    }
+
+    const uint16_t entry = decomposition_lookup(code_point);
+    const uint16_t header = NORM_DECOMPOSITIONS[entry];
+    const uint16_t *units = NORM_DECOMPOSITIONS + entry + 1;
+    size_t count = NORM_CANONICAL_UNITS(header);
+    if ((form == UNICODE_NFKC || form == UNICODE_NFKD) && NORM_COMPAT_UNITS(header)) {
+        units += count;
+        count = NORM_COMPAT_UNITS(header);
+    }
+    if (!entry || !count) {
+        return segment_push(segment, code_point, NORM_CCC(value));
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t part = units[i];
+        if (part >= 0xD800 && part < 0xDC00) {
+            part = 0x10000 + ((part - 0xD800) << 10 | (units[++i] - 0xDC00));
+        }
+        if (!segment_push(segment, part, NORM_CCC(norm_value(part)))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Canonical ordering: a stable sort of every run of non-starters by combining class
+ */
+static void
+segment_reorder(Segment *segment) {
+    uint32_t *entries = segment->entries;
+    for (size_t i = 1; i < segment->len; i++) {
+        const uint32_t entry = entries[i];
+        const uint32_t ccc = ENTRY_CCC(entry);
+        size_t k = i;
+        // starters have class 0 and never move
+        while (k > 0 && ENTRY_CCC(entries[k - 1]) > ccc && ccc) {
+            entries[k] = entries[k - 1];
+            k--;
+        }
+        entries[k] = entry;
+    }
+}
+
+/**
+ * Primary composite of a canonical pair, 0 if there is none
+ */
+static uint32_t
+compose_pair(const uint32_t first, const uint32_t second) {
+    if (first - HANGUL_L_BASE < HANGUL_L_COUNT && second - HANGUL_V_BASE < HANGUL_V_COUNT) {
+        return HANGUL_S_BASE + ((first - HANGUL_L_BASE) * HANGUL_V_COUNT + second - HANGUL_V_BASE) * HANGUL_T_COUNT;
+    }
+    if (first - HANGUL_S_BASE < HANGUL_S_COUNT && (first - HANGUL_S_BASE) % HANGUL_T_COUNT == 0
+        && second - (HANGUL_T_BASE + 1) < HANGUL_T_COUNT - 1) {
+        return first + second - HANGUL_T_BASE;
+    }
+
+    size_t low = 0;
+    size_t high = sizeof(NORM_COMPOSITIONS) / sizeof(*NORM_COMPOSITIONS);
+    while (low < high) {
+        const size_t mid = low + (high - low) / 2;
+        const uint32_t *pair = NORM_COMPOSITIONS[mid];
+        if (pair[0] < first || (pair[0] == first && pair[1] < second)) {
+            low = mid + 1;
+        } else if (pair[0] == first && pair[1] == second) {
+            return pair[2];
+        } else {
+            high = mid;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Canonical composition of a reordered segment in place: every char that is not blocked from the last starter and
+ * forms a primary composite with it replaces the starter
+ */
+static void
+segment_compose(Segment *segment) {
+    uint32_t *entries = segment->entries;
+    size_t starter = SIZE_MAX;
+    uint32_t last_ccc = 0;
+    size_t len = 0;
+
+    for (size_t i = 0; i < segment->len; i++) {
+        const uint32_t entry = entries[i];
+        const uint32_t ccc = ENTRY_CCC(entry);
+        // adjacent to the starter, or every char in between has a lower class (they are sorted, the last is highest)
+        if (starter != SIZE_MAX && (len == starter + 1 || last_ccc < ccc)) {
+            const uint32_t composite = compose_pair(entries[starter], ENTRY_CODE_POINT(entry));
+            if (composite) {
+                entries[starter] = composite;
+                continue;
+            }
+        }
+        if (!ccc) {
+            starter = len;
+        }
+        last_ccc = ccc;
+        entries[len++] = entry;
+    }
+    segment->len = len;
+}
+
+/**
+ * Copies pStr[0..len) to pOut at *pProduced if it fits into cap, advancing *pProduced either way
+ */
+static inline void
+put_bytes(uint8_t *pOut, const size_t cap, size_t *pProduced, const uint8_t *pStr, const size_t len) {
+    if (*pProduced + len <= cap) {
+        memcpy(pOut + *pProduced, pStr, len);
+    }
+    *pProduced += len;
+}
+
+/**
+ * Normalizes the combining sequence that starts at pStr[*pOffset], a boundary or the start of text, up to the next
+ * boundary and writes it to pOut, setting *pChanged if it differs from the text
+ * @return 0 if allocation fails
+ */
+static int
+normalize_segment(const uint8_t *pStr, const size_t nbytes, size_t *pOffset, const UnicodeNormalizationForm form,
+                  Segment *segment, uint8_t *pOut, const size_t cap, size_t *pProduced, int *pChanged) {
+    const uint8_t *pEnd = pStr + nbytes;
+    const size_t start = *pOffset;
+    size_t i = start;
+
+    segment->len = 0;
+    while (i < nbytes) {
+        const uint8_t len = pStr[i] < 0x80 ? 1 : utf8_sequence_len(pStr + i, pEnd);
+        if (!len) {
+            if (i == start) {
+                // an ill-formed byte is a sequence of its own and is copied as it is
+                put_bytes(pOut, cap, pProduced, pStr + i, 1);
+                i++;
+            }
+            break;
+        }
+        const uint32_t code_point = decode_utf8_valid(pStr + i, len);
+        const uint16_t value = norm_value(code_point);
+        if (i != start && is_boundary(value, form)) {
+            break;
+        }
+        if (!segment_decompose(segment, code_point, value, form)) {
+            return 0;
+        }
+        i += len;
+    }
+
+    segment_reorder(segment);
+    if (form == UNICODE_NFC || form == UNICODE_NFKC) {
+        segment_compose(segment);
+    }
+
+    size_t at = start;
+    for (size_t k = 0; k < segment->len; k++) {
+        const uint32_t code_point = ENTRY_CODE_POINT(segment->entries[k]);
+        const uint8_t len = utf8_encoded_len(code_point);
+        uint8_t bytes[4];
+        encode_utf8_char(code_point, len, bytes);
+        if (at + len > i || memcmp(bytes, pStr + at, len)) {
+            *pChanged = 1;
+        }
+        at += len;
+        put_bytes(pOut, cap, pProduced, bytes, len);
+    }
+    if (segment->len && at != i) {
+        *pChanged = 1;
+    }
+    *pOffset = i;
+    return 1;
+}
+
+size_t
+unicode_normalize(const uint8_t *pStr, const size_t nbytes, const UnicodeNormalizationForm form, uint8_t *pBuf,
+                  const size_t cap, UnicodeView *pOut) {
+    size_t i = quick_check(pStr, nbytes, form);
+    if (i == nbytes) {
+        *pOut = unicode_view(pStr, nbytes);
+        return nbytes;
+    }
+
+    Segment segment = {.len = 0, .cap = SEGMENT_INLINE};
+    segment.entries = segment.inline_entries;
+    size_t produced = 0;
+    int changed = 0;
+    int ok = 1;
+
+    put_bytes(pBuf, cap, &produced, pStr, i);
+    while (i < nbytes) {
+        if (!normalize_segment(pStr, nbytes, &i, form, &segment, pBuf, cap, &produced, &changed)) {
+            ok = 0;
+            break;
+        }
+        // what follows a boundary is likely normalized again
+        const size_t normalized = quick_check(pStr + i, nbytes - i, form);
+        put_bytes(pBuf, cap, &produced, pStr + i, normalized);
+        i += normalized;
+    }
+
+    if (segment.entries != segment.inline_entries) {
+        unicode_release(unicode_get_default_allocator(), segment.entries, segment.cap * sizeof(uint32_t));
+    }
+    if (!ok) {
+        *pOut = (UnicodeView){NULL, 0};
+        return UNICODE_NORMALIZE_FAILED;
+    }
+    if (!changed) {
+        *pOut = unicode_view(pStr, nbytes);
+        return nbytes;
+    }
+    *pOut = produced <= cap ? unicode_view(pBuf, produced) : (UnicodeView){NULL, 0};
+    return produced;
+}
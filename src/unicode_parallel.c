@@ -0,0 +1,186 @@
+//
+// Multithreaded counting, validation and decoding of large UTF-8 buffers.
+//
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "unicode_parallel.h"
+#include "unicode_internal.h"
+
+/**
+ * Work item of one thread: a chunk of the input and what the worker made of it
+ */
+typedef struct ParallelChunk_s {
+    const uint8_t *pStr;
+    size_t nbytes;
+    // byte offset of the chunk in the whole input
+    size_t offset;
+    // string to decode into and the index of the first char of the chunk in it
+    UnicodeString *str;
+    size_t at;
+    int strict;
+    // number of chars counted or decoded, validation result and error offset within the chunk
+    size_t chars;
+    int valid;
+    size_t error_offset;
+} ParallelChunk;
+
+/**
+ * Returns non-zero if a char starts at pStr[i] however the bytes before it are decoded: pStr[i] is not a continuation
+ * byte and none of the 3 bytes before it is a lead byte claiming it (lead bytes are trusted, see `get_octets_num`).
+ * i must be at least 3
+ */
+static int
+is_char_start(const uint8_t *pStr, const size_t i) {
+    return (pStr[i] & 0xC0) != 0x80
+           && !(pStr[i - 1] >= 0xC0 && pStr[i - 1] < 0xF8)
+           && !(pStr[i - 2] >= 0xE0 && pStr[i - 2] < 0xF8)
+           && !(pStr[i - 3] >= 0xF0 && pStr[i - 3] < 0xF8);
+}
+
+/**
+ * Splits pStr[0..nbytes) into at most `threads` chunks of about the same size. A boundary with no char start before
+ * the next one (a run of continuation or lead bytes as long as a chunk) is dropped and its chunks are merged
+ * @return number of chunks
+ */
+static size_t
+split_chunks(const uint8_t *pStr, const size_t nbytes, unsigned threads, ParallelChunk *chunks) {
+    if (!threads) {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (unsigned) cpus : 1;
+    }
+    size_t n = nbytes / UNICODE_PARALLEL_MIN_CHUNK;
+    n = n < threads ? n : threads;
+    n = n < UNICODE_PARALLEL_MAX_THREADS ? n : UNICODE_PARALLEL_MAX_THREADS;
+    n = n ? n : 1;
+
+    const size_t step = nbytes / n;
+    size_t start = 0;
+    size_t count = 0;
+    for (size_t k = 1; k <= n; k++) {
+        size_t end = nbytes;
+        if (k < n) {
+            const size_t limit = (k + 1) * step;
+            end = k * step;
+            while (end < limit && !is_char_start(pStr, end)) {
+                end++;
+            }
+            if (end == limit) {
+                continue;
+            }
+        }
+        chunks[count++] = (ParallelChunk){.pStr = pStr + start, .nbytes = end - start, .offset = start};
+        start = end;
+    }
+    return count;
+}
+
+/**
+ * Runs worker over every chunk: the first one on the calling thread, the others on new threads.
+ * A chunk whose thread can't be created is processed on the calling thread
+ */
+static void
+run_chunks(ParallelChunk *chunks, const size_t n, void *(*worker)(void *)) {
+    pthread_t threads[UNICODE_PARALLEL_MAX_THREADS];
+    int started[UNICODE_PARALLEL_MAX_THREADS];
+
+    for (size_t k = 1; k < n; k++) {
+        started[k] = pthread_create(&threads[k], NULL, worker, chunks + k) == 0;
+    }
+    worker(chunks);
+    for (size_t k = 1; k < n; k++) {
+        if (started[k]) {
+            pthread_join(threads[k], NULL);
+        } else {
+            worker(chunks + k);
+        }
+    }
+}
+
+static void *
+count_chunk(void *arg) {
+    ParallelChunk *chunk = arg;
+    chunk->chars = unicode_decoded_len(chunk->pStr, chunk->nbytes);
+    return NULL;
+}
+
+static void *
+validate_chunk(void *arg) {
+    ParallelChunk *chunk = arg;
+    chunk->valid = unicode_validate(chunk->pStr, chunk->nbytes, &chunk->error_offset);
+    return NULL;
+}
+
+static void *
+decode_chunk(void *arg) {
+    ParallelChunk *chunk = arg;
+    chunk->chars = ustr_decode_at(chunk->str, chunk->at, chunk->pStr, chunk->nbytes, chunk->strict);
+    return NULL;
+}
+
+size_t
+unicode_parallel_decoded_len(const uint8_t *pStr, const size_t nbytes, const unsigned threads) {
+    ParallelChunk chunks[UNICODE_PARALLEL_MAX_THREADS];
+    const size_t n = split_chunks(pStr, nbytes, threads, chunks);
+    run_chunks(chunks, n, count_chunk);
+
+    size_t chars = 0;
+    for (size_t k = 0; k < n; k++) {
+        chars += chunks[k].chars;
+    }
+    return chars;
+}
+
+int
+unicode_parallel_validate(const uint8_t *pStr, const size_t nbytes, const unsigned threads, size_t *pErrorOffset) {
+    ParallelChunk chunks[UNICODE_PARALLEL_MAX_THREADS];
+    const size_t n = split_chunks(pStr, nbytes, threads, chunks);
+    run_chunks(chunks, n, validate_chunk);
+
+    // chunks start at char starts, so the first error of the first invalid chunk is the first error of the input
+    for (size_t k = 0; k < n; k++) {
+        if (!chunks[k].valid) {
+            if (pErrorOffset != NULL) {
+                *pErrorOffset = chunks[k].offset + chunks[k].error_offset;
+            }
+            return 0;
+        }
+    }
+    return 1;
+}
+
+UnicodeString *
+read_into_unicode_string_parallel(const uint8_t *pStr, const size_t nbytes, const uint32_t flags,
+                                  const UnicodeLayout layout, const UnicodeAllocator *allocator,
+                                  const unsigned threads) {
+    ParallelChunk chunks[UNICODE_PARALLEL_MAX_THREADS];
+    const size_t n = split_chunks(pStr, nbytes, threads, chunks);
+    run_chunks(chunks, n, count_chunk);
+
+    size_t len = 0;
+    for (size_t k = 0; k < n; k++) {
+        chunks[k].at = len;
+        len += chunks[k].chars;
+    }
+
+    UnicodeString *str = new_ustr_with_allocator((ssize_t) len, layout, allocator);
+    if (str == NULL) {
+        return NULL;
+    }
+    for (size_t k = 0; k < n; k++) {
+        chunks[k].str = str;
+        chunks[k].strict = flags & UNICODE_DECODE_STRICT;
+    }
+    run_chunks(chunks, n, decode_chunk);
+
+    for (size_t k = 0; k < n; k++) {
+        if (chunks[k].chars == DECODE_ILL_FORMED) {
+            free_ustr(str);
+            return NULL;
+        }
+    }
+    str->len = len;
+    ustr_terminate(str);
+    return str;
+}
@@ -0,0 +1,154 @@
+//
+// Character properties through tables generated from the UCD, see tools/unicode_gen_tables.c.
+//
+
+#include "unicode_property.h"
+#include "unicode_property_tables.h"
+#include "unicode_internal.h"
+#include "unicode_simd.h"
+
+static inline uint16_t
+property_of(const uint32_t code_point) {
+    return PROPERTY_VALUES[property_lookup(code_point)];
+}
+
+#ifdef UNICODE_SIMD_X86
+/**
+ * Counts printable bytes (0x20..0x7E) of 32-byte blocks while they are all ASCII. Per-byte matches are summed into
+ * 64-bit lanes with PSADBW right away, a block adds at most 32 to a lane
+ * @return number of bytes measured, *pWidth is increased by their width
+ */
+UNICODE_TARGET_AVX2 static size_t
+ascii_width_run_avx2(const uint8_t *pStr, const size_t len, size_t *pWidth) {
+    const __m256i controls = _mm256_set1_epi8(0x1F);
+    const __m256i del = _mm256_set1_epi8(0x7F);
+    const __m256i one = _mm256_set1_epi8(1);
+    __m256i sums = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        const __m256i block = _mm256_loadu_si256((const __m256i *) (pStr + i));
+        if (_mm256_movemask_epi8(block)) {
+            break;
+        }
+        const __m256i printable = _mm256_and_si256(_mm256_cmpgt_epi8(block, controls), _mm256_cmpgt_epi8(del, block));
+        sums = _mm256_add_epi64(sums, _mm256_sad_epu8(_mm256_and_si256(printable, one), _mm256_setzero_si256()));
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, sums);
+    *pWidth += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    return i;
+}
+
+static size_t
+ascii_width_run_sse2(const uint8_t *pStr, const size_t len, size_t *pWidth) {
+    const __m128i controls = _mm_set1_epi8(0x1F);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i sums = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        const __m128i block = _mm_loadu_si128((const __m128i *) (pStr + i));
+        if (_mm_movemask_epi8(block)) {
+            break;
+        }
+        const __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(block, controls), _mm_cmpgt_epi8(del, block));
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(_mm_and_si128(printable, one), _mm_setzero_si128()));
+    }
+
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *) lanes, sums);
+    *pWidth += lanes[0] + lanes[1];
+    return i;
+}
+#endif
+
+/**
+ * Measures the leading ASCII run of pStr[0..len) a whole vector block at a time
+ * @return number of bytes measured, 0 if the run is shorter than a block
+ */
+static inline size_t
+ascii_width_run(const uint8_t *pStr, const size_t len, size_t *pWidth) {
+#ifdef UNICODE_SIMD_X86
+    return unicode_cpu_has_avx2() ? ascii_width_run_avx2(pStr, len, pWidth) : ascii_width_run_sse2(pStr, len, pWidth);
+#else
+    (void) pStr;
+    (void) len;
+    (void) pWidth;
+    return 0;
+#endif
+}
+
+UnicodeGeneralCategory
+unicode_general_category(const uint32_t code_point) {
+    return (UnicodeGeneralCategory) PROPERTY_CATEGORY(property_of(code_point));
+}
+
+UnicodeEastAsianWidth
+unicode_east_asian_width(const uint32_t code_point) {
+    return (UnicodeEastAsianWidth) PROPERTY_EAST_ASIAN_WIDTH(property_of(code_point));
+}
+
+int
+unicode_char_width(const uint32_t code_point) {
+    return PROPERTY_WIDTH(property_of(code_point));
+}
+
+size_t
+unicode_display_width(const uint8_t *pStr, const size_t nbytes) {
+    const uint8_t *pEnd = pStr + nbytes;
+    size_t width = 0;
+    size_t i = 0;
+
+    while (i < nbytes) {
+        const uint8_t byte = pStr[i];
+        if (byte < 0x80) {
+            const size_t run = ascii_width_run(pStr + i, nbytes - i, &width);
+            if (run) {
+                i += run;
+                continue;
+            }
+            width += byte >= 0x20 && byte != 0x7F;
+            i++;
+            continue;
+        }
+
+        uint32_t code_point;
+        uint8_t len;
+        if (byte >= 0xC2 && byte < 0xE0 && i + 1 < nbytes && (pStr[i + 1] & 0xC0) == 0x80) {
+            // 2-byte chars (Latin, Greek, Cyrillic) skip the general validation
+            code_point = (uint32_t) (byte & 0x1F) << 6 | (pStr[i + 1] & 0x3F);
+            len = 2;
+        } else {
+            len = utf8_sequence_len(pStr + i, pEnd);
+            if (!len) {
+                width++;
+                i++;
+                continue;
+            }
+            code_point = decode_utf8_valid(pStr + i, len);
+        }
+        width += PROPERTY_WIDTH(property_of(code_point));
+        i += len;
+    }
+    return width;
+}
+
+size_t
+ustr_display_width(const UnicodeString *self) {
+    size_t width = 0;
+    if (self->layout == USTR_LAYOUT_UTF32) {
+        for (size_t i = 0; i < self->len; i++) {
+            width += PROPERTY_WIDTH(property_of(self->code_points[i]));
+        }
+        return width;
+    }
+    for (size_t i = 0; i < self->len; i++) {
+        const UnicodeChar uchar = ustr_char_at(self, i);
+        width += get_octets_num(uchar.octet) == uchar.size ? PROPERTY_WIDTH(property_of(unicode_ord(uchar)))
+                                                           : uchar.size;
+    }
+    return width;
+}
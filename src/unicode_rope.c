@@ -0,0 +1,522 @@
+//
+// Rope of UTF-8 chunks: persistent AVL tree of reference-counted nodes.
+//
+
+#include <string.h>
+
+#include "unicode_rope.h"
+#include "unicode_internal.h"
+#include "unicode_simd.h"
+
+/**
+ * Leaves have height 0 and keep their bytes inline; internal nodes only sum up their children.
+ * Nodes are never modified once built, an operation builds new nodes along the paths it changes
+ */
+struct UnicodeRopeNode_s {
+    // allocator the node was allocated with, may differ from the allocator of a rope sharing it
+    const UnicodeAllocator *allocator;
+    size_t refs;
+    size_t len;
+    size_t nbytes;
+    UnicodeRopeNode *left;
+    UnicodeRopeNode *right;
+    uint8_t height;
+    uint8_t bytes[];
+};
+
+/*
+ * Functions below take references to the nodes they are given and return a new reference, so callers retain a node
+ * before passing it on if they keep using it. Trees passed to new_node / balance / join are never empty, so a NULL
+ * argument means that building it failed: the other arguments are released and NULL is passed up
+ */
+
+static UnicodeRopeNode *
+node_retain(UnicodeRopeNode *node) {
+    if (node != NULL) {
+        node->refs++;
+    }
+    return node;
+}
+
+static void
+node_release(UnicodeRopeNode *node) {
+    if (node == NULL || --node->refs) {
+        return;
+    }
+    if (node->height) {
+        node_release(node->left);
+        node_release(node->right);
+    }
+    unicode_release(node->allocator, node, sizeof(UnicodeRopeNode) + (node->height ? 0 : node->nbytes));
+}
+
+/**
+ * Gives up the reference to an internal node for references to its children
+ */
+static void
+node_unwrap(UnicodeRopeNode *node, UnicodeRopeNode **pLeft, UnicodeRopeNode **pRight) {
+    *pLeft = node_retain(node->left);
+    *pRight = node_retain(node->right);
+    node_release(node);
+}
+
+static UnicodeRopeNode *
+new_leaf(const UnicodeAllocator *allocator, const uint8_t *pStr, const size_t nbytes, const size_t len) {
+    UnicodeRopeNode *leaf = unicode_alloc(allocator, sizeof(UnicodeRopeNode) + nbytes);
+    if (leaf == NULL) {
+        return NULL;
+    }
+    *leaf = (UnicodeRopeNode){allocator, 1, len, nbytes, NULL, NULL, 0};
+    memcpy(leaf->bytes, pStr, nbytes);
+    return leaf;
+}
+
+static UnicodeRopeNode *
+new_node(const UnicodeAllocator *allocator, UnicodeRopeNode *left, UnicodeRopeNode *right) {
+    UnicodeRopeNode *node = left != NULL && right != NULL ? unicode_alloc(allocator, sizeof(UnicodeRopeNode)) : NULL;
+    if (node == NULL) {
+        node_release(left);
+        node_release(right);
+        return NULL;
+    }
+    const uint8_t height = (left->height > right->height ? left->height : right->height) + 1;
+    *node = (UnicodeRopeNode){allocator, 1, left->len + right->len, left->nbytes + right->nbytes, left, right, height};
+    return node;
+}
+
+/**
+ * Builds a node of subtrees whose heights differ by at most 2, rotating once or twice to restore AVL balance
+ */
+static UnicodeRopeNode *
+balance(const UnicodeAllocator *allocator, UnicodeRopeNode *left, UnicodeRopeNode *right) {
+    if (left == NULL || right == NULL) {
+        return new_node(allocator, left, right);
+    }
+
+    UnicodeRopeNode *outer, *inner, *inner_left, *inner_right;
+    if (left->height > right->height + 1) {
+        node_unwrap(left, &outer, &inner);
+        if (outer->height >= inner->height) {
+            return new_node(allocator, outer, new_node(allocator, inner, right));
+        }
+        node_unwrap(inner, &inner_left, &inner_right);
+        return new_node(allocator, new_node(allocator, outer, inner_left), new_node(allocator, inner_right, right));
+    }
+    if (right->height > left->height + 1) {
+        node_unwrap(right, &inner, &outer);
+        if (outer->height >= inner->height) {
+            return new_node(allocator, new_node(allocator, left, inner), outer);
+        }
+        node_unwrap(inner, &inner_left, &inner_right);
+        return new_node(allocator, new_node(allocator, left, inner_left), new_node(allocator, inner_right, outer));
+    }
+    return new_node(allocator, left, right);
+}
+
+/**
+ * Merges two small leaves into one, unless a sequence cut between them would be decoded differently.
+ * @return merged leaf, or NULL if the leaves have to stay apart (or allocation fails); left and right are kept then
+ */
+static UnicodeRopeNode *
+merge_leaves(const UnicodeAllocator *allocator, UnicodeRopeNode *left, UnicodeRopeNode *right) {
+    uint8_t bytes[UNICODE_ROPE_LEAF_SIZE];
+    const size_t nbytes = left->nbytes + right->nbytes;
+    memcpy(bytes, left->bytes, left->nbytes);
+    memcpy(bytes + left->nbytes, right->bytes, right->nbytes);
+
+    // decoding is forward-only: if chars of left still end at its last byte, chars of right follow unchanged
+    size_t count = left->len;
+    if (utf8_skip_chars(bytes, nbytes, &count) != left->nbytes) {
+        return NULL;
+    }
+
+    UnicodeRopeNode *merged = new_leaf(allocator, bytes, nbytes, left->len + right->len);
+    if (merged != NULL) {
+        node_release(left);
+        node_release(right);
+    }
+    return merged;
+}
+
+/**
+ * Concatenates two trees in O(|height difference|): the lower one is joined into the spine of the higher one
+ */
+static UnicodeRopeNode *
+join(const UnicodeAllocator *allocator, UnicodeRopeNode *left, UnicodeRopeNode *right) {
+    if (left == NULL || right == NULL) {
+        return new_node(allocator, left, right);
+    }
+
+    UnicodeRopeNode *outer, *inner;
+    if (left->height > right->height + 1) {
+        node_unwrap(left, &outer, &inner);
+        return balance(allocator, outer, join(allocator, inner, right));
+    }
+    if (right->height > left->height + 1) {
+        node_unwrap(right, &inner, &outer);
+        return balance(allocator, join(allocator, left, inner), outer);
+    }
+    if (!left->height && !right->height && left->nbytes + right->nbytes <= UNICODE_ROPE_LEAF_SIZE) {
+        UnicodeRopeNode *merged = merge_leaves(allocator, left, right);
+        if (merged != NULL) {
+            return merged;
+        }
+    }
+    return new_node(allocator, left, right);
+}
+
+/**
+ * Same as `join`, but either tree may be empty
+ * @return 1 on success, 0 if allocation fails
+ */
+static int
+concat(const UnicodeAllocator *allocator, UnicodeRopeNode *left, UnicodeRopeNode *right, UnicodeRopeNode **pOut) {
+    if (left == NULL || right == NULL) {
+        *pOut = left != NULL ? left : right;
+        return 1;
+    }
+    *pOut = join(allocator, left, right);
+    return *pOut != NULL;
+}
+
+/**
+ * Splits a tree (NULL for an empty one) into trees of chars [0, index) and [index, len), either of them may be empty
+ * @return 1 on success, 0 if allocation fails
+ */
+static int
+split(const UnicodeAllocator *allocator, UnicodeRopeNode *node, const size_t index, UnicodeRopeNode **pLeft,
+      UnicodeRopeNode **pRight) {
+    if (node == NULL || index == 0) {
+        *pLeft = NULL;
+        *pRight = node;
+        return 1;
+    }
+    if (index >= node->len) {
+        *pLeft = node;
+        *pRight = NULL;
+        return 1;
+    }
+
+    if (!node->height) {
+        size_t count = index;
+        const size_t offset = utf8_skip_chars(node->bytes, node->nbytes, &count);
+        *pLeft = new_leaf(allocator, node->bytes, offset, index);
+        *pRight = new_leaf(allocator, node->bytes + offset, node->nbytes - offset, node->len - index);
+        node_release(node);
+        if (*pLeft == NULL || *pRight == NULL) {
+            node_release(*pLeft);
+            node_release(*pRight);
+            return 0;
+        }
+        return 1;
+    }
+
+    UnicodeRopeNode *left, *right, *head, *tail;
+    node_unwrap(node, &left, &right);
+    if (index <= left->len) {
+        if (!split(allocator, left, index, &head, &tail)) {
+            node_release(right);
+            return 0;
+        }
+        *pLeft = head;
+        if (!concat(allocator, tail, right, pRight)) {
+            node_release(head);
+            return 0;
+        }
+        return 1;
+    }
+
+    if (!split(allocator, right, index - left->len, &head, &tail)) {
+        node_release(left);
+        return 0;
+    }
+    *pRight = tail;
+    if (!concat(allocator, left, head, pLeft)) {
+        node_release(tail);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Length of the longest prefix of pStr[0..nbytes) that fits into a leaf without cutting a char
+ * @param pLen receives the number of chars in the prefix
+ */
+static size_t
+leaf_prefix(const uint8_t *pStr, const size_t nbytes, size_t *pLen) {
+    size_t offset = 0;
+    size_t len = 0;
+
+    if (nbytes <= UNICODE_ROPE_LEAF_SIZE) {
+        *pLen = SIZE_MAX;
+        return utf8_skip_chars(pStr, nbytes, pLen);
+    }
+
+    // a char takes at most 4 bytes, so a quarter of the room left is always filled by whole chars
+    while (UNICODE_ROPE_LEAF_SIZE - offset >= 4) {
+        size_t count = (UNICODE_ROPE_LEAF_SIZE - offset) / 4;
+        offset += utf8_skip_chars(pStr + offset, nbytes - offset, &count);
+        len += count;
+    }
+    for (;;) {
+        size_t count = 1;
+        const size_t size = utf8_skip_chars(pStr + offset, nbytes - offset, &count);
+        if (offset + size > UNICODE_ROPE_LEAF_SIZE) {
+            break;
+        }
+        offset += size;
+        len++;
+    }
+
+    *pLen = len;
+    return offset;
+}
+
+/**
+ * Builds a perfectly balanced tree of leaves[0..n), taking their references
+ */
+static UnicodeRopeNode *
+build_tree(const UnicodeAllocator *allocator, UnicodeRopeNode **leaves, const size_t n) {
+    if (n == 1) {
+        return leaves[0];
+    }
+    const size_t half = n / 2;
+    return new_node(allocator, build_tree(allocator, leaves, half), build_tree(allocator, leaves + half, n - half));
+}
+
+/**
+ * Wraps a tree into a rope handle, taking its reference
+ */
+static UnicodeRope *
+new_rope_handle(const UnicodeAllocator *allocator, UnicodeRopeNode *root) {
+    UnicodeRope *rope = unicode_alloc(allocator, sizeof(UnicodeRope));
+    if (rope == NULL) {
+        node_release(root);
+        return NULL;
+    }
+    rope->root = root;
+    rope->len = root != NULL ? root->len : 0;
+    rope->nbytes = root != NULL ? root->nbytes : 0;
+    rope->allocator = allocator;
+    return rope;
+}
+
+UnicodeRope *
+new_rope(const uint8_t *pStr, const size_t nbytes) {
+    return new_rope_with_allocator(pStr, nbytes, NULL);
+}
+
+UnicodeRope *
+new_rope_with_allocator(const uint8_t *pStr, const size_t nbytes, const UnicodeAllocator *allocator) {
+    if (allocator == NULL) {
+        allocator = unicode_get_default_allocator();
+    }
+    if (!nbytes) {
+        return new_rope_handle(allocator, NULL);
+    }
+
+    // every leaf but the last one is filled up to the last 3 bytes
+    const size_t max_leaves = nbytes / (UNICODE_ROPE_LEAF_SIZE - 3) + 1;
+    UnicodeRopeNode **leaves = unicode_alloc(allocator, max_leaves * sizeof(UnicodeRopeNode *));
+    if (leaves == NULL) {
+        return NULL;
+    }
+
+    size_t count = 0;
+    for (size_t offset = 0; offset < nbytes; count++) {
+        size_t len;
+        const size_t size = leaf_prefix(pStr + offset, nbytes - offset, &len);
+        leaves[count] = new_leaf(allocator, pStr + offset, size, len);
+        if (leaves[count] == NULL) {
+            while (count) {
+                node_release(leaves[--count]);
+            }
+            unicode_release(allocator, leaves, max_leaves * sizeof(UnicodeRopeNode *));
+            return NULL;
+        }
+        offset += size;
+    }
+
+    UnicodeRopeNode *root = build_tree(allocator, leaves, count);
+    unicode_release(allocator, leaves, max_leaves * sizeof(UnicodeRopeNode *));
+    if (root == NULL) {
+        return NULL;
+    }
+    return new_rope_handle(allocator, root);
+}
+
+void
+free_rope(UnicodeRope *self) {
+    node_release(self->root);
+    unicode_release(self->allocator, self, sizeof(UnicodeRope));
+}
+
+UnicodeRope *
+rope_concat(const UnicodeRope *self, const UnicodeRope *other) {
+    UnicodeRopeNode *root;
+    if (!concat(self->allocator, node_retain(self->root), node_retain(other->root), &root)) {
+        return NULL;
+    }
+    return new_rope_handle(self->allocator, root);
+}
+
+UnicodeRope *
+rope_insert(const UnicodeRope *self, const size_t index, const UnicodeRope *other) {
+    const UnicodeAllocator *allocator = self->allocator;
+    UnicodeRopeNode *head, *tail, *root;
+
+    if (!split(allocator, node_retain(self->root), index, &head, &tail)) {
+        return NULL;
+    }
+    if (!concat(allocator, head, node_retain(other->root), &head)) {
+        node_release(tail);
+        return NULL;
+    }
+    if (!concat(allocator, head, tail, &root)) {
+        return NULL;
+    }
+    return new_rope_handle(allocator, root);
+}
+
+UnicodeRope *
+rope_delete(const UnicodeRope *self, const size_t start, size_t end) {
+    const UnicodeAllocator *allocator = self->allocator;
+    UnicodeRopeNode *head, *middle, *tail, *root;
+
+    if (end < start) {
+        end = start;
+    }
+    if (!split(allocator, node_retain(self->root), end, &head, &tail)) {
+        return NULL;
+    }
+    if (!split(allocator, head, start, &head, &middle)) {
+        node_release(tail);
+        return NULL;
+    }
+    node_release(middle);
+    if (!concat(allocator, head, tail, &root)) {
+        return NULL;
+    }
+    return new_rope_handle(allocator, root);
+}
+
+UnicodeRope *
+rope_slice(const UnicodeRope *self, const size_t start, size_t end) {
+    const UnicodeAllocator *allocator = self->allocator;
+    UnicodeRopeNode *head, *middle, *tail;
+
+    if (end < start) {
+        end = start;
+    }
+    if (!split(allocator, node_retain(self->root), end, &head, &tail)) {
+        return NULL;
+    }
+    node_release(tail);
+    if (!split(allocator, head, start, &head, &middle)) {
+        return NULL;
+    }
+    node_release(head);
+    return new_rope_handle(allocator, middle);
+}
+
+UnicodeChar
+rope_char_at(const UnicodeRope *self, size_t index) {
+    UnicodeChar uchar = {{0, 0, 0, 0}, 0};
+    if (index >= self->len) {
+        return uchar;
+    }
+
+    const UnicodeRopeNode *node = self->root;
+    while (node->height) {
+        if (index < node->left->len) {
+            node = node->left;
+        } else {
+            index -= node->left->len;
+            node = node->right;
+        }
+    }
+
+    const size_t offset = utf8_skip_chars(node->bytes, node->nbytes, &index);
+    const UnicodeView view = unicode_view(node->bytes + offset, node->nbytes - offset);
+    unicode_view_peek(&view, &uchar);
+    return uchar;
+}
+
+void
+rope_iter_init(UnicodeRopeIterator *it, const UnicodeRope *self) {
+    it->depth = 0;
+    if (self->root != NULL) {
+        it->stack[it->depth++] = self->root;
+    }
+}
+
+int
+rope_next_leaf(UnicodeRopeIterator *it, UnicodeView *pOut) {
+    if (!it->depth) {
+        return 0;
+    }
+
+    const UnicodeRopeNode *node = it->stack[--it->depth];
+    while (node->height) {
+        it->stack[it->depth++] = node->right;
+        node = node->left;
+    }
+    *pOut = unicode_view(node->bytes, node->nbytes);
+    return 1;
+}
+
+ssize_t
+rope_write_file(const UnicodeRope *self, FILE *stream) {
+    UnicodeRopeIterator it;
+    UnicodeView leaf;
+
+    rope_iter_init(&it, self);
+    while (rope_next_leaf(&it, &leaf)) {
+        if (fwrite(leaf.p, 1, leaf.nbytes, stream) != leaf.nbytes) {
+            return -1;
+        }
+    }
+    return (ssize_t) self->nbytes;
+}
+
+ssize_t
+rope_write_fd(const UnicodeRope *self, const int fd) {
+    uint8_t block[UNICODE_WRITE_BLOCK_SIZE];
+    size_t used = 0;
+    UnicodeRopeIterator it;
+    UnicodeView leaf;
+
+    rope_iter_init(&it, self);
+    while (rope_next_leaf(&it, &leaf)) {
+        if (used + leaf.nbytes > sizeof(block)) {
+            if (write_all(fd, block, used) < 0) {
+                return -1;
+            }
+            used = 0;
+        }
+        memcpy(block + used, leaf.p, leaf.nbytes);
+        used += leaf.nbytes;
+    }
+    if (write_all(fd, block, used) < 0) {
+        return -1;
+    }
+    return (ssize_t) self->nbytes;
+}
+
+CompressedUnicodeString *
+compress_rope_into_bytes_array(const UnicodeRope *self) {
+    CompressedUnicodeString *compressed = new_compressed_ustr(self->allocator, self->nbytes);
+    if (compressed == NULL) {
+        return NULL;
+    }
+
+    size_t offset = 0;
+    UnicodeRopeIterator it;
+    UnicodeView leaf;
+    rope_iter_init(&it, self);
+    while (rope_next_leaf(&it, &leaf)) {
+        memcpy(compressed->data + offset, leaf.p, leaf.nbytes);
+        offset += leaf.nbytes;
+    }
+    return compressed;
+}
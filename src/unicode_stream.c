@@ -0,0 +1,137 @@
+//
+// Incremental UTF-8 decoding of chunked input.
+//
+
+#include <string.h>
+
+#include "unicode_stream.h"
+#include "unicode_internal.h"
+#include "unicode_simd.h"
+
+/**
+ * Output of a decoder call: exactly one of `uchars` / `code_points` is set
+ */
+typedef struct DecoderOutput_s {
+    UnicodeChar *uchars;
+    uint32_t *code_points;
+    size_t cap;
+    size_t len;
+} DecoderOutput;
+
+static void
+decoder_emit(DecoderOutput *out, const UnicodeChar uchar) {
+    if (out->uchars != NULL) {
+        out->uchars[out->len++] = uchar;
+    } else {
+        out->code_points[out->len++] = uchar_to_code_point(uchar);
+    }
+}
+
+static size_t
+decoder_emit_ascii(DecoderOutput *out, const uint8_t *pStr, const size_t len) {
+    size_t ascii_len;
+    if (out->uchars != NULL) {
+        ascii_len = expand_ascii_run(pStr, len, out->uchars + out->len);
+    } else {
+        uint32_t *pOut = out->code_points + out->len;
+        ascii_len = ascii_prefix_len(pStr, len);
+        for (size_t i = 0; i < ascii_len; i++) {
+            pOut[i] = pStr[i];
+        }
+    }
+    out->len += ascii_len;
+    return ascii_len;
+}
+
+static size_t
+decoder_feed(UnicodeDecoder *decoder, const uint8_t *chunk, const size_t len, DecoderOutput *out,
+             size_t *pConsumed) {
+    size_t i = 0;
+
+    if (decoder->pending_len && out->cap) {
+        // complete the sequence started by the previous chunk
+        const uint8_t octets = get_octets_num(decoder->pending);
+        while (decoder->pending_len < octets && i < len) {
+            decoder->pending[decoder->pending_len++] = chunk[i++];
+        }
+        if (decoder->pending_len == octets) {
+            decoder_emit(out, read_unicode_char(decoder->pending));
+            decoder->pending_len = 0;
+        }
+    }
+
+    while (!decoder->pending_len && i < len && out->len < out->cap) {
+        const size_t room = out->cap - out->len;
+        i += decoder_emit_ascii(out, chunk + i, len - i < room ? len - i : room);
+        if (i == len || out->len == out->cap) {
+            break;
+        }
+
+        const uint8_t octets = get_octets_num(chunk + i);
+        if (octets > len - i) {
+            // sequence continues in the next chunk
+            decoder->pending_len = (uint8_t) (len - i);
+            memcpy(decoder->pending, chunk + i, decoder->pending_len);
+            i = len;
+            break;
+        }
+
+        UnicodeChar uchar;
+        i += decode_one_n(chunk + i, chunk + len, &uchar);
+        decoder_emit(out, uchar);
+    }
+
+    if (pConsumed != NULL) {
+        *pConsumed = i;
+    }
+    return out->len;
+}
+
+static size_t
+decoder_finish(UnicodeDecoder *decoder, DecoderOutput *out) {
+    const uint8_t *pEnd = decoder->pending + decoder->pending_len;
+    size_t flushed = 0;
+
+    // pending bytes are the end of input now: the lead byte is invalid, the rest decode as a whole buffer would
+    while (flushed < decoder->pending_len && out->len < out->cap) {
+        UnicodeChar uchar;
+        flushed += decode_one_n(decoder->pending + flushed, pEnd, &uchar);
+        decoder_emit(out, uchar);
+    }
+
+    // keep what did not fit for the next call
+    decoder->pending_len -= flushed;
+    memmove(decoder->pending, decoder->pending + flushed, decoder->pending_len);
+    return out->len;
+}
+
+void
+unicode_decoder_init(UnicodeDecoder *decoder) {
+    *decoder = (UnicodeDecoder){0};
+}
+
+size_t
+unicode_decoder_feed(UnicodeDecoder *decoder, const uint8_t *chunk, const size_t len, UnicodeChar *out,
+                     const size_t out_cap, size_t *pConsumed) {
+    DecoderOutput output = {out, NULL, out_cap, 0};
+    return decoder_feed(decoder, chunk, len, &output, pConsumed);
+}
+
+size_t
+unicode_decoder_feed_utf32(UnicodeDecoder *decoder, const uint8_t *chunk, const size_t len, uint32_t *out,
+                           const size_t out_cap, size_t *pConsumed) {
+    DecoderOutput output = {NULL, out, out_cap, 0};
+    return decoder_feed(decoder, chunk, len, &output, pConsumed);
+}
+
+size_t
+unicode_decoder_finish(UnicodeDecoder *decoder, UnicodeChar *out, const size_t out_cap) {
+    DecoderOutput output = {out, NULL, out_cap, 0};
+    return decoder_finish(decoder, &output);
+}
+
+size_t
+unicode_decoder_finish_utf32(UnicodeDecoder *decoder, uint32_t *out, const size_t out_cap) {
+    DecoderOutput output = {NULL, out, out_cap, 0};
+    return decoder_finish(decoder, &output);
+}
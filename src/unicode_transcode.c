@@ -0,0 +1,872 @@
+//
+// Bulk conversion between UTF-8 bytes and other Unicode encoding forms.
+//
+
+#include "unicode_transcode.h"
+#include "unicode_internal.h"
+#include "unicode_simd.h"
+
+/**
+ * Value `decode_utf8_char` reports for ill-formed subsequences, so they can be told apart from a real U+FFFD
+ */
+#define ILL_FORMED_CODE_POINT UINT32_MAX
+
+/**
+ * Decodes one char at pStr, validating it against Unicode Table 3-7
+ * @return number of bytes consumed: the sequence length, or the length of its maximal subpart if it is ill-formed
+ * (*pCodePoint is ILL_FORMED_CODE_POINT then); 0 if a well-formed prefix is cut by pEnd
+ */
+static uint8_t
+decode_utf8_char(const uint8_t *pStr, const uint8_t *pEnd, uint32_t *pCodePoint) {
+    const uint8_t lead = *pStr;
+    uint8_t len, low = 0x80, high = 0xBF;
+    uint32_t code_point;
+
+    if (lead < 0x80) {
+        *pCodePoint = lead;
+        return 1;
+    } else if (lead < 0xC2) {
+        *pCodePoint = ILL_FORMED_CODE_POINT;
+        return 1;
+    } else if (lead < 0xE0) {
+        len = 2;
+        code_point = lead & 0x1F;
+    } else if (lead < 0xF0) {
+        len = 3;
+        code_point = lead & 0x0F;
+        low = lead == 0xE0 ? 0xA0 : 0x80;
+        high = lead == 0xED ? 0x9F : 0xBF;
+    } else if (lead < 0xF5) {
+        len = 4;
+        code_point = lead & 0x07;
+        low = lead == 0xF0 ? 0x90 : 0x80;
+        high = lead == 0xF4 ? 0x8F : 0xBF;
+    } else {
+        *pCodePoint = ILL_FORMED_CODE_POINT;
+        return 1;
+    }
+
+    for (uint8_t i = 1; i < len; i++) {
+        if (pStr + i == pEnd) {
+            return 0;
+        }
+        if (pStr[i] < low || pStr[i] > high) {
+            *pCodePoint = ILL_FORMED_CODE_POINT;
+            return i;
+        }
+        code_point = (code_point << 6) | (pStr[i] & 0x3F);
+        low = 0x80;
+        high = 0xBF;
+    }
+
+    *pCodePoint = code_point;
+    return len;
+}
+
+/**
+ * Replaces the ill-formed marker written by `decode_utf8_char` and `decode_utf16_char`
+ * @return 1 if the code point was replaced
+ */
+static inline size_t
+replace_ill_formed(uint32_t *pCodePoint) {
+    if (*pCodePoint == ILL_FORMED_CODE_POINT) {
+        *pCodePoint = UNICODE_REPLACEMENT_CHAR;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Replaces surrogates and values above U+10FFFF, which have no UTF-8 encoding
+ * @return 1 if the code point was replaced
+ */
+static inline size_t
+replace_invalid_code_point(uint32_t *pCodePoint) {
+    if (*pCodePoint > 0x10FFFF || (*pCodePoint & 0xFFFFF800) == 0xD800) {
+        *pCodePoint = UNICODE_REPLACEMENT_CHAR;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * UTF-16 code units are accessed byte-wise, so both byte orders work the same on any host
+ */
+static inline uint16_t
+load_utf16_unit(const uint16_t *pUnit, const UnicodeByteOrder order) {
+    const uint8_t *bytes = (const uint8_t *) pUnit;
+    return order == UNICODE_BIG_ENDIAN ? (uint16_t) (bytes[0] << 8 | bytes[1]) : (uint16_t) (bytes[1] << 8 | bytes[0]);
+}
+
+static inline void
+store_utf16_unit(uint16_t *pUnit, const uint16_t unit, const UnicodeByteOrder order) {
+    uint8_t *bytes = (uint8_t *) pUnit;
+    bytes[order == UNICODE_BIG_ENDIAN ? 1 : 0] = unit & 0xFF;
+    bytes[order == UNICODE_BIG_ENDIAN ? 0 : 1] = unit >> 8;
+}
+
+/**
+ * Decodes one char at pUnit: a BMP code unit or a surrogate pair
+ * @return number of code units consumed (*pCodePoint is ILL_FORMED_CODE_POINT for an unpaired surrogate);
+ * 0 if a high surrogate is cut by pEnd
+ */
+static inline uint8_t
+decode_utf16_char(const uint16_t *pUnit, const uint16_t *pEnd, const UnicodeByteOrder order, uint32_t *pCodePoint) {
+    const uint16_t unit = load_utf16_unit(pUnit, order);
+
+    if ((unit & 0xF800) != 0xD800) {
+        *pCodePoint = unit;
+        return 1;
+    }
+    if (unit < 0xDC00) {
+        if (pUnit + 1 == pEnd) {
+            return 0;
+        }
+        const uint16_t low = load_utf16_unit(pUnit + 1, order);
+        if ((low & 0xFC00) == 0xDC00) {
+            *pCodePoint = 0x10000 + ((uint32_t) (unit - 0xD800) << 10) + (low - 0xDC00);
+            return 2;
+        }
+    }
+    *pCodePoint = ILL_FORMED_CODE_POINT;
+    return 1;
+}
+
+/**
+ * Encodes one valid code point as 1 or 2 code units at pOut
+ * @return number of code units written
+ */
+static inline uint8_t
+encode_utf16_char(const uint32_t code_point, uint16_t *pOut, const UnicodeByteOrder order) {
+    if (code_point < 0x10000) {
+        store_utf16_unit(pOut, code_point, order);
+        return 1;
+    }
+    store_utf16_unit(pOut, 0xD800 + ((code_point - 0x10000) >> 10), order);
+    store_utf16_unit(pOut + 1, 0xDC00 + ((code_point - 0x10000) & 0x3FF), order);
+    return 2;
+}
+
+#ifdef UNICODE_SIMD_X86
+/**
+ * UTF-8 decoding kernels read 16 bytes at pStr and may write a whole vector (up to 16 code units) at pOut, even if
+ * they consume less. The caller guarantees both: src has 16 bytes left and dst has room for 16 code units.
+ * Each kernel returns the number of bytes consumed (whole chars only), 0 if the first char doesn't fit the kernel
+ */
+
+/**
+ * Swaps bytes of 16-bit lanes, converting little-endian code units to big-endian ones
+ */
+static inline __m128i
+bswap16_sse2(const __m128i lanes) {
+    return _mm_or_si128(_mm_slli_epi16(lanes, 8), _mm_srli_epi16(lanes, 8));
+}
+
+/**
+ * Length of the leading ASCII run of a 16-byte block
+ */
+static inline size_t
+ascii_block_prefix_len(const __m128i block) {
+    return __builtin_ctz((uint32_t) _mm_movemask_epi8(block) | 0x10000);
+}
+
+/**
+ * Decodes leading 2-byte sequences of a block as 8 little-endian 16-bit lanes: lead byte low, continuation byte high
+ * @return number of leading lanes holding well-formed chars
+ */
+static inline size_t
+utf8_decode_2byte_sse2(const __m128i block, __m128i *pCodePoints) {
+    // 110xxxxx 10xxxxxx, and not an overlong C0 / C1 lead
+    const __m128i tags = _mm_and_si128(block, _mm_set1_epi16((short) 0xC0E0));
+    const __m128i code_points = _mm_or_si128(
+        _mm_slli_epi16(_mm_and_si128(block, _mm_set1_epi16(0x1F)), 6),
+        _mm_and_si128(_mm_srli_epi16(block, 8), _mm_set1_epi16(0x3F)));
+    const __m128i valid = _mm_and_si128(
+        _mm_cmpeq_epi16(tags, _mm_set1_epi16((short) 0x80C0)),
+        _mm_cmpgt_epi16(code_points, _mm_set1_epi16(0x7F)));
+
+    *pCodePoints = code_points;
+    return __builtin_ctz(~(uint32_t) _mm_movemask_epi8(valid)) / 2;
+}
+
+/**
+ * Decodes leading 3-byte sequences of the first 12 bytes of a block, one sequence per 32-bit lane
+ * @return number of leading lanes holding well-formed chars
+ */
+UNICODE_TARGET_SSSE3 static size_t
+utf8_decode_3byte_ssse3(const __m128i block, __m128i *pCodePoints) {
+    const __m128i lanes = _mm_shuffle_epi8(block, _mm_setr_epi8(
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+
+    // 1110xxxx 10xxxxxx 10xxxxxx, not overlong and not a surrogate
+    const __m128i tags = _mm_and_si128(lanes, _mm_set1_epi32(0xC0C0F0));
+    const __m128i code_points = _mm_or_si128(
+        _mm_or_si128(
+            _mm_slli_epi32(_mm_and_si128(lanes, _mm_set1_epi32(0x0F)), 12),
+            _mm_srli_epi32(_mm_and_si128(lanes, _mm_set1_epi32(0x3F00)), 2)),
+        _mm_srli_epi32(_mm_and_si128(lanes, _mm_set1_epi32(0x3F0000)), 16));
+    const __m128i surrogate = _mm_cmpeq_epi32(_mm_and_si128(code_points, _mm_set1_epi32(0xF800)),
+                                              _mm_set1_epi32(0xD800));
+    const __m128i valid = _mm_andnot_si128(surrogate, _mm_and_si128(
+        _mm_cmpeq_epi32(tags, _mm_set1_epi32(0x8080E0)),
+        _mm_cmpgt_epi32(code_points, _mm_set1_epi32(0x7FF))));
+
+    *pCodePoints = code_points;
+    return __builtin_ctz(~(uint32_t) _mm_movemask_ps(_mm_castsi128_ps(valid)));
+}
+
+/**
+ * Widens the leading ASCII bytes of a 16-byte block
+ */
+static inline size_t
+utf8_to_utf32_ascii_sse2(const __m128i block, uint32_t *pOut) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo = _mm_unpacklo_epi8(block, zero);
+    const __m128i hi = _mm_unpackhi_epi8(block, zero);
+    _mm_storeu_si128((__m128i *) pOut, _mm_unpacklo_epi16(lo, zero));
+    _mm_storeu_si128((__m128i *) (pOut + 4), _mm_unpackhi_epi16(lo, zero));
+    _mm_storeu_si128((__m128i *) (pOut + 8), _mm_unpacklo_epi16(hi, zero));
+    _mm_storeu_si128((__m128i *) (pOut + 12), _mm_unpackhi_epi16(hi, zero));
+    return ascii_block_prefix_len(block);
+}
+
+/**
+ * Widens whole 32-byte ASCII blocks
+ */
+UNICODE_TARGET_AVX2 static size_t
+utf8_to_utf32_ascii_avx2(const uint8_t *pStr, const size_t len, uint32_t *pOut) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        const __m256i block = _mm256_loadu_si256((const __m256i *) (pStr + i));
+        if (_mm256_movemask_epi8(block)) {
+            break;
+        }
+        const __m128i lo = _mm256_castsi256_si128(block);
+        const __m128i hi = _mm256_extracti128_si256(block, 1);
+        _mm256_storeu_si256((__m256i *) (pOut + i), _mm256_cvtepu8_epi32(lo));
+        _mm256_storeu_si256((__m256i *) (pOut + i + 8), _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8)));
+        _mm256_storeu_si256((__m256i *) (pOut + i + 16), _mm256_cvtepu8_epi32(hi));
+        _mm256_storeu_si256((__m256i *) (pOut + i + 24), _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8)));
+    }
+    return i;
+}
+
+static inline size_t
+utf8_to_utf32_2byte_sse2(const __m128i block, uint32_t *pOut) {
+    __m128i code_points;
+    const size_t chars = utf8_decode_2byte_sse2(block, &code_points);
+    const __m128i zero = _mm_setzero_si128();
+    _mm_storeu_si128((__m128i *) pOut, _mm_unpacklo_epi16(code_points, zero));
+    _mm_storeu_si128((__m128i *) (pOut + 4), _mm_unpackhi_epi16(code_points, zero));
+    return chars * 2;
+}
+
+UNICODE_TARGET_SSSE3 static size_t
+utf8_to_utf32_3byte_ssse3(const __m128i block, uint32_t *pOut) {
+    __m128i code_points;
+    const size_t chars = utf8_decode_3byte_ssse3(block, &code_points);
+    _mm_storeu_si128((__m128i *) pOut, code_points);
+    return chars * 3;
+}
+
+/**
+ * Same as `utf8_to_utf32_ascii_sse2` for 16-bit code units
+ */
+static inline size_t
+utf8_to_utf16_ascii_sse2(const __m128i block, uint16_t *pOut, const UnicodeByteOrder order) {
+    const __m128i zero = _mm_setzero_si128();
+    if (order == UNICODE_BIG_ENDIAN) {
+        _mm_storeu_si128((__m128i *) pOut, _mm_unpacklo_epi8(zero, block));
+        _mm_storeu_si128((__m128i *) (pOut + 8), _mm_unpackhi_epi8(zero, block));
+    } else {
+        _mm_storeu_si128((__m128i *) pOut, _mm_unpacklo_epi8(block, zero));
+        _mm_storeu_si128((__m128i *) (pOut + 8), _mm_unpackhi_epi8(block, zero));
+    }
+    return ascii_block_prefix_len(block);
+}
+
+static inline size_t
+utf8_to_utf16_2byte_sse2(const __m128i block, uint16_t *pOut, const UnicodeByteOrder order) {
+    __m128i code_points;
+    const size_t chars = utf8_decode_2byte_sse2(block, &code_points);
+    _mm_storeu_si128((__m128i *) pOut, order == UNICODE_BIG_ENDIAN ? bswap16_sse2(code_points) : code_points);
+    return chars * 2;
+}
+
+UNICODE_TARGET_SSSE3 static size_t
+utf8_to_utf16_3byte_ssse3(const __m128i block, uint16_t *pOut, const UnicodeByteOrder order) {
+    __m128i code_points;
+    const size_t chars = utf8_decode_3byte_ssse3(block, &code_points);
+    // low 16 bits of each 32-bit lane, in the requested byte order
+    const __m128i narrow = order == UNICODE_BIG_ENDIAN
+                               ? _mm_setr_epi8(1, 0, 5, 4, 9, 8, 13, 12, -1, -1, -1, -1, -1, -1, -1, -1)
+                               : _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+    _mm_storel_epi64((__m128i *) pOut, _mm_shuffle_epi8(code_points, narrow));
+    return chars * 3;
+}
+
+/**
+ * pshufb indices packing four 32-bit lanes of 1..3 UTF-8 bytes each (lane byte 0 first) into a contiguous run.
+ * Row index is sum of (lane length - 1) * 3^lane
+ */
+static const uint8_t UTF8_PACK_SHUFFLE[81][16] = {
+    {0x00, 0x04, 0x08, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x08, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x05, 0x08, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x05, 0x08, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x05, 0x08, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x05, 0x06, 0x08, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x05, 0x06, 0x08, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x05, 0x06, 0x08, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x08, 0x09, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x08, 0x09, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x09, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x05, 0x08, 0x09, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x05, 0x08, 0x09, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x05, 0x08, 0x09, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x08, 0x09, 0x0a, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x08, 0x09, 0x0a, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x09, 0x0a, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x05, 0x08, 0x09, 0x0a, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x05, 0x08, 0x09, 0x0a, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x05, 0x08, 0x09, 0x0a, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0a, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0a, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0a, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x08, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x08, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x05, 0x08, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x05, 0x08, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x05, 0x08, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x05, 0x06, 0x08, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x05, 0x06, 0x08, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x05, 0x06, 0x08, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x08, 0x09, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x08, 0x09, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x09, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x05, 0x08, 0x09, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x05, 0x08, 0x09, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x05, 0x08, 0x09, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x05, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x05, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x05, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x08, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x08, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x05, 0x08, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x05, 0x08, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x05, 0x08, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x05, 0x06, 0x08, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x05, 0x06, 0x08, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x05, 0x06, 0x08, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x08, 0x09, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x08, 0x09, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x09, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x05, 0x08, 0x09, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x05, 0x08, 0x09, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x05, 0x08, 0x09, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x05, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x05, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x05, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0x00, 0x01, 0x02, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x0e, 0x80, 0x80, 0x80, 0x80},
+};
+
+/**
+ * Row offset of `UTF8_PACK_SHUFFLE` contributed by a 4-bit lane mask: sum of 3^lane over set bits
+ */
+static const uint8_t UTF8_PACK_INDEX[16] = {0, 1, 3, 4, 9, 10, 12, 13, 27, 28, 30, 31, 36, 37, 39, 40};
+
+/**
+ * Encodes 4 BMP code points (no surrogates) into 4..12 bytes, storing 16 bytes at pOut
+ * @return number of bytes produced
+ */
+UNICODE_TARGET_SSSE3 static size_t
+utf8_pack_bmp_ssse3(const __m128i code_points, uint8_t *pOut) {
+    const __m128i low_6 = _mm_set1_epi32(0x3F);
+    const __m128i cont = _mm_set1_epi32(0x80);
+    const __m128i byte_last = _mm_or_si128(_mm_and_si128(code_points, low_6), cont);
+    const __m128i byte_mid = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(code_points, 6), low_6), cont);
+
+    // 110xxxxx 10xxxxxx
+    const __m128i two = _mm_or_si128(
+        _mm_or_si128(_mm_srli_epi32(code_points, 6), _mm_set1_epi32(0xC0)),
+        _mm_slli_epi32(byte_last, 8));
+    // 1110xxxx 10xxxxxx 10xxxxxx
+    const __m128i three = _mm_or_si128(
+        _mm_or_si128(_mm_srli_epi32(code_points, 12), _mm_set1_epi32(0xE0)),
+        _mm_or_si128(_mm_slli_epi32(byte_mid, 8), _mm_slli_epi32(byte_last, 16)));
+
+    const __m128i ge_2 = _mm_cmpgt_epi32(code_points, _mm_set1_epi32(0x7F));
+    const __m128i ge_3 = _mm_cmpgt_epi32(code_points, _mm_set1_epi32(0x7FF));
+    const __m128i lanes = _mm_or_si128(
+        _mm_andnot_si128(ge_2, code_points),
+        _mm_or_si128(_mm_and_si128(_mm_andnot_si128(ge_3, ge_2), two), _mm_and_si128(ge_3, three)));
+
+    const int mask_2 = _mm_movemask_ps(_mm_castsi128_ps(ge_2));
+    const int mask_3 = _mm_movemask_ps(_mm_castsi128_ps(ge_3));
+    const __m128i shuffle = _mm_loadu_si128(
+        (const __m128i *) UTF8_PACK_SHUFFLE[UTF8_PACK_INDEX[mask_2] + UTF8_PACK_INDEX[mask_3]]);
+    _mm_storeu_si128((__m128i *) pOut, _mm_shuffle_epi8(lanes, shuffle));
+
+    return 4 + __builtin_popcount(mask_2) + __builtin_popcount(mask_3);
+}
+
+/**
+ * Sums UTF-8 lengths of code points four at a time. Comparisons are signed, so lanes are biased by 2^31 to compare
+ * them as unsigned
+ */
+static size_t
+utf32_to_utf8_len_sse2(const uint32_t *pSrc, const size_t n, size_t *pLen) {
+    const __m128i bias = _mm_set1_epi32((int) 0x80000000);
+    const __m128i max_1 = _mm_set1_epi32((int) (0x80000000 | 0x7F));
+    const __m128i max_2 = _mm_set1_epi32((int) (0x80000000 | 0x7FF));
+    const __m128i max_3 = _mm_set1_epi32((int) (0x80000000 | 0xFFFF));
+    const __m128i max_4 = _mm_set1_epi32((int) (0x80000000 | 0x10FFFF));
+    size_t i = 0;
+
+    while (i + 4 <= n) {
+        // lanes add up to 4 per step, flush them before 32-bit lanes can overflow
+        const size_t end = n - i > (1u << 24) ? i + (1u << 24) : n;
+        __m128i lens = _mm_setzero_si128();
+        for (; i + 4 <= end; i += 4) {
+            const __m128i biased = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (pSrc + i)), bias);
+            // comparison masks are -1, above U+10FFFF the extra byte is taken back
+            lens = _mm_sub_epi32(lens, _mm_add_epi32(
+                _mm_add_epi32(_mm_cmpgt_epi32(biased, max_1), _mm_cmpgt_epi32(biased, max_2)),
+                _mm_sub_epi32(_mm_cmpgt_epi32(biased, max_3), _mm_cmpgt_epi32(biased, max_4))));
+        }
+        uint32_t lanes[4];
+        _mm_storeu_si128((__m128i *) lanes, lens);
+        *pLen += (size_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    // one byte per code point was not counted by the lanes
+    *pLen += i;
+    return i;
+}
+
+/**
+ * Packs 16 ASCII code points into 16 bytes
+ * @return 1 if all 16 code points were ASCII and written
+ */
+static inline int
+utf32_to_utf8_ascii_sse2(const uint32_t *pSrc, uint8_t *pOut) {
+    const __m128i a = _mm_loadu_si128((const __m128i *) pSrc);
+    const __m128i b = _mm_loadu_si128((const __m128i *) (pSrc + 4));
+    const __m128i c = _mm_loadu_si128((const __m128i *) (pSrc + 8));
+    const __m128i d = _mm_loadu_si128((const __m128i *) (pSrc + 12));
+    const __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+    const __m128i non_ascii = _mm_and_si128(any, _mm_set1_epi32(~0x7F));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(non_ascii, _mm_setzero_si128())) != 0xFFFF) {
+        return 0;
+    }
+
+    const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+    _mm_storeu_si128((__m128i *) pOut, bytes);
+    return 1;
+}
+
+/**
+ * Encodes 4 BMP code points, storing 16 bytes at pOut
+ * @return number of bytes produced, 0 if any code point is not in the BMP or is a surrogate
+ */
+UNICODE_TARGET_SSSE3 static size_t
+utf32_to_utf8_bmp_ssse3(const uint32_t *pSrc, uint8_t *pOut) {
+    const __m128i code_points = _mm_loadu_si128((const __m128i *) pSrc);
+    const __m128i above_bmp = _mm_and_si128(code_points, _mm_set1_epi32((int) 0xFFFF0000));
+    const __m128i surrogate = _mm_cmpeq_epi32(_mm_and_si128(code_points, _mm_set1_epi32(0xF800)),
+                                              _mm_set1_epi32(0xD800));
+    const __m128i in_bmp = _mm_cmpeq_epi32(above_bmp, _mm_setzero_si128());
+    if (_mm_movemask_epi8(_mm_andnot_si128(surrogate, in_bmp)) != 0xFFFF) {
+        return 0;
+    }
+    return utf8_pack_bmp_ssse3(code_points, pOut);
+}
+
+/**
+ * Loads 8 UTF-16 code units as native 16-bit lanes
+ */
+static inline __m128i
+load_utf16_block(const uint16_t *pSrc, const UnicodeByteOrder order) {
+    const __m128i units = _mm_loadu_si128((const __m128i *) pSrc);
+    return order == UNICODE_BIG_ENDIAN ? bswap16_sse2(units) : units;
+}
+
+static inline int
+utf16_block_has_surrogates(const __m128i units) {
+    return _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(units, _mm_set1_epi16((short) 0xF800)),
+                                             _mm_set1_epi16((short) 0xD800)));
+}
+
+/**
+ * Adds UTF-8 length of 8 code units to *pLen
+ * @return 1 if the block has no surrogates and was counted
+ */
+static inline int
+utf16_to_utf8_len_sse2(const uint16_t *pSrc, const UnicodeByteOrder order, size_t *pLen) {
+    const __m128i units = load_utf16_block(pSrc, order);
+    if (utf16_block_has_surrogates(units)) {
+        return 0;
+    }
+    const __m128i zero = _mm_setzero_si128();
+    const int ascii = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(units, _mm_set1_epi16((short) 0xFF80)), zero));
+    const int up_to_2 = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(units, _mm_set1_epi16((short) 0xF800)), zero));
+    // masks have 2 bits per lane, every non-ASCII lane adds a byte, every lane above U+07FF one more
+    *pLen += 8 + (__builtin_popcount(~ascii & 0xFFFF) + __builtin_popcount(~up_to_2 & 0xFFFF)) / 2;
+    return 1;
+}
+
+/**
+ * Packs 8 ASCII code units into 8 bytes
+ * @return 1 if all 8 code units were ASCII and written
+ */
+static inline int
+utf16_to_utf8_ascii_sse2(const uint16_t *pSrc, uint8_t *pOut, const UnicodeByteOrder order) {
+    const __m128i units = load_utf16_block(pSrc, order);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(units, _mm_set1_epi16((short) 0xFF80)),
+                                          _mm_setzero_si128())) != 0xFFFF) {
+        return 0;
+    }
+    _mm_storel_epi64((__m128i *) pOut, _mm_packus_epi16(units, units));
+    return 1;
+}
+
+/**
+ * Encodes 8 BMP code units (no surrogates) into 8..24 bytes, storing up to 28 bytes at pOut
+ * @return number of bytes produced, 0 if the block has surrogates
+ */
+UNICODE_TARGET_SSSE3 static size_t
+utf16_to_utf8_bmp_ssse3(const uint16_t *pSrc, uint8_t *pOut, const UnicodeByteOrder order) {
+    const __m128i units = load_utf16_block(pSrc, order);
+    if (utf16_block_has_surrogates(units)) {
+        return 0;
+    }
+    const __m128i zero = _mm_setzero_si128();
+    const size_t len = utf8_pack_bmp_ssse3(_mm_unpacklo_epi16(units, zero), pOut);
+    return len + utf8_pack_bmp_ssse3(_mm_unpackhi_epi16(units, zero), pOut + len);
+}
+#endif
+
+/**
+ * Number of UTF-16 code units of well-formed UTF-8: one per char and one more per 4-byte char
+ */
+static size_t
+utf16_len_of_valid_utf8(const uint8_t *pStr, const size_t n) {
+    size_t len = 0;
+    size_t i = 0;
+
+#ifdef UNICODE_SIMD_X86
+    for (; i + 16 <= n; i += 16) {
+        const __m128i block = _mm_loadu_si128((const __m128i *) (pStr + i));
+        // continuation bytes are -128..-65 as signed bytes
+        const int chars = _mm_movemask_epi8(_mm_cmpgt_epi8(block, _mm_set1_epi8(-65)));
+        const int four_byte = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(block, _mm_set1_epi8((char) 0xF0)), block));
+        len += __builtin_popcount(chars) + __builtin_popcount(four_byte);
+    }
+#endif
+    for (; i < n; i++) {
+        len += ((pStr[i] & 0xC0) != 0x80) + (pStr[i] >= 0xF0);
+    }
+
+    return len;
+}
+
+UnicodeTranscodeResult
+utf8_to_utf32(const uint8_t *src, const size_t n, uint32_t *dst) {
+    const uint8_t *pStr = src;
+    const uint8_t *pEnd = src + n;
+    uint32_t *pOut = dst;
+    size_t replaced = 0;
+
+#ifdef UNICODE_SIMD_X86
+    const int has_avx2 = unicode_cpu_has_avx2();
+    const int has_ssse3 = unicode_cpu_has_ssse3();
+
+    while (pEnd - pStr >= 16) {
+        const __m128i block = _mm_loadu_si128((const __m128i *) pStr);
+        size_t consumed = 0, produced = 0;
+
+        // the kernel is picked by the first char, and decodes as many chars of the same length as it can
+        if (*pStr < 0x80) {
+            if (has_avx2) {
+                consumed = utf8_to_utf32_ascii_avx2(pStr, pEnd - pStr, pOut);
+            }
+            if (!consumed) {
+                consumed = utf8_to_utf32_ascii_sse2(block, pOut);
+            }
+            produced = consumed;
+        } else if ((*pStr & 0xE0) == 0xC0) {
+            consumed = utf8_to_utf32_2byte_sse2(block, pOut);
+            produced = consumed / 2;
+        } else if ((*pStr & 0xF0) == 0xE0 && has_ssse3) {
+            consumed = utf8_to_utf32_3byte_ssse3(block, pOut);
+            produced = consumed / 3;
+        }
+
+        pStr += consumed;
+        pOut += produced;
+        if (consumed < 4) {
+            // a 4-byte or ill-formed char, or a short run in mixed text: the next char is cheaper to decode directly.
+            // 12 bytes are still left, so it can't be cut by the end of input
+            pStr += decode_utf8_char(pStr, pEnd, pOut);
+            replaced += replace_ill_formed(pOut++);
+        }
+    }
+#endif
+
+    while (pStr < pEnd) {
+        const uint8_t consumed = decode_utf8_char(pStr, pEnd, pOut);
+        if (!consumed) {
+            break;
+        }
+        pStr += consumed;
+        replaced += replace_ill_formed(pOut++);
+    }
+
+    return (UnicodeTranscodeResult){(size_t) (pStr - src), (size_t) (pOut - dst), replaced};
+}
+
+size_t
+utf32_to_utf8_len(const uint32_t *src, const size_t n) {
+    size_t len = 0;
+    size_t i = 0;
+
+#ifdef UNICODE_SIMD_X86
+    i = utf32_to_utf8_len_sse2(src, n, &len);
+#endif
+    for (; i < n; i++) {
+        len += utf8_encoded_len(src[i]);
+    }
+
+    return len;
+}
+
+UnicodeTranscodeResult
+utf32_to_utf8(const uint32_t *src, const size_t n, uint8_t *dst, const size_t cap) {
+    uint8_t *pOut = dst;
+    const uint8_t *pOutEnd = dst + cap;
+    size_t replaced = 0;
+    size_t i = 0;
+
+#ifdef UNICODE_SIMD_X86
+    const int has_ssse3 = unicode_cpu_has_ssse3();
+
+    // kernels store whole 16-byte vectors
+    while (n - i >= 4 && pOutEnd - pOut >= 16) {
+        if (src[i] < 0x80 && n - i >= 16 && utf32_to_utf8_ascii_sse2(src + i, pOut)) {
+            i += 16;
+            pOut += 16;
+            continue;
+        }
+        if (has_ssse3) {
+            const size_t produced = utf32_to_utf8_bmp_ssse3(src + i, pOut);
+            if (produced) {
+                i += 4;
+                pOut += produced;
+                continue;
+            }
+        }
+
+        uint32_t code_point = src[i++];
+        const uint8_t len = utf8_encoded_len(code_point);
+        replaced += replace_invalid_code_point(&code_point);
+        encode_utf8_char(code_point, len, pOut);
+        pOut += len;
+    }
+#endif
+
+    for (; i < n; i++) {
+        uint32_t code_point = src[i];
+        const uint8_t len = utf8_encoded_len(code_point);
+        if (len > pOutEnd - pOut) {
+            break;
+        }
+        replaced += replace_invalid_code_point(&code_point);
+        encode_utf8_char(code_point, len, pOut);
+        pOut += len;
+    }
+
+    return (UnicodeTranscodeResult){i, (size_t) (pOut - dst), replaced};
+}
+
+size_t
+utf8_to_utf16_len(const uint8_t *src, const size_t n) {
+    const uint8_t *pStr = src;
+    const uint8_t *pEnd = src + n;
+    size_t len = 0;
+
+    while (pStr < pEnd) {
+        // well-formed runs are counted by their lead bytes, ill-formed subsequences are decoded to be skipped
+        size_t valid_len = pEnd - pStr;
+        unicode_validate(pStr, pEnd - pStr, &valid_len);
+        len += utf16_len_of_valid_utf8(pStr, valid_len);
+        pStr += valid_len;
+        if (pStr == pEnd) {
+            break;
+        }
+
+        uint32_t code_point;
+        const uint8_t consumed = decode_utf8_char(pStr, pEnd, &code_point);
+        if (!consumed) {
+            break;
+        }
+        pStr += consumed;
+        len++;
+    }
+
+    return len;
+}
+
+UnicodeTranscodeResult
+utf8_to_utf16(const uint8_t *src, const size_t n, uint16_t *dst, const size_t cap, const UnicodeByteOrder order) {
+    const uint8_t *pStr = src;
+    const uint8_t *pEnd = src + n;
+    uint16_t *pOut = dst;
+    const uint16_t *pOutEnd = dst + cap;
+    size_t replaced = 0;
+    uint32_t code_point = 0;
+
+#ifdef UNICODE_SIMD_X86
+    const int has_ssse3 = unicode_cpu_has_ssse3();
+
+    // kernels store up to 16 code units, a char decoded in between takes 2 more at most
+    while (pEnd - pStr >= 16 && pOutEnd - pOut >= 18) {
+        const __m128i block = _mm_loadu_si128((const __m128i *) pStr);
+        size_t consumed = 0, produced = 0;
+
+        if (*pStr < 0x80) {
+            consumed = produced = utf8_to_utf16_ascii_sse2(block, pOut, order);
+        } else if ((*pStr & 0xE0) == 0xC0) {
+            consumed = utf8_to_utf16_2byte_sse2(block, pOut, order);
+            produced = consumed / 2;
+        } else if ((*pStr & 0xF0) == 0xE0 && has_ssse3) {
+            consumed = utf8_to_utf16_3byte_ssse3(block, pOut, order);
+            produced = consumed / 3;
+        }
+
+        pStr += consumed;
+        pOut += produced;
+        if (consumed < 4) {
+            pStr += decode_utf8_char(pStr, pEnd, &code_point);
+            replaced += replace_ill_formed(&code_point);
+            pOut += encode_utf16_char(code_point, pOut, order);
+        }
+    }
+#endif
+
+    while (pStr < pEnd) {
+        const uint8_t consumed = decode_utf8_char(pStr, pEnd, &code_point);
+        if (!consumed) {
+            break;
+        }
+        const uint8_t replacement = replace_ill_formed(&code_point);
+        if ((code_point > 0xFFFF ? 2 : 1) > pOutEnd - pOut) {
+            break;
+        }
+        pStr += consumed;
+        replaced += replacement;
+        pOut += encode_utf16_char(code_point, pOut, order);
+    }
+
+    return (UnicodeTranscodeResult){(size_t) (pStr - src), (size_t) (pOut - dst), replaced};
+}
+
+size_t
+utf16_to_utf8_len(const uint16_t *src, const size_t n, const UnicodeByteOrder order) {
+    size_t len = 0;
+    size_t i = 0;
+
+    while (i < n) {
+#ifdef UNICODE_SIMD_X86
+        if (n - i >= 8 && utf16_to_utf8_len_sse2(src + i, order, &len)) {
+            i += 8;
+            continue;
+        }
+#endif
+        uint32_t code_point;
+        const uint8_t consumed = decode_utf16_char(src + i, src + n, order, &code_point);
+        if (!consumed) {
+            break;
+        }
+        // ILL_FORMED_CODE_POINT is above U+10FFFF and counts as U+FFFD too
+        len += utf8_encoded_len(code_point);
+        i += consumed;
+    }
+
+    return len;
+}
+
+UnicodeTranscodeResult
+utf16_to_utf8(const uint16_t *src, const size_t n, uint8_t *dst, const size_t cap, const UnicodeByteOrder order) {
+    uint8_t *pOut = dst;
+    const uint8_t *pOutEnd = dst + cap;
+    size_t replaced = 0;
+    size_t i = 0;
+    uint32_t code_point = 0;
+
+#ifdef UNICODE_SIMD_X86
+    const int has_ssse3 = unicode_cpu_has_ssse3();
+
+    // kernels store up to 28 bytes
+    while (n - i >= 8 && pOutEnd - pOut >= 32) {
+        if (load_utf16_unit(src + i, order) < 0x80 && utf16_to_utf8_ascii_sse2(src + i, pOut, order)) {
+            i += 8;
+            pOut += 8;
+            continue;
+        }
+        if (has_ssse3) {
+            const size_t produced = utf16_to_utf8_bmp_ssse3(src + i, pOut, order);
+            if (produced) {
+                i += 8;
+                pOut += produced;
+                continue;
+            }
+        }
+
+        i += decode_utf16_char(src + i, src + n, order, &code_point);
+        replaced += replace_ill_formed(&code_point);
+        const uint8_t len = utf8_encoded_len(code_point);
+        encode_utf8_char(code_point, len, pOut);
+        pOut += len;
+    }
+#endif
+
+    while (i < n) {
+        const uint8_t consumed = decode_utf16_char(src + i, src + n, order, &code_point);
+        if (!consumed) {
+            break;
+        }
+        const uint8_t len = utf8_encoded_len(code_point);
+        if (len > pOutEnd - pOut) {
+            break;
+        }
+        replaced += replace_ill_formed(&code_point);
+        encode_utf8_char(code_point, len, pOut);
+        pOut += len;
+        i += consumed;
+    }
+
+    return (UnicodeTranscodeResult){i, (size_t) (pOut - dst), replaced};
+}
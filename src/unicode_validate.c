@@ -0,0 +1,331 @@
+//
+// Strict UTF-8 validation: table-driven DFA for scalar targets, lookup-table vector validator for SSSE3 / AVX2.
+//
+
+#include "unicode.h"
+#include "unicode_simd.h"
+
+/**
+ * DFA byte classes (Unicode Table 3-7 "Well-Formed UTF-8 Byte Sequences"):
+ * 0: 00..7F, 1: 80..8F, 2: 90..9F, 3: A0..BF, 4: C0..C1 / F5..FF, 5: C2..DF,
+ * 6: E0, 7: E1..EC / EE..EF, 8: ED, 9: F0, 10: F1..F3, 11: F4
+ */
+static const uint8_t UTF8_BYTE_CLASS[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    4, 4, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 7, 9, 10, 10, 10, 11, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+};
+
+/**
+ * DFA states
+ */
+enum {
+    DFA_ACCEPT = 0,
+    DFA_REJECT,
+    // one more continuation byte of any value
+    DFA_CONT_1,
+    DFA_CONT_2,
+    DFA_CONT_3,
+    // second byte after E0 (A0..BF), ED (80..9F), F0 (90..BF), F4 (80..8F)
+    DFA_AFTER_E0,
+    DFA_AFTER_ED,
+    DFA_AFTER_F0,
+    DFA_AFTER_F4,
+};
+
+static const uint8_t UTF8_DFA[9][12] = {
+    [DFA_ACCEPT] = {
+        DFA_ACCEPT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_CONT_1,
+        DFA_AFTER_E0, DFA_CONT_2, DFA_AFTER_ED, DFA_AFTER_F0, DFA_CONT_3, DFA_AFTER_F4
+    },
+    [DFA_REJECT] = {
+        DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT,
+        DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT
+    },
+    [DFA_CONT_1] = {
+        DFA_REJECT, DFA_ACCEPT, DFA_ACCEPT, DFA_ACCEPT, DFA_REJECT, DFA_REJECT,
+        DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT
+    },
+    [DFA_CONT_2] = {
+        DFA_REJECT, DFA_CONT_1, DFA_CONT_1, DFA_CONT_1, DFA_REJECT, DFA_REJECT,
+        DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT
+    },
+    [DFA_CONT_3] = {
+        DFA_REJECT, DFA_CONT_2, DFA_CONT_2, DFA_CONT_2, DFA_REJECT, DFA_REJECT,
+        DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT
+    },
+    [DFA_AFTER_E0] = {
+        DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_CONT_1, DFA_REJECT, DFA_REJECT,
+        DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT
+    },
+    [DFA_AFTER_ED] = {
+        DFA_REJECT, DFA_CONT_1, DFA_CONT_1, DFA_REJECT, DFA_REJECT, DFA_REJECT,
+        DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT
+    },
+    [DFA_AFTER_F0] = {
+        DFA_REJECT, DFA_REJECT, DFA_CONT_2, DFA_CONT_2, DFA_REJECT, DFA_REJECT,
+        DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT
+    },
+    [DFA_AFTER_F4] = {
+        DFA_REJECT, DFA_CONT_2, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT,
+        DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT, DFA_REJECT
+    },
+};
+
+/**
+ * Runs the DFA over pStr[0..len), skipping ASCII runs while between sequences
+ * @return 1 if valid, else 0 with *pErrorOffset set to the start of the first ill-formed sequence
+ */
+static int
+validate_dfa(const uint8_t *pStr, const size_t len, size_t *pErrorOffset) {
+    uint8_t state = DFA_ACCEPT;
+    size_t sequence_start = 0;
+    size_t i = 0;
+
+    while (i < len) {
+        if (state == DFA_ACCEPT) {
+            i += ascii_prefix_len(pStr + i, len - i);
+            if (i == len) {
+                break;
+            }
+            sequence_start = i;
+        }
+        state = UTF8_DFA[state][UTF8_BYTE_CLASS[pStr[i]]];
+        if (state == DFA_REJECT) {
+            *pErrorOffset = sequence_start;
+            return 0;
+        }
+        i++;
+    }
+
+    if (state != DFA_ACCEPT) {
+        // truncated by the end of input
+        *pErrorOffset = sequence_start;
+        return 0;
+    }
+    return 1;
+}
+
+#ifdef UNICODE_SIMD_X86
+/**
+ * Error flags of the lookup validator. Each of three tables maps a nibble (high / low of the previous byte, high of the
+ * current one) to flags of errors it may take part in; a byte pair is invalid iff all three agree on a flag.
+ * See Keiser, Lemire: "Validating UTF-8 In Less Than One Instruction Per Byte"
+ */
+#define TOO_SHORT (1 << 0)
+#define TOO_LONG (1 << 1)
+#define OVERLONG_3 (1 << 2)
+#define TOO_LARGE (1 << 3)
+#define SURROGATE (1 << 4)
+#define OVERLONG_2 (1 << 5)
+#define TOO_LARGE_1000 (1 << 6)
+#define OVERLONG_4 (1 << 6)
+#define TWO_CONTS (1 << 7)
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+static const uint8_t BYTE_1_HIGH[16] = {
+    // 0___ ASCII
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    // 10__ continuation
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    // 1100, 1101 two-byte lead
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    // 1110 three-byte lead
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    // 1111 four-byte lead
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+};
+
+static const uint8_t BYTE_1_LOW[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000
+};
+
+static const uint8_t BYTE_2_HIGH[16] = {
+    // 0___ ASCII
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    // 1000, 1001, 101_ continuation
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    // 11__ lead
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+};
+
+/**
+ * Last bytes of a block that start a sequence not finished within it: x > INCOMPLETE_MAX[i]
+ */
+static const uint8_t INCOMPLETE_MAX[32] = {
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+};
+
+UNICODE_TARGET_AVX2 static __m256i
+lookup_nibble_avx2(const uint8_t table[16], const __m256i nibbles) {
+    return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) table)), nibbles);
+}
+
+/**
+ * Validates whole 32-byte blocks of pStr[0..len)
+ * @return offset of the first block with an error, or of the first byte after the last whole block. Everything
+ * before the char that contains this offset is valid
+ */
+UNICODE_TARGET_AVX2 static size_t
+validate_blocks_avx2(const uint8_t *pStr, const size_t len) {
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+    const __m256i incomplete_max = _mm256_loadu_si256((const __m256i *) INCOMPLETE_MAX);
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        const __m256i input = _mm256_loadu_si256((const __m256i *) (pStr + i));
+
+        if (!_mm256_movemask_epi8(input)) {
+            // ASCII block is valid unless the previous block left a sequence unfinished
+            if (!_mm256_testz_si256(prev_incomplete, prev_incomplete)) {
+                break;
+            }
+            prev_input = input;
+            continue;
+        }
+
+        const __m256i prev_block = _mm256_permute2x128_si256(prev_input, input, 0x21);
+        const __m256i prev1 = _mm256_alignr_epi8(input, prev_block, 15);
+        const __m256i prev2 = _mm256_alignr_epi8(input, prev_block, 14);
+        const __m256i prev3 = _mm256_alignr_epi8(input, prev_block, 13);
+
+        const __m256i byte_1_high = lookup_nibble_avx2(
+            BYTE_1_HIGH, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble));
+        const __m256i byte_1_low = lookup_nibble_avx2(BYTE_1_LOW, _mm256_and_si256(prev1, low_nibble));
+        const __m256i byte_2_high = lookup_nibble_avx2(
+            BYTE_2_HIGH, _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble));
+        const __m256i special_cases = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+        // third and fourth bytes of a sequence must be continuations, which special cases report as TWO_CONTS
+        const __m256i is_third = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char) (0xE0 - 0x80)));
+        const __m256i is_fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char) (0xF0 - 0x80)));
+        const __m256i must_be_cont = _mm256_and_si256(
+            _mm256_or_si256(is_third, is_fourth), _mm256_set1_epi8((char) 0x80));
+
+        const __m256i error = _mm256_xor_si256(must_be_cont, special_cases);
+        if (!_mm256_testz_si256(error, error)) {
+            break;
+        }
+
+        prev_incomplete = _mm256_subs_epu8(input, incomplete_max);
+        prev_input = input;
+    }
+
+    return i;
+}
+
+UNICODE_TARGET_SSSE3 static __m128i
+lookup_nibble_ssse3(const uint8_t table[16], const __m128i nibbles) {
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) table), nibbles);
+}
+
+/**
+ * Same as `validate_blocks_avx2` for 16-byte blocks
+ */
+UNICODE_TARGET_SSSE3 static size_t
+validate_blocks_ssse3(const uint8_t *pStr, const size_t len) {
+    const __m128i low_nibble = _mm_set1_epi8(0x0F);
+    const __m128i incomplete_max = _mm_loadu_si128((const __m128i *) (INCOMPLETE_MAX + 16));
+    __m128i prev_input = _mm_setzero_si128();
+    __m128i prev_incomplete = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        const __m128i input = _mm_loadu_si128((const __m128i *) (pStr + i));
+
+        if (!_mm_movemask_epi8(input)) {
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(prev_incomplete, _mm_setzero_si128())) != 0xFFFF) {
+                break;
+            }
+            prev_input = input;
+            continue;
+        }
+
+        const __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+        const __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+        const __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+
+        const __m128i byte_1_high = lookup_nibble_ssse3(
+            BYTE_1_HIGH, _mm_and_si128(_mm_srli_epi16(prev1, 4), low_nibble));
+        const __m128i byte_1_low = lookup_nibble_ssse3(BYTE_1_LOW, _mm_and_si128(prev1, low_nibble));
+        const __m128i byte_2_high = lookup_nibble_ssse3(
+            BYTE_2_HIGH, _mm_and_si128(_mm_srli_epi16(input, 4), low_nibble));
+        const __m128i special_cases = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+        const __m128i is_third = _mm_subs_epu8(prev2, _mm_set1_epi8((char) (0xE0 - 0x80)));
+        const __m128i is_fourth = _mm_subs_epu8(prev3, _mm_set1_epi8((char) (0xF0 - 0x80)));
+        const __m128i must_be_cont = _mm_and_si128(_mm_or_si128(is_third, is_fourth), _mm_set1_epi8((char) 0x80));
+
+        const __m128i error = _mm_xor_si128(must_be_cont, special_cases);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) != 0xFFFF) {
+            break;
+        }
+
+        prev_incomplete = _mm_subs_epu8(input, incomplete_max);
+        prev_input = input;
+    }
+
+    return i;
+}
+#endif
+
+int
+unicode_validate(const uint8_t *pStr, const size_t len, size_t *pErrorOffset) {
+    size_t error_offset;
+    size_t start = 0;
+
+#ifdef UNICODE_SIMD_X86
+    if (unicode_cpu_has_avx2()) {
+        start = validate_blocks_avx2(pStr, len);
+    } else if (unicode_cpu_has_ssse3()) {
+        start = validate_blocks_ssse3(pStr, len);
+    }
+    // the rest (a failed block or the tail) is checked by the DFA, starting from the lead byte of a sequence
+    // the last validated block may have left unfinished
+    for (size_t back = 1; back <= 3 && back <= start; back++) {
+        const uint8_t byte = pStr[start - back];
+        if (byte < 0x80) {
+            break;
+        }
+        if (byte >= 0xC0) {
+            start -= back;
+            break;
+        }
+    }
+#endif
+
+    if (validate_dfa(pStr + start, len - start, &error_offset)) {
+        return 1;
+    }
+    if (pErrorOffset != NULL) {
+        *pErrorOffset = start + error_offset;
+    }
+    return 0;
+}
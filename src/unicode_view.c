@@ -0,0 +1,82 @@
+//
+// Non-owning views over borrowed UTF-8 bytes.
+//
+
+#include <string.h>
+
+#include "unicode_view.h"
+#include "unicode_internal.h"
+#include "unicode_simd.h"
+
+UnicodeView
+unicode_view(const uint8_t *pStr, const size_t nbytes) {
+    return (UnicodeView){pStr, nbytes};
+}
+
+UnicodeView
+unicode_view_cstr(const char *pStr) {
+    return (UnicodeView){(const uint8_t *) pStr, strlen(pStr)};
+}
+
+uint8_t
+unicode_view_peek(const UnicodeView *view, UnicodeChar *pOut) {
+    if (!view->nbytes) {
+        return 0;
+    }
+
+    UnicodeChar uchar = {{*view->p, 0, 0, 0}, 1};
+    const uint8_t consumed = *view->p < 0x80 ? 1 : decode_one_n(view->p, view->p + view->nbytes, &uchar);
+    if (pOut != NULL) {
+        *pOut = uchar;
+    }
+    return consumed;
+}
+
+uint8_t
+unicode_view_next(UnicodeView *view, UnicodeChar *pOut) {
+    const uint8_t consumed = unicode_view_peek(view, pOut);
+    view->p += consumed;
+    view->nbytes -= consumed;
+    return consumed;
+}
+
+uint8_t
+unicode_view_peek_code_point(const UnicodeView *view, uint32_t *pOut) {
+    UnicodeChar uchar;
+    const uint8_t consumed = unicode_view_peek(view, &uchar);
+    if (consumed && pOut != NULL) {
+        *pOut = uchar_to_code_point(uchar);
+    }
+    return consumed;
+}
+
+uint8_t
+unicode_view_next_code_point(UnicodeView *view, uint32_t *pOut) {
+    const uint8_t consumed = unicode_view_peek_code_point(view, pOut);
+    view->p += consumed;
+    view->nbytes -= consumed;
+    return consumed;
+}
+
+UnicodeView
+unicode_view_slice_bytes(const UnicodeView view, size_t start, size_t end) {
+    if (end > view.nbytes) {
+        end = view.nbytes;
+    }
+    if (start > end) {
+        start = end;
+    }
+    return (UnicodeView){view.p + start, end - start};
+}
+
+UnicodeView
+unicode_view_slice(const UnicodeView view, const size_t start, size_t end) {
+    if (end < start) {
+        end = start;
+    }
+    size_t head = start;
+    size_t count = end - start;
+    const size_t start_offset = utf8_skip_chars(view.p, view.nbytes, &head);
+    const size_t end_offset = start_offset + utf8_skip_chars(view.p + start_offset, view.nbytes - start_offset, &count);
+    return (UnicodeView){view.p + start_offset, end_offset - start_offset};
+}
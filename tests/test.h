@@ -0,0 +1,298 @@
+//
+// Assertions and random input shared by the tests. A failed check is reported and counted, the test goes on, so one
+// run shows every difference from the reference.
+//
+#pragma once
+
+#ifndef UNICODE_TEST_H
+#define UNICODE_TEST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Max number of failed checks printed, the rest are only counted
+ */
+#define TEST_MAX_REPORTS 20
+
+static int test_failures = 0;
+
+/**
+ * Counts a failed check and prints where it is
+ */
+static inline void
+test_fail(const char *file, const int line, const char *expr, const unsigned long long actual,
+          const unsigned long long expected) {
+    if (test_failures++ < TEST_MAX_REPORTS) {
+        fprintf(stderr, "%s:%d: %s: got %llu (0x%llx), expected %llu (0x%llx)\n", file, line, expr, actual, actual,
+                expected, expected);
+    }
+}
+
+#define CHECK(cond)                                                                                                    \
+    do {                                                                                                               \
+        if (!(cond)) {                                                                                                 \
+            test_fail(__FILE__, __LINE__, #cond, 0, 1);                                                                \
+        }                                                                                                              \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                                                     \
+    do {                                                                                                               \
+        const unsigned long long actual_ = (unsigned long long) (actual);                                              \
+        const unsigned long long expected_ = (unsigned long long) (expected);                                          \
+        if (actual_ != expected_) {                                                                                    \
+            test_fail(__FILE__, __LINE__, #actual " == " #expected, actual_, expected_);                               \
+        }                                                                                                              \
+    } while (0)
+
+/**
+ * Exit status of a test: prints the number of failed checks
+ */
+static inline int
+test_result(const char *name) {
+    if (test_failures) {
+        fprintf(stderr, "%s: %d checks failed\n", name, test_failures);
+        return 1;
+    }
+    return 0;
+}
+
+/* ============ Random input ============ */
+
+static uint64_t test_rng_state = 0x9E3779B97F4A7C15ULL;
+
+/**
+ * xorshift64* generator with a fixed seed, so failures reproduce
+ */
+static inline uint32_t
+test_rand(void) {
+    uint64_t x = test_rng_state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    test_rng_state = x;
+    return (uint32_t) ((x * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static inline uint32_t
+test_rand_below(const uint32_t n) {
+    return test_rand() % n;
+}
+
+/**
+ * Random code point of a UTF-8 length class: 1..4 bytes, anything but surrogates
+ */
+static inline uint32_t
+test_rand_code_point(const int octets) {
+    switch (octets) {
+        case 1:
+            return test_rand_below(0x80);
+        case 2:
+            return 0x80 + test_rand_below(0x780);
+        case 3: {
+            const uint32_t code_point = 0x800 + test_rand_below(0xF800);
+            return code_point >= 0xD800 && code_point < 0xE000 ? code_point + 0x800 : code_point;
+        }
+        default:
+            return 0x10000 + test_rand_below(0x100000);
+    }
+}
+
+static inline size_t
+test_encode_utf8(const uint32_t code_point, uint8_t *pOut) {
+    if (code_point < 0x80) {
+        pOut[0] = (uint8_t) code_point;
+        return 1;
+    }
+    if (code_point < 0x800) {
+        pOut[0] = (uint8_t) (0xC0 | code_point >> 6);
+        pOut[1] = (uint8_t) (0x80 | (code_point & 0x3F));
+        return 2;
+    }
+    if (code_point < 0x10000) {
+        pOut[0] = (uint8_t) (0xE0 | code_point >> 12);
+        pOut[1] = (uint8_t) (0x80 | (code_point >> 6 & 0x3F));
+        pOut[2] = (uint8_t) (0x80 | (code_point & 0x3F));
+        return 3;
+    }
+    pOut[0] = (uint8_t) (0xF0 | code_point >> 18);
+    pOut[1] = (uint8_t) (0x80 | (code_point >> 12 & 0x3F));
+    pOut[2] = (uint8_t) (0x80 | (code_point >> 6 & 0x3F));
+    pOut[3] = (uint8_t) (0x80 | (code_point & 0x3F));
+    return 4;
+}
+
+/**
+ * Fills up to cap bytes with runs of chars of one length class, long enough for vector kernels to take them.
+ * With `ill_formed` set some runs are bytes that are not UTF-8: stray continuation bytes, overlong forms, surrogates,
+ * truncated sequences, bytes that never occur
+ * @return number of bytes written
+ */
+static inline size_t
+test_random_utf8(uint8_t *pOut, const size_t cap, const int ill_formed) {
+    static const char *const ILL_FORMED[] = {
+            "\x80", "\xBF", "\xC0\xAF", "\xC1\x81", "\xE0\x80\xAF", "\xE2\x82", "\xED\xA0\x80", "\xED\xBF\xBF",
+            "\xF0\x8F\xBF\xBF", "\xF0\x9F\x98", "\xF4\x90\x80\x80", "\xF5\x80", "\xF8\x88\x80\x80\x80", "\xFE", "\xFF",
+    };
+    size_t len = 0;
+
+    while (len + 4 <= cap) {
+        const uint32_t run = 1 + test_rand_below(test_rand_below(4) ? 40 : 3);
+        if (ill_formed && test_rand_below(4) == 0) {
+            const char *bytes = ILL_FORMED[test_rand_below(sizeof(ILL_FORMED) / sizeof(ILL_FORMED[0]))];
+            const size_t n = strlen(bytes);
+            if (len + n > cap) {
+                break;
+            }
+            memcpy(pOut + len, bytes, n);
+            len += n;
+            continue;
+        }
+        const int octets = 1 + (int) test_rand_below(4);
+        for (uint32_t i = 0; i < run && len + 4 <= cap; i++) {
+            len += test_encode_utf8(test_rand_code_point(octets), pOut + len);
+        }
+    }
+    return len;
+}
+
+/* ============ Reference decoder ============ */
+
+/**
+ * Decodes the char at pStr by the book (Unicode 3.9, table 3-7), replacing a maximal subpart of an ill-formed
+ * sequence with one U+FFFD. A plain reference the optimized decoders are compared with
+ * @return bytes consumed, 0 if pStr[0..pEnd) is a well-formed sequence prefix cut by pEnd
+ */
+static inline size_t
+test_decode_utf8(const uint8_t *pStr, const uint8_t *pEnd, uint32_t *pCodePoint, int *pIllFormed) {
+    const uint8_t lead = pStr[0];
+    uint8_t low = 0x80, high = 0xBF;
+    size_t need;
+    uint32_t code_point;
+
+    *pIllFormed = 0;
+    if (lead < 0x80) {
+        *pCodePoint = lead;
+        return 1;
+    } else if (lead >= 0xC2 && lead <= 0xDF) {
+        need = 1;
+        code_point = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        need = 2;
+        code_point = lead & 0x0F;
+        low = lead == 0xE0 ? 0xA0 : 0x80;
+        high = lead == 0xED ? 0x9F : 0xBF;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        need = 3;
+        code_point = lead & 0x07;
+        low = lead == 0xF0 ? 0x90 : 0x80;
+        high = lead == 0xF4 ? 0x8F : 0xBF;
+    } else {
+        *pCodePoint = 0xFFFD;
+        *pIllFormed = 1;
+        return 1;
+    }
+
+    for (size_t i = 1; i <= need; i++) {
+        if (pStr + i == pEnd) {
+            return 0;
+        }
+        const uint8_t byte = pStr[i];
+        if (byte < (i == 1 ? low : 0x80) || byte > (i == 1 ? high : 0xBF)) {
+            *pCodePoint = 0xFFFD;
+            *pIllFormed = 1;
+            return i;
+        }
+        code_point = code_point << 6 | (byte & 0x3F);
+    }
+    *pCodePoint = code_point;
+    return need + 1;
+}
+
+/**
+ * Decodes the char at pStr the way the library documents it: the lead byte alone gives the char size, a byte that is
+ * not a lead or whose sequence is cut by pEnd becomes a 4-octet `\xNN` char. Octets past the size are zero
+ * @return bytes consumed
+ */
+static inline size_t
+test_decode_uchar(const uint8_t *pStr, const uint8_t *pEnd, uint8_t octet[4], uint8_t *pSize) {
+    static const char HEX[] = "0123456789abcdef";
+    const uint8_t lead = *pStr;
+    const size_t size = lead < 0x80 ? 1 : lead >> 5 == 0x6 ? 2 : lead >> 4 == 0xE ? 3 : lead >> 3 == 0x1E ? 4 : 0;
+
+    memset(octet, 0, 4);
+    if (!size || size > (size_t) (pEnd - pStr)) {
+        octet[0] = '\\';
+        octet[1] = 'x';
+        octet[2] = (uint8_t) HEX[lead >> 4];
+        octet[3] = (uint8_t) HEX[lead & 0xF];
+        *pSize = 4;
+        return 1;
+    }
+    memcpy(octet, pStr, size);
+    *pSize = (uint8_t) size;
+    return size;
+}
+
+/* ============ UCD files ============ */
+
+/**
+ * Max length of a line of a UCD file, comments included
+ */
+#define TEST_UCD_LINE 8192
+
+/**
+ * Opens dir/name, a test can't run without its data, so failing to open it ends the test
+ */
+static inline FILE *
+test_open_ucd(const char *dir, const char *name) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "can't open %s\n", path);
+        exit(1);
+    }
+    return file;
+}
+
+/**
+ * Parses space-separated hex code points of a UCD field, stops at `;`, `#` or the end of line
+ * @return number of code points parsed, at most max
+ */
+static inline size_t
+test_parse_code_points(const char *field, uint32_t *pOut, const size_t max) {
+    size_t n = 0;
+    while (n < max) {
+        while (*field == ' ') {
+            field++;
+        }
+        char *pEnd;
+        const unsigned long code_point = strtoul(field, &pEnd, 16);
+        if (pEnd == field) {
+            break;
+        }
+        pOut[n++] = (uint32_t) code_point;
+        field = pEnd;
+    }
+    return n;
+}
+
+/**
+ * Returns the field after the n-th `;` of a line, NULL if the line has fewer fields
+ */
+static inline const char *
+test_ucd_field(const char *line, size_t n) {
+    for (; n; n--) {
+        line = strchr(line, ';');
+        if (line == NULL) {
+            return NULL;
+        }
+        line++;
+    }
+    return line;
+}
+
+#endif //UNICODE_TEST_H
@@ -0,0 +1,260 @@
+//
+// Case mapping and folding of every code point against UnicodeData.txt, SpecialCasing.txt and CaseFolding.txt read
+// from the UCD directory, and UTF-8 text mapping against a code point by code point reference.
+//
+
+#include "test.h"
+#include "unicode_case.h"
+
+#define CODE_POINTS 0x110000
+#define MAX_SPECIAL 512
+#define BLOCK_CODE_POINTS 4096
+#define FUZZ_ROUNDS 1000
+#define MAX_LEN 512
+
+typedef struct Special_s {
+    uint32_t code_point;
+    UnicodeCaseMapping mapping;
+    uint32_t expansion[UNICODE_CASE_MAX_EXPANSION];
+    size_t len;
+} Special;
+
+static uint32_t *simple[3];
+static Special specials[MAX_SPECIAL];
+static size_t specials_count;
+// index of the special mapping of a code point + 1, 0 if it has none
+static uint16_t *special_of[3];
+
+static void
+add_special(const uint32_t code_point, const UnicodeCaseMapping mapping, const char *field) {
+    special_of[mapping][code_point] = (uint16_t) (specials_count + 1);
+    Special *pSpecial = &specials[specials_count++];
+    pSpecial->code_point = code_point;
+    pSpecial->mapping = mapping;
+    pSpecial->len = test_parse_code_points(field, pSpecial->expansion, UNICODE_CASE_MAX_EXPANSION);
+}
+
+static void
+load_ucd(const char *ucd_dir) {
+    char line[TEST_UCD_LINE];
+
+    for (int m = 0; m < 3; m++) {
+        simple[m] = malloc(CODE_POINTS * sizeof(uint32_t));
+        special_of[m] = calloc(CODE_POINTS, sizeof(uint16_t));
+        for (uint32_t cp = 0; cp < CODE_POINTS; cp++) {
+            simple[m][cp] = cp;
+        }
+    }
+
+    // simple mappings: fields 12 (uppercase) and 13 (lowercase); ranges have none
+    FILE *file = test_open_ucd(ucd_dir, "UnicodeData.txt");
+    while (fgets(line, sizeof(line), file)) {
+        const uint32_t cp = (uint32_t) strtoul(line, NULL, 16);
+        uint32_t mapped;
+        if (test_parse_code_points(test_ucd_field(line, 12), &mapped, 1)) {
+            simple[UNICODE_CASE_UPPER][cp] = mapped;
+        }
+        if (test_parse_code_points(test_ucd_field(line, 13), &mapped, 1)) {
+            simple[UNICODE_CASE_LOWER][cp] = mapped;
+        }
+    }
+    fclose(file);
+
+    // unconditional full mappings: lines without a condition field between the uppercase mapping and the comment
+    file = test_open_ucd(ucd_dir, "SpecialCasing.txt");
+    while (fgets(line, sizeof(line), file)) {
+        const char *condition = test_ucd_field(line, 4);
+        if (line[0] == '#' || condition == NULL) {
+            continue;
+        }
+        condition += strspn(condition, " ");
+        if (*condition != '#' && *condition != '\n' && *condition) {
+            continue;
+        }
+        const uint32_t cp = (uint32_t) strtoul(line, NULL, 16);
+        add_special(cp, UNICODE_CASE_LOWER, test_ucd_field(line, 1));
+        add_special(cp, UNICODE_CASE_UPPER, test_ucd_field(line, 3));
+    }
+    fclose(file);
+
+    // statuses C and S are the simple folding, C and F the full one; T (Turkic) is not applied
+    file = test_open_ucd(ucd_dir, "CaseFolding.txt");
+    while (fgets(line, sizeof(line), file)) {
+        const char *status = test_ucd_field(line, 1);
+        if (line[0] == '#' || status == NULL) {
+            continue;
+        }
+        status += strspn(status, " ");
+        const uint32_t cp = (uint32_t) strtoul(line, NULL, 16);
+        if (*status == 'C' || *status == 'S') {
+            test_parse_code_points(test_ucd_field(line, 2), &simple[UNICODE_CASE_FOLD][cp], 1);
+        } else if (*status == 'F') {
+            add_special(cp, UNICODE_CASE_FOLD, test_ucd_field(line, 2));
+        }
+    }
+    fclose(file);
+}
+
+/**
+ * Full mapping of a code point: the unconditional special one if there is one, else the simple one. For folding a
+ * code point with an F status never has a C one, so the S mapping it has is never used here
+ */
+static size_t
+reference_map_full(const uint32_t code_point, const UnicodeCaseMapping mapping, uint32_t *pOut) {
+    if (code_point >= CODE_POINTS) {
+        pOut[0] = code_point;
+        return 1;
+    }
+    if (special_of[mapping][code_point]) {
+        const Special *pSpecial = &specials[special_of[mapping][code_point] - 1];
+        memcpy(pOut, pSpecial->expansion, pSpecial->len * sizeof(uint32_t));
+        return pSpecial->len;
+    }
+    pOut[0] = simple[mapping][code_point];
+    return 1;
+}
+
+static void
+test_code_points(void) {
+    for (uint32_t cp = 0; cp < CODE_POINTS; cp++) {
+        CHECK_EQ(unicode_tolower(cp), simple[UNICODE_CASE_LOWER][cp]);
+        CHECK_EQ(unicode_toupper(cp), simple[UNICODE_CASE_UPPER][cp]);
+        CHECK_EQ(unicode_casefold(cp), simple[UNICODE_CASE_FOLD][cp]);
+
+        for (int m = 0; m < 3; m++) {
+            uint32_t expected[UNICODE_CASE_MAX_EXPANSION], actual[UNICODE_CASE_MAX_EXPANSION];
+            const size_t len = reference_map_full(cp, (UnicodeCaseMapping) m, expected);
+            CHECK_EQ(unicode_case_map_full(cp, (UnicodeCaseMapping) m, actual), len);
+            for (size_t i = 0; i < len; i++) {
+                CHECK_EQ(actual[i], expected[i]);
+            }
+        }
+    }
+    // past the code space nothing is mapped
+    CHECK_EQ(unicode_tolower(CODE_POINTS), CODE_POINTS);
+    CHECK_EQ(unicode_toupper(0xFFFFFFFF), 0xFFFFFFFF);
+}
+
+/**
+ * Maps UTF-8 text code point by code point, ill-formed subsequences and a truncated tail are copied
+ * @return length of the mapped text
+ */
+static size_t
+reference_map_text(const uint8_t *pStr, const size_t n, const UnicodeCaseMapping mapping, uint8_t *pOut) {
+    const uint8_t *pEnd = pStr + n;
+    size_t len = 0;
+
+    while (pStr < pEnd) {
+        uint32_t code_point;
+        int ill_formed;
+        size_t consumed = test_decode_utf8(pStr, pEnd, &code_point, &ill_formed);
+        if (!consumed || ill_formed) {
+            consumed = consumed ? consumed : (size_t) (pEnd - pStr);
+            memcpy(pOut + len, pStr, consumed);
+            len += consumed;
+        } else {
+            uint32_t mapped[UNICODE_CASE_MAX_EXPANSION];
+            const size_t mapped_len = reference_map_full(code_point, mapping, mapped);
+            for (size_t i = 0; i < mapped_len; i++) {
+                len += test_encode_utf8(mapped[i], pOut + len);
+            }
+        }
+        pStr += consumed;
+    }
+    return len;
+}
+
+static void
+test_text(const uint8_t *pStr, const size_t n, uint8_t *pExpected, uint8_t *pActual) {
+    for (int m = 0; m < 3; m++) {
+        const size_t len = reference_map_text(pStr, n, (UnicodeCaseMapping) m, pExpected);
+        const size_t cap = n * UNICODE_CASE_MAX_GROWTH;
+        CHECK_EQ(unicode_case_map(pStr, n, (UnicodeCaseMapping) m, pActual, cap), len);
+        CHECK(!memcmp(pActual, pExpected, len));
+
+        // a short buffer gets the same length back and nothing past cap
+        const size_t short_cap = len ? test_rand_below((uint32_t) len) : 0;
+        memset(pActual, 0xA5, cap);
+        CHECK_EQ(unicode_case_map(pStr, n, (UnicodeCaseMapping) m, pActual, short_cap), len);
+        for (size_t i = short_cap; i < cap; i++) {
+            CHECK_EQ(pActual[i], 0xA5);
+        }
+    }
+}
+
+/**
+ * Every code point but surrogates, a block at a time
+ */
+static void
+test_all_code_points_text(void) {
+    uint8_t *text = malloc(BLOCK_CODE_POINTS * 4);
+    uint8_t *expected = malloc(BLOCK_CODE_POINTS * 4 * UNICODE_CASE_MAX_GROWTH);
+    uint8_t *actual = malloc(BLOCK_CODE_POINTS * 4 * UNICODE_CASE_MAX_GROWTH);
+
+    for (uint32_t first = 0; first < CODE_POINTS; first += BLOCK_CODE_POINTS) {
+        size_t n = 0;
+        for (uint32_t cp = first; cp < first + BLOCK_CODE_POINTS; cp++) {
+            if (cp < 0xD800 || cp > 0xDFFF) {
+                n += test_encode_utf8(cp, text + n);
+            }
+        }
+        test_text(text, n, expected, actual);
+    }
+    free(text);
+    free(expected);
+    free(actual);
+}
+
+/**
+ * ustr_case_map of well-formed text in every layout gives the chars unicode_case_map gives
+ */
+static void
+test_string(const uint8_t *pStr, const size_t n, uint8_t *pMapped) {
+    static const UnicodeLayout LAYOUTS[] = {USTR_LAYOUT_UCHAR, USTR_LAYOUT_UTF32, USTR_LAYOUT_SPLIT};
+
+    for (int m = 0; m < 3; m++) {
+        const size_t len = unicode_case_map(pStr, n, (UnicodeCaseMapping) m, pMapped, n * UNICODE_CASE_MAX_GROWTH);
+        for (size_t l = 0; l < sizeof(LAYOUTS) / sizeof(LAYOUTS[0]); l++) {
+            UnicodeString *string = read_into_unicode_string_with_layout(pStr, n, UNICODE_DECODE_DEFAULT, LAYOUTS[l]);
+            UnicodeString *expected = read_into_unicode_string_n(pMapped, len, UNICODE_DECODE_DEFAULT);
+            UnicodeString *actual = ustr_case_map(string, (UnicodeCaseMapping) m);
+            CHECK_EQ(actual->layout, LAYOUTS[l]);
+            CHECK_EQ(actual->len, expected->len);
+            for (size_t i = 0; i < actual->len && i < expected->len; i++) {
+                CHECK_EQ(ustr_ord_at(actual, i), ustr_ord_at(expected, i));
+            }
+            free_ustr(actual);
+            free_ustr(expected);
+            free_ustr(string);
+        }
+    }
+}
+
+int
+main(const int argc, char **argv) {
+    static uint8_t text[MAX_LEN];
+    static uint8_t expected[MAX_LEN * UNICODE_CASE_MAX_GROWTH];
+    static uint8_t actual[MAX_LEN * UNICODE_CASE_MAX_GROWTH];
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s UCD_DIR\n", argv[0]);
+        return 1;
+    }
+    load_ucd(argv[1]);
+
+    test_code_points();
+    test_all_code_points_text();
+    for (int round = 0; round < FUZZ_ROUNDS; round++) {
+        const size_t n = test_random_utf8(text, test_rand_below(MAX_LEN), round % 2);
+        test_text(text, n, expected, actual);
+        if (round % 2 == 0) {
+            test_string(text, n, actual);
+        }
+    }
+
+    for (int m = 0; m < 3; m++) {
+        free(simple[m]);
+        free(special_of[m]);
+    }
+    return test_result("case");
+}
@@ -0,0 +1,198 @@
+//
+// Equality, ordering and hashing: unicode_hash against the XXH64 test vectors and a plain scalar XXH64, byte buffer
+// compares against memcmp, and string compares and hashes of every layout pair against the bytes they came from.
+//
+
+#include "test.h"
+#include "unicode.h"
+
+#define FUZZ_ROUNDS 2000
+#define MAX_LEN 512
+
+static const UnicodeLayout LAYOUTS[] = {USTR_LAYOUT_UCHAR, USTR_LAYOUT_UTF32, USTR_LAYOUT_SPLIT};
+#define LAYOUTS_COUNT (sizeof(LAYOUTS) / sizeof(LAYOUTS[0]))
+
+/* ============ Reference XXH64 ============ */
+
+static const uint64_t XXH_PRIME64[] = {
+        0x9E3779B185EBCA87ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL, 0x85EBCA77C2B2AE63ULL,
+        0x27D4EB2F165667C5ULL,
+};
+
+static uint64_t
+rotl64(const uint64_t x, const int r) {
+    return x << r | x >> (64 - r);
+}
+
+static uint64_t
+read_le(const uint8_t *p, const size_t n) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < n; i++) {
+        value |= (uint64_t) p[i] << (8 * i);
+    }
+    return value;
+}
+
+static uint64_t
+xxh64_round(uint64_t acc, const uint64_t input) {
+    acc += input * XXH_PRIME64[1];
+    return rotl64(acc, 31) * XXH_PRIME64[0];
+}
+
+/**
+ * XXH64 as the specification describes it, a byte at a time where it can
+ */
+static uint64_t
+reference_hash(const uint8_t *p, const size_t n, const uint64_t seed) {
+    size_t i = 0;
+    uint64_t hash;
+
+    if (n >= 32) {
+        uint64_t v[4] = {seed + XXH_PRIME64[0] + XXH_PRIME64[1], seed + XXH_PRIME64[1], seed, seed - XXH_PRIME64[0]};
+        for (; i + 32 <= n; i += 32) {
+            for (int lane = 0; lane < 4; lane++) {
+                v[lane] = xxh64_round(v[lane], read_le(p + i + 8 * lane, 8));
+            }
+        }
+        hash = rotl64(v[0], 1) + rotl64(v[1], 7) + rotl64(v[2], 12) + rotl64(v[3], 18);
+        for (int lane = 0; lane < 4; lane++) {
+            hash = (hash ^ xxh64_round(0, v[lane])) * XXH_PRIME64[0] + XXH_PRIME64[3];
+        }
+    } else {
+        hash = seed + XXH_PRIME64[4];
+    }
+    hash += n;
+
+    for (; i + 8 <= n; i += 8) {
+        hash = rotl64(hash ^ xxh64_round(0, read_le(p + i, 8)), 27) * XXH_PRIME64[0] + XXH_PRIME64[3];
+    }
+    if (i + 4 <= n) {
+        hash = rotl64(hash ^ read_le(p + i, 4) * XXH_PRIME64[0], 23) * XXH_PRIME64[1] + XXH_PRIME64[2];
+        i += 4;
+    }
+    for (; i < n; i++) {
+        hash = rotl64(hash ^ p[i] * XXH_PRIME64[4], 11) * XXH_PRIME64[0];
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64[1];
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64[2];
+    return hash ^ hash >> 32;
+}
+
+static void
+test_hash_vectors(void) {
+    CHECK_EQ(unicode_hash((const uint8_t *) "", 0, 0), 0xEF46DB3751D8E999ULL);
+    CHECK_EQ(unicode_hash((const uint8_t *) "a", 1, 0), 0xD24EC4F1A98C6E5BULL);
+    CHECK_EQ(unicode_hash((const uint8_t *) "abc", 3, 0), 0x44BC2CF5AD770999ULL);
+    CHECK_EQ(reference_hash((const uint8_t *) "", 0, 0), 0xEF46DB3751D8E999ULL);
+    CHECK_EQ(reference_hash((const uint8_t *) "a", 1, 0), 0xD24EC4F1A98C6E5BULL);
+    CHECK_EQ(reference_hash((const uint8_t *) "abc", 3, 0), 0x44BC2CF5AD770999ULL);
+}
+
+static int
+sign(const int value) {
+    return (value > 0) - (value < 0);
+}
+
+static int
+reference_compare(const uint8_t *pA, const size_t nA, const uint8_t *pB, const size_t nB) {
+    const int cmp = memcmp(pA, pB, nA < nB ? nA : nB);
+    return cmp ? sign(cmp) : (nA > nB) - (nA < nB);
+}
+
+/**
+ * Second text for a comparison: the same bytes, a prefix, an extension, or one char replaced, so that most pairs
+ * share a long common prefix
+ */
+static size_t
+related_text(const uint8_t *pStr, const size_t n, uint8_t *pOut) {
+    memcpy(pOut, pStr, n);
+    switch (test_rand_below(5)) {
+        case 0:
+            return n;
+        case 1: {
+            // cut at a char start
+            size_t len = test_rand_below((uint32_t) n + 1);
+            while (len < n && (pStr[len] & 0xC0) == 0x80) {
+                len++;
+            }
+            return len;
+        }
+        case 2:
+            return n + test_random_utf8(pOut + n, test_rand_below(16) + 4, 0);
+        case 3: {
+            // replace the char at a random position by a random one
+            size_t at = n ? test_rand_below((uint32_t) n) : 0;
+            while (at > 0 && (pStr[at] & 0xC0) == 0x80) {
+                at--;
+            }
+            size_t end = at + (at < n);
+            while (end < n && (pStr[end] & 0xC0) == 0x80) {
+                end++;
+            }
+            const size_t len = test_encode_utf8(test_rand_code_point(1 + (int) test_rand_below(4)), pOut + at);
+            memcpy(pOut + at + len, pStr + end, n - end);
+            return at + len + n - end;
+        }
+        default:
+            return test_random_utf8(pOut, MAX_LEN - 24, 0);
+    }
+}
+
+static void
+test_pair(const uint8_t *pA, const size_t nA, const uint8_t *pB, const size_t nB) {
+    const int expected = reference_compare(pA, nA, pB, nB);
+    const uint64_t seed = (uint64_t) test_rand() << 32 | test_rand();
+
+    CHECK_EQ(unicode_equal(pA, nA, pB, nB), expected == 0);
+    CHECK_EQ(sign(unicode_compare(pA, nA, pB, nB)), expected);
+    CHECK_EQ(unicode_hash(pA, nA, seed), reference_hash(pA, nA, seed));
+
+    UnicodeString *a[LAYOUTS_COUNT], *b[LAYOUTS_COUNT];
+    for (size_t l = 0; l < LAYOUTS_COUNT; l++) {
+        a[l] = read_into_unicode_string_with_layout(pA, nA, UNICODE_DECODE_DEFAULT, LAYOUTS[l]);
+        b[l] = read_into_unicode_string_with_layout(pB, nB, UNICODE_DECODE_DEFAULT, LAYOUTS[l]);
+        CHECK_EQ(ustr_hash(a[l], seed), unicode_hash(pA, nA, seed));
+    }
+    // same-layout pairs take the vector paths, mixed ones the char by char one
+    for (size_t la = 0; la < LAYOUTS_COUNT; la++) {
+        for (size_t lb = 0; lb < LAYOUTS_COUNT; lb++) {
+            CHECK_EQ(ustr_equal(a[la], b[lb]), expected == 0);
+            CHECK_EQ(sign(ustr_compare(a[la], b[lb])), expected);
+            CHECK_EQ(sign(ustr_compare(b[lb], a[la])), -expected);
+        }
+    }
+    for (size_t l = 0; l < LAYOUTS_COUNT; l++) {
+        free_ustr(a[l]);
+        free_ustr(b[l]);
+    }
+}
+
+int
+main(void) {
+    static uint8_t a[MAX_LEN], b[MAX_LEN];
+
+    test_hash_vectors();
+
+    // every tail length of the hash, from unaligned addresses
+    for (size_t n = 0; n < 200; n++) {
+        for (size_t i = 0; i < n + 8 && i < MAX_LEN; i++) {
+            a[i] = (uint8_t) test_rand();
+        }
+        const uint64_t seed = n % 2 ? 0 : (uint64_t) test_rand() << 32 | test_rand();
+        for (size_t shift = 0; shift < 8; shift++) {
+            CHECK_EQ(unicode_hash(a + shift, n, seed), reference_hash(a + shift, n, seed));
+        }
+    }
+
+    // well-formed text only: byte order is code point order there, and the bytes are what strings encode back to
+    for (int round = 0; round < FUZZ_ROUNDS; round++) {
+        const size_t nA = test_random_utf8(a, test_rand_below(MAX_LEN - 24), 0);
+        const size_t nB = related_text(a, nA, b);
+        test_pair(a, nA, b, nB);
+    }
+
+    return test_result("compare");
+}
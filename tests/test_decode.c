@@ -0,0 +1,334 @@
+//
+// Decoding into UnicodeChar arrays and strings of every layout against a byte-wise reference of the `\xNN` decoding
+// rules, and fuzz round trips of ustr_convert between the layouts.
+//
+
+#include "test.h"
+#include "unicode.h"
+
+#define MAX_LEN 512
+#define FUZZ_ROUNDS 2000
+
+static const UnicodeLayout LAYOUTS[] = {USTR_LAYOUT_UCHAR, USTR_LAYOUT_UTF32, USTR_LAYOUT_SPLIT};
+#define LAYOUTS_COUNT (sizeof(LAYOUTS) / sizeof(LAYOUTS[0]))
+
+typedef struct Reference_s {
+    UnicodeChar chars[MAX_LEN];
+    size_t len;
+    // every char is a well-formed sequence
+    int valid;
+} Reference;
+
+/**
+ * Decodes the whole input with `test_decode_uchar`; the input is valid if every char is what the by-the-book decoder
+ * reads there too
+ */
+static void
+reference_decode(const uint8_t *pStr, const size_t n, Reference *pRef) {
+    const uint8_t *pEnd = pStr + n;
+
+    pRef->len = 0;
+    pRef->valid = 1;
+    while (pStr < pEnd) {
+        UnicodeChar *pChar = &pRef->chars[pRef->len++];
+        const size_t consumed = test_decode_uchar(pStr, pEnd, pChar->octet, &pChar->size);
+
+        uint32_t code_point;
+        int ill_formed;
+        if (test_decode_utf8(pStr, pEnd, &code_point, &ill_formed) != consumed || ill_formed) {
+            pRef->valid = 0;
+        }
+        pStr += consumed;
+    }
+}
+
+static int
+uchar_equal(const UnicodeChar a, const UnicodeChar b) {
+    return a.size == b.size && !memcmp(a.octet, b.octet, sizeof(a.octet));
+}
+
+/**
+ * Code point a char is stored as in USTR_LAYOUT_UTF32 strings: the by-the-book decoding of its octets if they are
+ * one well-formed sequence, U+FFFD for `\xNN` slots and for ill-formed chars the lax decoder took by their lead byte
+ */
+static uint32_t
+reference_code_point(const UnicodeChar chr) {
+    uint32_t code_point;
+    int ill_formed;
+    const size_t consumed = test_decode_utf8(chr.octet, chr.octet + chr.size, &code_point, &ill_formed);
+    return consumed == chr.size && !ill_formed ? code_point : UNICODE_REPLACEMENT_CHAR;
+}
+
+static void
+test_array(const uint8_t *pStr, const size_t n, const Reference *pRef) {
+    CHECK_EQ(unicode_decoded_len(pStr, n), pRef->len);
+
+    const uint32_t flags[] = {UNICODE_DECODE_DEFAULT, UNICODE_DECODE_EXACT};
+    for (size_t f = 0; f < sizeof(flags) / sizeof(flags[0]); f++) {
+        UnicodeChar *chars;
+        const size_t len = read_into_unicode_array_n(pStr, n, &chars, flags[f]);
+        CHECK_EQ(len, pRef->len);
+        for (size_t i = 0; i < len && i < pRef->len; i++) {
+            CHECK(uchar_equal(chars[i], pRef->chars[i]));
+        }
+        CHECK_EQ(chars[len].size, 0);
+        free(chars);
+    }
+
+    // the null-terminated reader stops at the first zero byte
+    if (!memchr(pStr, 0, n)) {
+        uint8_t cstr[MAX_LEN + 1];
+        memcpy(cstr, pStr, n);
+        cstr[n] = 0;
+        UnicodeChar *chars;
+        read_into_unicode_array(cstr, &chars);
+        for (size_t i = 0; i <= pRef->len; i++) {
+            CHECK(uchar_equal(chars[i], i < pRef->len ? pRef->chars[i] : (UnicodeChar){{0, 0, 0, 0}, 0}));
+        }
+        free(chars);
+    }
+}
+
+static void
+check_string(const UnicodeString *string, const Reference *pRef) {
+    CHECK_EQ(string->len, pRef->len);
+    for (size_t i = 0; i < string->len && i < pRef->len; i++) {
+        CHECK_EQ(ustr_ord_at(string, i), reference_code_point(pRef->chars[i]));
+        if (string->layout != USTR_LAYOUT_UTF32) {
+            CHECK(uchar_equal(ustr_char_at(string, i), pRef->chars[i]));
+        }
+    }
+}
+
+static void
+test_string(const uint8_t *pStr, const size_t n, const Reference *pRef) {
+    for (size_t l = 0; l < LAYOUTS_COUNT; l++) {
+        UnicodeString *string = read_into_unicode_string_with_layout(pStr, n, UNICODE_DECODE_DEFAULT, LAYOUTS[l]);
+        CHECK_EQ(string->layout, LAYOUTS[l]);
+        check_string(string, pRef);
+
+        UnicodeString *strict = read_into_unicode_string_with_layout(pStr, n, UNICODE_DECODE_STRICT, LAYOUTS[l]);
+        CHECK_EQ(strict != NULL, pRef->valid);
+        CHECK_EQ(unicode_validate(pStr, n, NULL), pRef->valid);
+        if (strict) {
+            check_string(strict, pRef);
+            free_ustr(strict);
+        }
+
+        // every conversion and its way back keeps the chars, invalid bytes become U+FFFD only in UTF32 storage
+        for (size_t k = 0; k < LAYOUTS_COUNT; k++) {
+            UnicodeString *converted = ustr_convert(string, LAYOUTS[k]);
+            CHECK_EQ(converted->layout, LAYOUTS[k]);
+            CHECK_EQ(converted->len, string->len);
+            UnicodeString *back = ustr_convert(converted, LAYOUTS[l]);
+            CHECK_EQ(back->len, string->len);
+            for (size_t i = 0; i < string->len && i < converted->len && i < back->len; i++) {
+                CHECK_EQ(ustr_ord_at(converted, i), ustr_ord_at(string, i));
+                if (LAYOUTS[l] != USTR_LAYOUT_UTF32 && LAYOUTS[k] != USTR_LAYOUT_UTF32) {
+                    CHECK(uchar_equal(ustr_char_at(back, i), ustr_char_at(string, i)));
+                }
+                CHECK_EQ(ustr_ord_at(back, i), ustr_ord_at(string, i));
+            }
+            free_ustr(back);
+            free_ustr(converted);
+        }
+        free_ustr(string);
+    }
+}
+
+/**
+ * Short strings live in the inline storage; appending one char at a time moves them to the heap at some point, which
+ * must not lose or reorder anything
+ */
+static void
+test_growth(const Reference *pRef) {
+    for (size_t l = 0; l < LAYOUTS_COUNT; l++) {
+        UnicodeString *string = new_ustr_with_layout(-1, LAYOUTS[l]);
+        size_t i = 0;
+        while (i < pRef->len) {
+            const size_t n = test_rand_below(3) ? 1 : 1 + test_rand_below((uint32_t) (pRef->len - i));
+            if (n == 1) {
+                push_uchar(string, pRef->chars[i]);
+            } else {
+                ustr_append(string, pRef->chars + i, n);
+            }
+            i += n;
+        }
+        check_string(string, pRef);
+        ustr_shrink_to_fit(string);
+        check_string(string, pRef);
+        free_ustr(string);
+    }
+}
+
+/**
+ * Lead bytes are trusted by the decoder, but what they claim is not stored as a code point unless it is well-formed:
+ * an overlong `/` must not become a real one
+ */
+static void
+test_ill_formed_code_points(void) {
+    static const struct {
+        const char *bytes;
+        uint32_t code_points[3];
+        size_t len;
+    } CASES[] = {
+            {"\xC0\xAF", {UNICODE_REPLACEMENT_CHAR}, 1},
+            {"\xC3\x41", {UNICODE_REPLACEMENT_CHAR}, 1},
+            {"\xED\xA0\x80", {UNICODE_REPLACEMENT_CHAR}, 1},
+            {"\xF4\x90\x80\x80", {UNICODE_REPLACEMENT_CHAR}, 1},
+            {"\xE0\x80\xAF/", {UNICODE_REPLACEMENT_CHAR, '/'}, 2},
+            {"\xC3\xA9\xF0\x9F\x98\x80", {0xE9, 0x1F600}, 2},
+    };
+
+    for (size_t c = 0; c < sizeof(CASES) / sizeof(CASES[0]); c++) {
+        for (size_t l = 0; l < LAYOUTS_COUNT; l++) {
+            UnicodeString *string = read_into_unicode_string_with_layout((const uint8_t *) CASES[c].bytes,
+                                                                         strlen(CASES[c].bytes),
+                                                                         UNICODE_DECODE_DEFAULT, LAYOUTS[l]);
+            CHECK_EQ(string->len, CASES[c].len);
+            for (size_t i = 0; i < string->len && i < CASES[c].len; i++) {
+                CHECK_EQ(ustr_ord_at(string, i), CASES[c].code_points[i]);
+            }
+            free_ustr(string);
+        }
+    }
+}
+
+/**
+ * Compressed bytes of well-formed input are the input, invalid bytes would be written as their `\xNN` text. The
+ * struct and the bytes are separate libc blocks, so callers from before `free_compressed_ustr` that free both with
+ * free(3) keep working
+ */
+static void
+test_compress(const uint8_t *pStr, const size_t n) {
+    UnicodeString *string = read_into_unicode_string_n(pStr, n, UNICODE_DECODE_DEFAULT);
+    CompressedUnicodeString *compressed = compress_into_bytes_array(string);
+    CHECK_EQ(compressed->len, n + 1);
+    CHECK(!memcmp(compressed->data, pStr, n) && compressed->data[n] == 0);
+    free(compressed->data);
+    free(compressed);
+    free_ustr(string);
+}
+
+#define CHECKED_BLOCKS 8
+
+/**
+ * Allocator that fails one in `fail_every` allocs and resizes at random and checks that resize and release get the
+ * size of the block they are given
+ */
+typedef struct CheckedAllocator_s {
+    void *blocks[CHECKED_BLOCKS];
+    size_t sizes[CHECKED_BLOCKS];
+    uint32_t fail_every;
+} CheckedAllocator;
+
+static size_t
+checked_find(const CheckedAllocator *pChecked, const void *ptr, const size_t size) {
+    for (size_t b = 0; b < CHECKED_BLOCKS; b++) {
+        if (pChecked->blocks[b] == ptr) {
+            if (ptr != NULL) {
+                CHECK_EQ(pChecked->sizes[b], size);
+            }
+            return b;
+        }
+    }
+    CHECK(!"block allocated by the checked allocator");
+    return 0;
+}
+
+static void *
+checked_alloc(void *ctx, const size_t size) {
+    CheckedAllocator *pChecked = ctx;
+    if (test_rand_below(pChecked->fail_every) == 0) {
+        return NULL;
+    }
+    const size_t b = checked_find(pChecked, NULL, 0);
+    pChecked->blocks[b] = malloc(size);
+    pChecked->sizes[b] = size;
+    return pChecked->blocks[b];
+}
+
+static void *
+checked_resize(void *ctx, void *ptr, const size_t old_size, const size_t new_size) {
+    CheckedAllocator *pChecked = ctx;
+    const size_t b = checked_find(pChecked, ptr, old_size);
+    if (test_rand_below(pChecked->fail_every) == 0) {
+        return NULL;
+    }
+    pChecked->blocks[b] = realloc(ptr, new_size);
+    pChecked->sizes[b] = new_size;
+    return pChecked->blocks[b];
+}
+
+static void
+checked_release(void *ctx, void *ptr, const size_t size) {
+    CheckedAllocator *pChecked = ctx;
+    pChecked->blocks[checked_find(pChecked, ptr, size)] = NULL;
+    free(ptr);
+}
+
+/**
+ * Appends and shrinks that fail for want of memory leave the string as it was, with every storage array the size
+ * its capacity says
+ */
+static void
+test_allocation_failures(const Reference *pRef) {
+    for (size_t l = 0; l < LAYOUTS_COUNT; l++) {
+        for (uint32_t fail_every = 2; fail_every < 8; fail_every++) {
+            CheckedAllocator checked = {.fail_every = fail_every};
+            const UnicodeAllocator allocator = {checked_alloc, checked_resize, checked_release, &checked};
+            UnicodeString *string = NULL;
+            while (string == NULL) {
+                string = new_ustr_with_allocator(-1, LAYOUTS[l], &allocator);
+            }
+            size_t i = 0;
+            while (i < pRef->len) {
+                if (push_uchar(string, pRef->chars[i]) != NULL) {
+                    i++;
+                }
+                CHECK_EQ(string->len, i);
+                if (test_rand_below(16) == 0) {
+                    ustr_shrink_to_fit(string);
+                }
+            }
+            check_string(string, pRef);
+            free_ustr(string);
+            for (size_t b = 0; b < CHECKED_BLOCKS; b++) {
+                CHECK(checked.blocks[b] == NULL);
+            }
+        }
+    }
+}
+
+int
+main(void) {
+    static uint8_t str[MAX_LEN];
+    static Reference ref;
+
+    test_ill_formed_code_points();
+    for (int round = 0; round < FUZZ_ROUNDS; round++) {
+        // a third of the inputs is ASCII only, the block-wise ASCII paths take most of it
+        const size_t cap = test_rand_below(MAX_LEN);
+        size_t n;
+        if (round % 3 == 2) {
+            n = cap;
+            for (size_t i = 0; i < n; i++) {
+                str[i] = (uint8_t) (test_rand_below(4) ? ' ' + test_rand_below(95) : test_rand_below(0x80));
+            }
+        } else {
+            n = test_random_utf8(str, cap, round % 3);
+        }
+        reference_decode(str, n, &ref);
+        test_array(str, n, &ref);
+        test_string(str, n, &ref);
+        test_growth(&ref);
+        if (round % 8 == 0) {
+            test_allocation_failures(&ref);
+        }
+        if (ref.valid) {
+            test_compress(str, n);
+        }
+    }
+
+    return test_result("decode");
+}
@@ -0,0 +1,152 @@
+//
+// Substring search against a naive byte-by-byte search. Texts are built of a few letters, D0 / D1 lead bytes among
+// them, so needles match often, and needles are periodic words on both sides of UNICODE_FIND_TWO_WAY_MIN.
+//
+
+#include "test.h"
+#include "unicode_find.h"
+
+#define FUZZ_ROUNDS 20000
+#define MAX_HAYSTACK 1024
+#define MAX_NEEDLE (2 * UNICODE_FIND_TWO_WAY_MIN + 16)
+#define MAX_NEEDLES 4
+
+static const char *const LETTERS[] = {"a", "b", "\xD0\xB0", "\xD1\x8F", "\xD0", "\xD1", "\xB0", "\xF0\x9F\x98\x80"};
+#define LETTERS_COUNT (sizeof(LETTERS) / sizeof(LETTERS[0]))
+
+/**
+ * Text of whole letters of the alphabet, up to cap bytes
+ * @return number of bytes written
+ */
+static size_t
+random_text(uint8_t *pOut, const size_t cap, const size_t *pAlphabet, const size_t alphabet_len) {
+    size_t n = 0;
+    for (;;) {
+        const char *letter = LETTERS[pAlphabet[test_rand_below((uint32_t) alphabet_len)]];
+        const size_t len = strlen(letter);
+        if (n + len > cap) {
+            return n;
+        }
+        memcpy(pOut + n, letter, len);
+        n += len;
+    }
+}
+
+/**
+ * Needle of about `len` bytes: a random word repeated, so it has a short period, sometimes with its last byte changed
+ */
+static size_t
+random_needle(uint8_t *pOut, const size_t len, const size_t *pAlphabet, const size_t alphabet_len) {
+    uint8_t word[16];
+    const size_t word_len = random_text(word, 1 + test_rand_below(sizeof(word)), pAlphabet, alphabet_len);
+    if (word_len == 0) {
+        return random_text(pOut, len, pAlphabet, alphabet_len);
+    }
+    size_t n = 0;
+    while (n + word_len <= len) {
+        memcpy(pOut + n, word, word_len);
+        n += word_len;
+    }
+    if (n && test_rand_below(4) == 0) {
+        pOut[n - 1] ^= (uint8_t) (1 + test_rand_below(0xFF));
+    }
+    return n;
+}
+
+static int
+naive_find(const uint8_t *pHaystack, const size_t nbytes, const uint8_t *pNeedle, const size_t needle_nbytes,
+           size_t *pOffset) {
+    for (size_t i = 0; i + needle_nbytes <= nbytes; i++) {
+        if (!memcmp(pHaystack + i, pNeedle, needle_nbytes)) {
+            *pOffset = i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Chars before offset as `unicode_strlen` counts them: bytes that are not continuation bytes
+ */
+static size_t
+naive_index(const uint8_t *pHaystack, const size_t offset) {
+    size_t index = 0;
+    for (size_t i = 0; i < offset; i++) {
+        index += (pHaystack[i] & 0xC0) != 0x80;
+    }
+    return index;
+}
+
+static void
+check_find(const uint8_t *pHaystack, const size_t nbytes, const uint8_t *const *pNeedles, const size_t *pNeedleSizes,
+           const size_t count) {
+    size_t best = SIZE_MAX, best_needle = 0;
+
+    for (size_t k = 0; k < count; k++) {
+        size_t offset;
+        const int found = naive_find(pHaystack, nbytes, pNeedles[k], pNeedleSizes[k], &offset);
+        UnicodeMatch match;
+        CHECK_EQ(unicode_find(pHaystack, nbytes, pNeedles[k], pNeedleSizes[k], &match), found);
+        if (found) {
+            CHECK_EQ(match.offset, offset);
+            CHECK_EQ(match.index, naive_index(pHaystack, offset));
+            CHECK_EQ(match.needle, 0);
+            // a tie goes to the needle listed first
+            if (offset < best) {
+                best = offset;
+                best_needle = k;
+            }
+        }
+    }
+
+    UnicodeMatch match;
+    CHECK_EQ(unicode_find_any(pHaystack, nbytes, pNeedles, pNeedleSizes, count, &match), best != SIZE_MAX);
+    if (best != SIZE_MAX) {
+        CHECK_EQ(match.offset, best);
+        CHECK_EQ(match.index, naive_index(pHaystack, best));
+        CHECK_EQ(match.needle, best_needle);
+    }
+}
+
+int
+main(void) {
+    static uint8_t haystack[MAX_HAYSTACK];
+    static uint8_t needles[MAX_NEEDLES][MAX_NEEDLE];
+
+    for (int round = 0; round < FUZZ_ROUNDS; round++) {
+        // 1..4 letters; short haystacks leave matches to the last bytes the vector filter can't take whole blocks of
+        size_t alphabet[4];
+        const size_t alphabet_len = 1 + test_rand_below(4);
+        for (size_t a = 0; a < alphabet_len; a++) {
+            alphabet[a] = test_rand_below(LETTERS_COUNT);
+        }
+        const size_t cap = round % 4 == 0 ? test_rand_below(48) : test_rand_below(MAX_HAYSTACK);
+        const size_t n = random_text(haystack, cap, alphabet, alphabet_len);
+
+        const uint8_t *pNeedles[MAX_NEEDLES];
+        size_t sizes[MAX_NEEDLES];
+        const size_t count = 1 + test_rand_below(MAX_NEEDLES);
+        for (size_t k = 0; k < count; k++) {
+            // around the Two-Way threshold, a slice of the haystack (often its tail) or a periodic word
+            const size_t len = test_rand_below(2)
+                               ? UNICODE_FIND_TWO_WAY_MIN - 8 + test_rand_below(16)
+                               : test_rand_below(MAX_NEEDLE);
+            switch (test_rand_below(3)) {
+                case 0: {
+                    const size_t slice = len < n ? len : n;
+                    const size_t start = test_rand_below(2) ? n - slice : test_rand_below((uint32_t) (n - slice + 1));
+                    memcpy(needles[k], haystack + start, slice);
+                    sizes[k] = slice;
+                    break;
+                }
+                default:
+                    sizes[k] = random_needle(needles[k], len, alphabet, alphabet_len);
+                    break;
+            }
+            pNeedles[k] = needles[k];
+        }
+        check_find(haystack, n, pNeedles, sizes, count);
+    }
+
+    return test_result("find");
+}
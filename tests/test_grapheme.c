@@ -0,0 +1,169 @@
+//
+// Grapheme cluster boundaries against GraphemeBreakTest.txt read from the UCD directory: by unicode_grapheme_next,
+// by the streaming segmenter fed in random chunks and by ustr_grapheme_next in every layout. On random text, with
+// ill-formed bytes too, they must agree with each other.
+//
+
+#include "test.h"
+#include "unicode_grapheme.h"
+
+#define MAX_CODE_POINTS 64
+#define MAX_LEN 512
+#define FUZZ_ROUNDS 2000
+
+static const UnicodeLayout LAYOUTS[] = {USTR_LAYOUT_UCHAR, USTR_LAYOUT_UTF32, USTR_LAYOUT_SPLIT};
+
+/**
+ * Boundaries of text found by the streaming segmenter, fed chunks of random length; `cap` offsets at a time if
+ * cap is small, so a full buffer is taken care of too
+ * @return number of boundaries
+ */
+static size_t
+stream_breaks(const uint8_t *pStr, const size_t n, size_t *pBreaks, const size_t cap) {
+    UnicodeGraphemeBreaker breaker;
+    size_t count = 0, offset = 0;
+
+    unicode_grapheme_init(&breaker);
+    while (offset < n) {
+        const size_t len = 1 + test_rand_below((uint32_t) (n - offset < 16 ? n - offset : 16));
+        size_t done = 0;
+        while (done < len) {
+            size_t consumed;
+            count += unicode_grapheme_feed(&breaker, pStr + offset + done, len - done, pBreaks + count, cap,
+                                           &consumed);
+            done += consumed;
+        }
+        offset += len;
+    }
+    size_t written;
+    while ((written = unicode_grapheme_finish(&breaker, pBreaks + count, cap)) == cap) {
+        count += written;
+    }
+    return count + written;
+}
+
+/**
+ * Checks every API against the expected boundaries: byte offsets including 0 and n (none for empty text)
+ */
+static void
+check_breaks(const uint8_t *pStr, const size_t n, const size_t *pExpected, const size_t expected_count) {
+    size_t breaks[MAX_LEN + UNICODE_GRAPHEME_MAX_FINISH];
+
+    size_t count = 0;
+    for (size_t offset = 0; offset < n; offset = unicode_grapheme_next(pStr, n, offset)) {
+        breaks[count++] = offset;
+    }
+    if (n) {
+        breaks[count++] = n;
+    }
+    CHECK_EQ(count, expected_count);
+    for (size_t i = 0; i < count && i < expected_count; i++) {
+        CHECK_EQ(breaks[i], pExpected[i]);
+    }
+
+    const size_t caps[] = {MAX_LEN + UNICODE_GRAPHEME_MAX_FINISH, 1, 2};
+    for (size_t c = 0; c < sizeof(caps) / sizeof(caps[0]); c++) {
+        count = stream_breaks(pStr, n, breaks, caps[c]);
+        CHECK_EQ(count, expected_count);
+        for (size_t i = 0; i < count && i < expected_count; i++) {
+            CHECK_EQ(breaks[i], pExpected[i]);
+        }
+    }
+
+    // char indices of the boundaries, for the string functions; chars of ill-formed text are not the code points
+    // the byte functions see
+    if (!unicode_validate(pStr, n, NULL)) {
+        return;
+    }
+    for (size_t l = 0; l < sizeof(LAYOUTS) / sizeof(LAYOUTS[0]); l++) {
+        UnicodeString *string = read_into_unicode_string_with_layout(pStr, n, UNICODE_DECODE_DEFAULT, LAYOUTS[l]);
+        size_t k = 0, index = 0, offset = 0;
+        for (size_t i = 0; i < string->len; i++) {
+            if (offset == pExpected[k]) {
+                CHECK_EQ(index, i);
+                index = ustr_grapheme_next(string, i);
+                k++;
+            }
+            uint32_t code_point;
+            int ill_formed;
+            offset += test_decode_utf8(pStr + offset, pStr + n, &code_point, &ill_formed);
+        }
+        CHECK_EQ(index, string->len);
+        CHECK_EQ(k + (n ? 1 : 0), expected_count);
+        free_ustr(string);
+    }
+}
+
+/**
+ * Reads the test file: code points between ÷ (boundary) and × (no boundary) marks
+ * @return number of test lines
+ */
+static size_t
+test_file(const char *ucd_dir) {
+    char line[TEST_UCD_LINE];
+    uint8_t text[MAX_CODE_POINTS * 4];
+    size_t expected[MAX_CODE_POINTS + 1];
+    size_t lines = 0;
+
+    FILE *file = test_open_ucd(ucd_dir, "GraphemeBreakTest.txt");
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        size_t n = 0, count = 0;
+        for (const char *p = line; *p && *p != '#';) {
+            if (!strncmp(p, "÷", strlen("÷"))) {
+                expected[count++] = n;
+                p += strlen("÷");
+            } else if (!strncmp(p, "×", strlen("×"))) {
+                p += strlen("×");
+            } else if (*p == ' ' || *p == '\t') {
+                p++;
+            } else {
+                char *pEnd;
+                n += test_encode_utf8((uint32_t) strtoul(p, &pEnd, 16), text + n);
+                p = pEnd;
+            }
+        }
+        check_breaks(text, n, expected, count);
+        lines++;
+    }
+    fclose(file);
+    return lines;
+}
+
+/**
+ * Boundaries of random text found with unicode_grapheme_next are the expected ones for the other functions
+ */
+static void
+test_consistency(const uint8_t *pStr, const size_t n) {
+    size_t expected[MAX_LEN + 1];
+    size_t count = 0;
+
+    for (size_t offset = 0; offset < n; offset = unicode_grapheme_next(pStr, n, offset)) {
+        CHECK(count == 0 || offset > expected[count - 1]);
+        expected[count++] = offset;
+    }
+    if (n) {
+        expected[count++] = n;
+    }
+    check_breaks(pStr, n, expected, count);
+}
+
+int
+main(const int argc, char **argv) {
+    static uint8_t text[MAX_LEN];
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s UCD_DIR\n", argv[0]);
+        return 1;
+    }
+    CHECK(test_file(argv[1]) > 0);
+
+    for (int round = 0; round < FUZZ_ROUNDS; round++) {
+        const size_t n = test_random_utf8(text, test_rand_below(MAX_LEN), round % 2);
+        test_consistency(text, n);
+    }
+
+    return test_result("grapheme");
+}
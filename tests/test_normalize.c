@@ -0,0 +1,169 @@
+//
+// Normalization against NormalizationTest.txt read from the UCD directory: the conformance invariants of UAX #15 for
+// every line, every code point not listed in part 1 being its own normal form, and on random text, with ill-formed
+// bytes too, the forms being stable and consistent with each other.
+//
+
+#include "test.h"
+#include "unicode_normalize.h"
+
+#define CODE_POINTS 0x110000
+#define MAX_CODE_POINTS 64
+#define MAX_LEN 512
+#define FUZZ_ROUNDS 2000
+
+static const UnicodeNormalizationForm FORMS[] = {UNICODE_NFC, UNICODE_NFD, UNICODE_NFKC, UNICODE_NFKD};
+
+static uint8_t listed[CODE_POINTS];
+
+/**
+ * Normalizes into pBuf, which must hold `n * UNICODE_NORMALIZE_COMPAT_MAX_GROWTH` bytes; checks the view against the
+ * returned length and that a view of pBuf is only given for text that changed
+ */
+static UnicodeView
+normalize(const uint8_t *pStr, const size_t n, const UnicodeNormalizationForm form, uint8_t *pBuf) {
+    UnicodeView view;
+    const size_t len = unicode_normalize(pStr, n, form, pBuf, n * UNICODE_NORMALIZE_COMPAT_MAX_GROWTH, &view);
+    CHECK(view.p == pStr || view.p == pBuf);
+    CHECK_EQ(view.nbytes, len);
+    CHECK(view.p != pBuf || view.nbytes != n || memcmp(pBuf, pStr, n));
+    return view;
+}
+
+/**
+ * Checks that `form` of pStr is pExpected; a buffer shorter than the result gives its length and {NULL, 0} unless
+ * the text is already normalized
+ */
+static void
+check_form(const uint8_t *pStr, const size_t n, const UnicodeNormalizationForm form, const uint8_t *pExpected,
+           const size_t expected_len) {
+    static uint8_t buf[MAX_CODE_POINTS * 4 * UNICODE_NORMALIZE_COMPAT_MAX_GROWTH];
+
+    const UnicodeView view = normalize(pStr, n, form, buf);
+    CHECK_EQ(view.nbytes, expected_len);
+    CHECK(view.nbytes == expected_len && !memcmp(view.p, pExpected, expected_len));
+
+    const int unchanged = n == expected_len && !memcmp(pStr, pExpected, n);
+    UnicodeView short_view;
+    const size_t short_cap = expected_len ? test_rand_below((uint32_t) expected_len) : 0;
+    CHECK_EQ(unicode_normalize(pStr, n, form, buf, short_cap, &short_view), expected_len);
+    CHECK(unchanged ? short_view.p == pStr : short_view.p == NULL && short_view.nbytes == 0);
+}
+
+/**
+ * Reads the test file: lines of source, NFC, NFD, NFKC and NFKD columns; single code points of part 1 are marked
+ * as listed
+ * @return number of test lines
+ */
+static size_t
+test_file(const char *ucd_dir) {
+    char line[TEST_UCD_LINE];
+    uint8_t c[5][MAX_CODE_POINTS * 4];
+    size_t n[5];
+    size_t lines = 0;
+    int part = -1;
+
+    FILE *file = test_open_ucd(ucd_dir, "NormalizationTest.txt");
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '@') {
+            part = (int) strtol(line + strlen("@Part"), NULL, 10);
+            continue;
+        }
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        for (size_t f = 0; f < 5; f++) {
+            uint32_t code_points[MAX_CODE_POINTS];
+            const size_t count = test_parse_code_points(test_ucd_field(line, f), code_points, MAX_CODE_POINTS);
+            n[f] = 0;
+            for (size_t i = 0; i < count; i++) {
+                n[f] += test_encode_utf8(code_points[i], c[f] + n[f]);
+            }
+            if (f == 0 && part == 1 && count == 1) {
+                listed[code_points[0]] = 1;
+            }
+        }
+
+        // c2 == NFC(c1) == NFC(c2) == NFC(c3), c4 == NFC(c4) == NFC(c5)
+        // c3 == NFD(c1) == NFD(c2) == NFD(c3), c5 == NFD(c4) == NFD(c5)
+        // c4 == NFKC(c1..c5), c5 == NFKD(c1..c5)
+        for (size_t f = 0; f < 5; f++) {
+            check_form(c[f], n[f], UNICODE_NFC, f < 3 ? c[1] : c[3], f < 3 ? n[1] : n[3]);
+            check_form(c[f], n[f], UNICODE_NFD, f < 3 ? c[2] : c[4], f < 3 ? n[2] : n[4]);
+            check_form(c[f], n[f], UNICODE_NFKC, c[3], n[3]);
+            check_form(c[f], n[f], UNICODE_NFKD, c[4], n[4]);
+        }
+        lines++;
+    }
+    fclose(file);
+    return lines;
+}
+
+/**
+ * Every scalar value not listed in part 1 is its own normal form, given back as a view of the text
+ */
+static void
+test_unlisted_code_points(void) {
+    uint8_t text[4];
+    uint8_t buf[4 * UNICODE_NORMALIZE_COMPAT_MAX_GROWTH];
+
+    for (uint32_t cp = 0; cp < CODE_POINTS; cp++) {
+        if (listed[cp] || (cp >= 0xD800 && cp <= 0xDFFF)) {
+            continue;
+        }
+        const size_t n = test_encode_utf8(cp, text);
+        for (size_t f = 0; f < sizeof(FORMS) / sizeof(FORMS[0]); f++) {
+            const UnicodeView view = normalize(text, n, FORMS[f], buf);
+            CHECK(view.p == text && view.nbytes == n);
+        }
+    }
+}
+
+static int
+views_equal(const UnicodeView a, const UnicodeView b) {
+    return a.nbytes == b.nbytes && (a.nbytes == 0 || !memcmp(a.p, b.p, a.nbytes));
+}
+
+/**
+ * Forms of random text are normalized already, and composing or decomposing them again gives the other forms:
+ * NFC(NFD(x)) == NFC(x), NFD(NFC(x)) == NFD(x), NFKC(NFKD(x)) == NFKC(x) and NFKD(NFC(x)) == NFKD(x)
+ */
+static void
+test_consistency(const uint8_t *pStr, const size_t n) {
+    static uint8_t bufs[4][MAX_LEN * UNICODE_NORMALIZE_COMPAT_MAX_GROWTH];
+    static uint8_t again[MAX_LEN * UNICODE_NORMALIZE_COMPAT_MAX_GROWTH * UNICODE_NORMALIZE_COMPAT_MAX_GROWTH];
+    UnicodeView forms[4];
+
+    for (size_t f = 0; f < 4; f++) {
+        forms[f] = normalize(pStr, n, FORMS[f], bufs[f]);
+        const UnicodeView stable = normalize(forms[f].p, forms[f].nbytes, FORMS[f], again);
+        CHECK(stable.p == forms[f].p);
+    }
+    CHECK(views_equal(normalize(forms[UNICODE_NFD].p, forms[UNICODE_NFD].nbytes, UNICODE_NFC, again),
+                      forms[UNICODE_NFC]));
+    CHECK(views_equal(normalize(forms[UNICODE_NFC].p, forms[UNICODE_NFC].nbytes, UNICODE_NFD, again),
+                      forms[UNICODE_NFD]));
+    CHECK(views_equal(normalize(forms[UNICODE_NFKD].p, forms[UNICODE_NFKD].nbytes, UNICODE_NFKC, again),
+                      forms[UNICODE_NFKC]));
+    CHECK(views_equal(normalize(forms[UNICODE_NFC].p, forms[UNICODE_NFC].nbytes, UNICODE_NFKD, again),
+                      forms[UNICODE_NFKD]));
+}
+
+int
+main(const int argc, char **argv) {
+    static uint8_t text[MAX_LEN];
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s UCD_DIR\n", argv[0]);
+        return 1;
+    }
+    CHECK(test_file(argv[1]) > 0);
+    test_unlisted_code_points();
+
+    for (int round = 0; round < FUZZ_ROUNDS; round++) {
+        const size_t n = test_random_utf8(text, test_rand_below(MAX_LEN), round % 2);
+        test_consistency(text, n);
+    }
+
+    return test_result("normalize");
+}
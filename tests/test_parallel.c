@@ -0,0 +1,133 @@
+//
+// Multithreaded counting, validation and decoding against the single-threaded functions, on buffers large enough to
+// be split into chunks. Runs of continuation bytes, lead bytes, ill-formed and multibyte sequences are planted where
+// the chunk boundaries fall, so boundaries have to be moved or dropped.
+//
+
+#include "test.h"
+#include "unicode_parallel.h"
+
+#define TEXT_LEN (8 * UNICODE_PARALLEL_MIN_CHUNK + 1234)
+
+static const unsigned THREADS[] = {1, 2, 3, 8};
+static const UnicodeLayout LAYOUTS[] = {USTR_LAYOUT_UCHAR, USTR_LAYOUT_UTF32, USTR_LAYOUT_SPLIT};
+
+/**
+ * Same chars in the same layout; storage is compared as a whole, there are millions of chars
+ */
+static int
+strings_equal(const UnicodeString *a, const UnicodeString *b) {
+    if (a->len != b->len || a->layout != b->layout) {
+        return 0;
+    }
+    switch (a->layout) {
+        case USTR_LAYOUT_UCHAR:
+            return !memcmp(a->data, b->data, a->len * sizeof(UnicodeChar));
+        case USTR_LAYOUT_UTF32:
+            return !memcmp(a->code_points, b->code_points, a->len * sizeof(uint32_t));
+        default:
+            return !memcmp(a->octets, b->octets, a->len * sizeof(uint32_t)) && !memcmp(a->sizes, b->sizes, a->len);
+    }
+}
+
+static void
+check_text(const uint8_t *pStr, const size_t n) {
+    const size_t len = unicode_decoded_len(pStr, n);
+    size_t error_offset = SIZE_MAX;
+    const int valid = unicode_validate(pStr, n, &error_offset);
+
+    for (size_t t = 0; t < sizeof(THREADS) / sizeof(THREADS[0]); t++) {
+        CHECK_EQ(unicode_parallel_decoded_len(pStr, n, THREADS[t]), len);
+        size_t parallel_offset = SIZE_MAX;
+        CHECK_EQ(unicode_parallel_validate(pStr, n, THREADS[t], &parallel_offset), valid);
+        if (!valid) {
+            CHECK_EQ(parallel_offset, error_offset);
+        }
+    }
+
+    const uint32_t flags[] = {UNICODE_DECODE_DEFAULT, UNICODE_DECODE_STRICT};
+    for (size_t l = 0; l < sizeof(LAYOUTS) / sizeof(LAYOUTS[0]); l++) {
+        for (size_t f = 0; f < sizeof(flags) / sizeof(flags[0]); f++) {
+            UnicodeString *expected = read_into_unicode_string_with_layout(pStr, n, flags[f], LAYOUTS[l]);
+            for (size_t t = 0; t < sizeof(THREADS) / sizeof(THREADS[0]); t++) {
+                UnicodeString *actual = read_into_unicode_string_parallel(pStr, n, flags[f], LAYOUTS[l], NULL,
+                                                                          THREADS[t]);
+                CHECK_EQ(actual != NULL, expected != NULL);
+                if (actual) {
+                    CHECK(expected && strings_equal(actual, expected));
+                    free_ustr(actual);
+                }
+            }
+            if (expected) {
+                free_ustr(expected);
+            }
+        }
+    }
+}
+
+/**
+ * Planted at chunk boundaries: a 4-byte char, a truncated and an overlong sequence split by the boundary, continuation
+ * bytes the lead bytes before them claim or not, lead bytes with nothing to claim
+ */
+static const struct {
+    const char *bytes;
+    size_t len;
+    // bytes of the pattern before the boundary
+    size_t before;
+} PATTERNS[] = {
+        {"\xF0\x9F\x98\x80", 4, 2},
+        {"\xE2\x82" "A", 3, 1},
+        {"\xE0\x80\xAF", 3, 1},
+        {"\xF0\x80\x80\x80\x80\x80\x80\x80\x80\x80\x80\x80\x80\x80\x80\x80", 16, 8},
+        {"\xC3\xF0\xE0\xF0\xC3\xF0\xE0\xF0\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4", 16, 7},
+};
+#define PATTERNS_COUNT (sizeof(PATTERNS) / sizeof(PATTERNS[0]))
+
+/**
+ * Copies patterns over the text at the chunk boundaries of 8, 3 and 2 threads, taking them in turn from the r-th one;
+ * the 7 boundaries of 8 threads get every pattern
+ */
+static void
+plant(uint8_t *pStr, const size_t n, const size_t r) {
+    const unsigned threads[] = {8, 3, 2};
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+        const size_t step = n / threads[t];
+        for (size_t k = 1; k < threads[t]; k++) {
+            const size_t p = (r * threads[t] + k) % PATTERNS_COUNT;
+            memcpy(pStr + k * step - PATTERNS[p].before, PATTERNS[p].bytes, PATTERNS[p].len);
+        }
+    }
+}
+
+int
+main(void) {
+    uint8_t *text = malloc(TEXT_LEN);
+
+    // well-formed random text, then random text with patterns planted at the boundaries, ill-formed and well-formed
+    size_t n = test_random_utf8(text, TEXT_LEN, 0);
+    check_text(text, n);
+    for (size_t r = 0; r < 2; r++) {
+        n = test_random_utf8(text, TEXT_LEN, r == 0);
+        plant(text, n, r);
+        check_text(text, n);
+    }
+
+    // valid text but for one byte in the last chunk
+    n = test_random_utf8(text, 3 * UNICODE_PARALLEL_MIN_CHUNK + 1234, 0);
+    text[n - 10] = 0xFF;
+    check_text(text, n);
+
+    // continuation bytes longer than a chunk: boundaries with no char start before the next one are dropped
+    n = test_random_utf8(text, 4 * UNICODE_PARALLEL_MIN_CHUNK + 1234, 0);
+    memset(text + UNICODE_PARALLEL_MIN_CHUNK / 2, 0x80, 3 * UNICODE_PARALLEL_MIN_CHUNK);
+    check_text(text, n);
+    memset(text, 0x80, 3 * UNICODE_PARALLEL_MIN_CHUNK + 1234);
+    check_text(text, 3 * UNICODE_PARALLEL_MIN_CHUNK + 1234);
+
+    // below two chunks everything runs on the calling thread
+    n = test_random_utf8(text, 2 * UNICODE_PARALLEL_MIN_CHUNK - 1, 1);
+    check_text(text, n);
+
+    free(text);
+    return test_result("parallel");
+}
@@ -0,0 +1,178 @@
+//
+// General category, East Asian Width and display width of every code point against UnicodeData.txt and
+// EastAsianWidth.txt read from the UCD directory, and text widths against a code point by code point sum.
+//
+
+#include "test.h"
+#include "unicode_property.h"
+
+#define CODE_POINTS 0x110000
+#define FUZZ_ROUNDS 2000
+#define MAX_LEN 512
+
+// in the order of UnicodeGeneralCategory and UnicodeEastAsianWidth
+static const char *const CATEGORIES[] = {
+        "Cn", "Lu", "Ll", "Lt", "Lm", "Lo", "Mn", "Mc", "Me", "Nd", "Nl", "No", "Pc", "Pd", "Ps",
+        "Pe", "Pi", "Pf", "Po", "Sm", "Sc", "Sk", "So", "Zs", "Zl", "Zp", "Cc", "Cf", "Cs", "Co",
+};
+static const char *const WIDTHS[] = {"N", "A", "H", "W", "F", "Na"};
+
+static uint8_t categories[CODE_POINTS];
+static uint8_t widths[CODE_POINTS];
+
+static uint8_t
+find_value(const char *const *values, const size_t count, const char *field) {
+    field += strspn(field, " ");
+    const size_t len = strcspn(field, " ;#\n");
+    for (size_t i = 0; i < count; i++) {
+        if (strlen(values[i]) == len && !strncmp(values[i], field, len)) {
+            return (uint8_t) i;
+        }
+    }
+    fprintf(stderr, "unknown property value %.*s\n", (int) len, field);
+    exit(1);
+}
+
+static void
+load_ucd(const char *ucd_dir) {
+    char line[TEST_UCD_LINE];
+    uint32_t range_first = 0;
+
+    // a range is a "<..., First>" line followed by a "<..., Last>" one
+    FILE *file = test_open_ucd(ucd_dir, "UnicodeData.txt");
+    while (fgets(line, sizeof(line), file)) {
+        const uint32_t cp = (uint32_t) strtoul(line, NULL, 16);
+        const uint8_t category = find_value(CATEGORIES, sizeof(CATEGORIES) / sizeof(CATEGORIES[0]),
+                                            test_ucd_field(line, 2));
+        if (strstr(line, ", First>")) {
+            range_first = cp;
+        } else if (strstr(line, ", Last>")) {
+            memset(categories + range_first, category, cp - range_first);
+        }
+        categories[cp] = category;
+    }
+    fclose(file);
+
+    file = test_open_ucd(ucd_dir, "EastAsianWidth.txt");
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        char *pEnd;
+        const uint32_t first = (uint32_t) strtoul(line, &pEnd, 16);
+        const uint32_t last = pEnd[0] == '.' ? (uint32_t) strtoul(pEnd + 2, NULL, 16) : first;
+        memset(widths + first, find_value(WIDTHS, sizeof(WIDTHS) / sizeof(WIDTHS[0]), test_ucd_field(line, 1)),
+               last - first + 1);
+    }
+    fclose(file);
+}
+
+/**
+ * Zero-width rules come first, so a wide nonspacing mark (U+302A) takes 0 columns as in wcwidth(3)
+ */
+static int
+reference_width(const uint32_t cp) {
+    if (cp >= CODE_POINTS) {
+        return 1;
+    }
+    const uint8_t category = categories[cp];
+    if (category == UNICODE_GC_MN || category == UNICODE_GC_ME || category == UNICODE_GC_CC
+        || (category == UNICODE_GC_CF && cp != 0xAD) || (cp >= 0x1160 && cp <= 0x11FF)
+        || (cp >= 0xD7B0 && cp <= 0xD7FF)) {
+        return 0;
+    }
+    return widths[cp] == UNICODE_EAW_WIDE || widths[cp] == UNICODE_EAW_FULLWIDTH ? 2 : 1;
+}
+
+static void
+test_code_points(void) {
+    for (uint32_t cp = 0; cp < CODE_POINTS; cp++) {
+        CHECK_EQ(unicode_general_category(cp), categories[cp]);
+        CHECK_EQ(unicode_east_asian_width(cp), widths[cp]);
+        CHECK_EQ(unicode_char_width(cp), reference_width(cp));
+    }
+    CHECK_EQ(unicode_general_category(CODE_POINTS), UNICODE_GC_CN);
+    CHECK_EQ(unicode_east_asian_width(0xFFFFFFFF), UNICODE_EAW_NEUTRAL);
+    CHECK_EQ(unicode_char_width(0xFFFFFFFF), 1);
+}
+
+/**
+ * Width of UTF-8 text as documented: code point widths, 1 column per byte of an ill-formed subsequence
+ */
+static size_t
+reference_display_width(const uint8_t *pStr, const size_t n) {
+    const uint8_t *pEnd = pStr + n;
+    size_t width = 0;
+
+    while (pStr < pEnd) {
+        uint32_t code_point;
+        int ill_formed;
+        size_t consumed = test_decode_utf8(pStr, pEnd, &code_point, &ill_formed);
+        if (!consumed || ill_formed) {
+            consumed = consumed ? consumed : (size_t) (pEnd - pStr);
+            width += consumed;
+        } else {
+            width += (size_t) reference_width(code_point);
+        }
+        pStr += consumed;
+    }
+    return width;
+}
+
+/**
+ * Width of a string as printed: char widths, 4 columns of `\xNN` for an invalid byte slot
+ */
+static size_t
+reference_string_width(const uint8_t *pStr, const size_t n) {
+    const uint8_t *pEnd = pStr + n;
+    size_t width = 0;
+
+    while (pStr < pEnd) {
+        UnicodeChar chr;
+        pStr += test_decode_uchar(pStr, pEnd, chr.octet, &chr.size);
+        if (chr.size == 4 && chr.octet[0] == '\\') {
+            width += 4;
+        } else {
+            width += (size_t) reference_width(unicode_ord(chr));
+        }
+    }
+    return width;
+}
+
+static void
+test_text(const uint8_t *pStr, const size_t n) {
+    static const UnicodeLayout LAYOUTS[] = {USTR_LAYOUT_UCHAR, USTR_LAYOUT_SPLIT};
+
+    CHECK_EQ(unicode_display_width(pStr, n), reference_display_width(pStr, n));
+    for (size_t l = 0; l < sizeof(LAYOUTS) / sizeof(LAYOUTS[0]); l++) {
+        UnicodeString *string = read_into_unicode_string_with_layout(pStr, n, UNICODE_DECODE_DEFAULT, LAYOUTS[l]);
+        CHECK_EQ(ustr_display_width(string), reference_string_width(pStr, n));
+        free_ustr(string);
+    }
+    // UTF32 strings keep no invalid bytes, only the U+FFFD they became
+    if (unicode_validate(pStr, n, NULL)) {
+        UnicodeString *string = read_into_unicode_string_with_layout(pStr, n, UNICODE_DECODE_DEFAULT,
+                                                                     USTR_LAYOUT_UTF32);
+        CHECK_EQ(ustr_display_width(string), reference_display_width(pStr, n));
+        free_ustr(string);
+    }
+}
+
+int
+main(const int argc, char **argv) {
+    static uint8_t text[MAX_LEN];
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s UCD_DIR\n", argv[0]);
+        return 1;
+    }
+    load_ucd(argv[1]);
+
+    test_code_points();
+    for (int round = 0; round < FUZZ_ROUNDS; round++) {
+        const size_t n = test_random_utf8(text, test_rand_below(MAX_LEN), round % 2);
+        test_text(text, n);
+    }
+
+    return test_result("property");
+}
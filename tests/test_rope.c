@@ -0,0 +1,188 @@
+//
+// Random rope edits against a naive model: an array of chars with the bytes each one came from. Chars never span two
+// leaves, so concatenation, insertion, deletion and slicing are plain array operations on the model.
+//
+
+#include "test.h"
+#include "unicode_rope.h"
+
+#define ROPES 8
+#define FUZZ_ROUNDS 3000
+#define MAX_TEXT 4096
+// a model longer than this is cut down by a slice, so the ropes stay a few leaves deep
+#define MAX_CHARS 24000
+
+typedef struct ModelChar_s {
+    UnicodeChar chr;
+    uint8_t bytes[4];
+    uint8_t nbytes;
+} ModelChar;
+
+typedef struct Model_s {
+    ModelChar *chars;
+    size_t len;
+} Model;
+
+static void
+model_from_bytes(Model *pModel, const uint8_t *pStr, const size_t n) {
+    const uint8_t *pEnd = pStr + n;
+
+    pModel->chars = malloc((n + 1) * sizeof(ModelChar));
+    pModel->len = 0;
+    while (pStr < pEnd) {
+        ModelChar *pChar = &pModel->chars[pModel->len++];
+        pChar->nbytes = (uint8_t) test_decode_uchar(pStr, pEnd, pChar->chr.octet, &pChar->chr.size);
+        memcpy(pChar->bytes, pStr, pChar->nbytes);
+        pStr += pChar->nbytes;
+    }
+}
+
+/**
+ * Model of [start, end) of a followed by b, then [end, len) of a; clamps like the rope functions do
+ */
+static Model
+model_splice(const Model *a, size_t start, size_t end, const Model *b) {
+    end = end < a->len ? end : a->len;
+    start = start < end ? start : end;
+    Model result = {malloc((a->len + b->len + 1) * sizeof(ModelChar)), 0};
+    memcpy(result.chars, a->chars, start * sizeof(ModelChar));
+    memcpy(result.chars + start, b->chars, b->len * sizeof(ModelChar));
+    memcpy(result.chars + start + b->len, a->chars + end, (a->len - end) * sizeof(ModelChar));
+    result.len = a->len - (end - start) + b->len;
+    return result;
+}
+
+static void
+check_rope(const UnicodeRope *rope, const Model *pModel) {
+    size_t nbytes = 0;
+    for (size_t i = 0; i < pModel->len; i++) {
+        nbytes += pModel->chars[i].nbytes;
+    }
+    CHECK_EQ(rope->len, pModel->len);
+    CHECK_EQ(rope->nbytes, nbytes);
+    CHECK_EQ(rope->root == NULL, pModel->len == 0);
+
+    // a few random chars and both ends
+    for (int k = 0; k < 16 && pModel->len; k++) {
+        const size_t i = k == 0 ? 0 : k == 1 ? pModel->len - 1 : test_rand_below((uint32_t) pModel->len);
+        const UnicodeChar chr = rope_char_at(rope, i);
+        CHECK_EQ(chr.size, pModel->chars[i].chr.size);
+        CHECK(!memcmp(chr.octet, pModel->chars[i].chr.octet, sizeof(chr.octet)));
+    }
+    CHECK_EQ(rope_char_at(rope, pModel->len).size, 0);
+
+    // leaves hold whole chars of the model, in order
+    UnicodeRopeIterator it;
+    UnicodeView leaf;
+    size_t i = 0;
+    rope_iter_init(&it, rope);
+    while (rope_next_leaf(&it, &leaf)) {
+        CHECK(leaf.nbytes > 0 && leaf.nbytes <= UNICODE_ROPE_LEAF_SIZE);
+        while (leaf.nbytes && i < pModel->len) {
+            const ModelChar *pChar = &pModel->chars[i++];
+            CHECK(leaf.nbytes >= pChar->nbytes && !memcmp(leaf.p, pChar->bytes, pChar->nbytes));
+            UnicodeChar chr;
+            CHECK_EQ(unicode_view_next(&leaf, &chr), pChar->nbytes);
+            CHECK_EQ(chr.size, pChar->chr.size);
+        }
+        CHECK_EQ(leaf.nbytes, 0);
+    }
+    CHECK_EQ(i, pModel->len);
+
+    // `len` of a CompressedUnicodeString counts the terminator
+    CompressedUnicodeString *bytes = compress_rope_into_bytes_array(rope);
+    CHECK_EQ(bytes->len, nbytes + 1);
+    size_t offset = 0;
+    for (size_t k = 0; k < pModel->len && offset + pModel->chars[k].nbytes < bytes->len; k++) {
+        CHECK(!memcmp(bytes->data + offset, pModel->chars[k].bytes, pModel->chars[k].nbytes));
+        offset += pModel->chars[k].nbytes;
+    }
+    CHECK_EQ(offset < bytes->len ? bytes->data[offset] : 0xFF, 0);
+    free_compressed_ustr(bytes);
+}
+
+int
+main(void) {
+    static uint8_t text[MAX_TEXT];
+    UnicodeRope *ropes[ROPES];
+    Model models[ROPES];
+
+    for (int r = 0; r < ROPES; r++) {
+        const size_t n = test_random_utf8(text, test_rand_below(MAX_TEXT), r % 2);
+        ropes[r] = new_rope(text, n);
+        model_from_bytes(&models[r], text, n);
+    }
+
+    for (int round = 0; round < FUZZ_ROUNDS; round++) {
+        const int target = (int) test_rand_below(ROPES);
+        const int ia = (int) test_rand_below(ROPES), ib = (int) test_rand_below(ROPES);
+        const UnicodeRope *a = ropes[ia], *b = ropes[ib];
+        const Model *pA = &models[ia], *pB = &models[ib];
+        UnicodeRope *result;
+        Model model;
+
+        // indices past the end are clamped, a few of them check that
+        const size_t start = test_rand_below((uint32_t) pA->len + 2);
+        const size_t end = start + test_rand_below((uint32_t) (pA->len - (start < pA->len ? start : pA->len)) + 2);
+        static ModelChar none[1];
+        const Model empty = {none, 0};
+
+        switch (test_rand_below(5)) {
+            case 0: {
+                const size_t n = test_random_utf8(text, test_rand_below(MAX_TEXT), (int) test_rand_below(2));
+                result = new_rope(text, n);
+                model_from_bytes(&model, text, n);
+                break;
+            }
+            case 1:
+                result = rope_concat(a, b);
+                model = model_splice(pA, pA->len, pA->len, pB);
+                break;
+            case 2:
+                result = rope_insert(a, start, b);
+                model = model_splice(pA, start, start, pB);
+                break;
+            case 3:
+                result = rope_delete(a, start, end);
+                model = model_splice(pA, start, end, &empty);
+                break;
+            default: {
+                result = rope_slice(a, start, end);
+                const size_t slice_end = end < pA->len ? end : pA->len;
+                const size_t slice_start = start < slice_end ? start : slice_end;
+                model = (Model){malloc((slice_end - slice_start + 1) * sizeof(ModelChar)), slice_end - slice_start};
+                memcpy(model.chars, pA->chars + slice_start, model.len * sizeof(ModelChar));
+                break;
+            }
+        }
+        check_rope(result, &model);
+
+        // keep the texts in bounds, then replace the target; other ropes sharing its nodes must stay intact
+        if (model.len > MAX_CHARS) {
+            UnicodeRope *cut = rope_slice(result, 0, MAX_CHARS / 2);
+            free_rope(result);
+            result = cut;
+            model.len = MAX_CHARS / 2;
+        }
+        free_rope(ropes[target]);
+        free(models[target].chars);
+        ropes[target] = result;
+        models[target] = model;
+        for (int r = 0; r < ROPES; r++) {
+            CHECK_EQ(ropes[r]->len, models[r].len);
+        }
+        if (round % 100 == 0) {
+            for (int r = 0; r < ROPES; r++) {
+                check_rope(ropes[r], &models[r]);
+            }
+        }
+    }
+
+    for (int r = 0; r < ROPES; r++) {
+        check_rope(ropes[r], &models[r]);
+        free_rope(ropes[r]);
+        free(models[r].chars);
+    }
+
+    return test_result("rope");
+}
@@ -0,0 +1,303 @@
+//
+// UTF-8 <-> UTF-32 / UTF-16 transcoders against a char-by-char reference, on random text long enough for the vector
+// kernels and on every output capacity.
+//
+
+#include "test.h"
+#include "unicode_transcode.h"
+
+#define MAX_LEN 512
+#define FUZZ_ROUNDS 3000
+
+/**
+ * Canary past the end of output buffers, a kernel storing past dst + cap overwrites it
+ */
+#define CANARY 0xA5
+#define CANARY_SIZE 64
+
+typedef struct Reference_s {
+    uint32_t code_points[MAX_LEN];
+    size_t len;
+    size_t consumed;
+    size_t replaced;
+} Reference;
+
+/**
+ * Decodes the whole input with the reference decoder, stops at a sequence prefix cut by the end of input
+ */
+static void
+reference_decode(const uint8_t *pStr, const size_t n, Reference *pRef) {
+    const uint8_t *pEnd = pStr + n;
+    const uint8_t *p = pStr;
+
+    pRef->len = pRef->replaced = 0;
+    while (p < pEnd) {
+        int ill_formed;
+        const size_t consumed = test_decode_utf8(p, pEnd, &pRef->code_points[pRef->len], &ill_formed);
+        if (!consumed) {
+            break;
+        }
+        p += consumed;
+        pRef->len++;
+        pRef->replaced += ill_formed;
+    }
+    pRef->consumed = (size_t) (p - pStr);
+}
+
+static size_t
+utf16_units(const uint32_t code_point) {
+    return code_point > 0xFFFF ? 2 : 1;
+}
+
+static uint16_t
+load_unit(const uint16_t unit, const UnicodeByteOrder order) {
+    const uint8_t *bytes = (const uint8_t *) &unit;
+    return order == UNICODE_BIG_ENDIAN ? (uint16_t) (bytes[0] << 8 | bytes[1]) : (uint16_t) (bytes[1] << 8 | bytes[0]);
+}
+
+static void
+store_unit(uint16_t *pOut, const uint16_t unit, const UnicodeByteOrder order) {
+    uint8_t *bytes = (uint8_t *) pOut;
+    bytes[order == UNICODE_BIG_ENDIAN ? 0 : 1] = (uint8_t) (unit >> 8);
+    bytes[order == UNICODE_BIG_ENDIAN ? 1 : 0] = (uint8_t) unit;
+}
+
+static int
+canary_intact(const uint8_t *p) {
+    for (size_t i = 0; i < CANARY_SIZE; i++) {
+        if (p[i] != CANARY) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void
+test_utf8_to_utf32(const uint8_t *pStr, const size_t n, const Reference *pRef) {
+    // dst has room for n code points
+    uint32_t *out = malloc(n * sizeof(uint32_t) + CANARY_SIZE);
+    memset(out, CANARY, n * sizeof(uint32_t) + CANARY_SIZE);
+
+    const UnicodeTranscodeResult result = utf8_to_utf32(pStr, n, out);
+    CHECK(canary_intact((const uint8_t *) (out + n)));
+    CHECK_EQ(result.consumed, pRef->consumed);
+    CHECK_EQ(result.produced, pRef->len);
+    CHECK_EQ(result.replaced, pRef->replaced);
+    CHECK(memcmp(out, pRef->code_points, pRef->len * sizeof(uint32_t)) == 0);
+    free(out);
+}
+
+/**
+ * Converts into a buffer of exactly cap units followed by a canary, checks that the output is the longest prefix of
+ * the reference that fits
+ */
+static void
+test_utf8_to_utf16_cap(const uint8_t *pStr, const size_t n, const Reference *pRef, const size_t cap,
+                       const UnicodeByteOrder order) {
+    uint16_t *out = malloc(cap * sizeof(uint16_t) + CANARY_SIZE);
+    memset(out, CANARY, cap * sizeof(uint16_t) + CANARY_SIZE);
+
+    const UnicodeTranscodeResult result = utf8_to_utf16(pStr, n, out, cap, order);
+    CHECK(canary_intact((const uint8_t *) (out + cap)));
+
+    // chars of the reference that fit
+    size_t chars = 0, units = 0, consumed = 0, replaced = 0;
+    const uint8_t *pEnd = pStr + n;
+    while (chars < pRef->len && units + utf16_units(pRef->code_points[chars]) <= cap) {
+        uint32_t code_point;
+        int ill_formed;
+        consumed += test_decode_utf8(pStr + consumed, pEnd, &code_point, &ill_formed);
+        replaced += ill_formed;
+        units += utf16_units(pRef->code_points[chars++]);
+    }
+    CHECK_EQ(result.consumed, consumed);
+    CHECK_EQ(result.produced, units);
+    CHECK_EQ(result.replaced, replaced);
+
+    size_t k = 0;
+    for (size_t i = 0; i < chars && k + utf16_units(pRef->code_points[i]) <= result.produced; i++) {
+        const uint32_t code_point = pRef->code_points[i];
+        if (code_point > 0xFFFF) {
+            CHECK_EQ(load_unit(out[k++], order), 0xD800 + ((code_point - 0x10000) >> 10));
+            CHECK_EQ(load_unit(out[k++], order), 0xDC00 + ((code_point - 0x10000) & 0x3FF));
+        } else {
+            CHECK_EQ(load_unit(out[k++], order), code_point);
+        }
+    }
+    free(out);
+}
+
+static void
+test_utf8_to_utf16(const uint8_t *pStr, const size_t n, const Reference *pRef) {
+    size_t units = 0;
+    for (size_t i = 0; i < pRef->len; i++) {
+        units += utf16_units(pRef->code_points[i]);
+    }
+    CHECK_EQ(utf8_to_utf16_len(pStr, n), units);
+
+    // the length is the documented size of dst
+    test_utf8_to_utf16_cap(pStr, n, pRef, units, UNICODE_LITTLE_ENDIAN);
+    test_utf8_to_utf16_cap(pStr, n, pRef, units, UNICODE_BIG_ENDIAN);
+    test_utf8_to_utf16_cap(pStr, n, pRef, n, UNICODE_LITTLE_ENDIAN);
+    test_utf8_to_utf16_cap(pStr, n, pRef, test_rand_below((uint32_t) units + 1), UNICODE_LITTLE_ENDIAN);
+    test_utf8_to_utf16_cap(pStr, n, pRef, test_rand_below((uint32_t) units + 1), UNICODE_BIG_ENDIAN);
+}
+
+/**
+ * Code points and units around every range the encoders special-case
+ */
+static uint32_t
+random_utf32_value(void) {
+    switch (test_rand_below(8)) {
+        case 0:
+            return 0xD800 + test_rand_below(0x800);
+        case 1:
+            return 0x110000 + test_rand_below(0x1000);
+        case 2:
+            return test_rand();
+        default:
+            return test_rand_code_point(1 + (int) test_rand_below(4));
+    }
+}
+
+static void
+test_utf32_to_utf8(void) {
+    uint32_t src[MAX_LEN];
+    uint8_t expected[MAX_LEN * 4];
+    uint8_t out[MAX_LEN * 4 + CANARY_SIZE];
+    const size_t n = test_rand_below(MAX_LEN);
+    // runs of one class, so vector kernels take them
+    const int octets = 1 + (int) test_rand_below(4);
+    size_t len = 0, replaced = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        src[i] = test_rand_below(8) ? test_rand_code_point(octets) : random_utf32_value();
+        const int invalid = (src[i] >= 0xD800 && src[i] < 0xE000) || src[i] > 0x10FFFF;
+        replaced += invalid;
+        len += test_encode_utf8(invalid ? 0xFFFD : src[i], expected + len);
+    }
+    CHECK_EQ(utf32_to_utf8_len(src, n), len);
+
+    const size_t cap = test_rand_below(2) ? len : test_rand_below((uint32_t) len + 1);
+    memset(out, CANARY, sizeof(out));
+    const UnicodeTranscodeResult result = utf32_to_utf8(src, n, out, cap);
+    CHECK(canary_intact(out + cap));
+    if (cap == len) {
+        CHECK_EQ(result.consumed, n);
+        CHECK_EQ(result.produced, len);
+        CHECK_EQ(result.replaced, replaced);
+    }
+    CHECK(result.produced <= cap);
+    CHECK(memcmp(out, expected, result.produced) == 0);
+}
+
+static void
+test_utf16_to_utf8(const UnicodeByteOrder order) {
+    uint16_t src[MAX_LEN];
+    uint8_t expected[MAX_LEN * 3];
+    uint8_t out[MAX_LEN * 3 + CANARY_SIZE];
+    size_t n = 0;
+
+    while (n < MAX_LEN - 2 && test_rand_below(MAX_LEN / 2)) {
+        const uint32_t r = test_rand_below(16);
+        if (r == 0) {
+            // unpaired surrogate
+            store_unit(src + n++, (uint16_t) (0xD800 + test_rand_below(0x800)), order);
+        } else if (r < 4) {
+            const uint32_t code_point = test_rand_code_point(4);
+            store_unit(src + n++, (uint16_t) (0xD800 + ((code_point - 0x10000) >> 10)), order);
+            store_unit(src + n++, (uint16_t) (0xDC00 + ((code_point - 0x10000) & 0x3FF)), order);
+        } else {
+            store_unit(src + n++, (uint16_t) test_rand_code_point(1 + (int) test_rand_below(3)), order);
+        }
+    }
+
+    // reference: pairs, unpaired surrogates as U+FFFD, a high surrogate at the end is left
+    size_t i = 0, len = 0, replaced = 0;
+    while (i < n) {
+        const uint16_t unit = load_unit(src[i], order);
+        uint32_t code_point = unit;
+        if (unit >= 0xD800 && unit < 0xDC00) {
+            if (i + 1 == n) {
+                break;
+            }
+            const uint16_t next = load_unit(src[i + 1], order);
+            if (next >= 0xDC00 && next < 0xE000) {
+                code_point = 0x10000 + ((uint32_t) (unit - 0xD800) << 10) + (next - 0xDC00);
+                i++;
+            } else {
+                code_point = 0xFFFD;
+                replaced++;
+            }
+        } else if (unit >= 0xDC00 && unit < 0xE000) {
+            code_point = 0xFFFD;
+            replaced++;
+        }
+        i++;
+        len += test_encode_utf8(code_point, expected + len);
+    }
+    const size_t consumed = i;
+
+    // exactly what utf16_to_utf8 writes: a high surrogate at the end is not counted
+    CHECK_EQ(utf16_to_utf8_len(src, n, order), len);
+
+    memset(out, CANARY, sizeof(out));
+    UnicodeTranscodeResult result = utf16_to_utf8(src, n, out, len, order);
+    CHECK(canary_intact(out + len));
+    CHECK_EQ(result.consumed, consumed);
+    CHECK_EQ(result.produced, len);
+    CHECK_EQ(result.replaced, replaced);
+    CHECK(memcmp(out, expected, len) == 0);
+
+    const size_t cap = test_rand_below((uint32_t) len + 1);
+    memset(out, CANARY, sizeof(out));
+    result = utf16_to_utf8(src, n, out, cap, order);
+    CHECK(canary_intact(out + cap));
+    CHECK(result.produced <= cap);
+    CHECK(memcmp(out, expected, result.produced) == 0);
+}
+
+/**
+ * dst sized with `utf8_to_utf16_len` used to be overrun by the 16-unit ASCII kernel: the input is 16 bytes, the
+ * output 10 units
+ */
+static void
+test_utf8_to_utf16_exact_size(void) {
+    const uint8_t str[] = "a\xF0\x9F\x98\x80\xF0\x9F\x98\x80\xF0\x9F\x98\x80" "bcd";
+    const size_t n = sizeof(str) - 1;
+    const size_t units = utf8_to_utf16_len(str, n);
+    CHECK_EQ(n, 16);
+    CHECK_EQ(units, 10);
+
+    uint16_t *out = malloc(units * sizeof(uint16_t) + CANARY_SIZE);
+    memset(out, CANARY, units * sizeof(uint16_t) + CANARY_SIZE);
+    const UnicodeTranscodeResult result = utf8_to_utf16(str, n, out, units, UNICODE_LITTLE_ENDIAN);
+    CHECK_EQ(result.consumed, n);
+    CHECK_EQ(result.produced, units);
+    CHECK(canary_intact((const uint8_t *) (out + units)));
+    CHECK_EQ(out[0], 'a');
+    CHECK_EQ(out[1], 0xD83D);
+    CHECK_EQ(out[2], 0xDE00);
+    CHECK_EQ(out[9], 'd');
+    free(out);
+}
+
+int
+main(void) {
+    static uint8_t str[MAX_LEN];
+    static Reference ref;
+
+    test_utf8_to_utf16_exact_size();
+
+    for (int round = 0; round < FUZZ_ROUNDS; round++) {
+        const size_t n = test_random_utf8(str, test_rand_below(MAX_LEN), round % 2);
+        reference_decode(str, n, &ref);
+        test_utf8_to_utf32(str, n, &ref);
+        test_utf8_to_utf16(str, n, &ref);
+        test_utf32_to_utf8();
+        test_utf16_to_utf8(UNICODE_LITTLE_ENDIAN);
+        test_utf16_to_utf8(UNICODE_BIG_ENDIAN);
+    }
+
+    return test_result("transcode");
+}
@@ -0,0 +1,226 @@
+#!/usr/bin/env python3
+#
+# Writes NormalizationTest.txt and GraphemeBreakTest.txt into the UCD directory, in the format of the UCD test files
+# of the same names. The expected results come from implementations of Unicode 14.0.0 independent of this library:
+# Python's unicodedata for normalization and Perl's \X regex escape for grapheme clusters. The generated files are
+# not the official ones: they have fewer cases and no rule numbers, but the same columns and break markers.
+#
+# Usage: tools/gen_ucd_tests.py <ucd-dir>
+#
+
+import os
+import random
+import subprocess
+import sys
+import unicodedata
+
+UNICODE_VERSION = "14.0.0"
+CODE_POINTS = 0x110000
+RANDOM_CASES = 3000
+
+
+def is_scalar(cp):
+    return cp < 0xD800 or cp > 0xDFFF
+
+
+def hex_seq(cps):
+    return " ".join("%04X" % cp for cp in cps)
+
+
+def name(cp):
+    return unicodedata.name(chr(cp), "<U+%04X>" % cp)
+
+
+# ============ Normalization ============ #
+
+def normalization_line(cps):
+    source = "".join(map(chr, cps))
+    columns = [source] + [unicodedata.normalize(form, source) for form in ("NFC", "NFD", "NFKC", "NFKD")]
+    fields = "".join(hex_seq(map(ord, column)) + ";" for column in columns)
+    return "%s # %s" % (fields, ", ".join(name(cp) for cp in cps))
+
+
+def gen_normalization(ucd_dir):
+    rng = random.Random(15)
+    # starters, marks of several combining classes, Hangul jamo and syllables, singletons, compatibility chars and
+    # composition exclusions: the chars the normalization algorithm treats differently
+    samples = [
+        0x0041, 0x0061, 0x0065, 0x006F, 0x0075, 0x00C5, 0x00E9, 0x01B0, 0x1E0A, 0x1E63, 0x0300, 0x0301, 0x0302,
+        0x0303, 0x0307, 0x0308, 0x030A, 0x0323, 0x0327, 0x0328, 0x031B, 0x0345, 0x05B0, 0x05B7, 0x0591, 0x0F71,
+        0x0F72, 0x0F80, 0x1100, 0x1161, 0x11A8, 0x11C2, 0xAC00, 0xAC01, 0xD7A3, 0x212B, 0x2126, 0x0958, 0x0344,
+        0x0F73, 0xFB1D, 0x1E9B, 0xFB01, 0x2460, 0x00BD, 0x3099, 0x304B, 0x30AB, 0xFF76, 0xFF9E, 0x0CCA, 0x0CC6,
+        0x0CC2, 0x0CD5, 0x0B47, 0x0B3E, 0x0B57, 0x1D15E, 0x1D165, 0x1D16E, 0x2ADC, 0x0338, 0x003C, 0x2260,
+        0x1175, 0x11FF, 0x0020, 0x034F, 0x1DFA, 0x093C, 0x0929, 0x09BE, 0x09C7, 0x11131,
+        0x11127, 0x1611E, 0x16121,
+    ]
+    lines = [
+        "# NormalizationTest.txt",
+        "# Unicode %s" % UNICODE_VERSION,
+        "#",
+        "# Generated by tools/gen_ucd_tests.py with Python %s unicodedata (Unicode %s)." % (
+            sys.version.split()[0], unicodedata.unidata_version),
+        "# This is not the official NormalizationTest.txt, it follows its format:",
+        "# source; NFC; NFD; NFKC; NFKD; # names",
+        "#",
+        "# @Part0 sequences of chars normalization treats differently, @Part1 every code point whose forms are not",
+        "# all the code point itself: every code point not listed there is its own NFC, NFD, NFKC and NFKD.",
+        "# @Part2 random sequences of starters, combining marks and Hangul jamo.",
+        "#",
+        "@Part0 # Specific cases",
+    ]
+    specific = [
+        [0x1E0A], [0x1E0C], [0x1E0A, 0x0323], [0x1E0C, 0x0307], [0x0044, 0x0307, 0x0323], [0x0044, 0x0323, 0x0307],
+        [0x1E0A, 0x031B], [0x0061, 0x0315, 0x0300, 0x05AE, 0x0300, 0x0062], [0x0061, 0x0300, 0x0315, 0x0300, 0x05AE],
+        [0x00C5], [0x212B], [0x0041, 0x030A], [0x2126], [0x1E9B, 0x0323], [0xFB01], [0x1100, 0x1161, 0x11A8],
+        [0xAC00, 0x11A8], [0xAC01, 0x11A8], [0x1100, 0xAC00, 0x1161], [0x0958], [0x0915, 0x093C], [0x0344],
+        [0x0F73], [0x0F71, 0x0F72], [0x0F72, 0x0F71], [0x0061, 0x0345, 0x0301], [0x03B1, 0x0313, 0x0301, 0x0345],
+        [0x1D15E], [0x1D157, 0x1D165], [0x0B47, 0x0B3E], [0x0B47, 0x0300, 0x0B3E], [0x0CC6, 0x0CC2, 0x0CD5],
+        [0x3071], [0x306F, 0x309A], [0xFF8A, 0xFF9F], [0x003C, 0x0338], [0x226E], [0x2ADC], [0x2ADD, 0x0338],
+        [0x0041, 0x0308, 0x0301], [0x0041, 0x0301, 0x0308], [0x00C4, 0x0301], [0x0065, 0x0301, 0x0301],
+        [0x0041, 0x034F, 0x0308], [0x0041, 0x0328, 0x0308, 0x0301], [0x1EA5, 0x0328], [0x11131, 0x11127],
+        [0x11127, 0x11131], [0x1611E, 0x1611E, 0x1611F],
+    ]
+    lines += [normalization_line(cps) for cps in specific]
+    for _ in range(RANDOM_CASES // 3):
+        lines.append(normalization_line([rng.choice(samples) for _ in range(rng.randint(2, 7))]))
+
+    lines.append("@Part1 # Character by character test")
+    for cp in range(CODE_POINTS):
+        if not is_scalar(cp):
+            continue
+        c = chr(cp)
+        if any(unicodedata.normalize(form, c) != c for form in ("NFC", "NFD", "NFKC", "NFKD")):
+            lines.append(normalization_line([cp]))
+
+    lines.append("@Part2 # Random sequences")
+    marks = [cp for cp in range(0x0300, 0x0370)] + [0x0591, 0x05B0, 0x05BC, 0x0670, 0x093C, 0x0F71, 0x0F74, 0x3099,
+                                                     0x1D165, 0x1D16D, 0x1DFA]
+    jamo = [0x1100, 0x1112, 0x1161, 0x1175, 0x11A7, 0x11A8, 0x11C2, 0x11C3, 0xAC00, 0xAC1C, 0xD7A3]
+    starters = [0x0041, 0x0061, 0x006F, 0x03B1, 0x0415, 0x0627, 0x0915, 0x3046, 0x304B, 0x0B47, 0x0CC6, 0x1E0A]
+    for _ in range(RANDOM_CASES):
+        pool = rng.choice([marks + starters, jamo, marks + jamo + starters, samples])
+        lines.append(normalization_line([rng.choice(pool) for _ in range(rng.randint(1, 10))]))
+
+    with open(os.path.join(ucd_dir, "NormalizationTest.txt"), "w", encoding="utf-8") as out:
+        out.write("\n".join(lines) + "\n")
+
+
+# ============ Grapheme clusters ============ #
+
+def read_property_file(path, wanted=None):
+    values = {}
+    with open(path, encoding="utf-8") as file:
+        for line in file:
+            line = line.split("#")[0].strip()
+            if not line:
+                continue
+            range_, value = (field.strip() for field in line.split(";"))
+            if wanted and value != wanted:
+                continue
+            first, _, last = range_.partition("..")
+            for cp in range(int(first, 16), int(last or first, 16) + 1):
+                values[cp] = value
+    return values
+
+
+def perl_clusters(sequences):
+    """
+    Lengths, in code points, of the extended grapheme clusters Perl's \\X finds in every sequence
+    """
+    script = r'chomp; my $s = join "", map { chr hex } split / /; print join(" ", map { length } $s =~ /\X/g), "\n"'
+    version = subprocess.run(["perl", "-MUnicode::UCD", "-e", 'printf "%vd %s", $^V, Unicode::UCD::UnicodeVersion()'],
+                             capture_output=True, text=True, check=True).stdout.split()
+    if version[1] != UNICODE_VERSION:
+        sys.exit("perl implements Unicode %s, %s is needed" % (version[1], UNICODE_VERSION))
+    result = subprocess.run(["perl", "-CSD", "-ne", script], input="".join(hex_seq(s) + "\n" for s in sequences),
+                            capture_output=True, text=True, check=True)
+    return [list(map(int, line.split())) for line in result.stdout.splitlines()], version[0]
+
+
+def gen_grapheme(ucd_dir):
+    rng = random.Random(29)
+    properties = read_property_file(os.path.join(ucd_dir, "GraphemeBreakProperty.txt"))
+    pictographic = read_property_file(os.path.join(ucd_dir, "emoji-data.txt"), "Extended_Pictographic")
+
+    def describe(cp):
+        value = properties.get(cp, "Other")
+        if cp in pictographic:
+            value = "ExtPict" if value == "Other" else value + "_ExtPict"
+        return "%s (%s)" % (name(cp), value)
+
+    # one char of every Grapheme_Cluster_Break value, Extended_Pictographic and an unassigned code point, as the
+    # pair table of the official file has
+    pair_samples = [0x0020, 0x000D, 0x000A, 0x0001, 0x034F, 0x1F1E6, 0x0600, 0x0903, 0x1100, 0x1160, 0x11A8,
+                    0xAC00, 0xAC01, 0x231A, 0x0300, 0x200D, 0x0378]
+    sequences = []
+    for first in pair_samples:
+        for second in pair_samples:
+            sequences.append([first, second])
+            sequences.append([first, 0x0308, second])
+    sequences += [
+        [0x000D, 0x000A, 0x0061, 0x000A, 0x0308], [0x0061, 0x0308], [0x0020, 0x200D, 0x0646],
+        [0x0646, 0x200D, 0x0020], [0x1100, 0x1100], [0xAC00, 0x11A8, 0x1100], [0xAC01, 0x11A8, 0x1100],
+        [0x1F1E6, 0x1F1E7, 0x1F1E8, 0x0062], [0x0061, 0x1F1E6, 0x1F1E7, 0x1F1E8, 0x0062],
+        [0x0061, 0x1F1E6, 0x1F1E7, 0x200D, 0x1F1E8, 0x0062], [0x0061, 0x1F1E6, 0x200D, 0x1F1E7, 0x1F1E8, 0x0062],
+        [0x0061, 0x1F1E6, 0x1F1E7, 0x1F1E8, 0x1F1E9, 0x0062], [0x0061, 0x200D], [0x0061, 0x0308, 0x0062],
+        [0x0061, 0x0903, 0x0062], [0x0061, 0x0600, 0x0062], [0x1F476, 0x1F3FF, 0x1F476],
+        [0x0061, 0x1F3FF, 0x1F476], [0x0061, 0x1F3FF, 0x1F476, 0x200D, 0x1F6D1],
+        [0x1F476, 0x1F3FF, 0x0308, 0x200D, 0x1F476, 0x1F3FF], [0x1F6D1, 0x200D, 0x1F6D1], [0x0061, 0x200D, 0x1F6D1],
+        [0x2701, 0x200D, 0x2701], [0x0061, 0x200D, 0x2701], [0x1F469, 0x200D, 0x2764, 0xFE0F, 0x200D, 0x1F468],
+        [0x1F3F3, 0xFE0F, 0x200D, 0x1F308], [0x0915, 0x094D, 0x0937, 0x093F], [0x0E01, 0x0E33], [0x0E33, 0x0E01],
+        [0x0600, 0x0600, 0x0661], [0x0600, 0x000A], [0x1100, 0x1161, 0x11A8, 0x11A8], [0x1160, 0x1160, 0x11A8],
+    ]
+    # random sequences of chars of every value, several of each
+    by_value = {}
+    for cp, value in sorted(properties.items()):
+        by_value.setdefault(value, []).append(cp)
+    pool = pair_samples + [0x0061, 0x0915, 0x094D, 0xFE0F, 0x1F3FB, 0x1F468, 0x1F469, 0x2764]
+    for cps in by_value.values():
+        pool += rng.sample(cps, min(4, len(cps)))
+    pool += rng.sample(sorted(pictographic), 8)
+    for _ in range(RANDOM_CASES):
+        sequences.append([rng.choice(pool) for _ in range(rng.randint(1, 8))])
+
+    clusters, perl_version = perl_clusters(sequences)
+    lines = [
+        "# GraphemeBreakTest.txt",
+        "# Unicode %s" % UNICODE_VERSION,
+        "#",
+        "# Generated by tools/gen_ucd_tests.py: boundaries are the ones Perl %s \\X finds (Unicode %s)." % (
+            perl_version, UNICODE_VERSION),
+        "# This is not the official GraphemeBreakTest.txt, it follows its format without rule numbers:",
+        "# ÷ marks a boundary, × no boundary, between code points given in hex.",
+        "#",
+        "# Pairs of chars of every Grapheme_Cluster_Break value, alone and with U+0308 in between, then specific",
+        "# sequences (emoji ZWJ sequences, regional indicator runs, Hangul syllables) and random ones.",
+        "#",
+    ]
+    for cps, lengths in zip(sequences, clusters):
+        if sum(lengths) != len(cps):
+            sys.exit("perl split %s into %s" % (hex_seq(cps), lengths))
+        boundaries = set()
+        offset = 0
+        for length in lengths:
+            offset += length
+            boundaries.add(offset)
+        text = "÷ " + " ".join("%04X %s" % (cp, "÷" if i + 1 in boundaries else "×") for i, cp in enumerate(cps))
+        comment = "÷ " + " ".join("%s %s" % (describe(cp), "÷" if i + 1 in boundaries else "×")
+                                  for i, cp in enumerate(cps))
+        lines.append("%s\t#  %s" % (text, comment))
+
+    with open(os.path.join(ucd_dir, "GraphemeBreakTest.txt"), "w", encoding="utf-8") as out:
+        out.write("\n".join(lines) + "\n")
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("usage: %s <ucd-dir>" % sys.argv[0])
+    if unicodedata.unidata_version != UNICODE_VERSION:
+        sys.exit("python unicodedata implements Unicode %s, %s is needed" % (unicodedata.unidata_version,
+                                                                             UNICODE_VERSION))
+    gen_normalization(sys.argv[1])
+    gen_grapheme(sys.argv[1])
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,980 @@
+//
+// Build-time generator of the Unicode property tables the library looks code points up in.
+// Reads UCD data files from data/ucd and writes one header per table group.
+//
+// Usage: unicode-gen-tables <ucd-dir> <output-dir>
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CODE_POINTS 0x110000
+
+/**
+ * Code points are looked up in three stages: cp >> 12 selects a 4096-cp chunk, (cp >> 6) & 63 one of its 64-cp blocks,
+ * cp & 63 the value in the block. Equal chunks and equal blocks are stored once
+ */
+#define TRIE_BLOCK_SHIFT 6
+#define TRIE_CHUNK_SHIFT 12
+#define TRIE_BLOCK_SIZE (1 << TRIE_BLOCK_SHIFT)
+#define TRIE_CHUNK_BLOCKS (1 << (TRIE_CHUNK_SHIFT - TRIE_BLOCK_SHIFT))
+
+#define MAX_FIELDS 16
+#define MAX_MAPPING 3
+#define MAX_DECOMPOSITION 18
+#define LINE_SIZE 1024
+
+/**
+ * Case mappings of one code point in the order of UnicodeCaseMapping: lower, upper, fold
+ */
+#define CASE_MAPPINGS 3
+
+static const char *GENERATED_NOTICE = "// Generated by tools/unicode_gen_tables.c from data/ucd, do not edit.\n";
+
+static void
+die(const char *message, const char *arg) {
+    fprintf(stderr, "unicode-gen-tables: %s%s\n", message, arg);
+    exit(1);
+}
+
+static void *
+xcalloc(const size_t count, const size_t size) {
+    void *ptr = calloc(count, size);
+    if (ptr == NULL) {
+        die("out of memory", "");
+    }
+    return ptr;
+}
+
+static FILE *
+open_file(const char *dir, const char *name, const char *mode) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *file = fopen(path, mode);
+    if (file == NULL) {
+        die("can't open ", path);
+    }
+    return file;
+}
+
+/**
+ * Cuts the comment off a data file line and splits the rest into `;`-separated fields with surrounding spaces trimmed
+ * @return number of fields, 0 for an empty or comment-only line
+ */
+static size_t
+split_fields(char *line, char **fields) {
+    char *comment = strchr(line, '#');
+    if (comment != NULL) {
+        *comment = '\0';
+    }
+    line[strcspn(line, "\r\n")] = '\0';
+
+    size_t count = 0;
+    char *field = line;
+    while (count < MAX_FIELDS) {
+        char *end = strchr(field, ';');
+        if (end != NULL) {
+            *end = '\0';
+        }
+        while (*field == ' ') {
+            field++;
+        }
+        size_t len = strlen(field);
+        while (len && field[len - 1] == ' ') {
+            field[--len] = '\0';
+        }
+        fields[count++] = field;
+        if (end == NULL) {
+            break;
+        }
+        field = end + 1;
+    }
+    return count == 1 && !*fields[0] ? 0 : count;
+}
+
+/**
+ * Parses a space-separated list of hex code points
+ * @return number of code points parsed, at most max
+ */
+static size_t
+parse_code_points(const char *str, uint32_t *pOut, const size_t max) {
+    size_t count = 0;
+    char *end;
+    while (count < max) {
+        const unsigned long value = strtoul(str, &end, 16);
+        if (end == str) {
+            break;
+        }
+        pOut[count++] = (uint32_t) value;
+        str = end;
+    }
+    return count;
+}
+
+/**
+ * Parses a code point or a `first..last` range of code points
+ */
+static void
+parse_range(const char *str, uint32_t *pFirst, uint32_t *pLast) {
+    char *end;
+    *pFirst = (uint32_t) strtoul(str, &end, 16);
+    *pLast = end[0] == '.' && end[1] == '.' ? (uint32_t) strtoul(end + 2, NULL, 16) : *pFirst;
+    if (*pFirst > *pLast || *pLast >= CODE_POINTS) {
+        die("bad code point range ", str);
+    }
+}
+
+/**
+ * Writes values[0..count) as a C array initializer, 16 per line
+ */
+static void
+write_array(FILE *out, const char *type, const char *name, const uint32_t *values, const size_t count) {
+    fprintf(out, "static const %s %s[%zu] = {", type, name, count);
+    for (size_t i = 0; i < count; i++) {
+        fprintf(out, i % 16 ? " %u," : "\n    %u,", values[i]);
+    }
+    fprintf(out, "\n};\n\n");
+}
+
+static const char *
+smallest_type(const uint32_t max) {
+    return max <= UINT8_MAX ? "uint8_t" : max <= UINT16_MAX ? "uint16_t" : "uint32_t";
+}
+
+/**
+ * Finds `len` values in `pool[0..*pCount)` at an offset that is a multiple of len, appending them if there are none
+ * @return offset of the values in pool divided by len
+ */
+static uint32_t
+intern_block(uint32_t *pool, size_t *pCount, const uint32_t *values, const size_t len) {
+    for (size_t offset = 0; offset < *pCount; offset += len) {
+        if (!memcmp(pool + offset, values, len * sizeof(uint32_t))) {
+            return (uint32_t) (offset / len);
+        }
+    }
+    memcpy(pool + *pCount, values, len * sizeof(uint32_t));
+    *pCount += len;
+    return (uint32_t) (*pCount / len - 1);
+}
+
+/**
+ * Compresses values of all code points into a three-stage table `<PREFIX>_STAGE1..3` and writes it along with
+ * `<prefix>_lookup(code_point)`, which returns the value of a code point and 0 past U+10FFFF
+ */
+static void
+write_trie(FILE *out, const char *prefix, const char *PREFIX, const uint32_t *values) {
+    uint32_t *blocks = xcalloc(CODE_POINTS, sizeof(uint32_t));
+    uint32_t *chunks = xcalloc(CODE_POINTS >> TRIE_BLOCK_SHIFT, sizeof(uint32_t));
+    uint32_t stage1[CODE_POINTS >> TRIE_CHUNK_SHIFT];
+    uint32_t chunk[TRIE_CHUNK_BLOCKS];
+    size_t blocks_count = 0;
+    size_t chunks_count = 0;
+
+    for (uint32_t cp = 0; cp < CODE_POINTS; cp += 1 << TRIE_CHUNK_SHIFT) {
+        for (size_t k = 0; k < TRIE_CHUNK_BLOCKS; k++) {
+            chunk[k] = intern_block(blocks, &blocks_count, values + cp + (k << TRIE_BLOCK_SHIFT), TRIE_BLOCK_SIZE);
+        }
+        stage1[cp >> TRIE_CHUNK_SHIFT] = intern_block(chunks, &chunks_count, chunk, TRIE_CHUNK_BLOCKS);
+    }
+
+    uint32_t max_value = 0;
+    for (size_t i = 0; i < blocks_count; i++) {
+        max_value = blocks[i] > max_value ? blocks[i] : max_value;
+    }
+    const char *value_type = smallest_type(max_value);
+    char name[64];
+
+    snprintf(name, sizeof(name), "%s_STAGE1", PREFIX);
+    write_array(out, smallest_type((uint32_t) (chunks_count / TRIE_CHUNK_BLOCKS)), name, stage1,
+                CODE_POINTS >> TRIE_CHUNK_SHIFT);
+    snprintf(name, sizeof(name), "%s_STAGE2", PREFIX);
+    write_array(out, smallest_type((uint32_t) (blocks_count / TRIE_BLOCK_SIZE)), name, chunks, chunks_count);
+    snprintf(name, sizeof(name), "%s_STAGE3", PREFIX);
+    write_array(out, value_type, name, blocks, blocks_count);
+
+    fprintf(out,
+            "static inline %s\n"
+            "%s_lookup(const uint32_t code_point) {\n"
+            "    if (code_point >= 0x%X) {\n"
+            "        return 0;\n"
+            "    }\n"
+            "    const uint32_t block = %s_STAGE2[%s_STAGE1[code_point >> %d] << %d | (code_point >> %d & %d)];\n"
+            "    return %s_STAGE3[block << %d | (code_point & %d)];\n"
+            "}\n\n",
+            value_type, prefix, CODE_POINTS, PREFIX, PREFIX, TRIE_CHUNK_SHIFT, TRIE_CHUNK_SHIFT - TRIE_BLOCK_SHIFT,
+            TRIE_BLOCK_SHIFT, TRIE_CHUNK_BLOCKS - 1, PREFIX, TRIE_BLOCK_SHIFT, TRIE_BLOCK_SIZE - 1);
+
+    free(blocks);
+    free(chunks);
+}
+
+/**
+ * Full case mapping of one code point: 1..MAX_MAPPING code points, len 0 if it maps to its simple mapping
+ */
+typedef struct FullMapping_s {
+    uint8_t len;
+    uint32_t cp[MAX_MAPPING];
+} FullMapping;
+
+/**
+ * Distinct combination of simple mapping deltas and full mappings (indices into the expansion table) of code points
+ */
+typedef struct CaseRecord_s {
+    int32_t delta[CASE_MAPPINGS];
+    uint32_t full[CASE_MAPPINGS];
+} CaseRecord;
+
+/**
+ * Reads simple lower and upper mappings (fields 13 and 12) from UnicodeData.txt, `<First>` / `<Last>` ranges have none
+ */
+static void
+read_unicode_data_case(const char *dir, uint32_t (*simple)[CASE_MAPPINGS]) {
+    FILE *file = open_file(dir, "UnicodeData.txt", "r");
+    char line[LINE_SIZE];
+    char *fields[MAX_FIELDS];
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (split_fields(line, fields) < 15) {
+            continue;
+        }
+        const uint32_t cp = (uint32_t) strtoul(fields[0], NULL, 16);
+        if (*fields[13]) {
+            simple[cp][0] = (uint32_t) strtoul(fields[13], NULL, 16);
+        }
+        if (*fields[12]) {
+            simple[cp][1] = (uint32_t) strtoul(fields[12], NULL, 16);
+        }
+    }
+    fclose(file);
+}
+
+/**
+ * Reads unconditional full lower and upper mappings from SpecialCasing.txt. Mappings with a condition list
+ * (Final_Sigma, language-specific ones) depend on context or locale and are left out
+ */
+static void
+read_special_casing(const char *dir, FullMapping (*full)[CASE_MAPPINGS]) {
+    FILE *file = open_file(dir, "SpecialCasing.txt", "r");
+    char line[LINE_SIZE];
+    char *fields[MAX_FIELDS];
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        const size_t count = split_fields(line, fields);
+        if (count < 4 || (count > 4 && *fields[4])) {
+            continue;
+        }
+        const uint32_t cp = (uint32_t) strtoul(fields[0], NULL, 16);
+        full[cp][0].len = (uint8_t) parse_code_points(fields[1], full[cp][0].cp, MAX_MAPPING);
+        full[cp][1].len = (uint8_t) parse_code_points(fields[3], full[cp][1].cp, MAX_MAPPING);
+    }
+    fclose(file);
+}
+
+/**
+ * Reads simple (C + S) and full (C + F) case folding from CaseFolding.txt; Turkic (T) mappings are skipped
+ */
+static void
+read_case_folding(const char *dir, uint32_t (*simple)[CASE_MAPPINGS], FullMapping (*full)[CASE_MAPPINGS]) {
+    FILE *file = open_file(dir, "CaseFolding.txt", "r");
+    char line[LINE_SIZE];
+    char *fields[MAX_FIELDS];
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (split_fields(line, fields) < 3) {
+            continue;
+        }
+        const uint32_t cp = (uint32_t) strtoul(fields[0], NULL, 16);
+        const char status = fields[1][0];
+        if (status == 'C' || status == 'S') {
+            simple[cp][2] = (uint32_t) strtoul(fields[2], NULL, 16);
+        } else if (status == 'F') {
+            full[cp][2].len = (uint8_t) parse_code_points(fields[2], full[cp][2].cp, MAX_MAPPING);
+        }
+    }
+    fclose(file);
+}
+
+/**
+ * Writes unicode_case_tables.h: case records, the expansion table of full mappings and the trie of record indices
+ */
+static void
+gen_case_tables(const char *ucd_dir, const char *out_dir) {
+    uint32_t (*simple)[CASE_MAPPINGS] = xcalloc(CODE_POINTS, sizeof(*simple));
+    FullMapping (*full)[CASE_MAPPINGS] = xcalloc(CODE_POINTS, sizeof(*full));
+    for (uint32_t cp = 0; cp < CODE_POINTS; cp++) {
+        for (size_t m = 0; m < CASE_MAPPINGS; m++) {
+            simple[cp][m] = cp;
+        }
+    }
+    read_unicode_data_case(ucd_dir, simple);
+    read_special_casing(ucd_dir, full);
+    read_case_folding(ucd_dir, simple, full);
+
+    // expansion 0 is never referenced, so 0 in a record means "no full mapping"
+    uint32_t expansions[4096] = {0};
+    size_t expansions_count = 1;
+    CaseRecord records[1024] = {0};
+    size_t records_count = 1;
+    uint32_t *values = xcalloc(CODE_POINTS, sizeof(uint32_t));
+
+    for (uint32_t cp = 0; cp < CODE_POINTS; cp++) {
+        CaseRecord record = {0};
+        for (size_t m = 0; m < CASE_MAPPINGS; m++) {
+            record.delta[m] = (int32_t) (simple[cp][m] - cp);
+            const FullMapping *mapping = &full[cp][m];
+            // a full mapping to one code point only matters if it differs from the simple one
+            if (!mapping->len || (mapping->len == 1 && mapping->cp[0] == simple[cp][m])) {
+                continue;
+            }
+            uint32_t expansion[MAX_MAPPING + 1] = {mapping->len};
+            memcpy(expansion + 1, mapping->cp, mapping->len * sizeof(uint32_t));
+            size_t at = 1;
+            while (at < expansions_count && memcmp(expansions + at, expansion, (mapping->len + 1) * sizeof(uint32_t))) {
+                at += expansions[at] + 1;
+            }
+            if (at == expansions_count) {
+                if (expansions_count + mapping->len + 1 > sizeof(expansions) / sizeof(*expansions)) {
+                    die("too many case expansions", "");
+                }
+                memcpy(expansions + at, expansion, (mapping->len + 1) * sizeof(uint32_t));
+                expansions_count += mapping->len + 1;
+            }
+            record.full[m] = (uint32_t) at;
+        }
+
+        size_t index = 0;
+        while (index < records_count && memcmp(records + index, &record, sizeof(record))) {
+            index++;
+        }
+        if (index == records_count) {
+            if (records_count == sizeof(records) / sizeof(*records)) {
+                die("too many case records", "");
+            }
+            records[records_count++] = record;
+        }
+        values[cp] = (uint32_t) index;
+    }
+
+    FILE *out = open_file(out_dir, "unicode_case_tables.h", "w");
+    fprintf(out, "%s\n#ifndef UNICODE_CASE_TABLES_H\n#define UNICODE_CASE_TABLES_H\n\n#include <stdint.h>\n\n",
+            GENERATED_NOTICE);
+    fprintf(out,
+            "/**\n"
+            " * Case mappings shared by a set of code points, indexed by UnicodeCaseMapping: simple mappings as\n"
+            " * deltas from the code point, full ones as indices into CASE_EXPANSIONS (0 if the full mapping is the\n"
+            " * simple one)\n"
+            " */\n"
+            "typedef struct CaseRecord_s {\n"
+            "    int32_t delta[%d];\n"
+            "    uint16_t full[%d];\n"
+            "} CaseRecord;\n\n",
+            CASE_MAPPINGS, CASE_MAPPINGS);
+
+    fprintf(out, "static const CaseRecord CASE_RECORDS[%zu] = {\n", records_count);
+    for (size_t i = 0; i < records_count; i++) {
+        fprintf(out, "    {{%d, %d, %d}, {%u, %u, %u}},\n", records[i].delta[0], records[i].delta[1],
+                records[i].delta[2], records[i].full[0], records[i].full[1], records[i].full[2]);
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "/**\n * Full mappings to several code points: the number of code points followed by them\n */\n");
+    write_array(out, "uint32_t", "CASE_EXPANSIONS", expansions, expansions_count);
+    fprintf(out, "#define CASE_MAX_EXPANSION %d\n\n", MAX_MAPPING);
+    write_trie(out, "case", "CASE", values);
+    fprintf(out, "#endif //UNICODE_CASE_TABLES_H\n");
+    fclose(out);
+
+    free(simple);
+    free(full);
+    free(values);
+}
+
+/**
+ * Short names of general categories in the order of UnicodeGeneralCategory
+ */
+static const char *GENERAL_CATEGORIES[] = {
+    "Cn", "Lu", "Ll", "Lt", "Lm", "Lo", "Mn", "Mc", "Me", "Nd", "Nl", "No", "Pc", "Pd", "Ps",
+    "Pe", "Pi", "Pf", "Po", "Sm", "Sc", "Sk", "So", "Zs", "Zl", "Zp", "Cc", "Cf", "Cs", "Co",
+};
+
+/**
+ * East_Asian_Width values in the order of UnicodeEastAsianWidth
+ */
+static const char *EAST_ASIAN_WIDTHS[] = {"N", "A", "H", "W", "F", "Na"};
+
+static uint32_t
+find_name(const char **names, const size_t count, const char *name) {
+    for (size_t i = 0; i < count; i++) {
+        if (!strcmp(names[i], name)) {
+            return (uint32_t) i;
+        }
+    }
+    die("unknown property value ", name);
+    return 0;
+}
+
+/**
+ * Reads general categories (field 2) from UnicodeData.txt, filling `<..., First>` / `<..., Last>` ranges
+ */
+static void
+read_unicode_data_categories(const char *dir, uint8_t *categories) {
+    FILE *file = open_file(dir, "UnicodeData.txt", "r");
+    char line[LINE_SIZE];
+    char *fields[MAX_FIELDS];
+    uint32_t first = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (split_fields(line, fields) < 15) {
+            continue;
+        }
+        const uint32_t cp = (uint32_t) strtoul(fields[0], NULL, 16);
+        const uint8_t category = (uint8_t) find_name(GENERAL_CATEGORIES, sizeof(GENERAL_CATEGORIES) / sizeof(char *),
+                                                     fields[2]);
+        const size_t name_len = strlen(fields[1]);
+        if (name_len > 6 && !strcmp(fields[1] + name_len - 6, "First>")) {
+            first = cp;
+            continue;
+        }
+        if (name_len > 5 && !strcmp(fields[1] + name_len - 5, "Last>")) {
+            memset(categories + first, category, cp - first);
+        }
+        categories[cp] = category;
+    }
+    fclose(file);
+}
+
+/**
+ * Reads EastAsianWidth.txt, code points it doesn't list are left N
+ */
+static void
+read_east_asian_width(const char *dir, uint8_t *widths) {
+    FILE *file = open_file(dir, "EastAsianWidth.txt", "r");
+    char line[LINE_SIZE];
+    char *fields[MAX_FIELDS];
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (split_fields(line, fields) < 2) {
+            continue;
+        }
+        uint32_t first, last;
+        parse_range(fields[0], &first, &last);
+        const uint8_t width = (uint8_t) find_name(EAST_ASIAN_WIDTHS, sizeof(EAST_ASIAN_WIDTHS) / sizeof(char *),
+                                                  fields[1]);
+        memset(widths + first, width, last - first + 1);
+    }
+    fclose(file);
+}
+
+/**
+ * Number of terminal columns a code point takes, following wcwidth(3) as most terminals implement it: wide and
+ * fullwidth chars take 2; nonspacing and enclosing marks, format chars (but the soft hyphen), controls and conjoining
+ * Hangul vowels and trailing consonants take 0; everything else, ambiguous chars included, takes 1
+ */
+static uint32_t
+display_width(const uint32_t cp, const uint8_t category, const uint8_t east_asian_width) {
+    const char *gc = GENERAL_CATEGORIES[category];
+    if (!strcmp(gc, "Mn") || !strcmp(gc, "Me") || !strcmp(gc, "Cc") || (!strcmp(gc, "Cf") && cp != 0xAD)
+        || (cp >= 0x1160 && cp <= 0x11FF) || (cp >= 0xD7B0 && cp <= 0xD7FF)) {
+        return 0;
+    }
+    const char *ea = EAST_ASIAN_WIDTHS[east_asian_width];
+    return !strcmp(ea, "W") || !strcmp(ea, "F") ? 2 : 1;
+}
+
+/**
+ * Writes unicode_property_tables.h: a trie of packed general category, East_Asian_Width and display width
+ */
+static void
+gen_property_tables(const char *ucd_dir, const char *out_dir) {
+    uint8_t *categories = xcalloc(CODE_POINTS, 1);
+    uint8_t *widths = xcalloc(CODE_POINTS, 1);
+    uint32_t *values = xcalloc(CODE_POINTS, sizeof(uint32_t));
+    read_unicode_data_categories(ucd_dir, categories);
+    read_east_asian_width(ucd_dir, widths);
+
+    // there are few distinct combinations, the trie stores their indices to fit into bytes. Index 0, which lookups
+    // past U+10FFFF return, is an unassigned code point: Cn, N and 1 column
+    uint32_t packed[256] = {1};
+    size_t packed_count = 1;
+    for (uint32_t cp = 0; cp < CODE_POINTS; cp++) {
+        const uint32_t value = display_width(cp, categories[cp], widths[cp]) | (uint32_t) categories[cp] << 2
+                               | (uint32_t) widths[cp] << 7;
+        size_t index = 0;
+        while (index < packed_count && packed[index] != value) {
+            index++;
+        }
+        if (index == packed_count) {
+            if (packed_count == sizeof(packed) / sizeof(*packed)) {
+                die("too many property combinations", "");
+            }
+            packed[packed_count++] = value;
+        }
+        values[cp] = (uint32_t) index;
+    }
+
+    FILE *out = open_file(out_dir, "unicode_property_tables.h", "w");
+    fprintf(out, "%s\n#ifndef UNICODE_PROPERTY_TABLES_H\n#define UNICODE_PROPERTY_TABLES_H\n\n#include <stdint.h>\n\n",
+            GENERATED_NOTICE);
+    fprintf(out,
+            "/**\n"
+            " * Properties of a code point packed into one PROPERTY_VALUES entry: display width in bits 0..1,\n"
+            " * UnicodeGeneralCategory in bits 2..6, UnicodeEastAsianWidth in bits 7..9\n"
+            " */\n"
+            "#define PROPERTY_WIDTH(value) ((value) & 3)\n"
+            "#define PROPERTY_CATEGORY(value) ((value) >> 2 & 31)\n"
+            "#define PROPERTY_EAST_ASIAN_WIDTH(value) ((value) >> 7 & 7)\n\n");
+    write_array(out, "uint16_t", "PROPERTY_VALUES", packed, packed_count);
+    write_trie(out, "property", "PROPERTY", values);
+    fprintf(out, "#endif //UNICODE_PROPERTY_TABLES_H\n");
+    fclose(out);
+
+    free(categories);
+    free(widths);
+    free(values);
+}
+
+/**
+ * Grapheme_Cluster_Break values, Other first: code points GraphemeBreakProperty.txt doesn't list are Other
+ */
+static const char *GRAPHEME_BREAKS[] = {
+    "Other", "CR", "LF", "Control", "Extend", "ZWJ", "Regional_Indicator", "Prepend", "SpacingMark", "L", "V", "T",
+    "LV", "LVT",
+};
+
+#define GRAPHEME_BREAK_COUNT (sizeof(GRAPHEME_BREAKS) / sizeof(char *))
+
+/**
+ * Bit set in grapheme table values of Extended_Pictographic code points
+ */
+#define GRAPHEME_PICTOGRAPHIC_BIT 0x10
+
+/**
+ * Reads a `<range> ; <value>` data file: sets values of the listed code points to the index of their value in names,
+ * or, if bit isn't 0, sets bit in them
+ */
+static void
+read_ranges(const char *dir, const char *file_name, const char **names, const size_t count, uint8_t *values,
+            const uint8_t bit) {
+    FILE *file = open_file(dir, file_name, "r");
+    char line[LINE_SIZE];
+    char *fields[MAX_FIELDS];
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (split_fields(line, fields) < 2) {
+            continue;
+        }
+        uint32_t first, last;
+        parse_range(fields[0], &first, &last);
+        const uint32_t value = find_name(names, count, fields[1]);
+        for (uint32_t cp = first; cp <= last; cp++) {
+            values[cp] |= bit ? bit : (uint8_t) value;
+        }
+    }
+    fclose(file);
+}
+
+/**
+ * Whether UAX #29 rules GB3..GB9b and GB999 break between code points of Grapheme_Cluster_Break prev and cur.
+ * GB11 (emoji ZWJ sequences) and GB12 / GB13 (regional indicator pairs) depend on more than the pair, they are
+ * applied at run time over this table
+ */
+static int
+grapheme_pair_breaks(const char *prev, const char *cur) {
+#define IS(name, value) (!strcmp(name, value))
+    if (IS(prev, "CR") && IS(cur, "LF")) {
+        return 0;
+    }
+    if (IS(prev, "CR") || IS(prev, "LF") || IS(prev, "Control")) {
+        return 1;
+    }
+    if (IS(cur, "CR") || IS(cur, "LF") || IS(cur, "Control")) {
+        return 1;
+    }
+    if (IS(prev, "L") && (IS(cur, "L") || IS(cur, "V") || IS(cur, "LV") || IS(cur, "LVT"))) {
+        return 0;
+    }
+    if ((IS(prev, "LV") || IS(prev, "V")) && (IS(cur, "V") || IS(cur, "T"))) {
+        return 0;
+    }
+    if ((IS(prev, "LVT") || IS(prev, "T")) && IS(cur, "T")) {
+        return 0;
+    }
+    if (IS(cur, "Extend") || IS(cur, "ZWJ") || IS(cur, "SpacingMark") || IS(prev, "Prepend")) {
+        return 0;
+    }
+    return 1;
+#undef IS
+}
+
+/**
+ * Writes unicode_grapheme_tables.h: value constants, the pair break table and a trie of Grapheme_Cluster_Break
+ * with the Extended_Pictographic bit
+ */
+static void
+gen_grapheme_tables(const char *ucd_dir, const char *out_dir) {
+    static const char *PICTOGRAPHIC[] = {"Extended_Pictographic"};
+    uint8_t *breaks = xcalloc(CODE_POINTS, 1);
+    uint32_t *values = xcalloc(CODE_POINTS, sizeof(uint32_t));
+    read_ranges(ucd_dir, "GraphemeBreakProperty.txt", GRAPHEME_BREAKS, GRAPHEME_BREAK_COUNT, breaks, 0);
+    read_ranges(ucd_dir, "emoji-data.txt", PICTOGRAPHIC, 1, breaks, GRAPHEME_PICTOGRAPHIC_BIT);
+    for (uint32_t cp = 0; cp < CODE_POINTS; cp++) {
+        values[cp] = breaks[cp];
+    }
+
+    FILE *out = open_file(out_dir, "unicode_grapheme_tables.h", "w");
+    fprintf(out, "%s\n#ifndef UNICODE_GRAPHEME_TABLES_H\n#define UNICODE_GRAPHEME_TABLES_H\n\n#include <stdint.h>\n\n",
+            GENERATED_NOTICE);
+    fprintf(out, "/**\n"
+                 " * Grapheme_Cluster_Break values, GRAPHEME_PICTOGRAPHIC is the Extended_Pictographic bit\n"
+                 " */\n");
+    for (size_t i = 0; i < GRAPHEME_BREAK_COUNT; i++) {
+        char name[64];
+        size_t k = 0;
+        for (const char *c = GRAPHEME_BREAKS[i]; *c && k + 1 < sizeof(name); c++) {
+            name[k++] = (char) (*c >= 'a' && *c <= 'z' ? *c - 'a' + 'A' : *c);
+        }
+        name[k] = '\0';
+        fprintf(out, "#define GRAPHEME_%s %zu\n", name, i);
+    }
+    fprintf(out, "#define GRAPHEME_BREAK_MASK 0x%X\n", GRAPHEME_PICTOGRAPHIC_BIT - 1);
+    fprintf(out, "#define GRAPHEME_PICTOGRAPHIC 0x%X\n\n", GRAPHEME_PICTOGRAPHIC_BIT);
+
+    fprintf(out,
+            "/**\n"
+            " * GRAPHEME_PAIR_BREAKS[prev][cur] is 1 if rules GB3..GB9b and GB999 break between the two values\n"
+            " */\n"
+            "static const uint8_t GRAPHEME_PAIR_BREAKS[%zu][%zu] = {\n",
+            GRAPHEME_BREAK_COUNT, GRAPHEME_BREAK_COUNT);
+    for (size_t prev = 0; prev < GRAPHEME_BREAK_COUNT; prev++) {
+        fprintf(out, "    {");
+        for (size_t cur = 0; cur < GRAPHEME_BREAK_COUNT; cur++) {
+            fprintf(out, cur ? " %d," : "%d,", grapheme_pair_breaks(GRAPHEME_BREAKS[prev], GRAPHEME_BREAKS[cur]));
+        }
+        fprintf(out, "},\n");
+    }
+    fprintf(out, "};\n\n");
+
+    write_trie(out, "grapheme", "GRAPHEME", values);
+    fprintf(out, "#endif //UNICODE_GRAPHEME_TABLES_H\n");
+    fclose(out);
+
+    free(breaks);
+    free(values);
+}
+
+/**
+ * Hangul syllables decompose into conjoining jamo algorithmically (Unicode 3.12). Syllables themselves are not in the
+ * tables, but decompositions that contain one are stored fully decomposed
+ */
+#define HANGUL_S_BASE 0xAC00
+#define HANGUL_L_BASE 0x1100
+#define HANGUL_V_BASE 0x1161
+#define HANGUL_T_BASE 0x11A7
+#define HANGUL_V_COUNT 21
+#define HANGUL_T_COUNT 28
+#define HANGUL_S_COUNT 11172
+
+#define MAX_FULL_DECOMPOSITION 32
+
+/**
+ * Quick check values (UAX #15), stored for each form in the order of UnicodeNormalizationForm: NFC, NFD, NFKC, NFKD
+ */
+#define QC_YES 0
+#define QC_MAYBE 1
+#define QC_NO 2
+#define NORMALIZATION_FORMS 4
+
+/**
+ * Decomposition mapping of one code point (field 5 of UnicodeData.txt), compat if it has a `<tag>`
+ */
+typedef struct Decomposition_s {
+    uint8_t len;
+    uint8_t compat;
+    uint32_t cp[MAX_DECOMPOSITION];
+} Decomposition;
+
+/**
+ * Reads canonical combining classes (field 3) and decomposition mappings (field 5) from UnicodeData.txt
+ */
+static void
+read_unicode_data_decompositions(const char *dir, uint8_t *ccc, Decomposition *decompositions) {
+    FILE *file = open_file(dir, "UnicodeData.txt", "r");
+    char line[LINE_SIZE];
+    char *fields[MAX_FIELDS];
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (split_fields(line, fields) < 6) {
+            continue;
+        }
+        const uint32_t cp = (uint32_t) strtoul(fields[0], NULL, 16);
+        ccc[cp] = (uint8_t) strtoul(fields[3], NULL, 10);
+        const char *mapping = fields[5];
+        if (*mapping == '<') {
+            decompositions[cp].compat = 1;
+            mapping = strchr(mapping, '>') + 1;
+        }
+        decompositions[cp].len = (uint8_t) parse_code_points(mapping, decompositions[cp].cp, MAX_DECOMPOSITION);
+    }
+    fclose(file);
+}
+
+/**
+ * Reads code points explicitly excluded from composition from CompositionExclusions.txt
+ */
+static void
+read_composition_exclusions(const char *dir, uint8_t *excluded) {
+    FILE *file = open_file(dir, "CompositionExclusions.txt", "r");
+    char line[LINE_SIZE];
+    char *fields[MAX_FIELDS];
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (!split_fields(line, fields)) {
+            continue;
+        }
+        uint32_t first, last;
+        parse_range(fields[0], &first, &last);
+        for (uint32_t cp = first; cp <= last; cp++) {
+            excluded[cp] = 1;
+        }
+    }
+    fclose(file);
+}
+
+static int
+is_hangul_syllable(const uint32_t cp) {
+    return cp - HANGUL_S_BASE < HANGUL_S_COUNT;
+}
+
+/**
+ * Appends the full decomposition of cp (mappings applied recursively) to pOut: canonical mappings only, or compat ones
+ * as well
+ */
+static void
+decompose_full(const Decomposition *decompositions, const uint32_t cp, const int compat, uint32_t *pOut,
+               size_t *pLen) {
+    const Decomposition *decomposition = &decompositions[cp];
+    if (*pLen + 3 > MAX_FULL_DECOMPOSITION) {
+        die("decomposition too long", "");
+    }
+    if (is_hangul_syllable(cp)) {
+        const uint32_t index = cp - HANGUL_S_BASE;
+        pOut[(*pLen)++] = HANGUL_L_BASE + index / (HANGUL_V_COUNT * HANGUL_T_COUNT);
+        pOut[(*pLen)++] = HANGUL_V_BASE + index % (HANGUL_V_COUNT * HANGUL_T_COUNT) / HANGUL_T_COUNT;
+        if (index % HANGUL_T_COUNT) {
+            pOut[(*pLen)++] = HANGUL_T_BASE + index % HANGUL_T_COUNT;
+        }
+    } else if (decomposition->len && (compat || !decomposition->compat)) {
+        for (size_t i = 0; i < decomposition->len; i++) {
+            decompose_full(decompositions, decomposition->cp[i], compat, pOut, pLen);
+        }
+    } else {
+        pOut[(*pLen)++] = cp;
+    }
+}
+
+/**
+ * Appends code points to pool as UTF-16 code units
+ * @return number of code units appended
+ */
+static size_t
+append_utf16(uint32_t *pool, size_t *pCount, const uint32_t *cps, const size_t len) {
+    const size_t start = *pCount;
+    for (size_t i = 0; i < len; i++) {
+        if (cps[i] >= 0x10000) {
+            pool[(*pCount)++] = 0xD800 | (cps[i] - 0x10000) >> 10;
+            pool[(*pCount)++] = 0xDC00 | (cps[i] & 0x3FF);
+        } else {
+            pool[(*pCount)++] = cps[i];
+        }
+    }
+    return *pCount - start;
+}
+
+/**
+ * Primary composite: a canonical pair that composes into composite
+ */
+typedef struct Composition_s {
+    uint32_t first;
+    uint32_t second;
+    uint32_t composite;
+} Composition;
+
+static int
+compare_compositions(const void *pA, const void *pB) {
+    const Composition *a = pA, *b = pB;
+    if (a->first != b->first) {
+        return a->first < b->first ? -1 : 1;
+    }
+    return a->second < b->second ? -1 : a->second > b->second;
+}
+
+/**
+ * Writes unicode_normalize_tables.h: combining classes with quick check values, full decompositions and primary
+ * composites
+ */
+static void
+gen_normalize_tables(const char *ucd_dir, const char *out_dir) {
+    uint8_t *ccc = xcalloc(CODE_POINTS, 1);
+    uint8_t *excluded = xcalloc(CODE_POINTS, 1);
+    uint8_t *seconds = xcalloc(CODE_POINTS, 1);
+    Decomposition *decompositions = xcalloc(CODE_POINTS, sizeof(Decomposition));
+    uint32_t *values = xcalloc(CODE_POINTS, sizeof(uint32_t));
+    uint32_t *pool = xcalloc(CODE_POINTS, sizeof(uint32_t));
+    Composition *compositions = xcalloc(CODE_POINTS, sizeof(Composition));
+    size_t compositions_count = 0;
+    read_unicode_data_decompositions(ucd_dir, ccc, decompositions);
+    read_composition_exclusions(ucd_dir, excluded);
+
+    // Full_Composition_Exclusion: explicit exclusions, singletons and non-starter decompositions
+    for (uint32_t cp = 0; cp < CODE_POINTS; cp++) {
+        const Decomposition *decomposition = &decompositions[cp];
+        if (!decomposition->len || decomposition->compat) {
+            continue;
+        }
+        if (decomposition->len == 1 || ccc[cp] || ccc[decomposition->cp[0]]) {
+            excluded[cp] = 1;
+        }
+        if (!excluded[cp]) {
+            compositions[compositions_count++] = (Composition){decomposition->cp[0], decomposition->cp[1], cp};
+            seconds[decomposition->cp[1]] = 1;
+        }
+    }
+
+    qsort(compositions, compositions_count, sizeof(Composition), compare_compositions);
+
+    // there are few distinct combinations of a combining class and quick check values, the trie stores their indices.
+    // Index 0, which lookups past U+10FFFF return, is a starter that is normalized in every form
+    uint32_t packed[256] = {0};
+    size_t packed_count = 1;
+    uint32_t qc_min[NORMALIZATION_FORMS] = {CODE_POINTS, CODE_POINTS, CODE_POINTS, CODE_POINTS};
+    uint32_t max_decomposition = 0;
+    size_t pool_count = 1;
+    for (uint32_t cp = 0; cp < CODE_POINTS; cp++) {
+        uint32_t canonical[MAX_FULL_DECOMPOSITION], compat[MAX_FULL_DECOMPOSITION];
+        size_t canonical_len = 0, compat_len = 0;
+        decompose_full(decompositions, cp, 0, canonical, &canonical_len);
+        decompose_full(decompositions, cp, 1, compat, &compat_len);
+        const int has_canonical = canonical_len != 1 || canonical[0] != cp;
+        const int has_compat = compat_len != 1 || compat[0] != cp;
+        const int compat_differs = compat_len != canonical_len
+                                   || memcmp(compat, canonical, compat_len * sizeof(uint32_t));
+
+        uint32_t qc[NORMALIZATION_FORMS];
+        qc[0] = excluded[cp] ? QC_NO
+                : seconds[cp] || cp - HANGUL_V_BASE < HANGUL_V_COUNT || cp - (HANGUL_T_BASE + 1) < HANGUL_T_COUNT - 1
+                    ? QC_MAYBE
+                    : QC_YES;
+        qc[1] = has_canonical ? QC_NO : QC_YES;
+        qc[2] = compat_differs ? QC_NO : qc[0];
+        qc[3] = has_compat ? QC_NO : QC_YES;
+
+        uint32_t value = ccc[cp];
+        for (size_t form = 0; form < NORMALIZATION_FORMS; form++) {
+            value |= qc[form] << (8 + 2 * form);
+            if ((ccc[cp] || qc[form] != QC_YES) && cp < qc_min[form]) {
+                qc_min[form] = cp;
+            }
+        }
+        size_t index = 0;
+        while (index < packed_count && packed[index] != value) {
+            index++;
+        }
+        if (index == packed_count) {
+            if (packed_count == sizeof(packed) / sizeof(*packed)) {
+                die("too many normalization property combinations", "");
+            }
+            packed[packed_count++] = value;
+        }
+        values[cp] = (uint32_t) index;
+
+        // decompositions of Hangul syllables are computed, not stored
+        if (has_compat && !is_hangul_syllable(cp)) {
+            const size_t header = pool_count++;
+            const size_t canonical_units =
+                has_canonical ? append_utf16(pool, &pool_count, canonical, canonical_len) : 0;
+            const size_t compat_units = compat_differs ? append_utf16(pool, &pool_count, compat, compat_len) : 0;
+            pool[header] = (uint32_t) (canonical_units | compat_units << 8);
+            max_decomposition = compat_len > max_decomposition ? (uint32_t) compat_len : max_decomposition;
+            if (pool_count > UINT16_MAX) {
+                die("too many decompositions", "");
+            }
+            values[cp] |= (uint32_t) header << 8;
+        }
+    }
+
+    // the trie of decompositions needs indices of 16 bits, the values trie only 8
+    uint32_t *headers = xcalloc(CODE_POINTS, sizeof(uint32_t));
+    for (uint32_t cp = 0; cp < CODE_POINTS; cp++) {
+        headers[cp] = values[cp] >> 8;
+        values[cp] &= 0xFF;
+    }
+
+    FILE *out = open_file(out_dir, "unicode_normalize_tables.h", "w");
+    fprintf(out, "%s\n#ifndef UNICODE_NORMALIZE_TABLES_H\n#define UNICODE_NORMALIZE_TABLES_H\n\n"
+                 "#include <stdint.h>\n\n",
+            GENERATED_NOTICE);
+    fprintf(out,
+            "/**\n"
+            " * Properties of a code point packed into one NORM_VALUES entry: canonical combining class in bits 0..7,\n"
+            " * quick check values of UnicodeNormalizationForm form in bits 8 + 2 * form and 9 + 2 * form\n"
+            " */\n"
+            "#define NORM_CCC(value) ((value) & 0xFF)\n"
+            "#define NORM_QC(value, form) ((value) >> (8 + 2 * (form)) & 3)\n"
+            "#define NORM_QC_YES %d\n"
+            "#define NORM_QC_MAYBE %d\n"
+            "#define NORM_QC_NO %d\n\n",
+            QC_YES, QC_MAYBE, QC_NO);
+    write_array(out, "uint16_t", "NORM_VALUES", packed, packed_count);
+    write_trie(out, "norm", "NORM", values);
+    fprintf(out, "/**\n * Code points below NORM_QC_MIN[form] are starters that are normalized in form\n */\n");
+    write_array(out, "uint32_t", "NORM_QC_MIN", qc_min, NORMALIZATION_FORMS);
+
+    fprintf(out,
+            "/**\n"
+            " * Full decompositions as UTF-16 code units. An entry starts with a header, the number of units of the\n"
+            " * canonical decomposition (0 if there is none) | the number of units of the compatibility one << 8\n"
+            " * (0 if it is the canonical one), followed by the units of both\n"
+            " */\n"
+            "#define NORM_CANONICAL_UNITS(header) ((header) & 0xFF)\n"
+            "#define NORM_COMPAT_UNITS(header) ((header) >> 8)\n"
+            "#define NORM_MAX_DECOMPOSITION %u\n\n",
+            max_decomposition);
+    write_array(out, "uint16_t", "NORM_DECOMPOSITIONS", pool, pool_count);
+    write_trie(out, "decomposition", "DECOMPOSITION", headers);
+
+    fprintf(out,
+            "/**\n"
+            " * Primary composites sorted by their canonical pairs: {first, second, composite}\n"
+            " */\n"
+            "static const uint32_t NORM_COMPOSITIONS[%zu][3] = {\n",
+            compositions_count);
+    for (size_t i = 0; i < compositions_count; i++) {
+        fprintf(out, "    {0x%04X, 0x%04X, 0x%04X},\n", compositions[i].first, compositions[i].second,
+                compositions[i].composite);
+    }
+    fprintf(out, "};\n\n#endif //UNICODE_NORMALIZE_TABLES_H\n");
+    fclose(out);
+
+    free(ccc);
+    free(excluded);
+    free(seconds);
+    free(decompositions);
+    free(values);
+    free(headers);
+    free(pool);
+    free(compositions);
+}
+
+int
+main(const int argc, char **argv) {
+    if (argc != 3) {
+        die("usage: unicode-gen-tables <ucd-dir> <output-dir>", "");
+    }
+    gen_case_tables(argv[1], argv[2]);
+    gen_property_tables(argv[1], argv[2]);
+    gen_grapheme_tables(argv[1], argv[2]);
+    gen_normalize_tables(argv[1], argv[2]);
+    return 0;
+}